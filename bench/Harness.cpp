@@ -0,0 +1,159 @@
+#include "Harness.hpp"
+#include "lsp/Json.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace Bench
+{
+    namespace
+    {
+        // nearest rank percentile of sorted samples
+        double percentile(const std::vector<double>& sorted, double p)
+        {
+            std::size_t rank = std::size_t(p / 100 * double(sorted.size()) + 0.999999);
+            return sorted[std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1];
+        }
+
+        std::string formatTime(double ns)
+        {
+            char buffer[32];
+            if (ns >= 1e9)
+                std::snprintf(buffer, sizeof(buffer), "%8.3f s ", ns / 1e9);
+            else if (ns >= 1e6)
+                std::snprintf(buffer, sizeof(buffer), "%8.3f ms", ns / 1e6);
+            else if (ns >= 1e3)
+                std::snprintf(buffer, sizeof(buffer), "%8.3f us", ns / 1e3);
+            else
+                std::snprintf(buffer, sizeof(buffer), "%8.0f ns", ns);
+            return buffer;
+        }
+    }
+
+    void Harness::add(const std::string& name, Function run, std::size_t bytes, Function setup)
+    {
+        m_Benchmarks.push_back({name, std::move(run), bytes, std::move(setup)});
+    }
+
+    std::vector<Result> Harness::run(const Options& options, std::ostream& out) const
+    {
+        using Clock = std::chrono::steady_clock;
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-40s %11s %11s %11s %11s %10s\n",
+                      "benchmark", "median", "p90", "p99", "min", "MB/s");
+        out << line;
+
+        std::vector<Result> results;
+        for (const auto& benchmark : m_Benchmarks)
+        {
+            if (benchmark.name.find(options.filter) == std::string::npos)
+                continue;
+
+            for (unsigned i = 0; i < options.warmup; ++i)
+            {
+                if (benchmark.setup)
+                    benchmark.setup();
+                benchmark.run();
+            }
+
+            std::vector<double> samples;
+            samples.reserve(options.repetitions);
+            for (unsigned i = 0; i < std::max(options.repetitions, 1u); ++i)
+            {
+                if (benchmark.setup)
+                    benchmark.setup();
+                const Clock::time_point start = Clock::now();
+                benchmark.run();
+                const Clock::time_point end = Clock::now();
+                samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+            }
+
+            Result result;
+            result.name = benchmark.name;
+            result.repetitions = samples.size();
+            result.bytes = benchmark.bytes;
+            result.mean = 0;
+            for (double sample : samples)
+                result.mean += sample / double(samples.size());
+            std::sort(samples.begin(), samples.end());
+            result.min = samples.front();
+            result.median = samples.size() % 2 ? samples[samples.size() / 2]
+                                               : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+            result.p90 = percentile(samples, 90);
+            result.p99 = percentile(samples, 99);
+
+            char throughput[16] = "";
+            if (result.bytes)
+                std::snprintf(throughput, sizeof(throughput), "%10.2f", double(result.bytes) / result.median * 1e3);
+            std::snprintf(line, sizeof(line), "%-40s %s %s %s %s %s\n", result.name.c_str(),
+                          formatTime(result.median).c_str(), formatTime(result.p90).c_str(),
+                          formatTime(result.p99).c_str(), formatTime(result.min).c_str(), throughput);
+            out << line << std::flush;
+            results.push_back(result);
+        }
+        return results;
+    }
+
+    void Harness::writeJson(const std::vector<Result>& results, const std::string& filename)
+    {
+        LSP::Json root = LSP::Json::object();
+        LSP::Json& benchmarks = root["benchmarks"] = LSP::Json::array();
+        for (const auto& result : results)
+        {
+            LSP::Json entry = LSP::Json::object();
+            entry["name"] = result.name;
+            entry["repetitions"] = result.repetitions;
+            entry["bytes"] = result.bytes;
+            entry["min_ns"] = result.min;
+            entry["median_ns"] = result.median;
+            entry["p90_ns"] = result.p90;
+            entry["p99_ns"] = result.p99;
+            entry["mean_ns"] = result.mean;
+            benchmarks.push_back(std::move(entry));
+        }
+
+        std::ofstream file(filename);
+        file << root.dump() << '\n';
+        if (!file)
+            throw std::runtime_error("Error: couldn't write \"" + filename + '"');
+    }
+
+    std::size_t Harness::compare(const std::vector<Result>& results, const std::string& baselineFile,
+                                 double threshold, std::ostream& out)
+    {
+        const LSP::Json baseline = LSP::Json::parse(Utils::readAllText(baselineFile));
+        std::map<std::string, double> medians;
+        for (const auto& entry : baseline["benchmarks"].asArray())
+            medians[entry["name"].asString()] = entry["median_ns"].asNumber();
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "\n%-40s %11s %11s %9s\n", "compared to baseline", "baseline", "median", "change");
+        out << line;
+
+        std::size_t regressions = 0;
+        for (const auto& result : results)
+        {
+            auto base = medians.find(result.name);
+            if (base == medians.end() || base->second <= 0)
+            {
+                std::snprintf(line, sizeof(line), "%-40s %11s %s\n", result.name.c_str(), "-",
+                              formatTime(result.median).c_str());
+                out << line;
+                continue;
+            }
+            const double change = (result.median - base->second) / base->second * 100;
+            const bool regressed = change > threshold;
+            regressions += regressed;
+            std::snprintf(line, sizeof(line), "%-40s %s %s %+8.1f%%%s\n", result.name.c_str(),
+                          formatTime(base->second).c_str(), formatTime(result.median).c_str(),
+                          change, regressed ? "  REGRESSION" : "");
+            out << line;
+        }
+        return regressions;
+    }
+}
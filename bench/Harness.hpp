@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+    struct Options
+    {
+        unsigned warmup = 2;        // untimed runs before measuring
+        unsigned repetitions = 15;  // timed runs
+        std::string filter;         // only benchmarks whose name contains this
+        std::string jsonFile;       // results are written here if not empty
+        std::string baselineFile;   // results are compared against this if not empty
+        double threshold = 10;      // allowed slowdown of the median in percent
+    };
+
+    /**
+     * timings of one benchmark in nanoseconds
+     */
+    struct Result
+    {
+        std::string name;
+        std::size_t repetitions = 0;
+        std::size_t bytes = 0;      // input size processed per run, 0 if not meaningful
+        double min = 0;
+        double median = 0;
+        double p90 = 0;
+        double p99 = 0;
+        double mean = 0;
+    };
+
+    /**
+     * runs registered benchmarks with warmup and repetitions
+     * and reports median and percentiles of the wall clock time per run
+     */
+    class Harness
+    {
+    public:
+        using Function = std::function<void()>;
+
+        /**
+         * @param run timed code
+         * @param bytes input size processed by one run, used for the throughput column
+         * @param setup untimed code executed before every run, e.g. to restore input the run modifies
+         */
+        void add(const std::string& name, Function run, std::size_t bytes = 0, Function setup = Function());
+
+        std::vector<Result> run(const Options& options, std::ostream& out) const;
+
+        /**
+         * @throws std::runtime_error if the file can't be written
+         */
+        static void writeJson(const std::vector<Result>& results, const std::string& filename);
+
+        /**
+         * prints the change of the median against a baseline written by writeJson
+         * @return number of benchmarks slower than the baseline by more than threshold percent
+         * @throws std::runtime_error if the baseline can't be read
+         */
+        static std::size_t compare(const std::vector<Result>& results, const std::string& baselineFile,
+                                   double threshold, std::ostream& out);
+
+    private:
+        struct Benchmark
+        {
+            std::string name;
+            Function run;
+            std::size_t bytes;
+            Function setup;
+        };
+
+        std::vector<Benchmark> m_Benchmarks;
+    };
+
+    /**
+     * keeps the compiler from optimizing away a computed value
+     */
+    template <class T>
+    inline void doNotOptimize(const T& value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+}
@@ -0,0 +1,450 @@
+#include "Generator.hpp"
+#include <stdexcept>
+
+namespace Bench
+{
+    namespace
+    {
+        const char* const Words[] = {
+                "the", "guard", "castle", "ore", "mine", "camp", "swamp", "sleeper", "magic", "sword",
+                "gold", "trade", "old", "new", "rune", "hunter", "scavenger", "bridge", "tower", "valley"
+        };
+
+        const char* const BinaryOperators[] = {
+                "+", "-", "*", "/", "%", "<", ">", "<=", ">=", "==", "!=", "&&", "||", "&", "|", "^", "<<", ">>"
+        };
+
+        const char* const UnaryOperators[] = { "-", "!", "~" };
+
+        template <class T, std::size_t N>
+        std::uint32_t countOf(const T (&)[N])
+        {
+            return std::uint32_t(N);
+        }
+
+        const std::size_t FlushSize = 1u << 16u;
+    }
+
+    Generator::Generator(const Config& config)
+            : m_Config(config),
+              m_Random(config.seed),
+              m_Out(nullptr),
+              m_Written(0)
+    {
+    }
+
+    std::uint64_t Generator::generate(std::ostream& out)
+    {
+        m_Out = &out;
+        m_Written = 0;
+        m_Buffer = "// generated by daedalus_gen, seed " + std::to_string(m_Config.seed) + "\n\n";
+
+        unsigned index = 0;
+        do
+            round(index++);
+        while (m_Config.size != 0 && !full());
+
+        flush(true);
+        out.flush();
+        if (!out)
+            throw std::runtime_error("Error: couldn't write the generated source");
+        return m_Written;
+    }
+
+    void Generator::round(unsigned index)
+    {
+        m_Round = m_Config.prefix + std::to_string(index);
+        m_Classes.clear();
+        m_ConstArrays.clear();
+        m_Constants.clear();
+        m_Functions.clear();
+        m_FunctionClasses.clear();
+
+        // declarations only refer to earlier ones, so a round can stop after any of them
+        for (unsigned i = 0; i < std::max(m_Config.classes, 1u); ++i)
+        {
+            Class cls;
+            cls.name = "C_" + m_Round + "_" + std::to_string(i);
+            for (int field = 0, count = m_Random.range(2, 10); field < count; ++field)
+                cls.fields.push_back("field" + std::to_string(field));
+            cls.array = "values";
+            cls.arraySize = unsigned(m_Random.range(2, 16));
+            m_Classes.push_back(cls);
+            emitClass(m_Classes.back());
+            if (full())
+                return;
+        }
+
+        for (unsigned i = 0; i < m_Config.constArrays; ++i)
+        {
+            m_ConstArrays.push_back("TABLE_" + m_Round + "_" + std::to_string(i));
+            emitConstArray(m_ConstArrays.back());
+            if (full())
+                return;
+        }
+
+        for (unsigned i = 0; i < m_Config.constants; ++i)
+        {
+            emitConstant("CONST_" + m_Round + "_" + std::to_string(i));
+            m_Constants.push_back("CONST_" + m_Round + "_" + std::to_string(i));
+            if (full())
+                return;
+        }
+
+        for (unsigned i = 0; i < m_Config.functions; ++i)
+        {
+            m_Functions.push_back("Func_" + m_Round + "_" + std::to_string(i));
+            m_FunctionClasses.push_back(m_Random.below(std::uint32_t(m_Classes.size())));
+            emitFunction(i);
+            if (full())
+                return;
+        }
+
+        std::vector<unsigned> prototypeClasses;
+        for (unsigned i = 0; i < m_Config.prototypes; ++i)
+        {
+            prototypeClasses.push_back(m_Random.below(std::uint32_t(m_Classes.size())));
+            emitPrototype("Proto_" + m_Round + "_" + std::to_string(i), m_Classes[prototypeClasses.back()], i);
+            if (full())
+                return;
+        }
+
+        for (unsigned i = 0; i < m_Config.instances; ++i)
+        {
+            const std::string name = "Inst_" + m_Round + "_" + std::to_string(i);
+            if (!prototypeClasses.empty() && m_Random.chance(80))
+            {
+                unsigned prototype = m_Random.below(std::uint32_t(prototypeClasses.size()));
+                emitInstance(name, "Proto_" + m_Round + "_" + std::to_string(prototype),
+                             m_Classes[prototypeClasses[prototype]], i);
+            }
+            else
+            {
+                const Class& cls = m_Classes[m_Random.below(std::uint32_t(m_Classes.size()))];
+                emitInstance(name, cls.name, cls, i);
+            }
+            if (full())
+                return;
+        }
+    }
+
+    bool Generator::full() const
+    {
+        return m_Config.size != 0 && m_Written + m_Buffer.size() >= m_Config.size;
+    }
+
+    void Generator::emitClass(const Class& cls)
+    {
+        if (m_Random.chance(m_Config.comments))
+            emitComment();
+        m_Buffer += "class " + cls.name + "\n{\n    var int id;\n    var string name;\n";
+        for (const auto& field : cls.fields)
+            m_Buffer += "    var int " + field + ";\n";
+        m_Buffer += "    var int " + cls.array + "[" + std::to_string(cls.arraySize) + "];\n";
+        m_Buffer += "    var func onEvent;\n};\n\n";
+        flush();
+    }
+
+    void Generator::emitConstArray(const std::string& name)
+    {
+        if (m_Random.chance(m_Config.comments))
+            emitComment();
+        const unsigned size = std::max(m_Config.arraySize, 1u);
+        m_Buffer += "const int " + name + "[" + std::to_string(size) + "] =\n{";
+        for (unsigned i = 0; i < size; ++i)
+        {
+            m_Buffer += i % 16 ? " " : "\n    ";
+            m_Buffer += std::to_string(m_Random.range(-1000, 100000));
+            if (i + 1 < size)
+                m_Buffer += ',';
+            flush();
+        }
+        m_Buffer += "\n};\n\n";
+    }
+
+    void Generator::emitConstant(const std::string& name)
+    {
+        if (m_Random.chance(m_Config.comments))
+            emitComment();
+        Scope scope;
+        m_Buffer += "const int " + name + " = ";
+        emitExpression(scope, m_Config.expressionDepth);
+        m_Buffer += ";\n";
+        flush();
+    }
+
+    void Generator::emitPrototype(const std::string& name, const Class& cls, unsigned index)
+    {
+        if (m_Random.chance(m_Config.comments))
+            emitComment();
+        m_Buffer += "prototype " + name + "(" + cls.name + ")\n{\n";
+        m_Buffer += "    id = " + std::to_string(index) + ";\n";
+        Scope scope;
+        scope.members = &cls;
+        for (unsigned i = 0; i < m_Config.statements; ++i)
+        {
+            if (m_Random.chance(m_Config.comments))
+            {
+                indent(1);
+                emitComment(1);
+            }
+            indent(1);
+            emitMember(scope);
+            m_Buffer += " = ";
+            emitExpression(scope, m_Config.expressionDepth / 2);
+            m_Buffer += ";\n";
+        }
+        m_Buffer += "};\n\n";
+        flush();
+    }
+
+    void Generator::emitInstance(const std::string& name, const std::string& prototype, const Class& cls, unsigned index)
+    {
+        if (m_Random.chance(m_Config.comments))
+            emitComment();
+        m_Buffer += "instance " + name + "(" + prototype + ")\n{\n";
+        m_Buffer += "    name = \"" + std::string(Words[m_Random.below(countOf(Words))]) + " "
+                    + std::to_string(index) + "\";\n";
+        if (!m_Functions.empty() && m_Random.chance(50))
+            m_Buffer += "    onEvent = " + m_Functions[m_Random.below(std::uint32_t(m_Functions.size()))] + ";\n";
+        Scope scope;
+        scope.members = &cls;
+        for (unsigned i = 0, count = m_Random.below(m_Config.statements + 1); i < count; ++i)
+        {
+            indent(1);
+            emitMember(scope);
+            m_Buffer += m_Random.chance(80) ? " = " : " += ";
+            emitExpression(scope, m_Config.expressionDepth / 2);
+            m_Buffer += ";\n";
+        }
+        m_Buffer += "};\n\n";
+        flush();
+    }
+
+    void Generator::emitFunction(unsigned index)
+    {
+        const Class& cls = m_Classes[m_FunctionClasses[index]];
+        if (m_Random.chance(m_Config.comments))
+            emitComment();
+        m_Buffer += "func int " + m_Functions[index] + "(var int a, var int b, var " + cls.name + " slf)\n{\n";
+        m_Buffer += "    var int x;\n    var int y;\n    var string text;\n";
+        for (unsigned loop = 0; loop < m_Config.nesting; ++loop)
+            m_Buffer += "    var int i" + std::to_string(loop) + ";\n";
+
+        Scope scope;
+        scope.ints = {"a", "b", "x", "y"};
+        scope.members = &cls;
+        scope.object = "slf";
+
+        // a single call to an earlier function keeps the call graph acyclic and its run time linear
+        std::vector<unsigned> callees;
+        for (unsigned i = 0; i < index; ++i)
+        {
+            if (m_FunctionClasses[i] == m_FunctionClasses[index])
+                callees.push_back(i);
+        }
+        if (!callees.empty() && m_Random.chance(50))
+        {
+            m_Buffer += "    y = " + m_Functions[callees[m_Random.below(std::uint32_t(callees.size()))]] + "(";
+            emitExpression(scope, 2);
+            m_Buffer += ", b - 1, slf);\n";
+        }
+        emitBlock(scope, 1, 0);
+        m_Buffer += "    return ";
+        emitExpression(scope, m_Config.expressionDepth);
+        m_Buffer += ";\n};\n\n";
+        flush();
+    }
+
+    void Generator::emitBlock(Scope& scope, unsigned depth, unsigned loopDepth)
+    {
+        for (unsigned i = 0, count = 1 + m_Random.below(m_Config.statements); i < count; ++i)
+        {
+            if (m_Random.chance(m_Config.comments))
+            {
+                indent(depth);
+                emitComment(depth);
+            }
+            emitStatement(scope, depth, loopDepth);
+        }
+    }
+
+    void Generator::emitStatement(Scope& scope, unsigned depth, unsigned loopDepth)
+    {
+        const bool nested = depth <= m_Config.nesting;
+        const unsigned kind = m_Random.below(10);
+        if (nested && kind < 2)
+        {
+            indent(depth);
+            m_Buffer += "if (";
+            emitExpression(scope, m_Config.expressionDepth / 2);
+            m_Buffer += ")\n";
+            indent(depth);
+            m_Buffer += "{\n";
+            emitBlock(scope, depth + 1, loopDepth);
+            for (unsigned i = 0, count = m_Random.below(3); i < count; ++i)
+            {
+                indent(depth);
+                m_Buffer += "}\n";
+                indent(depth);
+                m_Buffer += "else if (";
+                emitExpression(scope, m_Config.expressionDepth / 2);
+                m_Buffer += ")\n";
+                indent(depth);
+                m_Buffer += "{\n";
+                emitBlock(scope, depth + 1, loopDepth);
+            }
+            if (m_Random.chance(50))
+            {
+                indent(depth);
+                m_Buffer += "}\n";
+                indent(depth);
+                m_Buffer += "else\n";
+                indent(depth);
+                m_Buffer += "{\n";
+                emitBlock(scope, depth + 1, loopDepth);
+            }
+            indent(depth);
+            m_Buffer += "};\n";
+        }
+        else if (nested && kind < 3 && loopDepth < m_Config.nesting)
+        {
+            // bounded loop, the counter is never assigned elsewhere
+            const std::string counter = "i" + std::to_string(loopDepth);
+            indent(depth);
+            m_Buffer += counter + " = 0;\n";
+            indent(depth);
+            m_Buffer += "while (" + counter + " < " + std::to_string(m_Random.range(1, 4)) + ")\n";
+            indent(depth);
+            m_Buffer += "{\n";
+            indent(depth + 1);
+            m_Buffer += counter + " += 1;\n";
+            emitBlock(scope, depth + 1, loopDepth + 1);
+            indent(depth);
+            m_Buffer += "};\n";
+        }
+        else if (kind < 4)
+        {
+            indent(depth);
+            m_Buffer += "text = \"";
+            for (int i = 0, count = m_Random.range(1, 6); i < count; ++i)
+                m_Buffer += std::string(i ? " " : "") + Words[m_Random.below(countOf(Words))];
+            m_Buffer += "\";\n";
+        }
+        else
+        {
+            indent(depth);
+            if (kind < 6)
+                emitMember(scope);
+            else
+                m_Buffer += m_Random.chance(50) ? "x" : "y";
+            m_Buffer += m_Random.chance(75) ? " = " : " += ";
+            emitExpression(scope, m_Config.expressionDepth);
+            m_Buffer += ";\n";
+        }
+    }
+
+    void Generator::emitExpression(const Scope& scope, unsigned depth)
+    {
+        if (depth == 0 || m_Random.chance(25))
+        {
+            emitLeaf(scope);
+            return;
+        }
+
+        const bool parenthesized = m_Random.chance(40);
+        if (parenthesized)
+            m_Buffer += '(';
+        if (m_Random.chance(10))
+        {
+            m_Buffer += UnaryOperators[m_Random.below(countOf(UnaryOperators))];
+            m_Buffer += '(';
+            emitExpression(scope, depth - 1);
+            m_Buffer += ')';
+        }
+        else
+        {
+            const std::string op = BinaryOperators[m_Random.below(countOf(BinaryOperators))];
+            emitExpression(scope, depth - 1);
+            m_Buffer += ' ' + op + ' ';
+            // no division by zero and no undefined shifts, if the expression is ever evaluated
+            if (op == "/" || op == "%")
+                m_Buffer += std::to_string(m_Random.range(1, 16));
+            else if (op == "<<" || op == ">>")
+                m_Buffer += std::to_string(m_Random.range(0, 7));
+            else
+                emitExpression(scope, depth - 1);
+        }
+        if (parenthesized)
+            m_Buffer += ')';
+    }
+
+    void Generator::emitLeaf(const Scope& scope)
+    {
+        const unsigned kind = m_Random.below(10);
+        if (kind < 3 && !scope.ints.empty())
+            m_Buffer += scope.ints[m_Random.below(std::uint32_t(scope.ints.size()))];
+        else if (kind < 5 && scope.members)
+            emitMember(scope);
+        else if (kind < 6 && !m_Constants.empty())
+            m_Buffer += m_Constants[m_Random.below(std::uint32_t(m_Constants.size()))];
+        else if (kind < 7 && !m_ConstArrays.empty())
+            m_Buffer += m_ConstArrays[m_Random.below(std::uint32_t(m_ConstArrays.size()))] + "["
+                        + std::to_string(m_Random.below(std::max(m_Config.arraySize, 1u))) + "]";
+        else
+            m_Buffer += std::to_string(m_Random.range(0, 1000));
+    }
+
+    void Generator::emitMember(const Scope& scope)
+    {
+        if (!scope.object.empty())
+            m_Buffer += scope.object + '.';
+        const Class& cls = *scope.members;
+        const std::uint32_t which = m_Random.below(std::uint32_t(cls.fields.size()) + 1);
+        if (which < cls.fields.size())
+            m_Buffer += cls.fields[which];
+        else
+            m_Buffer += cls.array + "[" + std::to_string(m_Random.below(cls.arraySize)) + "]";
+    }
+
+    void Generator::emitComment(unsigned depth)
+    {
+        if (m_Random.chance(70))
+        {
+            m_Buffer += "//";
+            for (int i = 0, count = m_Random.range(1, 12); i < count; ++i)
+                m_Buffer += std::string(" ") + Words[m_Random.below(countOf(Words))];
+            m_Buffer += '\n';
+            return;
+        }
+        // block comments containing code, which must not end declarations early
+        m_Buffer += "/*";
+        for (int line = 0, lines = m_Random.range(1, 8); line < lines; ++line)
+        {
+            m_Buffer += '\n';
+            indent(depth);
+            m_Buffer += " *";
+            for (int i = 0, count = m_Random.range(1, 10); i < count; ++i)
+                m_Buffer += std::string(" ") + Words[m_Random.below(countOf(Words))];
+            if (m_Random.chance(30))
+                m_Buffer += " x = \"}; // not code\";";
+        }
+        m_Buffer += '\n';
+        indent(depth);
+        m_Buffer += " */\n";
+    }
+
+    void Generator::indent(unsigned depth)
+    {
+        m_Buffer.append(depth * 4, ' ');
+    }
+
+    void Generator::flush(bool force)
+    {
+        if (m_Buffer.size() < FlushSize && !force)
+            return;
+        m_Out->write(m_Buffer.data(), std::streamsize(m_Buffer.size()));
+        m_Written += m_Buffer.size();
+        m_Buffer.clear();
+    }
+}
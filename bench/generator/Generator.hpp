@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+    /**
+     * small deterministic PRNG (splitmix64), so that a seed produces
+     * the same output on every platform and standard library
+     */
+    class Random
+    {
+    public:
+        explicit Random(std::uint64_t seed) : m_State(seed) {}
+
+        std::uint64_t next()
+        {
+            std::uint64_t z = (m_State += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27u)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31u);
+        }
+
+        /**
+         * uniform in [0, n), n > 0
+         */
+        std::uint32_t below(std::uint32_t n) { return std::uint32_t((next() >> 32u) * n >> 32u); }
+
+        /**
+         * uniform in [first, last]
+         */
+        int range(int first, int last) { return first + int(below(std::uint32_t(last - first + 1))); }
+
+        bool chance(unsigned percent) { return below(100) < percent; }
+
+    private:
+        std::uint64_t m_State;
+    };
+
+    /**
+     * emits syntactically valid and type correct Daedalus at a configurable scale.
+     * The declarations are generated in rounds of classes, const arrays, constants,
+     * functions, prototypes and instances, names carry a prefix and the round number,
+     * so rounds can be repeated until the requested size is reached.
+     */
+    class Generator
+    {
+    public:
+        struct Config
+        {
+            std::uint64_t seed = 1;
+            std::uint64_t size = 0;            // output size in bytes (exceeded by at most one declaration), 0 for a single round
+            std::string prefix = "gen";        // of all generated names, followed by the round number
+            unsigned classes = 4;
+            unsigned constArrays = 4;
+            unsigned arraySize = 64;           // elements of the const arrays
+            unsigned constants = 40;           // int constants with literal expressions
+            unsigned prototypes = 8;
+            unsigned instances = 60;
+            unsigned functions = 40;
+            unsigned statements = 6;           // statements per block
+            unsigned nesting = 3;              // maximum depth of nested if/while blocks
+            unsigned expressionDepth = 5;      // maximum depth of expression trees
+            unsigned comments = 20;            // percentage of statements and declarations with a comment
+        };
+
+        explicit Generator(const Config& config);
+
+        /**
+         * writes rounds to out until config.size bytes are written
+         * @return number of bytes written
+         */
+        std::uint64_t generate(std::ostream& out);
+
+    private:
+        struct Class
+        {
+            std::string name;
+            std::vector<std::string> fields; // int fields
+            std::string array;               // int array field
+            unsigned arraySize;
+        };
+
+        // what expressions may refer to
+        struct Scope
+        {
+            std::vector<std::string> ints;   // int valued names
+            const Class* members = nullptr;  // class whose members are accessible
+            std::string object;              // members are accessed through this instance, unqualified if empty
+        };
+
+        void round(unsigned index);
+        bool full() const;
+        void emitClass(const Class& cls);
+        void emitConstArray(const std::string& name);
+        void emitConstant(const std::string& name);
+        void emitPrototype(const std::string& name, const Class& cls, unsigned index);
+        void emitInstance(const std::string& name, const std::string& prototype, const Class& cls, unsigned index);
+        void emitFunction(unsigned index);
+        void emitBlock(Scope& scope, unsigned depth, unsigned loopDepth);
+        void emitStatement(Scope& scope, unsigned depth, unsigned loopDepth);
+        void emitExpression(const Scope& scope, unsigned depth);
+        void emitLeaf(const Scope& scope);
+        void emitMember(const Scope& scope);
+        void emitComment(unsigned depth = 0);
+        void indent(unsigned depth);
+        void flush(bool force = false);
+
+        Config m_Config;
+        Random m_Random;
+        std::ostream* m_Out;
+        std::string m_Buffer;
+        std::uint64_t m_Written;
+
+        // declarations of the current round
+        std::string m_Round;
+        std::vector<Class> m_Classes;
+        std::vector<std::string> m_ConstArrays;
+        std::vector<std::string> m_Constants;
+        std::vector<std::string> m_Functions;
+        std::vector<unsigned> m_FunctionClasses; // index into m_Classes of the instance parameter
+    };
+}
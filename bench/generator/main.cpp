@@ -0,0 +1,110 @@
+#include "Generator.hpp"
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace
+{
+    /**
+     * parses sizes like 4096, 10K, 500M or 1G
+     */
+    std::uint64_t parseSize(const std::string& text)
+    {
+        std::size_t end = 0;
+        std::uint64_t size = std::stoull(text, &end);
+        const std::string suffix = text.substr(end);
+        if (suffix == "K" || suffix == "k")
+            size <<= 10u;
+        else if (suffix == "M" || suffix == "m")
+            size <<= 20u;
+        else if (suffix == "G" || suffix == "g")
+            size <<= 30u;
+        else if (!suffix.empty())
+            throw std::runtime_error("Error: invalid size \"" + text + '"');
+        return size;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  Generates synthetic Daedalus sources for scale tests and benchmarks
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    namespace po = boost::program_options;
+
+    Bench::Generator::Config config;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "produce help message")
+            ("seed", po::value<std::uint64_t>(&config.seed)->default_value(config.seed), "the same seed gives the same output")
+            ("size", po::value<std::string>(), "minimum output size, e.g. 10K, 64M or 1G (default: a single round)")
+            ("o", po::value<std::string>(), "output file, or directory if --files is given (default: stdout)")
+            ("files", po::value<unsigned>()->default_value(1), "split the output into this many files named gen<n>.d")
+            ("prefix", po::value<std::string>(&config.prefix)->default_value(config.prefix), "prefix of all generated names")
+            ("classes", po::value<unsigned>(&config.classes)->default_value(config.classes), "classes per round")
+            ("const-arrays", po::value<unsigned>(&config.constArrays)->default_value(config.constArrays), "const int arrays per round")
+            ("array-size", po::value<unsigned>(&config.arraySize)->default_value(config.arraySize), "elements per const array")
+            ("constants", po::value<unsigned>(&config.constants)->default_value(config.constants), "int constants per round")
+            ("prototypes", po::value<unsigned>(&config.prototypes)->default_value(config.prototypes), "prototypes per round")
+            ("instances", po::value<unsigned>(&config.instances)->default_value(config.instances), "instances per round")
+            ("functions", po::value<unsigned>(&config.functions)->default_value(config.functions), "functions per round")
+            ("statements", po::value<unsigned>(&config.statements)->default_value(config.statements), "maximum statements per block")
+            ("nesting", po::value<unsigned>(&config.nesting)->default_value(config.nesting), "maximum depth of nested if/while")
+            ("depth", po::value<unsigned>(&config.expressionDepth)->default_value(config.expressionDepth), "maximum expression depth")
+            ("comments", po::value<unsigned>(&config.comments)->default_value(config.comments), "percentage of commented statements")
+            ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    po::notify(var_map);
+    if (var_map.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    try
+    {
+        const std::uint64_t size = var_map.count("size") ? parseSize(var_map["size"].as<std::string>()) : 0;
+        const unsigned files = std::max(var_map["files"].as<unsigned>(), 1u);
+
+        if (files == 1)
+        {
+            config.size = size;
+            Bench::Generator generator(config);
+            if (!var_map.count("o"))
+                generator.generate(std::cout);
+            else
+            {
+                std::ofstream out(var_map["o"].as<std::string>(), std::ios::binary);
+                generator.generate(out);
+            }
+            return 0;
+        }
+
+        if (!var_map.count("o"))
+            throw std::runtime_error("Error: --files needs an output directory given by --o");
+        const std::string directory = var_map["o"].as<std::string>();
+        mkdir(directory.c_str(), 0777);
+
+        // every file is generated from its own seed, so files can be reproduced individually,
+        // and gets its own prefix, so names don't clash across files
+        const std::uint64_t seed = config.seed;
+        const std::string prefix = config.prefix;
+        for (unsigned i = 0; i < files; ++i)
+        {
+            config.seed = seed + i;
+            config.prefix = prefix + std::to_string(i) + "_";
+            config.size = size / files;
+            std::ofstream out(directory + "/gen" + std::to_string(i) + ".d", std::ios::binary);
+            Bench::Generator(config).generate(out);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
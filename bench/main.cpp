@@ -0,0 +1,455 @@
+#include "Harness.hpp"
+#include "generator/Generator.hpp"
+#include "program.hpp"
+#include "project.hpp"
+#include "source_manager.hpp"
+#include "visitors/ExpressionCollapse.hpp"
+#include "visitors/PrettyPrinter.hpp"
+#include "visitors/TypeChecker.hpp"
+#include "visitors/compiler.hpp"
+#include "visitors/inliner.hpp"
+#include "vm/snapshot.hpp"
+#include "vm/vm.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+
+#ifndef DAEDALUS_BENCH_CORPUS
+#define DAEDALUS_BENCH_CORPUS "bench/corpus"
+#endif
+
+namespace
+{
+    std::string fileName(const std::string& path)
+    {
+        return path.substr(path.find_last_of('/') + 1);
+    }
+
+    /**
+     * benchmarks of one corpus file, the file stays loaded for the lifetime of the harness
+     */
+    void addFileBenchmarks(Bench::Harness& harness, const std::string& path, const parser::parsed_file& file)
+    {
+        const std::string name = fileName(path);
+        const std::size_t bytes = file.source->text.size();
+        auto errorHandler = std::make_shared<parser::error_handler_type>(*file.source, std::cerr);
+
+        harness.add("parse/" + name, [errorHandler]() {
+            ast::program ast;
+            Bench::doNotOptimize(parser::parse(*errorHandler, ast));
+        }, bytes);
+
+        // the collapse rewrites the AST, every run gets a fresh copy
+        auto copy = std::make_shared<ast::program>();
+        harness.add("expression_collapse/" + name, [copy, errorHandler]() {
+            ASTVisitors::ExpressionCollapse(*errorHandler).start(*copy);
+        }, bytes, [copy, &file]() {
+            *copy = file.ast;
+        });
+
+        // the output buffer is reused like when formatting many files
+        auto output = std::make_shared<std::string>();
+        harness.add("pretty_printer/" + name, [&file, output, errorHandler]() {
+            ASTVisitors::PrettyPrinter(*errorHandler, *output).start(const_cast<ast::program&>(file.ast));
+        }, bytes, [output]() {
+            output->clear();
+        });
+    }
+
+    /**
+     * compiles the right hand side of every int constant to a program returning its value
+     */
+    void compileConstants(const parser::error_handler_type& errorHandler, ast::program& ast,
+                          std::vector<code_gen::program>& programs)
+    {
+        for (auto& decl : ast)
+        {
+            auto* constant = boost::get<ast::variable_declaration>(&decl);
+            if (!constant || !constant->rhs || !constant->typed_var_.isConst || !boost::iequals(constant->typed_var_.type_.name, "int"))
+                continue;
+            programs.emplace_back();
+            code_gen::program& program = programs.back();
+            program.op(op_stk_adj, 0);
+            code_gen::compiler compiler(program, errorHandler);
+            if (!compiler(*constant->rhs))
+            {
+                programs.pop_back();
+                continue;
+            }
+            program.op(op_return);
+        }
+    }
+
+    /**
+     * source the code generator compiles completely and runs without errors:
+     * the generator divides by nonzero literals only
+     */
+    std::string generateProgram()
+    {
+        Bench::Generator::Config config;
+        config.size = 64u << 10u;
+        config.statements = 3;
+        config.nesting = 2;
+        config.expressionDepth = 3;
+        std::ostringstream out;
+        Bench::Generator(config).generate(out);
+        return out.str();
+    }
+
+    /**
+     * instances of a script class from a prototype. Their initializers call a script function and
+     * read a constant table, they run when the snapshot is written. Every fourth one also counts
+     * the instances in a global, those run at load
+     */
+    std::string instanceProgram(std::size_t count)
+    {
+        std::ostringstream out;
+        out << "class C_ITEM { var int value; var int flags; var int weight; var int price; var string name; };\n"
+               "const int PRICES[4] = {10, 20, 30, 40};\n"
+               "var int created;\n"
+               "func int weightOf(var int value) { return value / 2 + 1; };\n"
+               "prototype ItemPro(C_ITEM) { flags = 1; name = \"item\"; };\n";
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out << "instance Item_" << i << "(ItemPro) { value = " << i << "; flags = " << i % 4
+                << "; weight = weightOf(value); price = PRICES[flags];";
+            if (i % 4 == 3)
+                out << " created = created + 1;";
+            out << " };\n";
+        }
+        return out.str();
+    }
+
+    /**
+     * a call of a generated function, they take two ints and an object of one of the classes
+     */
+    struct FunctionCall
+    {
+        std::size_t address;
+        int object;             // handle of the zeroed object of the class, the class index + 1
+    };
+
+    std::vector<FunctionCall> functionCalls(const ast::program& ast, const code_gen::program& program)
+    {
+        std::vector<FunctionCall> calls;
+        for (const auto& decl : ast)
+        {
+            if (const auto* function = boost::get<ast::function>(&decl))
+                calls.push_back({program.find_function(function->name.name)->address,
+                                 program.find_class(function->params.back().type_.name) + 1});
+        }
+        return calls;
+    }
+
+    void prepareMachine(vmachine& machine, const code_gen::program& program, const std::vector<FunctionCall>& calls)
+    {
+        machine.strings().assign(program.string_pool());
+        machine.load_globals(program.global_data(), program.constant_data());
+        std::set<int> objects;
+        for (const auto& call : calls)
+        {
+            if (objects.insert(call.object).second)
+                machine.create_instance(call.object, program.class_at(call.object - 1).size);
+        }
+    }
+
+    verified_code verifyProgram(const code_gen::program& program)
+    {
+        return verifier::verify(program(), program.entry_points(), nullptr,
+                                program.global_data().size(), program.constant_data().size());
+    }
+
+    int runFunctions(vmachine& machine, const verified_code& code, const std::vector<FunctionCall>& calls)
+    {
+        int sum = 0;
+        for (const auto& call : calls)
+            sum += machine.execute(code, call.address, {7, 3, call.object});
+        return sum;
+    }
+
+    /**
+     * result of running every function once on a fresh machine
+     */
+    int firstRun(const code_gen::program& program, const verified_code& code, const std::vector<FunctionCall>& calls)
+    {
+        vmachine machine;
+        prepareMachine(machine, program, calls);
+        return runFunctions(machine, code, calls);
+    }
+
+    std::vector<snapshot_instance> snapshotInstances(const code_gen::program& program)
+    {
+        std::vector<snapshot_instance> instances;
+        for (int handle = 1; handle <= int(program.instance_count()); ++handle)
+            instances.push_back({handle, program.class_at(program.instance_class(handle)).size, &program.initializer(handle)});
+        return instances;
+    }
+
+    /**
+     * the globals and the memory of every instance after loading, with the instances bound to host memory
+     */
+    std::vector<std::vector<int>> loadedState(const code_gen::program& program, const verified_code& code,
+                                              const instance_snapshot* snapshot)
+    {
+        vmachine machine;
+        machine.strings().assign(program.string_pool());
+        machine.load_globals(program.global_data(), program.constant_data());
+        std::vector<std::vector<int>> state(1);
+        for (const auto& instance : snapshotInstances(program))
+        {
+            state.emplace_back((instance.size + sizeof(int) - 1) / sizeof(int), 0);
+            machine.bind_instance(instance.handle, state.back().data(), instance.size);
+        }
+        if (snapshot)
+            machine.load_snapshot(*snapshot, code);
+        else
+        {
+            for (const auto& instance : snapshotInstances(program))
+                machine.init_instance(code, instance.handle, *instance.init);
+        }
+        for (std::size_t slot = 0; slot < machine.global_count(); ++slot)
+            state.front().push_back(machine.global(slot));
+        return state;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  Benchmarks of parser, visitors, compiler and virtual machine
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    namespace po = boost::program_options;
+
+    Bench::Options options;
+    code_gen::inline_options inlineOptions;
+    unsigned profileRuns = 1000;
+    std::size_t instanceCount = 2000;
+    std::string snapshotFile = "daedalus_bench.snapshot";
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "produce help message")
+            ("corpus", po::value<std::string>()->default_value(DAEDALUS_BENCH_CORPUS),
+             "directory with the *.d files to run the benchmarks on")
+            ("filter", po::value<std::string>(&options.filter), "run only benchmarks whose name contains this")
+            ("warmup", po::value<unsigned>(&options.warmup)->default_value(options.warmup), "untimed runs per benchmark")
+            ("reps", po::value<unsigned>(&options.repetitions)->default_value(options.repetitions), "timed runs per benchmark")
+            ("json", po::value<std::string>(&options.jsonFile), "write the results to this file")
+            ("baseline", po::value<std::string>(&options.baselineFile),
+             "compare the medians against results written by --json before")
+            ("threshold", po::value<double>(&options.threshold)->default_value(options.threshold),
+             "slowdown in percent counted as regression")
+            ("inline-max-size", po::value<std::size_t>(&inlineOptions.max_size)->default_value(inlineOptions.max_size),
+             "inline_options::max_size of the inlined benchmarks")
+            ("inline-max-hot-size", po::value<std::size_t>(&inlineOptions.max_hot_size)->default_value(inlineOptions.max_hot_size),
+             "inline_options::max_hot_size of the inlined benchmarks")
+            ("inline-hot-calls", po::value<std::uint64_t>(&inlineOptions.hot_calls)->default_value(inlineOptions.hot_calls),
+             "inline_options::hot_calls of the inlined benchmarks")
+            ("inline-max-growth", po::value<double>(&inlineOptions.max_growth)->default_value(inlineOptions.max_growth),
+             "inline_options::max_growth of the inlined benchmarks")
+            ("profile-runs", po::value<unsigned>(&profileRuns)->default_value(profileRuns),
+             "runs of the generated functions the profile for inline_calls counts")
+            ("instances", po::value<std::size_t>(&instanceCount)->default_value(instanceCount),
+             "instances of the world loading benchmarks")
+            ("snapshot", po::value<std::string>(&snapshotFile)->default_value(snapshotFile),
+             "where the world loading benchmarks write their instance snapshot, removed once it is mapped")
+            ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    po::notify(var_map);
+    if (var_map.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    parser::project corpus;
+    corpus.add_directory(var_map["corpus"].as<std::string>());
+    for (const auto& file : corpus.files())
+    {
+        if (!file.second.success)
+        {
+            std::cerr << file.second.diagnostics << "Error: corpus file " << file.first << " doesn't parse" << std::endl;
+            return 1;
+        }
+    }
+    if (corpus.files().empty())
+    {
+        std::cerr << "Error: no *.d files in " << var_map["corpus"].as<std::string>() << std::endl;
+        return 1;
+    }
+
+    Bench::Harness harness;
+    std::size_t totalBytes = 0;
+    for (const auto& file : corpus.files())
+    {
+        addFileBenchmarks(harness, file.first, file.second);
+        totalBytes += file.second.source->text.size();
+    }
+
+    const parser::source_file& anySource = *corpus.files().begin()->second.source;
+    parser::error_handler_type errorHandler(anySource, std::cerr);
+
+    harness.add("type_checker/corpus", [&corpus, &errorHandler]() {
+        ASTVisitors::TypeChecker checker(errorHandler);
+        for (const auto& file : corpus.files())
+            checker.declare(const_cast<ast::program&>(file.second.ast));
+        for (const auto& file : corpus.files())
+            checker.check(const_cast<ast::program&>(file.second.ast));
+        Bench::doNotOptimize(checker.errorCount());
+    }, totalBytes);
+
+    // the int constants compiled one by one as expressions,
+    // constants referring to other declarations don't compile alone and are skipped quietly
+    std::ostream discard(nullptr);
+    parser::error_handler_type quietErrorHandler(anySource, discard);
+    ast::program constants;
+    for (const auto& file : corpus.files())
+        constants.insert(constants.end(), file.second.ast.begin(), file.second.ast.end());
+    std::vector<code_gen::program> programs;
+    compileConstants(quietErrorHandler, constants, programs);
+
+    harness.add("compiler/int_constants", [&constants, &quietErrorHandler]() {
+        std::vector<code_gen::program> compiled;
+        compileConstants(quietErrorHandler, constants, compiled);
+        Bench::doNotOptimize(compiled.size());
+    });
+
+    vmachine machine;
+    harness.add("vm/int_constants", [&programs, &machine]() {
+        int sum = 0;
+        for (const auto& program : programs)
+            sum += machine.execute(program());
+        Bench::doNotOptimize(sum);
+    });
+
+    std::vector<verified_code> verified;
+    for (const auto& program : programs)
+        verified.push_back(verifier::verify(program()));
+    harness.add("vm/int_constants_verified", [&verified, &machine]() {
+        int sum = 0;
+        for (const auto& code : verified)
+            sum += machine.execute(code);
+        Bench::doNotOptimize(sum);
+    });
+
+    // whole programs: the corpus indexes member arrays out of range, which the code generator rejects
+    const parser::source_file& generatedSource = parser::source_manager::get().add_file("generated.d", generateProgram());
+    parser::error_handler_type generatedErrorHandler(generatedSource, std::cerr);
+    ast::program generated;
+    code_gen::program compiled;
+    if (!parser::parse(generatedErrorHandler, generated)
+            || !code_gen::compiler(compiled, generatedErrorHandler).compile(generated))
+    {
+        std::cerr << "Error: the generated program doesn't compile" << std::endl;
+        return 1;
+    }
+
+    harness.add("compiler/generated", [&generated, &generatedErrorHandler]() {
+        code_gen::program program;
+        Bench::doNotOptimize(code_gen::compiler(program, generatedErrorHandler).compile(generated));
+    }, generatedSource.text.size());
+
+    const std::vector<FunctionCall> calls = functionCalls(generated, compiled);
+    const verified_code compiledCode = verifyProgram(compiled);
+    const int compiledResult = firstRun(compiled, compiledCode, calls);
+    vmachine compiledMachine;
+    prepareMachine(compiledMachine, compiled, calls);
+    harness.add("vm/generated_verified", [&compiledMachine, &compiledCode, &calls]() {
+        Bench::doNotOptimize(runFunctions(compiledMachine, compiledCode, calls));
+    });
+
+    // the same functions after inline_calls, without and with a profile of the calls
+    code_gen::program inlined = compiled;
+    const std::size_t inlinedCount = code_gen::inline_calls(inlined, inlineOptions);
+    const std::vector<FunctionCall> inlinedCalls = functionCalls(generated, inlined);
+    const verified_code inlinedCode = verifyProgram(inlined);
+    if (firstRun(inlined, inlinedCode, inlinedCalls) != compiledResult)
+    {
+        std::cerr << "Error: the generated functions compute other results after inline_calls" << std::endl;
+        return 1;
+    }
+    vmachine inlinedMachine;
+    prepareMachine(inlinedMachine, inlined, inlinedCalls);
+    harness.add("vm/generated_inlined", [&inlinedMachine, &inlinedCode, &inlinedCalls]() {
+        Bench::doNotOptimize(runFunctions(inlinedMachine, inlinedCode, inlinedCalls));
+    });
+
+    std::vector<std::uint64_t> profile;
+    compiledMachine.profile_calls(&profile);
+    for (unsigned i = 0; i < profileRuns; ++i)
+        runFunctions(compiledMachine, compiledCode, calls);
+    compiledMachine.profile_calls(nullptr);
+    code_gen::inline_options profileOptions = inlineOptions;
+    profileOptions.profile = &profile;
+    code_gen::program profiled = compiled;
+    const std::size_t profiledCount = code_gen::inline_calls(profiled, profileOptions);
+    const std::vector<FunctionCall> profiledCalls = functionCalls(generated, profiled);
+    const verified_code profiledCode = verifyProgram(profiled);
+    if (firstRun(profiled, profiledCode, profiledCalls) != compiledResult)
+    {
+        std::cerr << "Error: the generated functions compute other results after inline_calls with a profile" << std::endl;
+        return 1;
+    }
+    vmachine profiledMachine;
+    prepareMachine(profiledMachine, profiled, profiledCalls);
+    harness.add("vm/generated_inlined_profile", [&profiledMachine, &profiledCode, &profiledCalls]() {
+        Bench::doNotOptimize(runFunctions(profiledMachine, profiledCode, profiledCalls));
+    });
+
+    // world loading: running the instance initializers against mapping a snapshot written before
+    const parser::source_file& instanceSource = parser::source_manager::get().add_file("instances.d", instanceProgram(instanceCount));
+    parser::error_handler_type instanceErrorHandler(instanceSource, std::cerr);
+    ast::program instanceAst;
+    code_gen::program instanceProgram;
+    if (!parser::parse(instanceErrorHandler, instanceAst)
+            || !code_gen::compiler(instanceProgram, instanceErrorHandler).compile(instanceAst))
+    {
+        std::cerr << "Error: the instance program doesn't compile" << std::endl;
+        return 1;
+    }
+    const verified_code instanceCode = verifyProgram(instanceProgram);
+    const std::vector<snapshot_instance> instances = snapshotInstances(instanceProgram);
+    const std::size_t deferred = instance_snapshot::write(snapshotFile, instanceCode, instanceProgram, instances);
+    instance_snapshot snapshot(snapshotFile, instance_snapshot::fingerprint_of(instanceProgram));
+    std::remove(snapshotFile.c_str());
+    if (loadedState(instanceProgram, instanceCode, &snapshot) != loadedState(instanceProgram, instanceCode, nullptr))
+    {
+        std::cerr << "Error: loading the snapshot doesn't give the state of running the initializers" << std::endl;
+        return 1;
+    }
+
+    auto instanceMachine = std::make_shared<vmachine>();
+    auto resetMachine = [&instanceProgram, instanceMachine]() {
+        *instanceMachine = vmachine();
+        instanceMachine->strings().assign(instanceProgram.string_pool());
+        instanceMachine->load_globals(instanceProgram.global_data(), instanceProgram.constant_data());
+    };
+    harness.add("vm/instances_init", [&instanceCode, &instances, instanceMachine]() {
+        for (const auto& instance : instances)
+        {
+            instanceMachine->create_instance(instance.handle, instance.size);
+            instanceMachine->init_instance(instanceCode, instance.handle, *instance.init);
+        }
+    }, 0, resetMachine);
+    harness.add("vm/instances_snapshot", [&instanceCode, &snapshot, instanceMachine]() {
+        instanceMachine->load_snapshot(snapshot, instanceCode);
+    }, 0, resetMachine);
+
+    std::cout << "corpus: " << corpus.files().size() << " files, " << totalBytes << " bytes, "
+              << programs.size() << " int constants\n";
+    std::cout << "generated: " << generatedSource.text.size() << " bytes, " << calls.size() << " functions, "
+              << compiled().size() << " words of code\n";
+    std::cout << "inlined: " << inlinedCount << " calls, " << inlined().size() << " words of code, with the profile "
+              << profiledCount << " calls, " << profiled().size() << " words of code\n";
+    std::cout << "instances: " << instances.size() << ", " << deferred << " initializers left for the load\n\n";
+
+    const std::vector<Bench::Result> results = harness.run(options, std::cout);
+    if (!options.jsonFile.empty())
+        Bench::Harness::writeJson(results, options.jsonFile);
+    if (!options.baselineFile.empty())
+        return Bench::Harness::compare(results, options.baselineFile, options.threshold, std::cout) ? 1 : 0;
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "Input.hpp"
+#include "Mutator.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+//  Fuzz target: parser
+//  expectation failures must be reported through the error handler,
+//  an exception leaving the parser is a finding
+///////////////////////////////////////////////////////////////////////////////
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    Fuzz::Input input(data, size);
+    ast::program ast;
+    input.parse(ast);
+    return 0;
+}
+
+extern "C" std::size_t LLVMFuzzerCustomMutator(std::uint8_t* data, std::size_t size, std::size_t maxSize, unsigned int seed)
+{
+    return Fuzz::mutate(data, size, maxSize, seed);
+}
@@ -0,0 +1,104 @@
+#include "Input.hpp"
+#include "Mutator.hpp"
+#include "visitors/compiler.hpp"
+#include "visitors/inliner.hpp"
+#include "visitors/linker.hpp"
+#include "vm/vm.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+
+///////////////////////////////////////////////////////////////////////////////
+//  Fuzz target: code generator and vm
+//  the vm trusts its bytecode, so it only runs what the compiler produced:
+//  the right hand sides of the int constants of every input that parses.
+//  compiled code must pass the verifier and the fast path must agree with the checked one,
+//  run time errors included. every constant is divided by zero as well, which must throw.
+//  functions are only compiled and verified, before and after inlining and after
+//  stripping what all or half of them don't reach
+///////////////////////////////////////////////////////////////////////////////
+namespace
+{
+    constexpr long long threw = LLONG_MIN;
+
+    // result of the checked or the fast path, threw for run time errors
+    long long run(vmachine& machine, std::vector<int> const& code, bool verified)
+    {
+        try
+        {
+            return verified ? machine.execute(verifier::verify(code)) : machine.execute(code);
+        }
+        catch (std::runtime_error const&)
+        {
+            return threw;
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    Fuzz::Input input(data, size);
+    ast::program ast;
+    if (!input.parse(ast))
+        return 0;
+
+    // functions are compiled but not run, their loops need not terminate
+    code_gen::program functions;
+    code_gen::compiler compiler(functions, input.errorHandler());
+    if (compiler.compile(ast))
+    {
+        verifier::verify(functions(), functions.entry_points(), nullptr,
+                         functions.global_data().size(), functions.constant_data().size());
+
+        code_gen::link_roots roots;
+        for (auto& decl : ast)
+        {
+            if (auto* function = boost::get<ast::function>(&decl))
+                roots.functions.push_back(function->name.name);
+        }
+        for (std::size_t count : {roots.functions.size(), roots.functions.size() / 2})
+        {
+            code_gen::program stripped = functions;
+            code_gen::link_roots some;
+            some.functions.assign(roots.functions.begin(), roots.functions.begin() + std::ptrdiff_t(count));
+            code_gen::strip_unreachable(stripped, some);
+            verifier::verify(stripped(), stripped.entry_points(), nullptr,
+                             stripped.global_data().size(), stripped.constant_data().size());
+        }
+        if (code_gen::inline_calls(functions))
+            verifier::verify(functions(), functions.entry_points(), nullptr,
+                             functions.global_data().size(), functions.constant_data().size());
+    }
+
+    vmachine machine;
+    for (auto& decl : ast)
+    {
+        auto* constant = boost::get<ast::variable_declaration>(&decl);
+        if (!constant || !constant->rhs || !constant->typed_var_.isConst
+            || !boost::iequals(constant->typed_var_.type_.name, "int"))
+            continue;
+
+        code_gen::program program;
+        program.op(op_stk_adj, 0);
+        code_gen::compiler compiler(program, input.errorHandler());
+        if (!compiler(*constant->rhs))
+            continue;
+        code_gen::program by_zero = program;
+        program.op(op_return);
+        if (run(machine, program(), true) != run(machine, program(), false))
+            std::abort();
+
+        by_zero.op(op_int, 0);
+        by_zero.op(op_div);
+        by_zero.op(op_return);
+        if (run(machine, by_zero(), true) != threw || run(machine, by_zero(), false) != threw)
+            std::abort();
+    }
+    return 0;
+}
+
+extern "C" std::size_t LLVMFuzzerCustomMutator(std::uint8_t* data, std::size_t size, std::size_t maxSize, unsigned int seed)
+{
+    return Fuzz::mutate(data, size, maxSize, seed);
+}
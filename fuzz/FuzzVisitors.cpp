@@ -0,0 +1,30 @@
+#include "Input.hpp"
+#include "Mutator.hpp"
+#include "visitors/ExpressionCollapse.hpp"
+#include "visitors/PrettyPrinter.hpp"
+#include "visitors/SymbolCollector.hpp"
+#include "visitors/TypeChecker.hpp"
+#include <sstream>
+
+///////////////////////////////////////////////////////////////////////////////
+//  Fuzz target: visitors on every input that parses
+///////////////////////////////////////////////////////////////////////////////
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    Fuzz::Input input(data, size);
+    ast::program ast;
+    if (!input.parse(ast))
+        return 0;
+
+    ASTVisitors::TypeChecker(input.errorHandler()).start(ast);
+    ASTVisitors::SymbolCollector(input.errorHandler()).start(ast);
+    ASTVisitors::ExpressionCollapse(input.errorHandler()).start(ast);
+    std::ostringstream out;
+    ASTVisitors::PrettyPrinter(input.errorHandler(), out).start(ast);
+    return 0;
+}
+
+extern "C" std::size_t LLVMFuzzerCustomMutator(std::uint8_t* data, std::size_t size, std::size_t maxSize, unsigned int seed)
+{
+    return Fuzz::mutate(data, size, maxSize, seed);
+}
@@ -0,0 +1,24 @@
+#include "Input.hpp"
+#include "program.hpp"
+#include "source_manager.hpp"
+
+namespace Fuzz
+{
+    Input::Input(const std::uint8_t* data, std::size_t size)
+            : m_Discard(nullptr),
+              m_Source(parser::source_manager::get().add_file("fuzz-input.d",
+                                                              std::string(reinterpret_cast<const char*>(data), size))),
+              m_ErrorHandler(m_Source, m_Discard)
+    {
+    }
+
+    Input::~Input()
+    {
+        parser::source_manager::get().remove_file(m_Source);
+    }
+
+    bool Input::parse(ast::program& ast)
+    {
+        return parser::parse(m_ErrorHandler, ast);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ast.hpp"
+#include "config.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace parser
+{
+    struct source_file;
+}
+
+namespace Fuzz
+{
+    /**
+     * a fuzzer input loaded as source file for the lifetime of this object,
+     * diagnostics are discarded
+     */
+    class Input
+    {
+    public:
+        Input(const std::uint8_t* data, std::size_t size);
+        ~Input();
+
+        Input(const Input&) = delete;
+        Input& operator=(const Input&) = delete;
+
+        /**
+         * @return true if the entire input was parsed
+         */
+        bool parse(ast::program& ast);
+
+        parser::error_handler_type& errorHandler() { return m_ErrorHandler; }
+
+    private:
+        std::ostream m_Discard;
+        const parser::source_file& m_Source;
+        parser::error_handler_type m_ErrorHandler;
+    };
+}
@@ -0,0 +1,228 @@
+#include "Mutator.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Fuzz
+{
+    namespace
+    {
+        enum class TokenKind
+        {
+            Word,       // identifiers and keywords
+            Number,
+            String,
+            Comment,
+            Symbol      // operators and punctuation
+        };
+
+        /**
+         * token text including the whitespace in front of it
+         */
+        struct Token
+        {
+            TokenKind kind;
+            std::string text;
+        };
+
+        const char* const Keywords[] = {
+                "func", "var", "const", "class", "prototype", "instance", "return", "if", "else", "while",
+                "int", "float", "string", "void", "self", "other"
+        };
+
+        const char* const Symbols[] = {
+                "+", "-", "*", "/", "%", "<", ">", "<=", ">=", "==", "!=", "&&", "||", "&", "|", "^",
+                "<<", ">>", "!", "~", "=", "+=", "-=", "*=", "/=", "(", ")", "{", "}", "[", "]", ",", ";", "."
+        };
+
+        const char* const Numbers[] = {
+                "0", "1", "-1", "7", "31", "32", "255", "65536", "2147483647", "2147483648", "4294967296",
+                "99999999999999999999", "0.5", "1e38", "1e39"
+        };
+
+        // grammar fragments inserted between tokens
+        const char* const Fragments[] = {
+                " var int x;", " const int C = 1 + 2 * 3;", " x = x + 1;", " x += C;", " return x;",
+                " if (x < 1) { x = 2; };", " if (x) { } else if (x) { } else { };", " while (x) { x -= 1; };",
+                " func int f(var int a) { return a; };", " func void g() { f(1); };",
+                " class C { var int a; var int b[4]; };", " prototype P(C) { a = 1; };",
+                " instance I(P) { b[2] = a; };", " instance A, B(C);", " x.a[1]", " f(x, 1)", " \"text\"",
+                " /* comment */", " // comment\n", " ((((x))))", " -(-(-x))", " {{{{ }}}}", " x = y = z;"
+        };
+
+        template <class T, std::size_t N>
+        std::size_t countOf(const T (&)[N])
+        {
+            return N;
+        }
+
+        bool isWordChar(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        std::vector<Token> tokenize(const std::string& text)
+        {
+            std::vector<Token> tokens;
+            std::size_t i = 0;
+            while (i < text.size())
+            {
+                const std::size_t first = i;
+                while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+                    ++i;
+                if (i == text.size())
+                {
+                    // trailing whitespace sticks to the last token
+                    if (!tokens.empty())
+                        tokens.back().text += text.substr(first);
+                    break;
+                }
+
+                TokenKind kind;
+                const char c = text[i];
+                if (c == '/' && i + 1 < text.size() && (text[i + 1] == '/' || text[i + 1] == '*'))
+                {
+                    kind = TokenKind::Comment;
+                    const std::size_t end = text[i + 1] == '/' ? text.find('\n', i) : text.find("*/", i + 2);
+                    i = end == std::string::npos ? text.size() : end + (text[i + 1] == '/' ? 1 : 2);
+                }
+                else if (c == '"')
+                {
+                    kind = TokenKind::String;
+                    const std::size_t end = text.find('"', i + 1);
+                    i = end == std::string::npos ? text.size() : end + 1;
+                }
+                else if (std::isdigit(static_cast<unsigned char>(c)))
+                {
+                    kind = TokenKind::Number;
+                    while (i < text.size() && (isWordChar(text[i]) || text[i] == '.'))
+                        ++i;
+                }
+                else if (isWordChar(c))
+                {
+                    kind = TokenKind::Word;
+                    while (i < text.size() && isWordChar(text[i]))
+                        ++i;
+                }
+                else
+                {
+                    kind = TokenKind::Symbol;
+                    static const char* const twoChars[] = {"<=", ">=", "==", "!=", "&&", "||", "<<", ">>",
+                                                           "+=", "-=", "*=", "/="};
+                    bool matched = false;
+                    for (const char* symbol : twoChars)
+                        matched = matched || text.compare(i, 2, symbol) == 0;
+                    i += matched ? 2 : 1;
+                }
+                tokens.push_back({kind, text.substr(first, i - first)});
+            }
+            return tokens;
+        }
+
+        std::string join(const std::vector<Token>& tokens)
+        {
+            std::string text;
+            for (const auto& token : tokens)
+                text += token.text;
+            return text;
+        }
+
+        /**
+         * keeps the whitespace in front of a token, replaces the token itself
+         */
+        void replaceText(Token& token, const std::string& text)
+        {
+            std::size_t space = 0;
+            while (space < token.text.size() && std::isspace(static_cast<unsigned char>(token.text[space])))
+                ++space;
+            token.text = token.text.substr(0, space) + (space ? "" : " ") + text;
+        }
+    }
+
+    std::size_t mutate(std::uint8_t* data, std::size_t size, std::size_t maxSize, unsigned int seed)
+    {
+        std::minstd_rand random(seed);
+        auto below = [&random](std::size_t n) { return n ? std::size_t(random() % n) : 0; };
+
+        std::vector<Token> tokens = tokenize(std::string(reinterpret_cast<const char*>(data), size));
+        if (tokens.empty() || below(8) == 0)
+            return LLVMFuzzerMutate(data, size, maxSize);
+
+        for (std::size_t mutations = 1 + below(3); mutations > 0; --mutations)
+        {
+            const std::size_t first = below(tokens.size());
+            const std::size_t count = std::min(1 + below(below(16) + 1), tokens.size() - first);
+            switch (below(8))
+            {
+                case 0: // replace by a token of the same kind
+                {
+                    Token& token = tokens[first];
+                    if (token.kind == TokenKind::Word)
+                        replaceText(token, Keywords[below(countOf(Keywords))]);
+                    else if (token.kind == TokenKind::Number)
+                        replaceText(token, Numbers[below(countOf(Numbers))]);
+                    else if (token.kind == TokenKind::Symbol)
+                        replaceText(token, Symbols[below(countOf(Symbols))]);
+                    else
+                        replaceText(token, "x");
+                    break;
+                }
+                case 1: // delete
+                    tokens.erase(tokens.begin() + first, tokens.begin() + first + count);
+                    break;
+                case 2: // duplicate, grows nesting and repetitions
+                {
+                    std::vector<Token> copy(tokens.begin() + first, tokens.begin() + first + count);
+                    const std::size_t position = below(tokens.size() + 1);
+                    for (std::size_t repeat = 1 + below(4); repeat > 0; --repeat)
+                        tokens.insert(tokens.begin() + position, copy.begin(), copy.end());
+                    break;
+                }
+                case 3: // swap
+                    std::swap(tokens[first], tokens[below(tokens.size())]);
+                    break;
+                case 4: // wrap in brackets
+                {
+                    static const char* const brackets[][2] = {{"(", ")"}, {"{", "};"}, {"[", "]"}};
+                    const auto& bracket = brackets[below(countOf(brackets))];
+                    tokens.insert(tokens.begin() + first + count, {TokenKind::Symbol, bracket[1]});
+                    tokens.insert(tokens.begin() + first, {TokenKind::Symbol, bracket[0]});
+                    break;
+                }
+                case 5: // insert a fragment
+                {
+                    std::vector<Token> fragment = tokenize(Fragments[below(countOf(Fragments))]);
+                    tokens.insert(tokens.begin() + below(tokens.size() + 1), fragment.begin(), fragment.end());
+                    break;
+                }
+                case 6: // insert a single token
+                {
+                    const bool keyword = below(2) == 0;
+                    Token token{keyword ? TokenKind::Word : TokenKind::Symbol,
+                                std::string(" ") + (keyword ? Keywords[below(countOf(Keywords))]
+                                                            : Symbols[below(countOf(Symbols))])};
+                    tokens.insert(tokens.begin() + first, token);
+                    break;
+                }
+                default: // deep nesting, probes recursion depth and backtracking
+                {
+                    const std::size_t depth = 1 + below(64);
+                    tokens.insert(tokens.begin() + first + count, depth, {TokenKind::Symbol, ")"});
+                    tokens.insert(tokens.begin() + first, depth, {TokenKind::Symbol, "("});
+                    break;
+                }
+            }
+            if (tokens.empty())
+                break;
+        }
+
+        const std::string text = join(tokens);
+        if (text.empty() || text.size() > maxSize)
+            return LLVMFuzzerMutate(data, size, maxSize);
+        std::memcpy(data, text.data(), text.size());
+        return text.size();
+    }
+}
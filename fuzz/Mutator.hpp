@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * byte level mutation of libFuzzer, provided by the standalone driver when built without libFuzzer
+ */
+extern "C" std::size_t LLVMFuzzerMutate(std::uint8_t* data, std::size_t size, std::size_t maxSize);
+
+namespace Fuzz
+{
+    /**
+     * structure aware mutation: splits the input into Daedalus tokens and edits the token sequence
+     * (replace, delete, duplicate, swap, wrap in brackets, insert grammar fragments),
+     * so most results are near-valid programs that get past the first syntax error.
+     * Falls back to LLVMFuzzerMutate for some inputs and when the result doesn't fit.
+     * @return new size of data
+     */
+    std::size_t mutate(std::uint8_t* data, std::size_t size, std::size_t maxSize, unsigned int seed);
+}
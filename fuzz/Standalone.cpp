@@ -0,0 +1,240 @@
+#include "Mutator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <dirent.h>
+#include <exception>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size);
+extern "C" std::size_t LLVMFuzzerCustomMutator(std::uint8_t* data, std::size_t size, std::size_t maxSize, unsigned int seed);
+
+namespace
+{
+    std::minstd_rand g_Random;
+
+    // the input being run, written to a file if it crashes or times out
+    const std::uint8_t* g_Current = nullptr;
+    std::size_t g_CurrentSize = 0;
+
+    void saveCurrent(const char* filename)
+    {
+        int file = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0)
+            return;
+        std::size_t written = 0;
+        while (written < g_CurrentSize)
+        {
+            ssize_t result = write(file, g_Current + written, g_CurrentSize - written);
+            if (result <= 0)
+                break;
+            written += std::size_t(result);
+        }
+        close(file);
+    }
+
+    void onSignal(int signal)
+    {
+        const bool timeout = signal == SIGALRM;
+        const char* filename = timeout ? "timeout-input" : "crash-input";
+        saveCurrent(filename);
+        const char* message = timeout ? "\n==== timeout, input written to timeout-input\n"
+                                      : "\n==== crash, input written to crash-input\n";
+        ssize_t ignored = write(STDERR_FILENO, message, std::strlen(message));
+        (void)ignored;
+        _exit(timeout ? 70 : 71);
+    }
+
+    void collectInputs(const std::string& path, std::vector<std::string>& files)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            throw std::runtime_error("Error: couldn't open \"" + path + '"');
+        if (!S_ISDIR(info.st_mode))
+        {
+            files.push_back(path);
+            return;
+        }
+        DIR* handle = opendir(path.c_str());
+        while (dirent* entry = readdir(handle))
+        {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..")
+                collectInputs(path + '/' + name, files);
+        }
+        closedir(handle);
+    }
+
+    std::vector<std::uint8_t> readInput(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    /**
+     * @return run time in milliseconds
+     */
+    double run(const std::vector<std::uint8_t>& input, unsigned timeout)
+    {
+        g_Current = input.data();
+        g_CurrentSize = input.size();
+        alarm(timeout);
+        const auto start = std::chrono::steady_clock::now();
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        const auto end = std::chrono::steady_clock::now();
+        alarm(0);
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    long maxResidentKB()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+}
+
+/**
+ * simple byte level mutations standing in for the ones of libFuzzer
+ */
+extern "C" std::size_t LLVMFuzzerMutate(std::uint8_t* data, std::size_t size, std::size_t maxSize)
+{
+    const std::size_t position = size ? g_Random() % size : 0;
+    switch (g_Random() % 4)
+    {
+        case 0:
+            if (size)
+                data[position] ^= std::uint8_t(1u << (g_Random() % 8));
+            return size;
+        case 1:
+            if (size < maxSize)
+            {
+                std::memmove(data + position + 1, data + position, size - position);
+                data[position] = std::uint8_t(g_Random() % 128);
+                return size + 1;
+            }
+            return size;
+        case 2:
+            if (size > 1)
+            {
+                std::memmove(data + position, data + position + 1, size - position - 1);
+                return size - 1;
+            }
+            return size;
+        default:
+        {
+            // duplicate a chunk
+            const std::size_t length = std::min<std::size_t>(size - position, 1 + g_Random() % 32);
+            if (size + length > maxSize)
+                return size;
+            std::memmove(data + position + length, data + position, size - position);
+            return size + length;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  Standalone driver of a fuzz target for builds without libFuzzer:
+//  replays inputs (files or directories), and with --runs mutates them
+//  with the structure aware mutator, without coverage feedback
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    unsigned long runs = 0;
+    unsigned seed = 1;
+    unsigned timeout = 10;          // seconds per input
+    std::size_t maxLength = 1u << 16u;
+    std::vector<std::string> files;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--runs" && i + 1 < argc)
+                runs = std::stoul(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc)
+                seed = unsigned(std::stoul(argv[++i]));
+            else if (arg == "--timeout" && i + 1 < argc)
+                timeout = unsigned(std::stoul(argv[++i]));
+            else if (arg == "--max-len" && i + 1 < argc)
+                maxLength = std::stoul(argv[++i]);
+            else if (arg == "--help")
+            {
+                std::cout << "usage: " << argv[0]
+                          << " [--runs <n>] [--seed <n>] [--timeout <seconds>] [--max-len <bytes>] <file or directory>...\n";
+                return 0;
+            }
+            else
+                collectInputs(arg, files);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    for (int signal : {SIGSEGV, SIGABRT, SIGFPE, SIGILL, SIGBUS, SIGALRM})
+        std::signal(signal, onSignal);
+    g_Random.seed(seed);
+
+    // replay
+    std::vector<std::vector<std::uint8_t>> pool;
+    double slowest = 0;
+    std::string slowestFile;
+    for (const auto& file : files)
+    {
+        pool.push_back(readInput(file));
+        double time = run(pool.back(), timeout);
+        if (time >= slowest)
+        {
+            slowest = time;
+            slowestFile = file;
+        }
+    }
+    std::cout << "replayed " << files.size() << " inputs";
+    if (!files.empty())
+        std::cout << ", slowest " << slowest << " ms: " << slowestFile;
+    std::cout << ", max rss " << maxResidentKB() << " KB" << std::endl;
+
+    if (runs == 0)
+        return 0;
+    if (pool.empty())
+        pool.emplace_back();
+
+    // mutate, inputs that run slower than everything before are kept for further mutation
+    slowest = 0;
+    std::vector<std::uint8_t> input;
+    for (unsigned long i = 0; i < runs; ++i)
+    {
+        const auto& parent = pool[g_Random() % pool.size()];
+        input.assign(parent.begin(), parent.end());
+        input.resize(std::max(maxLength, input.size()));
+        input.resize(LLVMFuzzerCustomMutator(input.data(), parent.size(), input.size(), unsigned(g_Random())));
+
+        const double time = run(input, timeout);
+        if (time > slowest)
+        {
+            slowest = time;
+            pool.push_back(input);
+            std::ofstream("slow-input", std::ios::binary).write(reinterpret_cast<const char*>(input.data()),
+                                                                std::streamsize(input.size()));
+            std::cout << "run " << i << ": new slowest input, " << input.size() << " bytes, " << time
+                      << " ms, written to slow-input" << std::endl;
+        }
+    }
+    std::cout << runs << " runs, max rss " << maxResidentKB() << " KB" << std::endl;
+    return 0;
+}
@@ -7,10 +7,10 @@
 #pragma once
 
 #include <boost/spirit/home/x3/support/ast/variant.hpp>
-#include <boost/spirit/home/x3/support/ast/position_tagged.hpp>
 #include <boost/fusion/include/io.hpp>
 #include <boost/optional.hpp>
 #include <list>
+#include <cstdint>
 
 namespace ast
 {
@@ -19,6 +19,16 @@ namespace ast
     ///////////////////////////////////////////////////////////////////////////
     namespace x3 = boost::spirit::x3;
 
+    // offset of a node's first character in the address space of parser::source_manager,
+    // which holds all loaded files back to back
+    typedef std::uint32_t source_location;
+    constexpr source_location invalid_location = 0xFFFFFFFFu;
+
+    // position tag of annotated nodes, the range of a node is derived on demand from its source
+    struct position_tagged {
+        source_location location = invalid_location;
+    };
+
     struct nil {
     };
     struct unary;
@@ -26,18 +36,18 @@ namespace ast
     struct func_call;
     struct array_access;
 
-    struct variable : x3::position_tagged {
+    struct variable : position_tagged {
         variable(std::string const &name = "") : name(name) {}
         std::string name;
     };
 
-    struct memberAccess : x3::position_tagged
+    struct memberAccess : position_tagged
     {
         variable object;
         variable member;
     };
 
-    struct type : x3::position_tagged {
+    struct type : position_tagged {
         type(std::string const &name = "") : name(name) {}
         std::string name;
     };
@@ -100,33 +110,33 @@ namespace ast
         operand operand_;
     };
 
-    struct operation : x3::position_tagged {
+    struct operation : position_tagged {
         optoken operator_;
         operand operand_;
     };
 
-    struct binary_expression : x3::position_tagged {
+    struct binary_expression : position_tagged {
         operand left;
         operand right;
         optoken operator_;
     };
 
-    struct expression : x3::position_tagged {
+    struct expression : position_tagged {
         operand first;
         std::list<operation> rest;
     };
 
-    struct func_call : x3::position_tagged {
+    struct func_call : position_tagged {
         variable var;
         std::list<operand> args;
     };
 
-    struct array_access : x3::position_tagged {
+    struct array_access : position_tagged {
         operand var;
         operand index;
     };
 
-    struct assignment : x3::position_tagged {
+    struct assignment : position_tagged {
         operand lhs;
         optoken operator_;
         operand rhs;
@@ -149,7 +159,7 @@ namespace ast
         boost::optional<std::list<operand>> rhs;
     };
 
-    struct return_statement
+    struct return_statement : position_tagged
     {
         boost::optional<operand> operand_;
     };
@@ -17,11 +17,11 @@ namespace parser {
     typedef x3::phrase_parse_context<skipper_type>::type phrase_context_type;
     typedef error_handler <iterator_type> error_handler_type;
 
-    typedef x3::with_context<
+    typedef x3::context<
             error_handler_tag,
-            std::reference_wrapper<error_handler_type> const,
+            std::reference_wrapper<error_handler_type>,
             phrase_context_type
-                >::type
+                >
             context_type;
 }
 
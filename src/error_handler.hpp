@@ -8,18 +8,185 @@
 
 #include <boost/spirit/home/x3.hpp>
 #include <boost/spirit/home/x3/support/utility/error_reporting.hpp>
-#include <boost/spirit/home/x3/support/ast/position_tagged.hpp>
 #include "expression.hpp"
 #include "statement.hpp"
+#include "source_manager.hpp"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <ostream>
+#include <type_traits>
 
 namespace parser {
     namespace x3 = boost::spirit::x3;
 
     ////////////////////////////////////////////////////////////////////////////
     //  Our error handler
+    //  same interface as x3::error_handler, but line and column lookups go
+    //  through the line_index of the source_file instead of rescanning the
+    //  source from the beginning for every diagnostic.
+    //  AST nodes are tagged with a single source_location, the highlighted
+    //  range of a node is derived from its first token on demand.
     ////////////////////////////////////////////////////////////////////////////
     template<typename Iterator>
-    using error_handler = x3::error_handler<Iterator>;
+    class error_handler
+    {
+    public:
+        typedef Iterator iterator_type;
+        typedef void result_type;
+        // receives every reported diagnostic as location range in addition to the printed message
+        typedef std::function<void(ast::source_location first, ast::source_location last, std::string const& message)> listener_type;
+
+        error_handler(source_file const& source, std::ostream& err_out, int tabs = 4)
+                : err_out(err_out)
+                , source(source)
+                , tabs(tabs) {}
+
+        void operator()(Iterator err_pos, std::string const& error_message) const
+        {
+            std::size_t offset = skip_whitespace(source, err_pos - source.begin());
+            if (listener)
+                listener(source.base + offset, source.base + offset, error_message);
+            print_file_line(source, offset);
+            err_out << error_message << std::endl;
+            print_line(source, offset);
+            std::size_t column = source.lines.column_of(source.begin(), offset, tabs);
+            err_out << std::string(column - 1, '_') << "^_" << std::endl;
+        }
+
+        void operator()(Iterator err_first, Iterator err_last, std::string const& error_message) const
+        {
+            report(source, err_first - source.begin(), err_last - source.begin(), error_message);
+        }
+
+        void operator()(ast::position_tagged pos, std::string const& message) const
+        {
+            const source_file* file = source_manager::get().file_of(pos.location);
+            BOOST_ASSERT_MSG(file, "position tag outside of loaded files");
+            std::size_t first = file->offset_of(pos.location);
+            report(*file, first, file->token_end(first), message);
+        }
+
+        template <typename AST>
+        void tag(AST& ast, Iterator first, Iterator last)
+        {
+            annotate(ast, first, std::is_base_of<ast::position_tagged, AST>());
+        }
+
+        boost::iterator_range<Iterator> position_of(ast::position_tagged pos) const
+        {
+            const source_file* file = source_manager::get().file_of(pos.location);
+            BOOST_ASSERT_MSG(file, "position tag outside of loaded files");
+            std::size_t first = file->offset_of(pos.location);
+            return boost::make_iterator_range(file->begin() + first, file->begin() + file->token_end(first));
+        }
+
+        source_file const& get_source() const
+        {
+            return source;
+        }
+
+        void set_listener(listener_type const& on_diagnostic)
+        {
+            listener = on_diagnostic;
+        }
+
+    private:
+        template <typename AST>
+        void annotate(AST& ast, Iterator first, std::true_type) const
+        {
+            ast.location = source.location_of(first);
+        }
+
+        template <typename AST>
+        void annotate(AST&, Iterator, std::false_type) const
+        {
+        }
+
+        void report(source_file const& file, std::size_t first, std::size_t last, std::string const& error_message) const
+        {
+            first = skip_whitespace(file, first);
+            last = std::max(first, std::min(last, line_end(file, first)));
+            if (listener)
+                listener(file.base + first, file.base + last, error_message);
+            print_file_line(file, first);
+            err_out << error_message << std::endl;
+            print_line(file, first);
+            std::size_t column_first = file.lines.column_of(file.begin(), first, tabs);
+            std::size_t column_last = file.lines.column_of(file.begin(), last, tabs);
+            err_out << std::string(column_first - 1, ' ')
+                    << std::string(column_last - column_first, '~')
+                    << " <<-- Here" << std::endl;
+        }
+
+        static std::size_t line_end(source_file const& file, std::size_t offset)
+        {
+            std::size_t end = file.text.find_first_of("\r\n", offset);
+            return end == std::string::npos ? file.text.size() : end;
+        }
+
+        void print_file_line(source_file const& file, std::size_t offset) const
+        {
+            if (file.name != "")
+                err_out << "In file " << file.name << ", ";
+            else
+                err_out << "In ";
+            err_out << "line " << file.lines.line_of(offset) << ':' << std::endl;
+        }
+
+        /**
+         * prints the line containing offset, tabs expanded to spaces so that
+         * the indicator below lines up with the source
+         */
+        void print_line(source_file const& file, std::size_t offset) const
+        {
+            std::size_t start = file.lines.line_start(offset);
+            std::size_t end = line_end(file, start);
+            std::string line;
+            for (std::size_t i = start; i != end; ++i)
+            {
+                if (file.text[i] == '\t' && tabs > 0)
+                    line.append(tabs - line.size() % tabs, ' ');
+                else
+                    line += file.text[i];
+            }
+            err_out << line << std::endl;
+        }
+
+        /**
+         * make sure the offset does not point to white space or comments,
+         * error positions are taken before the skipper ran
+         */
+        static std::size_t skip_whitespace(source_file const& file, std::size_t offset)
+        {
+            const std::string& text = file.text;
+            while (offset < text.size())
+            {
+                if (std::isspace(static_cast<unsigned char>(text[offset])))
+                {
+                    ++offset;
+                    continue;
+                }
+                if (text.compare(offset, 2, "//") == 0)
+                {
+                    offset = text.find('\n', offset);
+                }
+                else if (text.compare(offset, 2, "/*") == 0)
+                {
+                    offset = text.find("*/", offset + 2);
+                    offset = offset == std::string::npos ? offset : offset + 2;
+                }
+                else
+                    break;
+            }
+            return std::min(offset, text.size());
+        }
+
+        std::ostream& err_out;
+        source_file const& source;
+        int tabs;
+        listener_type listener;
+    };
 
     // tag used to get our error handler from the context
     using error_handler_tag = x3::error_handler_tag;
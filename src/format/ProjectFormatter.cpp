@@ -0,0 +1,459 @@
+#include "ProjectFormatter.hpp"
+#include "program.hpp"
+#include "project.hpp"
+#include "source_manager.hpp"
+#include "utils.hpp"
+#include "visitors/ExpressionCollapse.hpp"
+#include "visitors/PrettyPrinter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace Format
+{
+    namespace
+    {
+        // changes whenever the pretty printer output changes, invalidates old cache entries
+        const char* const FormatVersion = "daedalus-format 1";
+
+        std::uint64_t hashOf(const std::string& text)
+        {
+            // FNV-1a
+            std::uint64_t hash = 0xCBF29CE484222325ull;
+            for (const char* c = FormatVersion; *c; ++c)
+                hash = (hash ^ static_cast<unsigned char>(*c)) * 0x100000001B3ull;
+            for (char c : text)
+                hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+            return hash ? hash : 1;
+        }
+
+        bool isDirectory(const std::string& path)
+        {
+            struct stat info;
+            return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        }
+
+        bool exists(const std::string& path)
+        {
+            return access(path.c_str(), F_OK) == 0;
+        }
+
+        bool hasSuffix(const std::string& path, const std::string& suffix)
+        {
+            if (path.size() < suffix.size())
+                return false;
+            return std::equal(suffix.begin(), suffix.end(), path.end() - suffix.size(), [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            });
+        }
+
+        std::vector<std::string> listDirectory(const std::string& directory)
+        {
+            std::vector<std::string> names;
+            DIR* handle = opendir(directory.c_str());
+            if (!handle)
+                throw std::runtime_error("Error: couldn't open directory \"" + directory + '"');
+            while (dirent* entry = readdir(handle))
+            {
+                const std::string name = entry->d_name;
+                if (name != "." && name != "..")
+                    names.push_back(name);
+            }
+            closedir(handle);
+            std::sort(names.begin(), names.end());
+            return names;
+        }
+
+        void addDirectory(const std::string& directory, std::vector<std::string>& files)
+        {
+            for (const auto& name : listDirectory(directory))
+            {
+                const std::string path = directory + '/' + name;
+                if (isDirectory(path))
+                    addDirectory(path, files);
+                else if (parser::project::isSourceFile(path))
+                    files.push_back(path);
+            }
+        }
+
+        /**
+         * case insensitive match with * and ? wildcards
+         */
+        bool matches(const char* pattern, const char* name)
+        {
+            for (; *pattern; ++pattern, ++name)
+            {
+                if (*pattern == '*')
+                {
+                    for (const char* rest = name;; ++rest)
+                    {
+                        if (matches(pattern + 1, rest))
+                            return true;
+                        if (!*rest)
+                            return false;
+                    }
+                }
+                if (!*name)
+                    return false;
+                if (*pattern != '?' && std::tolower(static_cast<unsigned char>(*pattern))
+                                       != std::tolower(static_cast<unsigned char>(*name)))
+                    return false;
+            }
+            return !*name;
+        }
+
+        /**
+         * entries of directory matching the pattern, case insensitive like the engine on Windows
+         */
+        std::vector<std::string> resolve(const std::string& directory, const std::string& pattern)
+        {
+            if (pattern.find_first_of("*?") == std::string::npos && exists(directory + '/' + pattern))
+                return {directory + '/' + pattern};
+
+            std::vector<std::string> paths;
+            for (const auto& name : listDirectory(directory))
+            {
+                if (matches(pattern.c_str(), name.c_str()))
+                    paths.push_back(directory + '/' + name);
+            }
+            return paths;
+        }
+
+        /**
+         * whether the pretty printer would drop comments of the text
+         */
+        bool hasComments(const std::string& text)
+        {
+            for (std::size_t i = 0; i + 1 < text.size(); ++i)
+            {
+                if (text[i] == '"')
+                {
+                    i = text.find('"', i + 1);
+                    if (i == std::string::npos)
+                        return false;
+                }
+                else if (text[i] == '/' && (text[i + 1] == '/' || text[i + 1] == '*'))
+                    return true;
+            }
+            return false;
+        }
+
+        /**
+         * keeps a source file loaded for the lifetime of the object
+         */
+        class LoadedSource
+        {
+        public:
+            LoadedSource(const std::string& name, std::string text)
+                    : m_Source(parser::source_manager::get().add_file(name, std::move(text)))
+            {}
+
+            ~LoadedSource()
+            {
+                parser::source_manager::get().remove_file(m_Source);
+            }
+
+            const parser::source_file& get() const { return m_Source; }
+
+        private:
+            const parser::source_file& m_Source;
+        };
+
+        void writeAtomic(const std::string& filename, const std::string& text)
+        {
+            const std::string temporary = filename + ".tmp" + std::to_string(getpid())
+                                          + '.' + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                if (!file.write(text.data(), std::streamsize(text.size())) || !file.flush())
+                {
+                    std::remove(temporary.c_str());
+                    throw std::runtime_error("Error: couldn't write \"" + temporary + '"');
+                }
+            }
+            if (std::rename(temporary.c_str(), filename.c_str()) != 0)
+            {
+                std::remove(temporary.c_str());
+                throw std::runtime_error("Error: couldn't replace \"" + filename + '"');
+            }
+        }
+    }
+
+    ProjectFormatter::ProjectFormatter(const Options& options, std::ostream& out)
+            : m_Options(options),
+              m_Out(out)
+    {
+    }
+
+    void ProjectFormatter::add(const std::string& input)
+    {
+        if (isDirectory(input))
+            addDirectory(input, m_Files);
+        else if (hasSuffix(input, ".src"))
+        {
+            for (auto& file : readManifest(input))
+                m_Files.push_back(std::move(file));
+        }
+        else if (exists(input))
+            m_Files.push_back(input);
+        else
+            throw std::runtime_error("Error: couldn't open \"" + input + '"');
+    }
+
+    std::vector<std::string> ProjectFormatter::readManifest(const std::string& filename)
+    {
+        std::istringstream manifest(Utils::readAllText(filename));
+        const std::size_t slash = filename.find_last_of('/');
+        const std::string root = slash == std::string::npos ? "." : filename.substr(0, slash);
+
+        std::vector<std::string> files;
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            line = line.substr(0, line.find("//"));
+            std::replace(line.begin(), line.end(), '\\', '/');
+            const auto first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos)
+                continue;
+            line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+
+            // directories are resolved one component at a time, only the last one may contain wildcards
+            std::vector<std::string> directories = {root};
+            std::size_t start = 0;
+            for (std::size_t end; (end = line.find('/', start)) != std::string::npos; start = end + 1)
+            {
+                const std::string component = line.substr(start, end - start);
+                std::vector<std::string> resolved;
+                for (const auto& directory : directories)
+                {
+                    for (auto& path : resolve(directory, component))
+                    {
+                        if (isDirectory(path))
+                            resolved.push_back(std::move(path));
+                    }
+                }
+                directories = std::move(resolved);
+            }
+
+            std::vector<std::string> matched;
+            for (const auto& directory : directories)
+            {
+                for (auto& path : resolve(directory, line.substr(start)))
+                    matched.push_back(std::move(path));
+            }
+            if (matched.empty() && line.find_first_of("*?") == std::string::npos)
+                throw std::runtime_error("Error: \"" + line + "\" listed in " + filename + " doesn't exist");
+
+            for (auto& path : matched)
+            {
+                if (hasSuffix(path, ".src"))
+                {
+                    for (auto& file : readManifest(path))
+                        files.push_back(std::move(file));
+                }
+                else if (parser::project::isSourceFile(path))
+                    files.push_back(std::move(path));
+            }
+        }
+        return files;
+    }
+
+    int ProjectFormatter::run()
+    {
+        // a file listed twice is formatted once, whatever way it was reached, e.g. ./d/a.d from a manifest and d/a.d.
+        // the normalized path is the cache key as well
+        std::vector<std::string> files;
+        std::unordered_set<std::string> seen;
+        for (const auto& file : m_Files)
+        {
+            std::string path = parser::project::normalize(file);
+            if (seen.insert(path).second)
+                files.push_back(std::move(path));
+        }
+        m_Files = std::move(files);
+        loadCache();
+
+        std::vector<Result> results(m_Files.size());
+        std::atomic<std::size_t> next(0);
+        auto worker = [this, &results, &next]() {
+            std::string buffer; // reused for every file of this worker
+            for (std::size_t i; (i = next++) < m_Files.size();)
+            {
+                try
+                {
+                    results[i] = format(m_Files[i], buffer);
+                }
+                catch (const std::exception& e)
+                {
+                    results[i].status = Status::Failed;
+                    results[i].message = e.what();
+                }
+            }
+        };
+
+        unsigned jobs = m_Options.jobs ? m_Options.jobs : std::max(1u, std::thread::hardware_concurrency());
+        jobs = unsigned(std::min<std::size_t>(jobs, m_Files.size()));
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < jobs; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+
+        // messages in file order, independent of the scheduling
+        std::size_t failed = 0, unformatted = 0, written = 0, skipped = 0;
+        for (std::size_t i = 0; i < m_Files.size(); ++i)
+        {
+            const Result& result = results[i];
+            const std::string output = m_Options.inPlace || m_Options.check ? m_Files[i] : m_Files[i] + m_Options.suffix;
+            if (result.hash)
+                m_Cache[output] = result.hash;
+            else
+                m_Cache.erase(output);
+
+            switch (result.status)
+            {
+                case Status::Failed:
+                    ++failed;
+                    m_Out << result.message;
+                    if (!result.message.empty() && result.message.back() != '\n')
+                        m_Out << '\n';
+                    break;
+                case Status::Unformatted:
+                    ++unformatted;
+                    m_Out << "not formatted: " << m_Files[i];
+                    if (!result.message.empty())
+                        m_Out << " (" << result.message << ')';
+                    m_Out << '\n';
+                    break;
+                case Status::Written:
+                    ++written;
+                    break;
+                case Status::Skipped:
+                    ++skipped;
+                    m_Out << "skipped " << m_Files[i] << ": comments would be lost\n";
+                    break;
+                default:
+                    break;
+            }
+        }
+        saveCache();
+
+        m_Out << m_Files.size() << " files, " << (m_Options.check ? unformatted : written)
+              << (m_Options.check ? " not formatted, " : " written, ") << skipped << " skipped, "
+              << failed << " failed" << std::endl;
+        return failed || unformatted || skipped ? 1 : 0;
+    }
+
+    ProjectFormatter::Result ProjectFormatter::format(const std::string& path, std::string& buffer) const
+    {
+        Result result;
+        std::string text = Utils::readAllText(path);
+        const std::uint64_t hash = hashOf(text);
+        const bool inPlace = m_Options.inPlace || m_Options.check;
+        const std::string output = inPlace ? path : path + m_Options.suffix;
+
+        auto cached = m_Cache.find(output);
+        if (cached != m_Cache.end() && cached->second == hash && (inPlace || exists(output)))
+        {
+            result.status = Status::Cached;
+            result.hash = hash;
+            return result;
+        }
+        // check compares anyway, the comments make the file count as not formatted
+        const bool comments = inPlace && hasComments(text);
+        if (comments && !m_Options.check)
+        {
+            result.status = Status::Skipped;
+            return result;
+        }
+
+        bool formatted;
+        {
+            LoadedSource source(path, std::move(text));
+            std::ostringstream errors;
+            parser::error_handler_type error_handler(source.get(), errors);
+            ast::program ast;
+            if (!parser::parse(error_handler, ast))
+            {
+                result.message = errors.str();
+                return result;
+            }
+            // the same visitors as a plain daedalusx3 <file> run
+            ASTVisitors::ExpressionCollapse(error_handler).start(ast);
+            buffer.clear();
+            ASTVisitors::PrettyPrinter(error_handler, buffer).start(ast);
+            formatted = buffer == source.get().text;
+        }
+
+        if (inPlace)
+        {
+            if (formatted)
+                result.status = Status::Formatted;
+            else if (m_Options.check)
+            {
+                result.status = Status::Unformatted;
+                if (comments)
+                    result.message = "comments would be lost";
+            }
+            else
+            {
+                writeAtomic(output, buffer);
+                result.status = Status::Written;
+            }
+            result.hash = formatted ? hash : m_Options.check ? 0 : hashOf(buffer);
+            return result;
+        }
+
+        if (exists(output) && Utils::readAllText(output) == buffer)
+            result.status = Status::Formatted;
+        else
+        {
+            writeAtomic(output, buffer);
+            result.status = Status::Written;
+        }
+        result.hash = hash;
+        return result;
+    }
+
+    void ProjectFormatter::loadCache()
+    {
+        m_Cache.clear();
+        if (m_Options.cacheFile.empty() || !exists(m_Options.cacheFile))
+            return;
+        std::istringstream cache(Utils::readAllText(m_Options.cacheFile));
+        std::string line;
+        while (std::getline(cache, line))
+        {
+            // <hash in hex> <path>
+            const std::size_t space = line.find(' ');
+            if (space == std::string::npos)
+                continue;
+            m_Cache[line.substr(space + 1)] = std::strtoull(line.substr(0, space).c_str(), nullptr, 16);
+        }
+    }
+
+    void ProjectFormatter::saveCache() const
+    {
+        if (m_Options.cacheFile.empty())
+            return;
+        std::string text;
+        char hash[20];
+        for (const auto& entry : m_Cache)
+        {
+            std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(entry.second));
+            text += hash;
+            text += ' ' + entry.first + '\n';
+        }
+        writeAtomic(m_Options.cacheFile, text);
+    }
+}
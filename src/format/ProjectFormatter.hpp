@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Format
+{
+    struct Options
+    {
+        bool check = false;         // only report files that aren't formatted, write nothing
+        bool inPlace = false;       // replace the sources instead of writing <file><suffix>
+        std::string suffix = ".pretty";
+        unsigned jobs = 0;          // worker threads, 0 for one per core
+        std::string cacheFile = ".daedalus-format-cache"; // empty to disable the cache
+    };
+
+    /**
+     * formats the *.d files of directories and .src manifests across a thread pool.
+     * Output files are replaced atomically. Content hashes of formatted files
+     * are kept in a cache file, so unchanged files are skipped without parsing.
+     */
+    class ProjectFormatter
+    {
+    public:
+        ProjectFormatter(const Options& options, std::ostream& out);
+
+        /**
+         * adds a directory (recursively), a .src manifest or a single file
+         * @throws std::runtime_error if the input doesn't exist
+         */
+        void add(const std::string& input);
+
+        /**
+         * @return exit status: 0 on success, 1 if a file failed to parse, was skipped
+         * for its comments or, with check, isn't formatted
+         */
+        int run();
+
+        /**
+         * reads a Daedalus .src manifest: one path per line relative to the manifest,
+         * backslashes as separators, wildcards in the file name and nested manifests.
+         * Paths are matched case insensitive.
+         * @throws std::runtime_error if the manifest or a listed file doesn't exist
+         */
+        static std::vector<std::string> readManifest(const std::string& filename);
+
+    private:
+        enum class Status
+        {
+            Cached,         // content hash in the cache, not parsed
+            Formatted,      // output was up to date
+            Written,
+            Unformatted,    // check only, including files with comments
+            Skipped,        // comments would be lost in place
+            Failed
+        };
+
+        struct Result
+        {
+            Status status = Status::Failed;
+            std::uint64_t hash = 0;     // cache entry, 0 for none
+            std::string message;
+        };
+
+        Result format(const std::string& path, std::string& buffer) const;
+        void loadCache();
+        void saveCache() const;
+
+        Options m_Options;
+        std::ostream& m_Out;
+        std::vector<std::string> m_Files;
+        std::map<std::string, std::uint64_t> m_Cache; // output path -> hash of the formatted source
+    };
+}
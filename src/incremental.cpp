@@ -0,0 +1,191 @@
+#include "incremental.hpp"
+#include "program.hpp"
+#include "visitors/LocationShift.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace parser
+{
+    namespace
+    {
+        segment parse_segment(error_handler_type& error_handler, std::size_t offset, std::size_t length,
+                              ast::program& ast)
+        {
+            segment result{offset, length, 0, {}};
+            error_handler.set_listener([&result](ast::source_location first, ast::source_location last, std::string const& message) {
+                result.errors.push_back({first, last, message});
+            });
+
+            const source_file& source = error_handler.get_source();
+            iterator_type parsed_until;
+            ast::program declarations;
+            if (!parse(error_handler, source.begin() + offset, source.begin() + offset + length, declarations, &parsed_until)
+                && result.errors.empty())
+            {
+                ast::source_location location = source.location_of(parsed_until);
+                result.errors.push_back({location, location, "Parsing failed"});
+            }
+            error_handler.set_listener(nullptr);
+
+            result.declarations = declarations.size();
+            ast.splice(ast.end(), declarations);
+            return result;
+        }
+
+        void shift(error_handler_type& error_handler, ast::program::iterator first, ast::program::iterator last,
+                   ast::source_location amount)
+        {
+            if (amount == 0)
+                return;
+            ASTVisitors::LocationShift visitor(error_handler, amount);
+            for (; first != last; ++first)
+                visitor.start(*first);
+        }
+
+        void shift(std::vector<segment>::iterator first, std::vector<segment>::iterator last,
+                   std::ptrdiff_t offset, ast::source_location amount)
+        {
+            for (; first != last; ++first)
+            {
+                first->offset += offset;
+                for (auto& error : first->errors)
+                {
+                    error.first += amount;
+                    error.last += amount;
+                }
+            }
+        }
+
+        bool all_parsed(const std::vector<segment>& segments)
+        {
+            return std::all_of(segments.begin(), segments.end(),
+                               [](const segment& s) { return s.errors.empty(); });
+        }
+
+        std::size_t count_declarations(std::vector<segment>::const_iterator first, std::vector<segment>::const_iterator last)
+        {
+            std::size_t count = 0;
+            for (; first != last; ++first)
+                count += first->declarations;
+            return count;
+        }
+    }
+
+    std::size_t segment_end(const std::string& text, std::size_t offset)
+    {
+        int depth = 0;
+        while (offset < text.size())
+        {
+            const char c = text[offset];
+            const char next = offset + 1 < text.size() ? text[offset + 1] : '\0';
+            std::size_t skip_to = std::string::npos;
+            if (c == '/' && next == '/')
+                skip_to = text.find('\n', offset);
+            else if (c == '/' && next == '*')
+                skip_to = text.find("*/", offset + 2);
+            else if (c == '"')
+                skip_to = text.find('"', offset + 1);
+            else
+            {
+                ++offset;
+                if (c == '{')
+                    ++depth;
+                else if (c == '}')
+                    depth = std::max(depth - 1, 0);
+                else if (c == ';' && depth == 0)
+                    return offset;
+                continue;
+            }
+            // unterminated comments and strings run to the end of the file
+            if (skip_to == std::string::npos)
+                return text.size();
+            offset = skip_to + (c == '/' && next == '*' ? 2 : 1);
+        }
+        return offset;
+    }
+
+    text_edit diff(const std::string& old_text, const std::string& new_text)
+    {
+        const std::size_t common = std::min(old_text.size(), new_text.size());
+        std::size_t prefix = 0;
+        while (prefix < common && old_text[prefix] == new_text[prefix])
+            ++prefix;
+        std::size_t suffix = 0;
+        while (suffix < common - prefix
+               && old_text[old_text.size() - 1 - suffix] == new_text[new_text.size() - 1 - suffix])
+            ++suffix;
+        return {prefix, old_text.size() - prefix - suffix, new_text.substr(prefix, new_text.size() - prefix - suffix)};
+    }
+
+    bool parse_segments(error_handler_type& error_handler, ast::program& ast, std::vector<segment>& segments)
+    {
+        const std::string& text = error_handler.get_source().text;
+        ast.clear();
+        segments.clear();
+        for (std::size_t offset = 0; offset < text.size(); offset = segments.back().offset + segments.back().length)
+            segments.push_back(parse_segment(error_handler, offset, segment_end(text, offset) - offset, ast));
+        return all_parsed(segments);
+    }
+
+    bool reparse(error_handler_type& error_handler, ast::source_location old_base, const text_edit& edit,
+                 ast::program& ast, std::vector<segment>& segments, segment_change& change)
+    {
+        const source_file& source = error_handler.get_source();
+        const std::string& text = source.text;
+        const std::ptrdiff_t delta = std::ptrdiff_t(edit.text.size()) - std::ptrdiff_t(edit.removed);
+        const std::size_t edit_end = edit.offset + edit.text.size();
+
+        // the segment containing the start of the edit is the first one to parse again
+        auto by_offset = [](std::size_t offset, const segment& s) { return offset < s.offset; };
+        auto first = std::upper_bound(segments.begin(), segments.end(), edit.offset, by_offset);
+        if (first != segments.begin())
+            --first;
+        std::size_t offset = first == segments.end() ? 0 : first->offset;
+
+        // parse until a segment boundary behind the edit lines up with an old boundary,
+        // from there on the old segments are unaffected
+        std::vector<segment> parsed;
+        ast::program declarations;
+        auto last = segments.end();
+        while (offset < text.size())
+        {
+            const std::size_t end = segment_end(text, offset);
+            parsed.push_back(parse_segment(error_handler, offset, end - offset, declarations));
+            offset = end;
+            if (offset < edit_end)
+                continue;
+            const std::size_t old_offset = offset - edit.text.size() + edit.removed;
+            auto old = std::lower_bound(first, segments.end(), old_offset,
+                                        [](const segment& s, std::size_t value) { return s.offset < value; });
+            if (old != segments.end() && old->offset == old_offset)
+            {
+                last = old;
+                break;
+            }
+        }
+
+        // keep the declarations in front of and behind the parsed segments,
+        // the ones in front only move if the source got a new base
+        const ast::source_location rebase = source.base - old_base;
+        const ast::source_location moved = rebase + ast::source_location(delta);
+        auto declarations_first = std::next(ast.begin(), std::ptrdiff_t(count_declarations(segments.begin(), first)));
+        auto declarations_last = std::next(declarations_first, std::ptrdiff_t(count_declarations(first, last)));
+        shift(error_handler, ast.begin(), declarations_first, rebase);
+        shift(error_handler, declarations_last, ast.end(), moved);
+        ast.erase(declarations_first, declarations_last);
+        change.declarations = declarations.empty() ? declarations_last : declarations.begin();
+        ast.splice(declarations_last, declarations);
+
+        change.first = std::size_t(first - segments.begin());
+        change.removed = std::size_t(last - first);
+        change.inserted = parsed.size();
+        change.shift = moved;
+        change.rebased = rebase != 0;
+
+        shift(segments.begin(), first, 0, rebase);
+        shift(last, segments.end(), delta, moved);
+        auto inserted = segments.erase(first, last);
+        segments.insert(inserted, std::make_move_iterator(parsed.begin()), std::make_move_iterator(parsed.end()));
+        return all_parsed(segments);
+    }
+}
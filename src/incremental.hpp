@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ast.hpp"
+#include "config.hpp"
+#include "source_manager.hpp"
+#include <string>
+#include <vector>
+
+namespace parser
+{
+    struct diagnostic
+    {
+        ast::source_location first;
+        ast::source_location last;
+        std::string message;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    //  A top-level segment of a file
+    //  files are split behind every semicolon outside of braces, comments and
+    //  strings. No declaration spans such a boundary, so every segment can be
+    //  parsed on its own and an edit only has to parse the segments it touches.
+    ////////////////////////////////////////////////////////////////////////////
+    struct segment
+    {
+        std::size_t offset;
+        std::size_t length;
+        std::size_t declarations;       // number of global_decls parsed from the segment
+        std::vector<diagnostic> errors; // empty if the segment parsed
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    //  What the last parse of a file replaced
+    //  lets consumers of the AST, like the symbol index, redo only the
+    //  declarations of the reparsed segments.
+    ////////////////////////////////////////////////////////////////////////////
+    struct segment_change
+    {
+        std::size_t first = 0;      // index of the first reparsed segment
+        std::size_t removed = 0;    // number of old segments replaced
+        std::size_t inserted = 0;   // number of new segments, starting at first
+        ast::program::const_iterator declarations; // first declaration of the new segments
+        ast::source_location shift = 0; // amount the locations behind the new segments moved
+        bool rebased = true;        // the locations in front of the new segments moved as well
+    };
+
+    struct text_edit
+    {
+        std::size_t offset;  // start of the replaced range in the old text
+        std::size_t removed; // length of the replaced range in the old text
+        std::string text;    // replacement
+    };
+
+    /**
+     * @return offset one past the segment starting at offset
+     */
+    std::size_t segment_end(const std::string& text, std::size_t offset);
+
+    /**
+     * @return single edit turning old_text into new_text, keeping their common prefix and suffix
+     */
+    text_edit diff(const std::string& old_text, const std::string& new_text);
+
+    /**
+     * parses the whole source of the error handler segment by segment,
+     * the listener of the error handler is replaced to collect the errors of each segment
+     * @return true if every segment parsed, ast holds the declarations of all segments in any case
+     */
+    bool parse_segments(error_handler_type& error_handler, ast::program& ast, std::vector<segment>& segments);
+
+    /**
+     * brings ast and segments up to date with the source of the error handler,
+     * after edit was applied to it in place and its base moved from old_base.
+     * Only the segments touched by the edit are parsed again, the declarations of all
+     * other segments are kept. Their position tags only move if they are behind the edit
+     * or the base of the source moved.
+     * @return true if every segment parsed
+     */
+    bool reparse(error_handler_type& error_handler, ast::source_location old_base, const text_edit& edit,
+                 ast::program& ast, std::vector<segment>& segments, segment_change& change);
+}
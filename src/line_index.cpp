@@ -0,0 +1,38 @@
+#include "line_index.hpp"
+#include <algorithm>
+
+namespace parser
+{
+    std::size_t line_index::line_of(std::size_t offset) const
+    {
+        // first line start behind offset; its index is the 1-based line number
+        auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+        return std::size_t(it - line_starts.begin());
+    }
+
+    std::size_t line_index::line_start(std::size_t offset) const
+    {
+        return line_starts[line_of(offset) - 1];
+    }
+
+    void line_index::replace(const std::string& text, std::size_t offset, std::size_t removed, std::size_t inserted)
+    {
+        // a line start depends on the character in front of it and the one at it,
+        // so the starts in [offset, offset + removed] of the old text are the ones to redo
+        const std::size_t first = std::max<std::size_t>(offset, 1);
+        auto begin = std::lower_bound(line_starts.begin(), line_starts.end(), first);
+        auto end = std::upper_bound(begin, line_starts.end(), offset + removed);
+        for (auto it = end; it != line_starts.end(); ++it)
+            *it = *it - removed + inserted;
+
+        std::vector<std::size_t> starts;
+        for (std::size_t start = first; start <= offset + inserted && start <= text.size(); ++start)
+        {
+            const char c = text[start - 1];
+            if (c == '\n' || (c == '\r' && (start == text.size() || text[start] != '\n')))
+                starts.push_back(start);
+        }
+        begin = line_starts.erase(begin, end);
+        line_starts.insert(begin, starts.begin(), starts.end());
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+
+namespace parser
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  Line start offsets of a source buffer
+    //  built once when the source is loaded, so that line and column lookups
+    //  of diagnostics are a binary search instead of a rescan of the file.
+    //  Line terminators are "\n", "\r\n" and a lone "\r".
+    ////////////////////////////////////////////////////////////////////////////
+    class line_index
+    {
+    public:
+        line_index() : line_starts(1, 0) {}
+
+        template <typename Iterator>
+        line_index(Iterator first, Iterator last)
+        {
+            line_starts.push_back(0);
+            std::size_t offset = 0;
+            for (Iterator it = first; it != last; ++it, ++offset)
+            {
+                const char c = *it;
+                if (c == '\n')
+                    line_starts.push_back(offset + 1);
+                else if (c == '\r' && (std::next(it) == last || *std::next(it) != '\n'))
+                    line_starts.push_back(offset + 1);
+            }
+        }
+
+        /**
+         * @return 1-based line number of the given offset
+         */
+        std::size_t line_of(std::size_t offset) const;
+
+        /**
+         * @return offset of the first character of the line containing offset
+         */
+        std::size_t line_start(std::size_t offset) const;
+
+        /**
+         * @return 1-based display column of offset, tabs advance to the next multiple of tabs
+         */
+        template <typename Iterator>
+        std::size_t column_of(Iterator first, std::size_t offset, unsigned tabs) const
+        {
+            std::size_t column = 0;
+            for (Iterator it = first + line_start(offset), end = first + offset; it != end; ++it)
+            {
+                if (*it == '\t' && tabs != 0)
+                    column += tabs - column % tabs;
+                else
+                    ++column;
+            }
+            return column + 1;
+        }
+
+        /**
+         * @return offset of the first character of the 1-based line, clamped to the last line
+         */
+        std::size_t offset_of_line(std::size_t line) const
+        {
+            return line_starts[std::min(std::max<std::size_t>(line, 1), line_starts.size()) - 1];
+        }
+
+        std::size_t line_count() const { return line_starts.size(); }
+
+        /**
+         * updates the index after removed characters at offset were replaced in place,
+         * text is the buffer after the edit and inserted the length of the replacement.
+         * Only the lines of the edit are scanned, the ones behind it are moved.
+         */
+        void replace(const std::string& text, std::size_t offset, std::size_t removed, std::size_t inserted);
+
+    private:
+        std::vector<std::size_t> line_starts;
+    };
+}
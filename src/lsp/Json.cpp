@@ -0,0 +1,366 @@
+#include "Json.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace LSP
+{
+    namespace
+    {
+        class JsonParser
+        {
+        public:
+            JsonParser(const std::string& text) : m_Text(text), m_Pos(0) {}
+
+            Json parseDocument()
+            {
+                Json value = parseValue();
+                skipWhitespace();
+                if (m_Pos != m_Text.size())
+                    fail("trailing characters");
+                return value;
+            }
+
+        private:
+            [[noreturn]] void fail(const std::string& what) const
+            {
+                throw std::runtime_error("Error: malformed json, " + what + " at offset " + std::to_string(m_Pos));
+            }
+
+            void skipWhitespace()
+            {
+                while (m_Pos < m_Text.size() && (m_Text[m_Pos] == ' ' || m_Text[m_Pos] == '\t'
+                                                 || m_Text[m_Pos] == '\n' || m_Text[m_Pos] == '\r'))
+                    ++m_Pos;
+            }
+
+            bool consume(const char* literal)
+            {
+                std::size_t length = std::char_traits<char>::length(literal);
+                if (m_Text.compare(m_Pos, length, literal) != 0)
+                    return false;
+                m_Pos += length;
+                return true;
+            }
+
+            void expect(char c)
+            {
+                skipWhitespace();
+                if (m_Pos >= m_Text.size() || m_Text[m_Pos] != c)
+                    fail(std::string("expected '") + c + "'");
+                ++m_Pos;
+            }
+
+            Json parseValue()
+            {
+                skipWhitespace();
+                if (m_Pos >= m_Text.size())
+                    fail("unexpected end");
+                const char c = m_Text[m_Pos];
+                if (c == '{')
+                    return parseObject();
+                if (c == '[')
+                    return parseArray();
+                if (c == '"')
+                    return Json(parseString());
+                if (consume("true"))
+                    return Json(true);
+                if (consume("false"))
+                    return Json(false);
+                if (consume("null"))
+                    return Json();
+                return parseNumber();
+            }
+
+            Json parseObject()
+            {
+                Json object = Json::object();
+                expect('{');
+                skipWhitespace();
+                if (m_Pos < m_Text.size() && m_Text[m_Pos] == '}')
+                {
+                    ++m_Pos;
+                    return object;
+                }
+                while (true)
+                {
+                    skipWhitespace();
+                    std::string key = parseString();
+                    expect(':');
+                    object[key] = parseValue();
+                    skipWhitespace();
+                    if (m_Pos < m_Text.size() && m_Text[m_Pos] == ',')
+                    {
+                        ++m_Pos;
+                        continue;
+                    }
+                    expect('}');
+                    return object;
+                }
+            }
+
+            Json parseArray()
+            {
+                Json array = Json::array();
+                expect('[');
+                skipWhitespace();
+                if (m_Pos < m_Text.size() && m_Text[m_Pos] == ']')
+                {
+                    ++m_Pos;
+                    return array;
+                }
+                while (true)
+                {
+                    array.push_back(parseValue());
+                    skipWhitespace();
+                    if (m_Pos < m_Text.size() && m_Text[m_Pos] == ',')
+                    {
+                        ++m_Pos;
+                        continue;
+                    }
+                    expect(']');
+                    return array;
+                }
+            }
+
+            Json parseNumber()
+            {
+                const char* begin = m_Text.c_str() + m_Pos;
+                char* end = nullptr;
+                double value = std::strtod(begin, &end);
+                if (end == begin)
+                    fail("unexpected character");
+                m_Pos += std::size_t(end - begin);
+                return Json(value);
+            }
+
+            unsigned parseHex4()
+            {
+                if (m_Pos + 4 > m_Text.size())
+                    fail("truncated escape");
+                unsigned value = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    const char c = m_Text[m_Pos++];
+                    value <<= 4;
+                    if (c >= '0' && c <= '9')
+                        value |= unsigned(c - '0');
+                    else if (c >= 'a' && c <= 'f')
+                        value |= unsigned(c - 'a' + 10);
+                    else if (c >= 'A' && c <= 'F')
+                        value |= unsigned(c - 'A' + 10);
+                    else
+                        fail("invalid escape");
+                }
+                return value;
+            }
+
+            static void appendUtf8(std::string& out, unsigned codepoint)
+            {
+                if (codepoint < 0x80)
+                    out += char(codepoint);
+                else if (codepoint < 0x800)
+                {
+                    out += char(0xC0 | (codepoint >> 6));
+                    out += char(0x80 | (codepoint & 0x3F));
+                }
+                else if (codepoint < 0x10000)
+                {
+                    out += char(0xE0 | (codepoint >> 12));
+                    out += char(0x80 | ((codepoint >> 6) & 0x3F));
+                    out += char(0x80 | (codepoint & 0x3F));
+                }
+                else
+                {
+                    out += char(0xF0 | (codepoint >> 18));
+                    out += char(0x80 | ((codepoint >> 12) & 0x3F));
+                    out += char(0x80 | ((codepoint >> 6) & 0x3F));
+                    out += char(0x80 | (codepoint & 0x3F));
+                }
+            }
+
+            std::string parseString()
+            {
+                if (m_Pos >= m_Text.size() || m_Text[m_Pos] != '"')
+                    fail("expected string");
+                ++m_Pos;
+                std::string out;
+                while (true)
+                {
+                    if (m_Pos >= m_Text.size())
+                        fail("unterminated string");
+                    const char c = m_Text[m_Pos++];
+                    if (c == '"')
+                        return out;
+                    if (c != '\\')
+                    {
+                        out += c;
+                        continue;
+                    }
+                    if (m_Pos >= m_Text.size())
+                        fail("unterminated string");
+                    const char escaped = m_Text[m_Pos++];
+                    switch (escaped)
+                    {
+                        case '"': out += '"'; break;
+                        case '\\': out += '\\'; break;
+                        case '/': out += '/'; break;
+                        case 'b': out += '\b'; break;
+                        case 'f': out += '\f'; break;
+                        case 'n': out += '\n'; break;
+                        case 'r': out += '\r'; break;
+                        case 't': out += '\t'; break;
+                        case 'u': {
+                            unsigned codepoint = parseHex4();
+                            // surrogate pair
+                            if (codepoint >= 0xD800 && codepoint < 0xDC00 && consume("\\u"))
+                            {
+                                unsigned low = parseHex4();
+                                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                            }
+                            appendUtf8(out, codepoint);
+                            break;
+                        }
+                        default:
+                            fail("invalid escape");
+                    }
+                }
+            }
+
+            const std::string& m_Text;
+            std::size_t m_Pos;
+        };
+
+        void dumpString(std::string& out, const std::string& value)
+        {
+            out += '"';
+            for (char c : value)
+            {
+                switch (c)
+                {
+                    case '"': out += "\\\""; break;
+                    case '\\': out += "\\\\"; break;
+                    case '\n': out += "\\n"; break;
+                    case '\r': out += "\\r"; break;
+                    case '\t': out += "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20)
+                        {
+                            char escape[8];
+                            std::snprintf(escape, sizeof(escape), "\\u%04x", unsigned(c));
+                            out += escape;
+                        }
+                        else
+                            out += c;
+                }
+            }
+            out += '"';
+        }
+    }
+
+    Json Json::array()
+    {
+        Json value;
+        value.m_Type = Type::Array;
+        return value;
+    }
+
+    Json Json::object()
+    {
+        Json value;
+        value.m_Type = Type::Object;
+        return value;
+    }
+
+    Json Json::parse(const std::string& text)
+    {
+        return JsonParser(text).parseDocument();
+    }
+
+    std::string Json::dump() const
+    {
+        std::string out;
+        dump(out);
+        return out;
+    }
+
+    void Json::dump(std::string& out) const
+    {
+        switch (m_Type)
+        {
+            case Type::Null:
+                out += "null";
+                break;
+            case Type::Bool:
+                out += m_Bool ? "true" : "false";
+                break;
+            case Type::Number: {
+                char buffer[32];
+                if (std::floor(m_Number) == m_Number && std::fabs(m_Number) < 1e15)
+                    std::snprintf(buffer, sizeof(buffer), "%.0f", m_Number);
+                else
+                    std::snprintf(buffer, sizeof(buffer), "%.17g", m_Number);
+                out += buffer;
+                break;
+            }
+            case Type::String:
+                dumpString(out, m_String);
+                break;
+            case Type::Array: {
+                out += '[';
+                bool first = true;
+                for (const auto& element : m_Array)
+                {
+                    if (!first)
+                        out += ',';
+                    first = false;
+                    element.dump(out);
+                }
+                out += ']';
+                break;
+            }
+            case Type::Object: {
+                out += '{';
+                bool first = true;
+                for (const auto& member : m_Object)
+                {
+                    if (!first)
+                        out += ',';
+                    first = false;
+                    dumpString(out, member.first);
+                    out += ':';
+                    member.second.dump(out);
+                }
+                out += '}';
+                break;
+            }
+        }
+    }
+
+    Json& Json::operator[](const std::string& key)
+    {
+        if (m_Type == Type::Null)
+            m_Type = Type::Object;
+        return m_Object[key];
+    }
+
+    const Json& Json::operator[](const std::string& key) const
+    {
+        static const Json null;
+        auto it = m_Object.find(key);
+        return it == m_Object.end() ? null : it->second;
+    }
+
+    bool Json::has(const std::string& key) const
+    {
+        return m_Object.find(key) != m_Object.end();
+    }
+
+    void Json::push_back(Json value)
+    {
+        if (m_Type == Type::Null)
+            m_Type = Type::Array;
+        m_Array.push_back(std::move(value));
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace LSP
+{
+    /**
+     * minimal JSON value as used by the language server protocol
+     */
+    class Json
+    {
+    public:
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Json() : m_Type(Type::Null) {}
+        Json(std::nullptr_t) : m_Type(Type::Null) {}
+        Json(bool value) : m_Type(Type::Bool), m_Bool(value) {}
+        Json(int value) : m_Type(Type::Number), m_Number(value) {}
+        Json(unsigned value) : m_Type(Type::Number), m_Number(value) {}
+        Json(std::size_t value) : m_Type(Type::Number), m_Number(double(value)) {}
+        Json(double value) : m_Type(Type::Number), m_Number(value) {}
+        Json(const char* value) : m_Type(Type::String), m_String(value) {}
+        Json(std::string value) : m_Type(Type::String), m_String(std::move(value)) {}
+
+        static Json array();
+        static Json object();
+
+        /**
+         * @throws std::runtime_error on malformed input
+         */
+        static Json parse(const std::string& text);
+
+        std::string dump() const;
+
+        Type type() const { return m_Type; }
+        bool isNull() const { return m_Type == Type::Null; }
+
+        bool asBool() const { return m_Type == Type::Bool && m_Bool; }
+        double asNumber() const { return m_Type == Type::Number ? m_Number : 0; }
+        int asInt() const { return int(asNumber()); }
+        const std::string& asString() const { return m_String; }
+        const std::vector<Json>& asArray() const { return m_Array; }
+
+        /**
+         * object member access, inserts null members (converts null values to objects)
+         */
+        Json& operator[](const std::string& key);
+
+        /**
+         * object member access, null for missing members
+         */
+        const Json& operator[](const std::string& key) const;
+
+        bool has(const std::string& key) const;
+
+        void push_back(Json value);
+
+    private:
+        void dump(std::string& out) const;
+
+        Type m_Type;
+        bool m_Bool = false;
+        double m_Number = 0;
+        std::string m_String;
+        std::vector<Json> m_Array;
+        std::map<std::string, Json> m_Object;
+    };
+}
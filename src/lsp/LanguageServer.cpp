@@ -0,0 +1,454 @@
+#include "LanguageServer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace LSP
+{
+    using ASTVisitors::SymbolKind;
+
+    namespace
+    {
+        // JSON-RPC error codes
+        const int MethodNotFound = -32601;
+        const int InternalError = -32603;
+
+        // LSP SymbolKind values
+        int symbolKind(SymbolKind kind)
+        {
+            switch (kind)
+            {
+                case SymbolKind::Function: return 12;
+                case SymbolKind::Prototype: return 5;
+                case SymbolKind::Instance: return 19;
+                case SymbolKind::Class: return 5;
+                case SymbolKind::Constant: return 14;
+                case SymbolKind::Member: return 8;
+                case SymbolKind::Variable:
+                case SymbolKind::Parameter:
+                case SymbolKind::Local:
+                default:
+                    return 13;
+            }
+        }
+
+        /**
+         * @return length in bytes of the UTF-8 sequence at offset, units receives its UTF-16 code units.
+         * A malformed byte stands for itself, clients decode it as a single replacement character
+         */
+        std::size_t utf8Sequence(const std::string& text, std::size_t offset, std::size_t& units)
+        {
+            const unsigned char lead = static_cast<unsigned char>(text[offset]);
+            std::size_t length = 1;
+            if (lead >= 0xC2 && lead <= 0xDF)
+                length = 2;
+            else if (lead >= 0xE0 && lead <= 0xEF)
+                length = 3;
+            else if (lead >= 0xF0 && lead <= 0xF4)
+                length = 4;
+            units = 1;
+            if (length == 1 || offset + length > text.size())
+                return 1;
+            for (std::size_t i = 1; i < length; ++i)
+            {
+                if ((static_cast<unsigned char>(text[offset + i]) & 0xC0) != 0x80)
+                    return 1;
+            }
+            if (length == 4)
+                units = 2;  // surrogate pair
+            return length;
+        }
+
+        /**
+         * @return position character of the byte offset within the line starting at lineStart
+         */
+        std::size_t characterOf(const std::string& text, std::size_t lineStart, std::size_t offset, bool utf8)
+        {
+            if (utf8)
+                return offset - lineStart;
+            std::size_t character = 0;
+            for (std::size_t i = lineStart; i < offset;)
+            {
+                std::size_t units;
+                i += utf8Sequence(text, i, units);
+                character += units;
+            }
+            return character;
+        }
+
+        /**
+         * @return byte offset of the position character within the line starting at lineStart,
+         * clamped to the end of the line
+         */
+        std::size_t offsetOfCharacter(const std::string& text, std::size_t lineStart, std::size_t character, bool utf8)
+        {
+            std::size_t offset = lineStart;
+            while (offset < text.size() && text[offset] != '\n' && text[offset] != '\r')
+            {
+                std::size_t units = 1;
+                const std::size_t length = utf8 ? 1 : utf8Sequence(text, offset, units);
+                if (character < units)
+                    break;
+                character -= units;
+                offset += length;
+            }
+            return offset;
+        }
+    }
+
+    LanguageServer::LanguageServer(std::istream& in, std::ostream& out)
+            : m_In(in),
+              m_Out(out),
+              m_ShutdownRequested(false),
+              m_Utf8Positions(false)
+    {
+    }
+
+    int LanguageServer::run()
+    {
+        Json message;
+        while (readMessage(message))
+        {
+            if (message["method"].asString() == "exit")
+                return m_ShutdownRequested ? 0 : 1;
+            try
+            {
+                handle(message);
+            }
+            catch (const std::exception& e)
+            {
+                if (message.has("id"))
+                    respondError(message["id"], InternalError, e.what());
+            }
+        }
+        return 1;
+    }
+
+    bool LanguageServer::readMessage(Json& message)
+    {
+        std::size_t length = 0;
+        std::string header;
+        while (std::getline(m_In, header))
+        {
+            if (!header.empty() && header.back() == '\r')
+                header.pop_back();
+            if (header.empty())
+                break;
+            const std::string contentLength = "Content-Length:";
+            if (header.compare(0, contentLength.size(), contentLength) == 0)
+                length = std::stoul(header.substr(contentLength.size()));
+        }
+        if (!m_In || length == 0)
+            return false;
+
+        std::string body(length, '\0');
+        if (!m_In.read(&body[0], std::streamsize(length)))
+            return false;
+        message = Json::parse(body);
+        return true;
+    }
+
+    void LanguageServer::send(const Json& message)
+    {
+        const std::string body = message.dump();
+        m_Out << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+        m_Out.flush();
+    }
+
+    void LanguageServer::respond(const Json& id, Json result)
+    {
+        Json response = Json::object();
+        response["jsonrpc"] = "2.0";
+        response["id"] = id;
+        response["result"] = std::move(result);
+        send(response);
+    }
+
+    void LanguageServer::respondError(const Json& id, int code, const std::string& message)
+    {
+        Json response = Json::object();
+        response["jsonrpc"] = "2.0";
+        response["id"] = id;
+        response["error"]["code"] = code;
+        response["error"]["message"] = message;
+        send(response);
+    }
+
+    void LanguageServer::notify(const std::string& method, Json params)
+    {
+        Json notification = Json::object();
+        notification["jsonrpc"] = "2.0";
+        notification["method"] = method;
+        notification["params"] = std::move(params);
+        send(notification);
+    }
+
+    void LanguageServer::handle(const Json& message)
+    {
+        const std::string& method = message["method"].asString();
+        const Json& params = message["params"];
+        const bool isRequest = message.has("id");
+
+        if (method == "initialize")
+            respond(message["id"], initialize(params));
+        else if (method == "shutdown")
+        {
+            m_ShutdownRequested = true;
+            respond(message["id"], Json());
+        }
+        else if (method == "textDocument/didOpen")
+            didOpen(params);
+        else if (method == "textDocument/didChange")
+            didChange(params);
+        else if (method == "textDocument/didClose")
+            didClose(params);
+        else if (method == "textDocument/definition")
+            respond(message["id"], definition(params));
+        else if (method == "textDocument/references")
+            respond(message["id"], references(params));
+        else if (method == "textDocument/documentSymbol")
+            respond(message["id"], documentSymbol(params));
+        else if (isRequest)
+            respondError(message["id"], MethodNotFound, "unsupported method " + method);
+        // other notifications (initialized, didSave, $/...) need no answer
+    }
+
+    Json LanguageServer::initialize(const Json& params)
+    {
+        std::string root;
+        if (params["rootUri"].type() == Json::Type::String)
+            root = uriToPath(params["rootUri"].asString());
+        else if (params["rootPath"].type() == Json::Type::String)
+            root = params["rootPath"].asString();
+
+        if (!root.empty())
+        {
+            try
+            {
+                m_Project.add_directory(root);
+            }
+            catch (const std::exception&)
+            {
+                // no readable workspace, serve the opened documents only
+            }
+            for (const auto& file : m_Project.files())
+                m_Index.update(file.first, file.second);
+        }
+
+        Json result = Json::object();
+        Json& capabilities = result["capabilities"];
+        // positions count UTF-16 code units unless the client accepts bytes of the UTF-8 text
+        m_Utf8Positions = false;
+        for (const auto& encoding : params["capabilities"]["general"]["positionEncodings"].asArray())
+        {
+            if (encoding.asString() == "utf-8")
+                m_Utf8Positions = true;
+        }
+        capabilities["positionEncoding"] = m_Utf8Positions ? "utf-8" : "utf-16";
+        capabilities["textDocumentSync"] = 2; // changed ranges only
+        capabilities["definitionProvider"] = true;
+        capabilities["referencesProvider"] = true;
+        capabilities["documentSymbolProvider"] = true;
+        result["serverInfo"]["name"] = "daedalus-lsp";
+        return result;
+    }
+
+    void LanguageServer::didOpen(const Json& params)
+    {
+        const Json& document = params["textDocument"];
+        const std::string path = parser::project::normalize(uriToPath(document["uri"].asString()));
+        m_OpenDocuments.insert(path);
+        update(path, document["text"].asString());
+    }
+
+    void LanguageServer::didChange(const Json& params)
+    {
+        const std::string path = parser::project::normalize(uriToPath(params["textDocument"]["uri"].asString()));
+        const auto& changes = params["contentChanges"].asArray();
+        if (changes.empty())
+            return;
+
+        // changes apply one after the other, each one to the text left by the previous one.
+        // The index follows every change, so that it only collects the reparsed segments
+        for (const auto& change : changes)
+        {
+            const parser::parsed_file* file = m_Project.find(path);
+            if (!change.has("range") || !file || !file->source)
+            {
+                m_Index.update(path, m_Project.update(path, change["text"].asString()));
+                continue;
+            }
+            const parser::source_file& source = *file->source;
+            const std::size_t first = offsetOf(source, change["range"]["start"]);
+            const std::size_t last = std::max(first, offsetOf(source, change["range"]["end"]));
+            m_Index.update(path, m_Project.edit(path, {first, last - first, change["text"].asString()}));
+        }
+        publishDiagnostics(path);
+    }
+
+    void LanguageServer::didClose(const Json& params)
+    {
+        const std::string path = parser::project::normalize(uriToPath(params["textDocument"]["uri"].asString()));
+        m_OpenDocuments.erase(path);
+
+        // back to the content on disk, unsaved edits are gone
+        if (access(path.c_str(), R_OK) == 0)
+            m_Index.update(path, m_Project.update(path));
+        else
+        {
+            m_Index.remove(path);
+            m_Project.remove(path);
+        }
+
+        Json diagnostics = Json::object();
+        diagnostics["uri"] = pathToUri(path);
+        diagnostics["diagnostics"] = Json::array();
+        notify("textDocument/publishDiagnostics", std::move(diagnostics));
+    }
+
+    void LanguageServer::update(const std::string& path, std::string text)
+    {
+        m_Index.update(path, m_Project.update(path, std::move(text)));
+        publishDiagnostics(path);
+    }
+
+    void LanguageServer::publishDiagnostics(const std::string& path)
+    {
+        const parser::parsed_file* file = m_Project.find(path);
+        if (!file)
+            return;
+
+        Json params = Json::object();
+        params["uri"] = pathToUri(path);
+        Json& diagnostics = params["diagnostics"] = Json::array();
+        for (const auto& error : file->errors)
+        {
+            Json diagnostic = Json::object();
+            diagnostic["range"] = range(error.first, error.last);
+            diagnostic["severity"] = 1;
+            diagnostic["source"] = "daedalus";
+            diagnostic["message"] = error.message;
+            diagnostics.push_back(std::move(diagnostic));
+        }
+        notify("textDocument/publishDiagnostics", std::move(params));
+    }
+
+    Json LanguageServer::definition(const Json& params)
+    {
+        const std::string path = parser::project::normalize(uriToPath(params["textDocument"]["uri"].asString()));
+        SymbolIndex::Symbol symbol = m_Index.definitionAt(path, locationOf(path, params["position"]));
+        if (!symbol)
+            return Json();
+        return location(*symbol.path, symbol.definition->location, symbol.definition->name.size());
+    }
+
+    Json LanguageServer::references(const Json& params)
+    {
+        const std::string path = parser::project::normalize(uriToPath(params["textDocument"]["uri"].asString()));
+        SymbolIndex::Symbol symbol = m_Index.definitionAt(path, locationOf(path, params["position"]));
+
+        Json result = Json::array();
+        if (!symbol)
+            return result;
+        if (params["context"]["includeDeclaration"].asBool())
+            result.push_back(location(*symbol.path, symbol.definition->location, symbol.definition->name.size()));
+        for (const auto& reference : m_Index.references(symbol))
+            result.push_back(location(*reference.path, reference.reference->location, reference.reference->name.size()));
+        return result;
+    }
+
+    Json LanguageServer::documentSymbol(const Json& params)
+    {
+        const std::string path = parser::project::normalize(uriToPath(params["textDocument"]["uri"].asString()));
+        Json result = Json::array();
+        for (const auto& definition : m_Index.definitions(path))
+        {
+            if (definition.kind == SymbolKind::Parameter || definition.kind == SymbolKind::Local)
+                continue;
+            Json symbol = Json::object();
+            symbol["name"] = definition.name;
+            symbol["kind"] = symbolKind(definition.kind);
+            symbol["location"] = location(path, definition.location, definition.name.size());
+            if (!definition.container.empty())
+                symbol["containerName"] = definition.container;
+            result.push_back(std::move(symbol));
+        }
+        return result;
+    }
+
+    Json LanguageServer::location(const std::string& path, ast::source_location location, std::size_t length) const
+    {
+        Json result = Json::object();
+        result["uri"] = pathToUri(path);
+        result["range"] = range(location, location + ast::source_location(length));
+        return result;
+    }
+
+    Json LanguageServer::range(ast::source_location first, ast::source_location last) const
+    {
+        Json result = Json::object();
+        const parser::source_file* file = parser::source_manager::get().file_of(first);
+        auto position = [this, file](ast::source_location location) {
+            Json position = Json::object();
+            std::size_t offset = file ? std::min(file->offset_of(location), file->text.size()) : 0;
+            position["line"] = file ? file->lines.line_of(offset) - 1 : 0;
+            position["character"] = file ? characterOf(file->text, file->lines.line_start(offset), offset, m_Utf8Positions) : 0;
+            return position;
+        };
+        result["start"] = position(first);
+        result["end"] = position(last);
+        return result;
+    }
+
+    ast::source_location LanguageServer::locationOf(const std::string& path, const Json& position) const
+    {
+        const parser::parsed_file* file = m_Project.find(path);
+        if (!file || !file->source)
+            return ast::invalid_location;
+        return file->source->base + ast::source_location(offsetOf(*file->source, position));
+    }
+
+    std::size_t LanguageServer::offsetOf(const parser::source_file& source, const Json& position) const
+    {
+        const std::size_t lineStart = source.lines.offset_of_line(std::size_t(position["line"].asInt()) + 1);
+        return offsetOfCharacter(source.text, lineStart, std::size_t(position["character"].asInt()), m_Utf8Positions);
+    }
+
+    std::string LanguageServer::uriToPath(const std::string& uri)
+    {
+        const std::string scheme = "file://";
+        std::string encoded = uri.compare(0, scheme.size(), scheme) == 0 ? uri.substr(scheme.size()) : uri;
+        std::string path;
+        for (std::size_t i = 0; i < encoded.size(); ++i)
+        {
+            if (encoded[i] == '%' && i + 2 < encoded.size())
+            {
+                path += char(std::strtol(encoded.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+                path += encoded[i];
+        }
+        return path;
+    }
+
+    std::string LanguageServer::pathToUri(const std::string& path)
+    {
+        std::string uri = "file://";
+        for (char c : path)
+        {
+            if (std::isalnum(static_cast<unsigned char>(c)) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~')
+                uri += c;
+            else
+            {
+                char escape[4];
+                std::snprintf(escape, sizeof(escape), "%%%02X", static_cast<unsigned char>(c));
+                uri += escape;
+            }
+        }
+        return uri;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Json.hpp"
+#include "SymbolIndex.hpp"
+#include "project.hpp"
+#include <istream>
+#include <ostream>
+#include <set>
+
+namespace LSP
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  Language server speaking LSP (JSON-RPC with Content-Length headers)
+    //  Provides diagnostics, go-to-definition, find-references and document
+    //  symbols. Files below the workspace root are parsed on initialize and
+    //  kept in memory together with their symbols. Documents are synced
+    //  incrementally, an edit only parses the touched top-level declarations
+    //  again and replaces the symbols of the edited file.
+    //  Documents arrive as UTF-8, position characters count UTF-16 code units
+    //  unless the client offers the "utf-8" position encoding.
+    ////////////////////////////////////////////////////////////////////////////
+    class LanguageServer
+    {
+    public:
+        LanguageServer(std::istream& in, std::ostream& out);
+
+        /**
+         * serves requests until the client sends exit
+         * @return exit code, 0 if shutdown was requested before
+         */
+        int run();
+
+    private:
+        bool readMessage(Json& message);
+        void send(const Json& message);
+        void respond(const Json& id, Json result);
+        void respondError(const Json& id, int code, const std::string& message);
+        void notify(const std::string& method, Json params);
+
+        void handle(const Json& message);
+        Json initialize(const Json& params);
+        void didOpen(const Json& params);
+        void didChange(const Json& params);
+        void didClose(const Json& params);
+        Json definition(const Json& params);
+        Json references(const Json& params);
+        Json documentSymbol(const Json& params);
+
+        void update(const std::string& path, std::string text);
+        void publishDiagnostics(const std::string& path);
+
+        Json location(const std::string& path, ast::source_location location, std::size_t length) const;
+        Json range(ast::source_location first, ast::source_location last) const;
+        ast::source_location locationOf(const std::string& path, const Json& position) const;
+        std::size_t offsetOf(const parser::source_file& source, const Json& position) const;
+
+        static std::string uriToPath(const std::string& uri);
+        static std::string pathToUri(const std::string& path);
+
+        std::istream& m_In;
+        std::ostream& m_Out;
+        parser::project m_Project;
+        SymbolIndex m_Index;
+        std::set<std::string> m_OpenDocuments;
+        bool m_ShutdownRequested;
+        bool m_Utf8Positions;   // negotiated position encoding, UTF-16 code units otherwise
+    };
+}
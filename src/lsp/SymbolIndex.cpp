@@ -0,0 +1,265 @@
+#include "SymbolIndex.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <sstream>
+#include <unordered_set>
+#include <tuple>
+
+namespace LSP
+{
+    using ASTVisitors::SymbolDefinition;
+    using ASTVisitors::SymbolReference;
+    using ASTVisitors::SymbolKind;
+
+    namespace
+    {
+        template <typename T>
+        const T* findAt(const std::vector<T>& symbols, ast::source_location location)
+        {
+            // last symbol starting at or before location
+            auto it = std::upper_bound(symbols.begin(), symbols.end(), location,
+                                       [](ast::source_location loc, const T& symbol) { return loc < symbol.location; });
+            if (it == symbols.begin())
+                return nullptr;
+            --it;
+            // the cursor may stand right behind the name
+            return location <= it->location + it->name.size() ? &*it : nullptr;
+        }
+
+        bool isScoped(SymbolKind kind)
+        {
+            return kind == SymbolKind::Parameter || kind == SymbolKind::Local;
+        }
+    }
+
+    void SymbolIndex::eraseSegment(SegmentMap& map, const std::string& key, const SegmentSymbols* segment)
+    {
+        auto it = map.find(key);
+        if (it == map.end())
+            return;
+        it->second.erase(segment);
+        if (it->second.empty())
+            map.erase(it);
+    }
+
+    std::string SymbolIndex::key(const std::string& name)
+    {
+        return boost::algorithm::to_lower_copy(name);
+    }
+
+    std::unique_ptr<SymbolIndex::SegmentSymbols> SymbolIndex::collect(const std::string* path,
+                                                                      ASTVisitors::SymbolCollector::ErrorHandler& errorHandler,
+                                                                      ast::source_location location, std::size_t declarations,
+                                                                      ast::program::const_iterator& declaration)
+    {
+        // scopes are the index of the declaration within the segment
+        ASTVisitors::SymbolCollector collector(errorHandler);
+        for (std::size_t i = 0; i < declarations; ++i, ++declaration)
+        {
+            // visitors take mutable ASTs, the collector only reads
+            collector.collect(const_cast<ast::global_decl&>(*declaration));
+        }
+
+        std::unique_ptr<SegmentSymbols> segment(new SegmentSymbols());
+        segment->path = path;
+        segment->location = location;
+        segment->definitions = collector.definitions();
+        segment->references = collector.references();
+
+        auto byLocation = [](const auto& a, const auto& b) { return a.location < b.location; };
+        std::sort(segment->definitions.begin(), segment->definitions.end(), byLocation);
+        std::sort(segment->references.begin(), segment->references.end(), byLocation);
+
+        for (std::size_t i = 0; i < segment->definitions.size(); ++i)
+        {
+            const SymbolDefinition& definition = segment->definitions[i];
+            if (isScoped(definition.kind))
+                segment->scoped.emplace(std::make_pair(definition.scope, key(definition.name)), i);
+            else
+                segment->globals[key(definition.name)].push_back(i);
+        }
+        for (std::size_t i = 0; i < segment->references.size(); ++i)
+            segment->named[key(segment->references[i].name)].push_back(i);
+
+        for (const auto& global : segment->globals)
+            m_Globals[global.first].insert(segment.get());
+        for (const auto& reference : segment->named)
+            m_References[reference.first].insert(segment.get());
+        return segment;
+    }
+
+    void SymbolIndex::erase(const SegmentSymbols& segment)
+    {
+        for (const auto& global : segment.globals)
+            eraseSegment(m_Globals, global.first, &segment);
+        for (const auto& reference : segment.named)
+            eraseSegment(m_References, reference.first, &segment);
+    }
+
+    void SymbolIndex::update(const std::string& path, const parser::parsed_file& parsed)
+    {
+        auto it = m_Files.find(path);
+        if (it != m_Files.end() && it->second.version == parsed.version)
+            return;
+
+        // the segments of the last parse replace the old ones if the index holds the version before it,
+        // locations in front of them stay, the ones behind them move along
+        const parser::segment_change& change = parsed.change;
+        const bool incremental = it != m_Files.end() && it->second.version + 1 == parsed.version && !change.rebased
+                                 && change.first + change.removed <= it->second.segments.size()
+                                 && it->second.segments.size() - change.removed + change.inserted == parsed.segments.size();
+        std::size_t first = change.first, inserted = change.inserted;
+        ast::program::const_iterator declaration = change.declarations;
+        if (!incremental)
+        {
+            // files with errors still contribute the declarations that parsed
+            remove(path);
+            it = m_Files.emplace(path, FileSymbols()).first;
+            first = 0;
+            inserted = parsed.segments.size();
+            declaration = parsed.ast.begin();
+        }
+        FileSymbols& file = it->second;
+        file.version = parsed.version;
+
+        auto segments = file.segments.begin() + std::ptrdiff_t(first);
+        if (incremental)
+        {
+            auto removed = segments + std::ptrdiff_t(change.removed);
+            for (auto moved = removed; moved != file.segments.end(); ++moved)
+            {
+                SegmentSymbols& segment = **moved;
+                segment.location += change.shift;
+                for (auto& definition : segment.definitions)
+                    definition.location += change.shift;
+                for (auto& reference : segment.references)
+                    reference.location += change.shift;
+            }
+            for (auto dropped = segments; dropped != removed; ++dropped)
+                erase(**dropped);
+            segments = file.segments.erase(segments, removed);
+        }
+
+        std::ostringstream diagnostics;
+        parser::error_handler_type error_handler(*parsed.source, diagnostics);
+        std::vector<std::unique_ptr<SegmentSymbols>> collected;
+        collected.reserve(inserted);
+        for (std::size_t i = first; i < first + inserted; ++i)
+        {
+            const parser::segment& segment = parsed.segments[i];
+            collected.push_back(collect(&it->first, error_handler, parsed.source->base + ast::source_location(segment.offset),
+                                        segment.declarations, declaration));
+        }
+        file.segments.insert(segments, std::make_move_iterator(collected.begin()), std::make_move_iterator(collected.end()));
+    }
+
+    void SymbolIndex::remove(const std::string& path)
+    {
+        auto it = m_Files.find(path);
+        if (it == m_Files.end())
+            return;
+        for (const auto& segment : it->second.segments)
+            erase(*segment);
+        m_Files.erase(it);
+    }
+
+    SymbolIndex::Symbol SymbolIndex::resolve(const SegmentSymbols& segment, const SymbolReference& reference) const
+    {
+        const std::string name = key(reference.name);
+        auto globals = m_Globals.find(name);
+
+        // a name defined more than once resolves to its first definition by path and location,
+        // the segments come in hash order
+        auto first = [&](bool member) {
+            Symbol found;
+            if (globals == m_Globals.end())
+                return found;
+            for (const SegmentSymbols* defining : globals->second)
+            {
+                for (std::size_t index : defining->globals.at(name))
+                {
+                    const SymbolDefinition& definition = defining->definitions[index];
+                    if ((definition.kind == SymbolKind::Member) != member)
+                        continue;
+                    if (!found || std::tie(*defining->path, definition.location) < std::tie(*found.path, found.definition->location))
+                        found = {defining->path, &definition};
+                }
+            }
+            return found;
+        };
+
+        if (!reference.member)
+        {
+            // parameters and locals of the enclosing declaration shadow globals
+            auto scoped = segment.scoped.find(std::make_pair(reference.scope, name));
+            if (scoped != segment.scoped.end())
+                return {segment.path, &segment.definitions[scoped->second]};
+
+            if (Symbol global = first(false))
+                return global;
+        }
+
+        // member accesses and bare member names in prototype and instance bodies
+        return first(true);
+    }
+
+    SymbolIndex::Symbol SymbolIndex::definitionAt(const std::string& path, ast::source_location location) const
+    {
+        auto it = m_Files.find(path);
+        if (it == m_Files.end())
+            return {};
+        const auto& segments = it->second.segments;
+
+        // last segment starting at or before location
+        auto segment = std::upper_bound(segments.begin(), segments.end(), location,
+                                        [](ast::source_location loc, const std::unique_ptr<SegmentSymbols>& s) {
+                                            return loc < s->location;
+                                        });
+        if (segment == segments.begin())
+            return {};
+        --segment;
+
+        if (const SymbolDefinition* definition = findAt((*segment)->definitions, location))
+            return {&it->first, definition};
+        if (const SymbolReference* reference = findAt((*segment)->references, location))
+            return resolve(**segment, *reference);
+        return {};
+    }
+
+    std::vector<SymbolIndex::Reference> SymbolIndex::references(const Symbol& symbol) const
+    {
+        std::vector<Reference> result;
+        if (!symbol)
+            return result;
+
+        const std::string name = key(symbol.definition->name);
+        auto it = m_References.find(name);
+        if (it == m_References.end())
+            return result;
+        for (const SegmentSymbols* segment : it->second)
+        {
+            for (std::size_t index : segment->named.at(name))
+            {
+                const SymbolReference& reference = segment->references[index];
+                if (resolve(*segment, reference).definition == symbol.definition)
+                    result.push_back({segment->path, &reference});
+            }
+        }
+        // segments are unordered, report by file and location
+        std::sort(result.begin(), result.end(), [](const Reference& a, const Reference& b) {
+            return a.path != b.path ? *a.path < *b.path : a.reference->location < b.reference->location;
+        });
+        return result;
+    }
+
+    std::vector<SymbolDefinition> SymbolIndex::definitions(const std::string& path) const
+    {
+        std::vector<SymbolDefinition> definitions;
+        auto it = m_Files.find(path);
+        if (it == m_Files.end())
+            return definitions;
+        for (const auto& segment : it->second.segments)
+            definitions.insert(definitions.end(), segment->definitions.begin(), segment->definitions.end());
+        return definitions;
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "project.hpp"
+#include "visitors/SymbolCollector.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace LSP
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  Definitions and references of all files of a project
+    //  kept across edits, updating a file only replaces the symbols of the
+    //  segments the last parse replaced. Names are case insensitive like
+    //  Daedalus identifiers.
+    ////////////////////////////////////////////////////////////////////////////
+    class SymbolIndex
+    {
+    public:
+        struct Symbol
+        {
+            const std::string* path = nullptr;
+            const ASTVisitors::SymbolDefinition* definition = nullptr;
+
+            explicit operator bool() const { return definition != nullptr; }
+        };
+
+        struct Reference
+        {
+            const std::string* path;
+            const ASTVisitors::SymbolReference* reference;
+        };
+
+        /**
+         * brings the symbols of path up to date with file, only the segments of file.change
+         * are collected again if the index holds the previous version of file
+         */
+        void update(const std::string& path, const parser::parsed_file& file);
+        void remove(const std::string& path);
+
+        /**
+         * @return definition of the symbol at location, the definition itself if location is on a definition
+         */
+        Symbol definitionAt(const std::string& path, ast::source_location location) const;
+
+        /**
+         * @return all references resolving to the symbol
+         */
+        std::vector<Reference> references(const Symbol& symbol) const;
+
+        /**
+         * @return definitions of the file ordered by location
+         */
+        std::vector<ASTVisitors::SymbolDefinition> definitions(const std::string& path) const;
+
+        static std::string key(const std::string& name);
+
+    private:
+        struct SegmentSymbols
+        {
+            const std::string* path;
+            ast::source_location location; // start of the segment
+            std::vector<ASTVisitors::SymbolDefinition> definitions; // ordered by location
+            std::vector<ASTVisitors::SymbolReference> references;   // ordered by location
+            std::map<std::pair<int, std::string>, std::size_t> scoped; // (scope, key) -> parameter or local
+            std::unordered_map<std::string, std::vector<std::size_t>> globals; // key -> global and member definitions
+            std::unordered_map<std::string, std::vector<std::size_t>> named;   // key -> references
+        };
+
+        struct FileSymbols
+        {
+            std::uint64_t version = 0; // of the parsed_file the symbols were collected from
+            std::vector<std::unique_ptr<SegmentSymbols>> segments; // one per parsed segment, in file order
+        };
+
+        // segments by key, dropping a segment only touches the keys it contains
+        typedef std::unordered_map<std::string, std::unordered_set<const SegmentSymbols*>> SegmentMap;
+
+        std::unique_ptr<SegmentSymbols> collect(const std::string* path, ASTVisitors::SymbolCollector::ErrorHandler& errorHandler,
+                                                ast::source_location location, std::size_t declarations,
+                                                ast::program::const_iterator& declaration);
+        void erase(const SegmentSymbols& segment);
+        static void eraseSegment(SegmentMap& map, const std::string& key, const SegmentSymbols* segment);
+
+        Symbol resolve(const SegmentSymbols& segment, const ASTVisitors::SymbolReference& reference) const;
+
+        std::map<std::string, FileSymbols> m_Files;
+        SegmentMap m_Globals;    // key -> segments defining globals and members
+        SegmentMap m_References; // key -> segments referencing it
+    };
+}
@@ -0,0 +1,12 @@
+#include "lsp/LanguageServer.hpp"
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+//  Language server, speaks LSP over stdin/stdout
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    std::ios::sync_with_stdio(false);
+    LSP::LanguageServer server(std::cin, std::cout);
+    return server.run();
+}
@@ -27,7 +27,14 @@
 #include "common.hpp"
 #include "visitors/PrettyPrinter.hpp"
 #include "visitors/DumpAstVisitor.hpp"
+#include "visitors/TypeChecker.hpp"
 #include "utils.hpp"
+#include "source_manager.hpp"
+#include "project.hpp"
+#include "server/CompileServer.hpp"
+#include "xref/Builder.hpp"
+#include "xref/Query.hpp"
+#include "format/ProjectFormatter.hpp"
 
 ///////////////////////////////////////////////////////////////////////////////
 //  Main program
@@ -39,9 +46,31 @@ int main(int argc, char* argv[])
     po::options_description desc("Allowed options");
     desc.add_options()
             ("help", "produce help message")
-            ("input-file", po::value<std::string>(), "daedalus input file")
+            ("input-file", po::value<std::vector<std::string>>(), "daedalus input file")
             ("o", po::value<std::string>(),
              "output file. usage:\n--o <filename>")
+            ("server", po::value<std::string>(),
+             "run as compile server on a unix socket. usage:\n--server <socket> --project <dir>...")
+            ("project", po::value<std::vector<std::string>>(),
+             "directory with *.d files kept in memory by the compile server")
+            ("client", po::value<std::string>(),
+             "send a request to a running compile server. usage:\n--client <socket> check|build|pretty|files|shutdown [<file>...]")
+            ("typecheck",
+             "type check the input files and project directories. usage:\n--typecheck [--project <dir>...] [--externals <file>...] [<file>...]")
+            ("externals", po::value<std::vector<std::string>>(),
+             "files declaring engine externals, visible to the type checker but not checked")
+            ("index", po::value<std::string>(),
+             "write a symbol and cross-reference index. usage:\n--index <index file> --project <dir>... [<file>...]")
+            ("query", po::value<std::string>(),
+             "query a symbol index. usage:\n--query <index file> definitions|references|derived|bases <name>")
+            ("format",
+             "pretty print directories, .src manifests or files to <file>.pretty. usage:\n--format [--in-place] [--check] [--jobs <n>] <dir|manifest.src|file>...")
+            ("in-place", "--format replaces the sources, files with comments are skipped with exit status 1")
+            ("check", "--format only reports files that aren't formatted (files with comments never are), exit status 1 if there are any")
+            ("suffix", po::value<std::string>()->default_value(".pretty"), "file name suffix of --format output")
+            ("jobs", po::value<unsigned>()->default_value(0), "threads used by --format, 0 for one per core")
+            ("format-cache", po::value<std::string>()->default_value(".daedalus-format-cache"),
+             "hashes of formatted files, unchanged files aren't parsed again. Empty to disable")
             ;
     po::positional_options_description positional;
     positional.add("input-file", -1);
@@ -54,9 +83,118 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    std::string daedalus_filename;
+    std::vector<std::string> input_files;
     if (var_map.count("input-file"))
-        daedalus_filename = var_map["input-file"].as<std::string>();
+        input_files = var_map["input-file"].as<std::vector<std::string>>();
+
+    if (var_map.count("client"))
+    {
+        // the server may run in another working directory
+        std::vector<std::string> request = input_files;
+        for (std::size_t i = 1; i < request.size(); ++i)
+            request[i] = parser::project::normalize(request[i]);
+        return Server::runClient(var_map["client"].as<std::string>(), request);
+    }
+
+    if (var_map.count("query"))
+        return XRef::runQuery(var_map["query"].as<std::string>(), input_files, std::cout);
+
+    if (var_map.count("format"))
+    {
+        Format::Options options;
+        options.check = var_map.count("check") != 0;
+        options.inPlace = var_map.count("in-place") != 0;
+        options.suffix = var_map["suffix"].as<std::string>();
+        options.jobs = var_map["jobs"].as<unsigned>();
+        options.cacheFile = var_map["format-cache"].as<std::string>();
+
+        Format::ProjectFormatter formatter(options, std::cerr);
+        for (const auto& input : input_files)
+            formatter.add(input);
+        return formatter.run();
+    }
+
+    if (var_map.count("typecheck"))
+    {
+        parser::project project;
+        parser::project externals;
+        if (var_map.count("project"))
+        {
+            for (const auto& directory : var_map["project"].as<std::vector<std::string>>())
+                project.add_directory(directory);
+        }
+        for (const auto& file : input_files)
+            project.update(file);
+        if (var_map.count("externals"))
+        {
+            for (const auto& file : var_map["externals"].as<std::vector<std::string>>())
+                externals.update(file);
+        }
+
+        bool success = true;
+        const parser::source_file* anySource = nullptr;
+        for (const auto* files : {&externals, &project})
+        {
+            for (const auto& file : files->files())
+            {
+                std::cerr << file.second.diagnostics;
+                success = success && file.second.success;
+                anySource = file.second.source;
+            }
+        }
+        if (!anySource)
+            return success ? 0 : 1;
+
+        parser::error_handler_type error_handler(*anySource, std::cerr);
+        ASTVisitors::TypeChecker checker(error_handler);
+        for (auto* files : {&externals, &project})
+        {
+            for (const auto& file : files->files())
+                checker.declare(files->find(file.first)->ast);
+        }
+        for (const auto& file : project.files())
+            checker.check(project.find(file.first)->ast);
+        return success && checker.errorCount() == 0 ? 0 : 1;
+    }
+
+    if (var_map.count("index"))
+    {
+        parser::project project;
+        if (var_map.count("project"))
+        {
+            for (const auto& directory : var_map["project"].as<std::vector<std::string>>())
+                project.add_directory(directory);
+        }
+        for (const auto& file : input_files)
+            project.update(file);
+
+        // files with errors still contribute the declarations that parsed
+        XRef::Builder builder;
+        for (const auto& file : project.files())
+        {
+            std::cerr << file.second.diagnostics;
+            builder.add(file.first, file.second);
+        }
+        builder.write(var_map["index"].as<std::string>());
+        return 0;
+    }
+
+    if (var_map.count("server"))
+    {
+        parser::project project;
+        if (var_map.count("project"))
+        {
+            for (const auto& directory : var_map["project"].as<std::vector<std::string>>())
+                project.add_directory(directory);
+        }
+        Server::CompileServer server(var_map["server"].as<std::string>(), project);
+        server.run();
+        return 0;
+    }
+
+    std::string daedalus_filename;
+    if (!input_files.empty())
+        daedalus_filename = input_files.front();
 
     std::string ofilename = "opcodes.txt";
     if (var_map.count("o"))
@@ -70,35 +208,19 @@ int main(int argc, char* argv[])
         std::istreambuf_iterator<char> stdinIter(std::cin), inputEnd;
         sourceCode = std::string(stdinIter, inputEnd);
     }
-
-    // TODO line numbers are wrong due to multiline comments
-    // fixes alignment of compile-error indicator when tabs are used
-    std::replace(sourceCode.begin(), sourceCode.end(), '\t', ' ');
+    const parser::source_file& source = parser::source_manager::get().add_file(daedalus_filename, std::move(sourceCode));
 
     using parser::iterator_type;
-    const iterator_type sourceBegin = sourceCode.begin();
-    iterator_type iter(sourceCode.begin());
-    const iterator_type sourceEnd(sourceCode.end());
+    const iterator_type sourceBegin = source.begin();
+    iterator_type iter(source.begin());
 
     ast::program ast;
 
-    using boost::spirit::x3::with;
     using parser::error_handler_type;
-    error_handler_type error_handler(iter, sourceEnd, std::cerr); // Our error handler
-
-    // Our parser
-    auto const parser =
-            // we pass our error handler to the parser so we can access
-            // it later on in our on_error and on_success handlers
-            with<parser::error_handler_tag>(std::ref(error_handler))
-            [
-                    getProgramParser()
-            ];
-
-    const auto& skipper = parser::getSkipper();
+    error_handler_type error_handler(source, std::cerr); // Our error handler
 
-    bool success = phrase_parse(iter, sourceEnd, parser, skipper, ast);
-    if (!success || iter != sourceEnd)
+    bool success = parser::parse(error_handler, ast, &iter);
+    if (!success)
     {
         std::cerr << "Parsing failed. Compilation aborted." << std::endl;
         if (!daedalus_filename.empty())
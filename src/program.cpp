@@ -5,4 +5,35 @@
 namespace parser {
     //BOOST_SPIRIT_INSTANTIATE(operand_type, iterator_type, context_type)
     BOOST_SPIRIT_INSTANTIATE(program_type, iterator_type, context_type)
-}
\ No newline at end of file
+
+    bool parse(error_handler_type& error_handler, ast::program& ast, iterator_type* parsed_until)
+    {
+        return parse(error_handler, error_handler.get_source().begin(), error_handler.get_source().end(),
+                     ast, parsed_until);
+    }
+
+    bool parse(error_handler_type& error_handler, iterator_type first, iterator_type last,
+               ast::program& ast, iterator_type* parsed_until)
+    {
+        using boost::spirit::x3::with;
+
+        // we pass our error handler to the parser so we can access
+        // it later on in our on_error and on_success handlers
+        auto const parser = with<error_handler_tag>(std::ref(error_handler))[getProgramParser()];
+
+        bool success = false;
+        try
+        {
+            success = phrase_parse(first, last, parser, getSkipper(), ast);
+        }
+        catch (boost::spirit::x3::expectation_failure<iterator_type> const& x)
+        {
+            // the skipper between declarations has no on_error, e.g. for an unterminated block comment
+            error_handler(x.where(), "Error! Expecting: " + x.which() + " here:");
+            first = x.where();
+        }
+        if (parsed_until)
+            *parsed_until = first;
+        return success && first == last;
+    }
+}
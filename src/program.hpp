@@ -2,12 +2,27 @@
 
 #include <boost/spirit/home/x3.hpp>
 #include "ast.hpp"
+#include "config.hpp"
 
 namespace parser {
     struct program_class;
     typedef boost::spirit::x3::rule<program_class, ast::program> program_type;
 
     BOOST_SPIRIT_DECLARE(program_type)
+
+    /**
+     * parses the whole source of the error handler, errors are reported through it
+     * @param parsed_until if given, receives the position where parsing stopped
+     * @return true if the entire source was parsed
+     */
+    bool parse(error_handler_type& error_handler, ast::program& ast, iterator_type* parsed_until = nullptr);
+
+    /**
+     * parses [first, last) of the source of the error handler, the parsed declarations are appended to ast
+     * @return true if the entire range was parsed
+     */
+    bool parse(error_handler_type& error_handler, iterator_type first, iterator_type last,
+               ast::program& ast, iterator_type* parsed_until = nullptr);
 }
 
 const parser::program_type& getProgramParser();
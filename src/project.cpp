@@ -0,0 +1,186 @@
+#include "project.hpp"
+#include "program.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <climits>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace parser
+{
+    project::~project()
+    {
+        for (auto& entry : m_Files)
+        {
+            if (entry.second.source)
+                source_manager::get().remove_file(*entry.second.source);
+        }
+    }
+
+    void project::add_directory(const std::string& directory)
+    {
+        std::string dir = normalize(directory);
+        DIR* handle = opendir(dir.c_str());
+        if (!handle)
+            throw std::runtime_error("Error: couldn't open directory \"" + directory + '"');
+        if (std::find(m_Directories.begin(), m_Directories.end(), dir) == m_Directories.end())
+            m_Directories.push_back(dir);
+
+        std::vector<std::string> subdirectories;
+        while (dirent* entry = readdir(handle))
+        {
+            const std::string name = entry->d_name;
+            if (name == "." || name == "..")
+                continue;
+            const std::string path = dir + '/' + name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+                continue;
+            if (S_ISDIR(info.st_mode))
+                subdirectories.push_back(path);
+            else if (S_ISREG(info.st_mode) && isSourceFile(path))
+                update(path);
+        }
+        closedir(handle);
+
+        for (const auto& subdirectory : subdirectories)
+            add_directory(subdirectory);
+    }
+
+    void project::remove_directory(const std::string& directory)
+    {
+        // the directory may be gone already, so it can't be normalized
+        const std::string dir = directory.size() > 1 && directory.back() == '/' ? directory.substr(0, directory.size() - 1) : directory;
+        auto below = [&dir](const std::string& path) {
+            return path == dir || (path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/');
+        };
+        m_Directories.erase(std::remove_if(m_Directories.begin(), m_Directories.end(), below), m_Directories.end());
+        for (auto it = m_Files.begin(); it != m_Files.end();)
+        {
+            if (!below(it->first))
+            {
+                ++it;
+                continue;
+            }
+            it->second.ast.clear();
+            if (it->second.source)
+                source_manager::get().remove_file(*it->second.source);
+            it = m_Files.erase(it);
+        }
+    }
+
+    const parsed_file& project::update(const std::string& path)
+    {
+        return update(path, Utils::readAllText(path));
+    }
+
+    const parsed_file& project::update(const std::string& path, std::string text)
+    {
+        parsed_file& file = m_Files[normalize(path)];
+        if (file.source)
+            return reparse(path, file, diff(file.source->text, text));
+
+        // room to grow, so that edits keep the locations in front of them
+        const std::size_t reserve = text.size() / 2;
+        file.source = &source_manager::get().add_file(path, std::move(text), reserve);
+
+        std::ostringstream discarded;
+        error_handler_type error_handler(*file.source, discarded);
+        file.success = parse_segments(error_handler, file.ast, file.segments);
+        file.change = segment_change();
+        file.change.inserted = file.segments.size();
+        file.change.declarations = file.ast.begin();
+        ++file.version;
+        report(path, file);
+        return file;
+    }
+
+    const parsed_file& project::edit(const std::string& path, const text_edit& change)
+    {
+        parsed_file* file = find(path);
+        if (!file || !file->source)
+            throw std::runtime_error("Error: can't edit unknown file \"" + path + '"');
+        if (change.offset + change.removed > file->source->text.size())
+            throw std::runtime_error("Error: edit out of range in \"" + path + '"');
+        return reparse(path, *file, change);
+    }
+
+    const parsed_file& project::reparse(const std::string& path, parsed_file& file, const text_edit& change)
+    {
+        // the text is edited in place, locations only move behind the edit unless the file outgrows its reserve
+        const ast::source_location old_base = file.source->base;
+        source_manager::get().edit_file(*file.source, change.offset, change.removed, change.text);
+
+        std::ostringstream discarded;
+        error_handler_type error_handler(*file.source, discarded);
+        file.success = parser::reparse(error_handler, old_base, change, file.ast, file.segments, file.change);
+        ++file.version;
+        report(path, file);
+        return file;
+    }
+
+    void project::report(const std::string& path, parsed_file& file)
+    {
+        // print the errors of all segments, the kept ones moved along with their segment
+        std::ostringstream diagnostics;
+        error_handler_type printer(*file.source, diagnostics);
+        file.errors.clear();
+        for (const auto& segment : file.segments)
+        {
+            for (const auto& error : segment.errors)
+            {
+                file.errors.push_back(error);
+                const iterator_type first = file.source->begin() + std::ptrdiff_t(file.source->offset_of(error.first));
+                if (error.first == error.last)
+                    printer(first, error.message);
+                else
+                    printer(first, file.source->begin() + std::ptrdiff_t(file.source->offset_of(error.last)), error.message);
+            }
+        }
+        if (!file.success)
+            diagnostics << "Parsing failed: " << path << std::endl;
+        file.diagnostics = diagnostics.str();
+    }
+
+    void project::remove(const std::string& path)
+    {
+        auto it = m_Files.find(normalize(path));
+        if (it == m_Files.end())
+            return;
+        it->second.ast.clear();
+        if (it->second.source)
+            source_manager::get().remove_file(*it->second.source);
+        m_Files.erase(it);
+    }
+
+    const parsed_file* project::find(const std::string& path) const
+    {
+        auto it = m_Files.find(normalize(path));
+        return it == m_Files.end() ? nullptr : &it->second;
+    }
+
+    parsed_file* project::find(const std::string& path)
+    {
+        auto it = m_Files.find(normalize(path));
+        return it == m_Files.end() ? nullptr : &it->second;
+    }
+
+    std::string project::normalize(const std::string& path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        return path;
+    }
+
+    bool project::isSourceFile(const std::string& path)
+    {
+        if (path.size() < 2)
+            return false;
+        std::string extension = path.substr(path.size() - 2);
+        return extension == ".d" || extension == ".D";
+    }
+}
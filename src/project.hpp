@@ -0,0 +1,98 @@
+#pragma once
+
+#include "ast.hpp"
+#include "incremental.hpp"
+#include "source_manager.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace parser
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  A parsed file of a project
+    ////////////////////////////////////////////////////////////////////////////
+    struct parsed_file
+    {
+        const source_file* source = nullptr;
+        ast::program ast;
+        bool success = false;   // the AST misses the declarations of segments with errors otherwise
+        std::string diagnostics; // parser errors as printed by the error handler
+        std::vector<diagnostic> errors;
+        std::vector<segment> segments;
+        segment_change change;  // what the last parse replaced
+        std::uint64_t version = 0; // incremented by every parse
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    //  Keeps the ASTs of a set of files in memory
+    //  so that only changed files have to be parsed again,
+    //  within a changed file only the changed top-level segments are parsed
+    ////////////////////////////////////////////////////////////////////////////
+    class project
+    {
+    public:
+        project() = default;
+        project(const project&) = delete;
+        project& operator=(const project&) = delete;
+        ~project();
+
+        /**
+         * adds all *.d files below the directory and parses them
+         */
+        void add_directory(const std::string& directory);
+
+        /**
+         * removes the directory, its subdirectories and all files below them
+         */
+        void remove_directory(const std::string& directory);
+
+        /**
+         * parses the file from disk, replacing an earlier version
+         */
+        const parsed_file& update(const std::string& path);
+
+        /**
+         * parses the given text as new content of path, replacing an earlier version
+         */
+        const parsed_file& update(const std::string& path, std::string text);
+
+        /**
+         * applies the edit to the current text of path and parses the touched segments again
+         */
+        const parsed_file& edit(const std::string& path, const text_edit& change);
+
+        void remove(const std::string& path);
+
+        /**
+         * @return parsed file or nullptr if the path is not part of the project
+         */
+        const parsed_file* find(const std::string& path) const;
+        parsed_file* find(const std::string& path);
+
+        const std::map<std::string, parsed_file>& files() const { return m_Files; }
+        const std::vector<std::string>& directories() const { return m_Directories; }
+
+        /**
+         * @return absolute path without symlinks, or the path itself if it doesn't exist
+         */
+        static std::string normalize(const std::string& path);
+
+        static bool isSourceFile(const std::string& path);
+
+    private:
+        /**
+         * applies the edit to the source of file in place and parses the touched segments again
+         */
+        const parsed_file& reparse(const std::string& path, parsed_file& file, const text_edit& change);
+
+        /**
+         * collects and prints the errors of all segments of file
+         */
+        static void report(const std::string& path, parsed_file& file);
+
+        std::map<std::string, parsed_file> m_Files;
+        std::vector<std::string> m_Directories;
+    };
+}
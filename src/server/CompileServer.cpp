@@ -0,0 +1,556 @@
+#include "CompileServer.hpp"
+#include "visitors/ExpressionCollapse.hpp"
+#include "visitors/PrettyPrinter.hpp"
+#include "visitors/TypeChecker.hpp"
+#include "visitors/compiler.hpp"
+#include "vm/verifier.hpp"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace Server
+{
+    namespace
+    {
+        std::runtime_error systemError(const std::string& what)
+        {
+            return std::runtime_error("Error: " + what + ": " + std::strerror(errno));
+        }
+
+        sockaddr_un socketAddress(const std::string& socketPath)
+        {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            if (socketPath.size() >= sizeof(address.sun_path))
+                throw std::runtime_error("Error: socket path too long \"" + socketPath + '"');
+            std::strcpy(address.sun_path, socketPath.c_str());
+            return address;
+        }
+
+        std::string readAll(int fd)
+        {
+            std::string data;
+            char buffer[4096];
+            ssize_t n;
+            while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+                data.append(buffer, std::size_t(n));
+            return data;
+        }
+
+        // the server serves one connection at a time, a client must not hold it up
+        constexpr std::chrono::milliseconds requestTimeout(2000);
+        constexpr std::size_t maxRequestSize = 1 << 20;
+
+        /**
+         * reads a request until the client shuts down its write side
+         * @return false if the client stalls past requestTimeout or sends more than maxRequestSize
+         */
+        bool readRequest(int fd, std::string& data)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + requestTimeout;
+            char buffer[4096];
+            for (;;)
+            {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0)
+                    return false;
+                pollfd fds = {fd, POLLIN, 0};
+                int ready = poll(&fds, 1, int(left.count()));
+                if (ready == -1 && errno == EINTR)
+                    continue;
+                if (ready <= 0)
+                    return false;
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n == 0)
+                    return true;
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data.append(buffer, std::size_t(n));
+                if (data.size() > maxRequestSize)
+                    return false;
+            }
+        }
+
+        void writeAll(int fd, const std::string& data)
+        {
+            std::size_t written = 0;
+            while (written < data.size())
+            {
+                // a client that hung up must not kill the server with SIGPIPE
+                ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return;
+                written += std::size_t(n);
+            }
+        }
+
+        std::vector<std::string> splitLines(const std::string& text)
+        {
+            std::vector<std::string> lines;
+            std::istringstream stream(text);
+            std::string line;
+            while (std::getline(stream, line))
+            {
+                if (!line.empty())
+                    lines.push_back(line);
+            }
+            return lines;
+        }
+    }
+
+    CompileServer::CompileServer(const std::string& socketPath, parser::project& project)
+            : m_SocketPath(socketPath),
+              m_Project(project),
+              m_Socket(-1),
+              m_Inotify(-1),
+              m_Running(false)
+    {
+        // the pretty printer expects collapsed expressions, do it once for the cached ASTs
+        for (auto& entry : m_Project.files())
+            prepare(entry.first);
+    }
+
+    CompileServer::~CompileServer()
+    {
+        if (m_Socket != -1)
+        {
+            close(m_Socket);
+            unlink(m_SocketPath.c_str());
+        }
+        if (m_Inotify != -1)
+            close(m_Inotify);
+    }
+
+    void CompileServer::run()
+    {
+        m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_Inotify == -1)
+            throw systemError("inotify_init1");
+        for (const auto& directory : m_Project.directories())
+            watchDirectory(directory);
+
+        m_Socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_Socket == -1)
+            throw systemError("socket");
+        sockaddr_un address = socketAddress(m_SocketPath);
+        unlink(m_SocketPath.c_str());
+        if (bind(m_Socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+            throw systemError("bind \"" + m_SocketPath + '"');
+        if (listen(m_Socket, 16) == -1)
+            throw systemError("listen");
+
+        m_Running = true;
+        while (m_Running)
+        {
+            pollfd fds[2] = {{m_Inotify, POLLIN, 0}, {m_Socket, POLLIN, 0}};
+            if (poll(fds, 2, -1) == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw systemError("poll");
+            }
+            // file events first, so a request right after a save sees the new content
+            if (fds[0].revents & POLLIN)
+                handleFileEvents();
+            if (fds[1].revents & POLLIN)
+            {
+                int connection = accept4(m_Socket, nullptr, nullptr, SOCK_CLOEXEC);
+                if (connection != -1)
+                {
+                    handleFileEvents();
+                    handleConnection(connection);
+                    close(connection);
+                }
+            }
+        }
+    }
+
+    void CompileServer::watchDirectory(const std::string& directory)
+    {
+        for (const auto& watched : m_WatchedDirectories)
+        {
+            if (watched.second == directory)
+                return;
+        }
+        int wd = inotify_add_watch(m_Inotify, directory.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+        if (wd == -1)
+            throw systemError("inotify_add_watch \"" + directory + '"');
+        m_WatchedDirectories[wd] = directory;
+    }
+
+    void CompileServer::handleFileEvents()
+    {
+        alignas(inotify_event) char buffer[16 * 1024];
+        ssize_t length;
+        bool overflow = false;
+        while ((length = read(m_Inotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len)
+            {
+                const inotify_event* event = reinterpret_cast<inotify_event*>(ptr);
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    overflow = true;
+                    continue;
+                }
+                if (event->mask & IN_IGNORED)
+                {
+                    // the directory is gone or its watch was removed
+                    m_WatchedDirectories.erase(event->wd);
+                    continue;
+                }
+                auto dir = m_WatchedDirectories.find(event->wd);
+                if (dir == m_WatchedDirectories.end() || event->len == 0)
+                    continue;
+                const std::string path = dir->second + '/' + event->name;
+
+                // files come and go while the server reads them, e.g. on a checkout, that must not stop it
+                try
+                {
+                    handleFileEvent(event->mask, path);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+        }
+        // events were lost, the ASTs may be stale
+        if (overflow)
+            rescan();
+    }
+
+    void CompileServer::handleFileEvent(std::uint32_t mask, const std::string& path)
+    {
+        if (mask & IN_ISDIR)
+        {
+            if (mask & (IN_CREATE | IN_MOVED_TO))
+                addDirectory(path);
+            else if (mask & (IN_DELETE | IN_MOVED_FROM))
+                removeDirectory(path);
+        }
+        else if (!parser::project::isSourceFile(path))
+            return;
+        else if (mask & (IN_DELETE | IN_MOVED_FROM))
+            m_Project.remove(path);
+        else if (mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            updateFile(path);
+    }
+
+    void CompileServer::addDirectory(const std::string& directory)
+    {
+        // watched before it is read, files created meanwhile arrive as events
+        watchDirectory(directory);
+        m_Project.add_directory(directory);
+        const std::string prefix = directory + '/';
+        for (const auto& subdirectory : m_Project.directories())
+        {
+            if (subdirectory.compare(0, prefix.size(), prefix) == 0)
+                watchDirectory(subdirectory);
+        }
+        for (const auto& entry : m_Project.files())
+        {
+            if (entry.first.compare(0, prefix.size(), prefix) == 0)
+                prepare(entry.first);
+        }
+    }
+
+    void CompileServer::removeDirectory(const std::string& directory)
+    {
+        const std::string prefix = directory + '/';
+        for (auto it = m_WatchedDirectories.begin(); it != m_WatchedDirectories.end();)
+        {
+            if (it->second == directory || it->second.compare(0, prefix.size(), prefix) == 0)
+            {
+                // fails harmlessly if the directory was deleted and the kernel dropped the watch already
+                inotify_rm_watch(m_Inotify, it->first);
+                it = m_WatchedDirectories.erase(it);
+            }
+            else
+                ++it;
+        }
+        m_Project.remove_directory(directory);
+    }
+
+    void CompileServer::updateFile(const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+        {
+            // vanished before it could be read, e.g. a temporary file of an editor
+            m_Project.remove(path);
+            return;
+        }
+        try
+        {
+            m_Project.update(path);
+        }
+        catch (const std::exception&)
+        {
+            if (stat(path.c_str(), &info) == 0)
+                throw;
+            m_Project.remove(path);
+            return;
+        }
+        prepare(path);
+    }
+
+    void CompileServer::rescan()
+    {
+        std::cerr << "inotify queue overflow, rescanning the project" << std::endl;
+        struct stat info;
+        std::vector<std::string> directories = m_Project.directories();
+        for (const auto& directory : directories)
+        {
+            if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+                removeDirectory(directory);
+        }
+        std::vector<std::string> files;
+        for (const auto& entry : m_Project.files())
+            files.push_back(entry.first);
+        for (const auto& path : files)
+        {
+            if (stat(path.c_str(), &info) != 0)
+                m_Project.remove(path);
+        }
+
+        // new and changed files, the directories given to the project are the ones without a parent in the project
+        directories = m_Project.directories();
+        for (const auto& directory : directories)
+        {
+            const bool nested = std::any_of(directories.begin(), directories.end(), [&directory](const std::string& parent) {
+                return directory.size() > parent.size() && directory.compare(0, parent.size(), parent) == 0
+                       && directory[parent.size()] == '/';
+            });
+            if (nested)
+                continue;
+            try
+            {
+                addDirectory(directory);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+
+    void CompileServer::prepare(const std::string& path)
+    {
+        if (parser::parsed_file* file = m_Project.find(path))
+            prepare(*file);
+    }
+
+    void CompileServer::prepare(parser::parsed_file& file)
+    {
+        // the project parsed the file, run the AST transformations every consumer expects
+        if (!file.success)
+            return;
+        std::ostringstream diagnostics;
+        parser::error_handler_type error_handler(*file.source, diagnostics);
+        ASTVisitors::ExpressionCollapse collapse(error_handler);
+        collapse.start(file.ast);
+    }
+
+    void CompileServer::handleConnection(int connection)
+    {
+        std::string message;
+        if (!readRequest(connection, message))
+            return;     // stalled, dropped without an answer
+        // nor may a client that doesn't read the answer
+        const timeval timeout = {time_t(requestTimeout.count() / 1000), 0};
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::vector<std::string> request = splitLines(message);
+        std::string output;
+        int status;
+        try
+        {
+            status = handleRequest(request, output);
+        }
+        catch (const std::exception& e)
+        {
+            output = std::string(e.what()) + '\n';
+            status = 1;
+        }
+        writeAll(connection, "status " + std::to_string(status) + '\n' + output);
+    }
+
+    int CompileServer::handleRequest(const std::vector<std::string>& request, std::string& output)
+    {
+        if (request.empty())
+        {
+            output = "empty request\n";
+            return 1;
+        }
+
+        const std::string& command = request[0];
+        const std::vector<std::string> args(request.begin() + 1, request.end());
+        if (command == "check")
+            return check(args, output);
+        if (command == "build")
+            return build(output);
+        if (command == "pretty" && args.size() == 1)
+            return pretty(args[0], output);
+        if (command == "files")
+        {
+            for (const auto& entry : m_Project.files())
+                output += entry.first + '\n';
+            return 0;
+        }
+        if (command == "shutdown")
+        {
+            m_Running = false;
+            return 0;
+        }
+        output = "unknown request: " + command + '\n';
+        return 1;
+    }
+
+    int CompileServer::check(const std::vector<std::string>& paths, std::string& output)
+    {
+        int status = 0;
+        auto checkFile = [&](const parser::parsed_file& file) {
+            output += file.diagnostics;
+            if (!file.success)
+                status = 1;
+        };
+
+        if (paths.empty())
+        {
+            for (const auto& entry : m_Project.files())
+                checkFile(entry.second);
+        }
+        for (const auto& path : paths)
+        {
+            if (const parser::parsed_file* file = m_Project.find(path))
+                checkFile(*file);
+            else
+            {
+                // not part of the watched project, parsed for this request only so build never sees it
+                parser::project adhoc;
+                checkFile(adhoc.update(path));
+            }
+        }
+        return status;
+    }
+
+    int CompileServer::build(std::string& output)
+    {
+        int status = check({}, output);
+        if (m_Project.files().empty())
+            return status;
+
+        // declarations of all files are visible everywhere, the order of the files doesn't matter
+        std::ostringstream diagnostics;
+        parser::error_handler_type error_handler(*m_Project.files().begin()->second.source, diagnostics);
+        ASTVisitors::TypeChecker checker(error_handler);
+        for (const auto& entry : m_Project.files())
+            checker.declare(m_Project.find(entry.first)->ast);
+        for (const auto& entry : m_Project.files())
+            checker.check(m_Project.find(entry.first)->ast);
+        output += diagnostics.str();
+        if (status != 0 || checker.errorCount() != 0)
+            return 1;
+
+        // the compiler sees the project as one program, on a copy of the ASTs so the cached ones stay as parsed
+        ast::program whole;
+        for (const auto& entry : m_Project.files())
+            whole.insert(whole.end(), entry.second.ast.begin(), entry.second.ast.end());
+        std::ostringstream compileErrors;
+        parser::error_handler_type compileErrorHandler(*m_Project.files().begin()->second.source, compileErrors);
+        code_gen::program program;
+        const bool compiled = code_gen::compiler(program, compileErrorHandler).compile(whole);
+        output += compileErrors.str();
+        if (!compiled)
+        {
+            output += "Compilation failed\n";
+            return 1;
+        }
+        try
+        {
+            verifier::verify(program(), program.entry_points(), nullptr,
+                             program.global_data().size(), program.constant_data().size());
+        }
+        catch (const std::runtime_error& e)
+        {
+            output += std::string(e.what()) + '\n';
+            return 1;
+        }
+        output += "compiled " + std::to_string(m_Project.files().size()) + " files to "
+                  + std::to_string(program.size()) + " words of code\n";
+        return 0;
+    }
+
+    int CompileServer::pretty(const std::string& path, std::string& output)
+    {
+        // a file outside the watched project lives as long as the request
+        parser::project adhoc;
+        parser::parsed_file* file = m_Project.find(path);
+        if (!file)
+        {
+            adhoc.update(path);
+            file = adhoc.find(path);
+            prepare(*file);
+        }
+        if (!file->success)
+        {
+            output = file->diagnostics;
+            return 1;
+        }
+
+        std::ostringstream errors;
+        parser::error_handler_type error_handler(*file->source, errors);
+        output.clear();
+        ASTVisitors::PrettyPrinter printer(error_handler, output);
+        printer.start(file->ast);
+        return 0;
+    }
+
+    int runClient(const std::string& socketPath, const std::vector<std::string>& request)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            throw systemError("socket");
+        sockaddr_un address = socketAddress(socketPath);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+        {
+            close(fd);
+            throw systemError("connect \"" + socketPath + '"');
+        }
+
+        std::string message;
+        for (const auto& line : request)
+            message += line + '\n';
+        writeAll(fd, message);
+        shutdown(fd, SHUT_WR);
+        std::string response = readAll(fd);
+        close(fd);
+
+        // "status <n>\n" followed by the output
+        std::size_t headerEnd = response.find('\n');
+        if (response.compare(0, 7, "status ") != 0 || headerEnd == std::string::npos)
+        {
+            std::cerr << "Error: malformed response from compile server" << std::endl;
+            return 1;
+        }
+        std::cout << response.substr(headerEnd + 1);
+        return std::stoi(response.substr(7, headerEnd - 7));
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "project.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Server
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  Long-running compile server
+    //  keeps the ASTs of a project in memory, reparses files changed on disk
+    //  (inotify) and answers requests on a local unix socket.
+    //
+    //  Protocol: one request per connection. The client sends the command and
+    //  its arguments one per line and shuts down its write side. The server
+    //  answers "status <n>\n" followed by the output and closes the connection.
+    //  Requests take at most 2 seconds to arrive and 1 MiB, clients that stall
+    //  or send more are dropped without an answer.
+    //
+    //  Commands:
+    //      check <file>...   parser diagnostics of the files (all files if none given)
+    //                        files outside the project are parsed for the request only
+    //      build             compiles and verifies all project files as one program,
+    //                        reports parser, type checker, compiler and verifier errors
+    //      pretty <file>     pretty printed source of the file, which may be outside the project
+    //      files             loaded files
+    //      shutdown          stop the server
+    ////////////////////////////////////////////////////////////////////////////
+    class CompileServer
+    {
+    public:
+        CompileServer(const std::string& socketPath, parser::project& project);
+        ~CompileServer();
+
+        /**
+         * serves requests until a shutdown request arrives
+         */
+        void run();
+
+        /**
+         * handles a single request
+         * @param output receives the response text
+         * @return status, 0 on success
+         */
+        int handleRequest(const std::vector<std::string>& request, std::string& output);
+
+    private:
+        void watchDirectory(const std::string& directory);
+        void handleFileEvents();
+        void handleFileEvent(std::uint32_t mask, const std::string& path);
+
+        /**
+         * loads and watches the directory and its subdirectories
+         */
+        void addDirectory(const std::string& directory);
+
+        /**
+         * drops the watches and files of the directory and its subdirectories
+         */
+        void removeDirectory(const std::string& directory);
+
+        /**
+         * parses the file again, removes it from the project if it vanished
+         */
+        void updateFile(const std::string& path);
+
+        /**
+         * compares the project with the disk after file events were lost
+         */
+        void rescan();
+        void handleConnection(int connection);
+        void prepare(const std::string& path);
+        static void prepare(parser::parsed_file& file);
+
+        int check(const std::vector<std::string>& paths, std::string& output);
+        int build(std::string& output);
+        int pretty(const std::string& path, std::string& output);
+
+        std::string m_SocketPath;
+        parser::project& m_Project;
+        int m_Socket;
+        int m_Inotify;
+        std::map<int, std::string> m_WatchedDirectories;
+        bool m_Running;
+    };
+
+    /**
+     * sends a request to a running compile server and prints the response output
+     * @return status of the response
+     */
+    int runClient(const std::string& socketPath, const std::vector<std::string>& request);
+}
@@ -0,0 +1,148 @@
+#include "source_manager.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace parser
+{
+    namespace
+    {
+        bool isIdentChar(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        bool by_base(ast::source_location location, const std::unique_ptr<source_file>& file)
+        {
+            return location < file->base;
+        }
+    }
+
+    std::size_t source_file::token_end(std::size_t offset) const
+    {
+        std::size_t end = offset;
+        if (end >= text.size())
+            return text.size();
+
+        const char c = text[end];
+        if (isIdentChar(c))
+        {
+            // identifiers and numbers, including the fraction of floats
+            while (end < text.size() && (isIdentChar(text[end]) || (text[end] == '.' && std::isdigit(static_cast<unsigned char>(c)))))
+                ++end;
+        }
+        else if (c == '"')
+        {
+            end = text.find('"', end + 1);
+            end = end == std::string::npos ? text.size() : end + 1;
+        }
+        else
+            ++end;
+        return end;
+    }
+
+    source_manager& source_manager::get()
+    {
+        static source_manager instance;
+        return instance;
+    }
+
+    const source_file& source_manager::add_file(const std::string& name, std::string text, std::size_t reserve)
+    {
+        std::unique_ptr<source_file> file(new source_file());
+        file->name = name;
+        file->text = std::move(text);
+        file->reserved = file->text.size() + reserve;
+        file->lines = line_index(file->text.begin(), file->text.end());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        file->base = find_gap(file->reserved, file->name, nullptr);
+        auto it = std::upper_bound(files.begin(), files.end(), file->base, by_base);
+        return **files.insert(it, std::move(file));
+    }
+
+    ast::source_location source_manager::find_gap(std::size_t reserved, const std::string& name,
+                                                  const source_file* ignore) const
+    {
+        // first gap between loaded files that fits the reserved size,
+        // + 1: the end of a file gets its own location
+        const std::uint64_t needed = std::uint64_t(reserved) + 1;
+        std::uint64_t base = 0;
+        for (const auto& other : files)
+        {
+            if (other.get() == ignore)
+                continue;
+            if (other->base - base >= needed)
+                break;
+            base = std::uint64_t(other->base) + other->reserved + 1;
+        }
+        if (base + needed > ast::invalid_location)
+            throw std::runtime_error("Error: source location space exhausted by \"" + name + '"');
+        return ast::source_location(base);
+    }
+
+    ast::source_location source_manager::edit_file(const source_file& file, std::size_t offset, std::size_t removed,
+                                                   const std::string& text)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(files.begin(), files.end(), [&file](const std::unique_ptr<source_file>& f) {
+            return f.get() == &file;
+        });
+        if (it == files.end())
+            throw std::runtime_error("Error: can't edit unloaded file \"" + file.name + '"');
+
+        source_file& edited = **it;
+        const ast::source_location old_base = edited.base;
+        const std::size_t size = edited.text.size() - removed + text.size();
+        if (size > edited.reserved)
+        {
+            // grow by half of the text, so that a file growing edit by edit moves rarely.
+            // The gap may include the old locations of the file itself
+            const std::size_t reserved = size + size / 2;
+            const ast::source_location base = find_gap(reserved, edited.name, &edited);
+
+            std::unique_ptr<source_file> moved = std::move(*it);
+            files.erase(it);
+            moved->base = base;
+            moved->reserved = reserved;
+            files.insert(std::upper_bound(files.begin(), files.end(), base, by_base), std::move(moved));
+        }
+
+        edited.text.replace(offset, removed, text);
+        edited.lines.replace(edited.text, offset, removed, text.size());
+        return edited.base - old_base;
+    }
+
+    void source_manager::remove_file(const source_file& file)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(files.begin(), files.end(), [&file](const std::unique_ptr<source_file>& f) {
+            return f.get() == &file;
+        });
+        if (it != files.end())
+            files.erase(it);
+    }
+
+    const source_file& source_manager::load_file(const std::string& filename)
+    {
+        return add_file(filename, Utils::readAllText(filename));
+    }
+
+    const source_file* source_manager::file_of(ast::source_location location) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // files are ordered by base, find the last one starting at or before location
+        auto it = std::upper_bound(files.begin(), files.end(), location, by_base);
+        if (it == files.begin())
+            return nullptr;
+        const source_file& file = **(it - 1);
+        return file.contains(location) ? &file : nullptr;
+    }
+
+    std::size_t source_manager::file_count() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.size();
+    }
+}
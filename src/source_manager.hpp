@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ast.hpp"
+#include "line_index.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace parser
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  A loaded source file
+    //  occupies the locations [base, base + text.size()] of the source_manager,
+    //  [base, base + reserved] are kept free so that edits in place keep the base
+    ////////////////////////////////////////////////////////////////////////////
+    struct source_file
+    {
+        typedef std::string::const_iterator iterator;
+
+        std::string name;
+        std::string text;
+        ast::source_location base;
+        std::size_t reserved;   // >= text.size()
+        line_index lines;
+
+        iterator begin() const { return text.begin(); }
+        iterator end() const { return text.end(); }
+
+        ast::source_location location_of(iterator it) const
+        {
+            return base + ast::source_location(it - text.begin());
+        }
+
+        std::size_t offset_of(ast::source_location location) const
+        {
+            return location - base;
+        }
+
+        bool contains(ast::source_location location) const
+        {
+            return location >= base && location - base <= text.size();
+        }
+
+        /**
+         * @return offset one past the token starting at offset,
+         * used to derive the range of a position tag on demand
+         */
+        std::size_t token_end(std::size_t offset) const;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    //  Owns all loaded files
+    //  maps 32-bit source locations back to their file, so position tags
+    //  on AST nodes can be a single offset instead of an iterator range.
+    //  Files may be added, removed and looked up from several threads
+    ////////////////////////////////////////////////////////////////////////////
+    class source_manager
+    {
+    public:
+        static source_manager& get();
+
+        /**
+         * takes ownership of the text, iterators into the file stay valid
+         * for the lifetime of the source_manager
+         * @param reserve locations kept free behind the text for edit_file
+         */
+        const source_file& add_file(const std::string& name, std::string text, std::size_t reserve = 0);
+
+        /**
+         * replaces removed characters at offset by text in place, invalidating iterators into the file.
+         * The file keeps its base while the text fits the reserved locations,
+         * otherwise it moves to a gap with room to grow
+         * @return amount the base moved, 0 if it stayed
+         */
+        ast::source_location edit_file(const source_file& file, std::size_t offset, std::size_t removed,
+                                       const std::string& text);
+
+        /**
+         * reads the file from disk and adds it
+         */
+        const source_file& load_file(const std::string& filename);
+
+        /**
+         * releases the file and its locations for reuse,
+         * all AST nodes tagged with locations of this file must be dropped before
+         */
+        void remove_file(const source_file& file);
+
+        /**
+         * @return file containing location or nullptr
+         */
+        const source_file* file_of(ast::source_location location) const;
+
+        std::size_t file_count() const;
+
+    private:
+        source_manager() = default;
+
+        /**
+         * @return base of the first gap of locations that fits reserved,
+         * the locations of ignore count as free. mutex must be held
+         */
+        ast::source_location find_gap(std::size_t reserved, const std::string& name, const source_file* ignore) const;
+
+        mutable std::mutex mutex;
+        // ordered by base
+        std::vector<std::unique_ptr<source_file>> files;
+    };
+}
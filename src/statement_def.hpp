@@ -207,4 +207,6 @@ namespace parser {
 
     struct assignment_class : x3::annotate_on_success {
     };
+    struct return_statement_class : x3::annotate_on_success {
+    };
 }
@@ -0,0 +1,15 @@
+#include "LocationShift.hpp"
+
+namespace ASTVisitors
+{
+    LocationShift::LocationShift(const ErrorHandler& errorHandler, ast::source_location shift)
+            : VisitorAdapter(errorHandler),
+              m_Shift(shift)
+    {
+    }
+
+    void LocationShift::start(ast::global_decl& x)
+    {
+        visitDerived(x);
+    }
+}
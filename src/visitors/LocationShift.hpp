@@ -0,0 +1,48 @@
+#pragma once
+
+#include "visitors/VisitorAdapter.hpp"
+#include <type_traits>
+
+namespace ASTVisitors
+{
+    /**
+     * moves the position tags of all visited nodes by a fixed amount,
+     * used to reuse subtrees after the text in front of them changed
+     */
+    class LocationShift : public VisitorAdapter<LocationShift>
+    {
+    public:
+        /**
+         * @param shift added to every location, wraps around for negative shifts
+         */
+        LocationShift(const ErrorHandler& errorHandler, ast::source_location shift);
+
+        /**
+         * moves a single top-level declaration
+         */
+        void start(ast::global_decl& x);
+        using VisitorAdapter::start;
+
+        template <class T>
+        result_type operator()(T& x)
+        {
+            move(x, std::is_base_of<ast::position_tagged, T>());
+            return visitBase(x);
+        }
+
+    private:
+        template <class T>
+        void move(T& x, std::true_type)
+        {
+            if (x.location != ast::invalid_location)
+                x.location += m_Shift;
+        }
+
+        template <class T>
+        void move(T&, std::false_type)
+        {
+        }
+
+        ast::source_location m_Shift;
+    };
+}
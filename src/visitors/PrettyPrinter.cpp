@@ -1,28 +1,65 @@
 #include "PrettyPrinter.hpp"
+#include <cstdio>
+#include <vector>
 
 
 namespace ASTVisitors
 {
+    namespace
+    {
+        // indentation is appended from here, deeper levels in several pieces
+        const std::string Spaces(128, ' ');
+    }
+
     PrettyPrinter::PrettyPrinter(const ErrorHandler& errorHandler, const std::string& filename)
             : VisitorAdapter(errorHandler),
               m_File(filename),
-              m_Out(m_File)
+              m_Out(&m_File),
+              m_Buffer(m_OwnBuffer)
     {
         init();
     }
 
     PrettyPrinter::PrettyPrinter(const ErrorHandler& errorHandler, std::ostream& out)
             : VisitorAdapter(errorHandler),
-              m_Out(out)
+              m_Out(&out),
+              m_Buffer(m_OwnBuffer)
     {
         init();
     }
 
+    PrettyPrinter::PrettyPrinter(const ErrorHandler& errorHandler, std::string& buffer)
+            : VisitorAdapter(errorHandler),
+              m_Out(nullptr),
+              m_Buffer(buffer)
+    {
+        init();
+    }
+
+    PrettyPrinter::~PrettyPrinter()
+    {
+        flush();
+    }
+
     void PrettyPrinter::init()
     {
         m_Indentation = 0;
     }
 
+    void PrettyPrinter::start(ast::program& x)
+    {
+        visitDerived(x);
+        flush();
+    }
+
+    void PrettyPrinter::flush()
+    {
+        if (!m_Out || m_Buffer.empty())
+            return;
+        m_Out->write(m_Buffer.data(), std::streamsize(m_Buffer.size()));
+        m_Buffer.clear();
+    }
+
     void PrettyPrinter::addIndentation(int indent)
     {
         m_Indentation += indent;
@@ -31,17 +68,60 @@ namespace ASTVisitors
     void PrettyPrinter::writeIndentedLine(const std::string &line)
     {
         writeIndented(line);
-        *this << '\n';
+        m_Buffer += '\n';
     }
 
     void PrettyPrinter::writeIndented(const std::string &str)
     {
-        *this << indent() << str;
+        writeIndentation();
+        m_Buffer += str;
+    }
+
+    void PrettyPrinter::writeIndentation()
+    {
+        for (std::size_t width = m_Indentation * 4u; width > 0;)
+        {
+            std::size_t piece = std::min(width, Spaces.size());
+            m_Buffer.append(Spaces, 0, piece);
+            width -= piece;
+        }
+    }
+
+    PrettyPrinter& PrettyPrinter::operator<<(unsigned int value)
+    {
+        char digits[10];
+        char* first = digits + sizeof(digits);
+        do
+        {
+            *--first = char('0' + value % 10);
+            value /= 10;
+        } while (value);
+        m_Buffer.append(first, digits + sizeof(digits));
+        return *this;
+    }
+
+    PrettyPrinter& PrettyPrinter::operator<<(float value)
+    {
+        // %f of the largest float has 39 integer digits
+        char text[64];
+        int length = std::snprintf(text, sizeof(text), "%f", double(value));
+        m_Buffer.append(text, std::size_t(std::max(length, 0)));
+        return *this;
     }
 
-    std::string PrettyPrinter::indent()
+    const std::string& PrettyPrinter::token(ast::optoken op)
     {
-        return std::string(m_Indentation * 4u, ' ');
+        static const std::vector<std::string> tokens = []() {
+            std::vector<std::string> result;
+            for (const auto& entry : parser::getOpTokenLookup())
+            {
+                if (std::size_t(entry.first) >= result.size())
+                    result.resize(std::size_t(entry.first) + 1);
+                result[entry.first] = entry.second;
+            }
+            return result;
+        }();
+        return tokens.at(op);
     }
 
     PrettyPrinter::Indentation::Indentation(PrettyPrinter &prettyPrinter, int addIndent)
@@ -55,4 +135,4 @@ namespace ASTVisitors
     {
         m_PrettyPrinter.addIndentation(-m_IndentChange);
     }
-}
\ No newline at end of file
+}
@@ -7,25 +7,62 @@
 
 namespace ASTVisitors
 {
+    /**
+     * formats the AST into a growable text buffer, which is written
+     * to the output stream in one piece when the program is done.
+     * A printer (or a caller supplied buffer) can be reused for many files,
+     * the buffer keeps its capacity.
+     */
     class PrettyPrinter : public VisitorAdapter<PrettyPrinter>
     {
     public:
         PrettyPrinter(const ErrorHandler& errorHandler, const std::string& filename);
         PrettyPrinter(const ErrorHandler& errorHandler, std::ostream& out);
 
+        /**
+         * appends to buffer instead of writing to a stream
+         */
+        PrettyPrinter(const ErrorHandler& errorHandler, std::string& buffer);
+
+        ~PrettyPrinter() override;
+
+        void start(ast::program& x) override;
+
+        /**
+         * writes the buffered text to the output stream
+         */
+        void flush();
+
         void writeIndentedLine(const std::string &line);
         void writeIndented(const std::string& str);
 
-        std::string indent();
-
         void addIndentation(int indent);
 
-        template <class T>
-        std::ostream& operator<<(T value)
+        PrettyPrinter& operator<<(char c)
         {
-            return m_Out << value;
+            m_Buffer += c;
+            return *this;
         }
 
+        PrettyPrinter& operator<<(const char* str)
+        {
+            m_Buffer += str;
+            return *this;
+        }
+
+        PrettyPrinter& operator<<(const std::string& str)
+        {
+            m_Buffer += str;
+            return *this;
+        }
+
+        PrettyPrinter& operator<<(unsigned int value);
+
+        /**
+         * fixed notation with 6 decimals like std::fixed
+         */
+        PrettyPrinter& operator<<(float value);
+
         /**
          * ---------------------------------------------------------------
          * Visitor methods
@@ -43,7 +80,7 @@ namespace ASTVisitors
 
         result_type operator()(float& x)
         {
-            *this << std::fixed << x;
+            *this << x;
         }
 
         result_type operator()(std::string& x)
@@ -78,13 +115,13 @@ namespace ASTVisitors
 
         result_type operator()(ast::operation& x)
         {
-            *this << " " << parser::getOpTokenLookup().at(x.operator_) << " ";
+            *this << ' ' << token(x.operator_) << ' ';
             return visitBase(x);
         }
 
         result_type operator()(ast::unary& x)
         {
-            *this << parser::getOpTokenLookup().at(x.operator_);
+            *this << token(x.operator_);
             return visitBase(x);
         }
 
@@ -98,7 +135,7 @@ namespace ASTVisitors
         result_type operator()(ast::assignment& x)
         {
             visitDerived(x.lhs);
-            *this << ' ' << parser::getOpTokenLookup().at(x.operator_) << ' ';
+            *this << ' ' << token(x.operator_) << ' ';
             visitDerived(x.rhs);
         }
 
@@ -300,9 +337,13 @@ namespace ASTVisitors
         };
 
         void init();
+        void writeIndentation();
+        static const std::string& token(ast::optoken op);
 
         std::ofstream m_File;
-        std::ostream& m_Out;
+        std::ostream* m_Out;      // nullptr if printing into a caller supplied buffer
+        std::string m_OwnBuffer;
+        std::string& m_Buffer;
         unsigned int m_Indentation;
     };
 }
@@ -0,0 +1,137 @@
+#include "SymbolCollector.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+
+namespace ASTVisitors
+{
+    SymbolCollector::SymbolCollector(const ErrorHandler& errorHandler)
+            : VisitorAdapter(errorHandler),
+              m_GlobalIndex(0),
+              m_Scope(-1),
+              m_DeclarationKind(SymbolKind::Variable)
+    {
+    }
+
+    bool SymbolCollector::isBuiltinType(const std::string& name)
+    {
+        const std::string type = boost::algorithm::to_lower_copy(name);
+        return type == "int" || type == "float" || type == "string"
+               || type == "void" || type == "func" || type == "instance";
+    }
+
+    void SymbolCollector::define(ast::variable& name, SymbolKind kind, const std::string& type)
+    {
+        // only members, parameters and locals live in the scope of their global declaration
+        bool scoped = kind == SymbolKind::Member || kind == SymbolKind::Parameter || kind == SymbolKind::Local;
+        m_Definitions.push_back({name.name, kind, name.location, scoped ? m_Scope : -1, type,
+                                 scoped ? m_Container : std::string()});
+    }
+
+    SymbolKind SymbolCollector::localKind(bool isConst) const
+    {
+        if (m_DeclarationKind == SymbolKind::Variable && isConst)
+            return SymbolKind::Constant;
+        return m_DeclarationKind;
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::variable& x)
+    {
+        m_References.push_back({x.name, x.location, m_Scope, false, m_Container});
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::type& x)
+    {
+        if (!isBuiltinType(x.name))
+            m_References.push_back({x.name, x.location, m_Scope, false, m_Container});
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::memberAccess& x)
+    {
+        visitDerived(x.object);
+        m_References.push_back({x.member.name, x.member.location, m_Scope, true, m_Container});
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::typed_var& x)
+    {
+        visitDerived(x.type_);
+        define(x.var, localKind(x.isConst), x.type_.name);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::variable_declaration& x)
+    {
+        visitDerived(x.typed_var_);
+        if (x.rhs)
+            visitDerived(*x.rhs);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::array_declaration& x)
+    {
+        visitDerived(x.typed_var_);
+        visitDerived(x.size);
+        if (x.rhs)
+        {
+            for (auto& op : *x.rhs)
+                visitDerived(op);
+        }
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::multi_variable_declaration& x)
+    {
+        visitDerived(x.type_);
+        for (auto& var : x.vars)
+            define(var, localKind(x.isConst), x.type_.name);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::global_decl& x)
+    {
+        m_Scope = m_GlobalIndex++;
+        m_Container.clear();
+        m_DeclarationKind = SymbolKind::Variable;
+        visitBase(x);
+        m_Scope = -1;
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::function& x)
+    {
+        define(x.name, SymbolKind::Function, x.returnType.name);
+        m_Container = x.name.name;
+        visitDerived(x.returnType);
+        m_DeclarationKind = SymbolKind::Parameter;
+        for (auto& param : x.params)
+            visitDerived(param);
+        m_DeclarationKind = SymbolKind::Local;
+        visitDerived(x.body);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::prototype& x)
+    {
+        define(x.name, SymbolKind::Prototype, x.baseClassName.name);
+        m_Container = x.name.name;
+        visitDerived(x.baseClassName);
+        m_DeclarationKind = SymbolKind::Local;
+        visitDerived(x.body);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::instance& x)
+    {
+        define(x.name, SymbolKind::Instance, x.type_.name);
+        m_Container = x.name.name;
+        visitDerived(x.type_);
+        m_DeclarationKind = SymbolKind::Local;
+        visitDerived(x.body);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::instance_var_decl& x)
+    {
+        visitDerived(x.type_);
+        for (auto& var : x.vars)
+            define(var, SymbolKind::Variable, x.type_.name);
+    }
+
+    SymbolCollector::result_type SymbolCollector::operator()(ast::extern_class& x)
+    {
+        define(x.name, SymbolKind::Class, "");
+        m_Container = x.name.name;
+        m_DeclarationKind = SymbolKind::Member;
+        visitDerived(x.body);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "visitors/VisitorAdapter.hpp"
+#include <vector>
+
+namespace ASTVisitors
+{
+    enum class SymbolKind
+    {
+        Function,
+        Prototype,
+        Instance,
+        Class,
+        Variable,
+        Constant,
+        Member,
+        Parameter,
+        Local
+    };
+
+    struct SymbolDefinition
+    {
+        std::string name;
+        SymbolKind kind;
+        ast::source_location location;
+        int scope;              // index of the enclosing global declaration, -1 for globals
+        std::string type;       // declared type, return type or base class/prototype
+        std::string container;  // name of the enclosing global declaration
+    };
+
+    struct SymbolReference
+    {
+        std::string name;
+        ast::source_location location;
+        int scope;              // index of the enclosing global declaration
+        bool member;            // right side of a member access, resolves to class members only
+        std::string container;  // name of the enclosing global declaration
+    };
+
+    /**
+     * collects all definitions and name references of a program
+     * with the index of their enclosing global declaration as scope
+     */
+    class SymbolCollector : public VisitorAdapter<SymbolCollector>
+    {
+    public:
+        SymbolCollector(const ErrorHandler& errorHandler);
+
+        /**
+         * collects a single global declaration, its scope is the number of declarations collected before
+         */
+        void collect(ast::global_decl& declaration) { visitDerived(declaration); }
+
+        const std::vector<SymbolDefinition>& definitions() const { return m_Definitions; }
+        const std::vector<SymbolReference>& references() const { return m_References; }
+
+        /**
+         * @return true for types that are part of the language (int, float, ...)
+         */
+        static bool isBuiltinType(const std::string& name);
+
+        result_type operator()(ast::variable& x);
+        result_type operator()(ast::type& x);
+        result_type operator()(ast::memberAccess& x);
+        result_type operator()(ast::typed_var& x);
+        result_type operator()(ast::variable_declaration& x);
+        result_type operator()(ast::array_declaration& x);
+        result_type operator()(ast::multi_variable_declaration& x);
+        result_type operator()(ast::global_decl& x);
+        result_type operator()(ast::function& x);
+        result_type operator()(ast::prototype& x);
+        result_type operator()(ast::instance& x);
+        result_type operator()(ast::instance_var_decl& x);
+        result_type operator()(ast::extern_class& x);
+
+        /**
+         * default case: call base function
+         */
+        template <class T>
+        result_type operator()(T& x)
+        {
+            return visitBase(x);
+        }
+
+    private:
+        void define(ast::variable& name, SymbolKind kind, const std::string& type);
+        SymbolKind localKind(bool isConst) const;
+
+        std::vector<SymbolDefinition> m_Definitions;
+        std::vector<SymbolReference> m_References;
+        int m_GlobalIndex;
+        int m_Scope;
+        std::string m_Container;
+        SymbolKind m_DeclarationKind; // kind of names declared by typed_var in the current context
+    };
+}
@@ -0,0 +1,729 @@
+#include "TypeChecker.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace ASTVisitors
+{
+    namespace x3 = boost::spirit::x3;
+
+    namespace
+    {
+        bool isComparison(ast::optoken op)
+        {
+            switch (op)
+            {
+                case ast::op_equal:
+                case ast::op_not_equal:
+                case ast::op_less:
+                case ast::op_less_equal:
+                case ast::op_greater:
+                case ast::op_greater_equal:
+                case ast::op_logical_and:
+                case ast::op_logical_or:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool isIntegral(ast::optoken op)
+        {
+            switch (op)
+            {
+                case ast::op_modulo:
+                case ast::op_shift_left:
+                case ast::op_shift_right:
+                case ast::op_bitwise_and:
+                case ast::op_bitwise_xor:
+                case ast::op_bitwise_or:
+                case ast::op_bitwise_not:
+                case ast::op_assign_modulo:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // ints, instances and function symbols are all 32-bit integers at runtime
+        bool isNumeric(ValueType type)
+        {
+            return type.kind == ValueType::Int || type.kind == ValueType::Float
+                   || type.kind == ValueType::Instance || type.kind == ValueType::Func;
+        }
+    }
+
+    const std::uint32_t ValueType::AnyClass;
+    const std::uint32_t TypeChecker::None;
+
+    TypeChecker::TypeChecker(const ErrorHandler& errorHandler)
+            : VisitorAdapter(errorHandler, "TypeChecker"),
+              m_CurrentClass(nullptr),
+              m_InFunction(false),
+              m_ErrorCount(0)
+    {
+    }
+
+    std::uint32_t TypeChecker::intern(const std::string& name)
+    {
+        std::uint32_t key = findKey(name);
+        if (key != None)
+            return key;
+        key = std::uint32_t(m_Keys.size());
+        m_Keys.emplace(m_KeyBuffer, key);
+        m_GlobalOfKey.push_back(None);
+        return key;
+    }
+
+    std::uint32_t TypeChecker::findKey(const std::string& name)
+    {
+        // identifiers are case insensitive, the buffer avoids an allocation per lookup
+        m_KeyBuffer.assign(name);
+        for (char& c : m_KeyBuffer)
+            c = char(std::tolower(static_cast<unsigned char>(c)));
+        auto it = m_Keys.find(m_KeyBuffer);
+        return it == m_Keys.end() ? None : it->second;
+    }
+
+    std::uint32_t TypeChecker::globalOf(std::uint32_t key) const
+    {
+        return key == None ? None : m_GlobalOfKey[key];
+    }
+
+    void TypeChecker::start(ast::program& x)
+    {
+        declare(x);
+        check(x);
+    }
+
+    void TypeChecker::declare(ast::program& x)
+    {
+        for (const auto& decl : x)
+        {
+            const auto& declaration = decl.get();
+            if (auto* var = boost::get<ast::variable_declaration>(&declaration))
+                addGlobal(var->typed_var_.var, var->typed_var_.isConst ? Global::Kind::Constant : Global::Kind::Variable, decl);
+            else if (auto* array = boost::get<ast::array_declaration>(&declaration))
+                addGlobal(array->typed_var_.var, array->typed_var_.isConst ? Global::Kind::Constant : Global::Kind::Variable, decl);
+            else if (auto* instances = boost::get<ast::instance_var_decl>(&declaration))
+            {
+                for (const auto& name : instances->vars)
+                    addGlobal(name, Global::Kind::Variable, decl);
+            }
+            else if (auto* function = boost::get<ast::function>(&declaration))
+                addGlobal(function->name, Global::Kind::Function, decl);
+            else if (auto* prototype = boost::get<ast::prototype>(&declaration))
+                addGlobal(prototype->name, Global::Kind::Prototype, decl);
+            else if (auto* instance = boost::get<ast::instance>(&declaration))
+                addGlobal(instance->name, Global::Kind::Instance, decl);
+            else if (auto* cls = boost::get<ast::extern_class>(&declaration))
+            {
+                addGlobal(cls->name, Global::Kind::Class, decl);
+                m_Globals.back().classId = std::uint32_t(m_Classes.size());
+                m_Classes.push_back({cls->name.name, {}});
+            }
+        }
+    }
+
+    void TypeChecker::check(ast::program& x)
+    {
+        resolveDeclarations();
+        visitDerived(x);
+    }
+
+    void TypeChecker::addGlobal(const ast::variable& name, Global::Kind kind, const ast::global_decl& declaration)
+    {
+        const std::uint32_t key = intern(name.name);
+        if (m_GlobalOfKey[key] != None)
+        {
+            report(name, "Error! Redefinition of " + name.name);
+            return;
+        }
+        m_GlobalOfKey[key] = std::uint32_t(m_Globals.size());
+        m_Unresolved.push_back(std::uint32_t(m_Globals.size()));
+        m_Globals.push_back({kind, name.name, ValueType(), false, None, {}, &declaration, false});
+    }
+
+    void TypeChecker::resolveDeclarations()
+    {
+        // types may refer to declarations of any program, so they are resolved once all are declared.
+        // classes come first as every other type depends on them, prototypes before the instances based on them
+        const Global::Kind order[] = {Global::Kind::Class, Global::Kind::Prototype, Global::Kind::Instance,
+                                      Global::Kind::Variable, Global::Kind::Constant, Global::Kind::Function};
+        for (Global::Kind kind : order)
+        {
+            for (std::uint32_t index : m_Unresolved)
+            {
+                if (m_Globals[index].kind == kind)
+                    resolveGlobal(m_Globals[index]);
+            }
+        }
+        m_Unresolved.clear();
+    }
+
+    void TypeChecker::resolveGlobal(Global& global)
+    {
+        if (global.resolved)
+            return;
+        global.resolved = true;
+
+        const auto& declaration = global.declaration->get();
+        switch (global.kind)
+        {
+            case Global::Kind::Class:
+            {
+                Class& cls = m_Classes[global.classId];
+                global.type = ValueType(ValueType::Instance, global.classId);
+                for (const auto& statement : boost::get<ast::extern_class>(declaration).body)
+                {
+                    if (auto* var = boost::get<ast::variable_declaration>(&statement.get()))
+                        addMember(cls, var->typed_var_, false);
+                    else if (auto* array = boost::get<ast::array_declaration>(&statement.get()))
+                        addMember(cls, array->typed_var_, true);
+                    else if (auto* vars = boost::get<ast::multi_variable_declaration>(&statement.get()))
+                    {
+                        for (const auto& name : vars->vars)
+                            addMember(cls, {vars->isConst, vars->type_, name}, false);
+                    }
+                }
+                std::sort(cls.members.begin(), cls.members.end(),
+                          [](const Member& a, const Member& b) { return a.key < b.key; });
+                break;
+            }
+            case Global::Kind::Prototype:
+            {
+                const ast::variable& base = boost::get<ast::prototype>(declaration).baseClassName;
+                global.type = baseOf(base.name, base, false);
+                break;
+            }
+            case Global::Kind::Instance:
+            {
+                const ast::type& base = boost::get<ast::instance>(declaration).type_;
+                global.type = baseOf(base.name, base, true);
+                break;
+            }
+            case Global::Kind::Variable:
+            case Global::Kind::Constant:
+                if (auto* var = boost::get<ast::variable_declaration>(&declaration))
+                    global.type = typeOf(var->typed_var_.type_);
+                else if (auto* array = boost::get<ast::array_declaration>(&declaration))
+                {
+                    global.type = typeOf(array->typed_var_.type_);
+                    global.isArray = true;
+                }
+                else
+                    global.type = typeOf(boost::get<ast::instance_var_decl>(declaration).type_);
+                break;
+            case Global::Kind::Function:
+            {
+                const auto& function = boost::get<ast::function>(declaration);
+                global.type = typeOf(function.returnType);
+                for (const auto& param : function.params)
+                    global.params.push_back(typeOf(param.type_));
+                break;
+            }
+        }
+    }
+
+    ValueType TypeChecker::typeOf(const ast::type& type)
+    {
+        findKey(type.name);
+        const std::string& name = m_KeyBuffer;
+        if (name == "int")
+            return ValueType::Int;
+        if (name == "float")
+            return ValueType::Float;
+        if (name == "string")
+            return ValueType::String;
+        if (name == "void")
+            return ValueType::Void;
+        if (name == "func")
+            return ValueType::Func;
+        if (name == "instance")
+            return ValueType::Instance;
+
+        const std::uint32_t global = globalOf(findKey(type.name));
+        if (global != None && m_Globals[global].kind == Global::Kind::Class)
+            return ValueType(ValueType::Instance, m_Globals[global].classId);
+        report(type, "Error! Unknown type " + type.name);
+        return ValueType::Error;
+    }
+
+    ValueType TypeChecker::baseOf(const std::string& name, const ast::position_tagged& position, bool allowPrototype)
+    {
+        const std::uint32_t index = globalOf(findKey(name));
+        if (index != None)
+        {
+            Global& global = m_Globals[index];
+            if (global.kind == Global::Kind::Class)
+                return ValueType(ValueType::Instance, global.classId);
+            if (global.kind == Global::Kind::Prototype && allowPrototype)
+            {
+                resolveGlobal(global);
+                return global.type;
+            }
+        }
+        report(position, std::string(allowPrototype ? "Error! Unknown class or prototype " : "Error! Unknown class ") + name);
+        return ValueType::Error;
+    }
+
+    void TypeChecker::addMember(Class& cls, const ast::typed_var& var, bool isArray)
+    {
+        cls.members.push_back({intern(var.var.name), typeOf(var.type_), isArray});
+    }
+
+    const TypeChecker::Member* TypeChecker::findMember(const Class& cls, std::uint32_t key) const
+    {
+        auto it = std::lower_bound(cls.members.begin(), cls.members.end(), key,
+                                   [](const Member& member, std::uint32_t value) { return member.key < value; });
+        return it != cls.members.end() && it->key == key ? &*it : nullptr;
+    }
+
+    void TypeChecker::declareLocal(const ast::variable& name, ValueType type, bool isArray, bool isConst)
+    {
+        m_Locals.push_back({intern(name.name), type, isArray, isConst});
+    }
+
+    TypeChecker::Resolved TypeChecker::resolveName(ast::variable& x)
+    {
+        track(x);
+        const std::uint32_t key = findKey(x.name);
+        if (key != None)
+        {
+            for (auto it = m_Locals.rbegin(); it != m_Locals.rend(); ++it)
+            {
+                if (it->key == key)
+                    return {it->type, it->isArray, it->isConst, true};
+            }
+            if (m_CurrentClass)
+            {
+                if (const Member* member = findMember(*m_CurrentClass, key))
+                    return {member->type, member->isArray, false, true};
+            }
+            const std::uint32_t index = globalOf(key);
+            if (index != None)
+            {
+                const Global& global = m_Globals[index];
+                switch (global.kind)
+                {
+                    case Global::Kind::Variable:
+                        return {global.type, global.isArray, false, true};
+                    case Global::Kind::Constant:
+                        return {global.type, global.isArray, true, true};
+                    case Global::Kind::Function:
+                        return {ValueType::Func, false, true, false};
+                    default:
+                        // classes, prototypes and instances are used as instance indices
+                        return {global.type, false, true, false};
+                }
+            }
+        }
+        report(x, "Error! Unknown identifier " + x.name);
+        return {ValueType::Error, false, false, true};
+    }
+
+    TypeChecker::Resolved TypeChecker::resolveMember(ast::memberAccess& x)
+    {
+        const Resolved object = resolveName(x.object);
+        track(x.member);
+        if (object.type.kind == ValueType::Error)
+            return {ValueType::Error, false, false, true};
+        if (object.type.kind != ValueType::Instance)
+        {
+            report(x.object, "Error! " + x.object.name + " is no instance");
+            return {ValueType::Error, false, false, true};
+        }
+
+        const std::uint32_t key = findKey(x.member.name);
+        if (key != None)
+        {
+            if (object.type.classId != ValueType::AnyClass)
+            {
+                if (const Member* member = findMember(m_Classes[object.type.classId], key))
+                    return {member->type, member->isArray, false, true};
+            }
+            else
+            {
+                // untyped instance, any class with that member will do
+                for (const Class& cls : m_Classes)
+                {
+                    if (const Member* member = findMember(cls, key))
+                        return {member->type, member->isArray, false, true};
+                }
+            }
+        }
+        report(x.member, "Error! " + typeName(object.type) + " has no member " + x.member.name);
+        return {ValueType::Error, false, false, true};
+    }
+
+    TypeChecker::Resolved TypeChecker::resolveAccess(ast::array_access& x)
+    {
+        track(x);
+        Resolved target = resolveOperand(x.var);
+        if (target.type.kind != ValueType::Error && !target.isArray)
+            report(x, "Error! Indexed value is no array");
+
+        const ValueType index = visitDerived(x.index);
+        if (index.kind != ValueType::Error && index.kind != ValueType::Int)
+            report(x, "Error! Array index must be int, not " + typeName(index));
+        target.isArray = false;
+        return target;
+    }
+
+    TypeChecker::Resolved TypeChecker::resolveOperand(ast::operand& x)
+    {
+        auto& value = x.get();
+        if (auto* variable = boost::get<ast::variable>(&value))
+            return resolveName(*variable);
+        if (auto* member = boost::get<ast::memberAccess>(&value))
+            return resolveMember(*member);
+        if (auto* access = boost::get<x3::forward_ast<ast::array_access>>(&value))
+            return resolveAccess(access->get());
+        if (auto* expression = boost::get<x3::forward_ast<ast::expression>>(&value))
+        {
+            // expressions are only collapsed by the ExpressionCollapse pass
+            if (expression->get().rest.empty())
+                return resolveOperand(expression->get().first);
+        }
+        return {visitDerived(x), false, true, false};
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(unsigned int& x)
+    {
+        return ValueType::Int;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(float& x)
+    {
+        return ValueType::Float;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(std::string& x)
+    {
+        return ValueType::String;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::variable& x)
+    {
+        return resolveName(x).type;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::memberAccess& x)
+    {
+        return resolveMember(x).type;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::array_access& x)
+    {
+        return resolveAccess(x).type;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::unary& x)
+    {
+        const ValueType type = visitDerived(x.operand_);
+        if (type.kind == ValueType::Error)
+            return type;
+        if (!isNumeric(type) || (type.kind == ValueType::Float && isIntegral(x.operator_)))
+        {
+            report("Error! Operator not defined for " + typeName(type));
+            return ValueType::Error;
+        }
+        return x.operator_ == ast::op_logical_not ? ValueType::Int : type;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::expression& x)
+    {
+        ValueType type = visitDerived(x.first);
+        for (auto& operation : x.rest)
+        {
+            const ValueType right = visitDerived(operation.operand_);
+            track(operation);
+            type = binaryResult(operation.operator_, type, right);
+        }
+        return type;
+    }
+
+    ValueType TypeChecker::binaryResult(ast::optoken op, ValueType left, ValueType right)
+    {
+        if (left.kind == ValueType::Error || right.kind == ValueType::Error)
+            return ValueType::Error;
+        if (!isNumeric(left) || !isNumeric(right))
+        {
+            // strings are compared and concatenated by externals only
+            report("Error! Operator not defined for " + typeName(isNumeric(left) ? right : left));
+            return ValueType::Error;
+        }
+        if (isComparison(op))
+            return ValueType::Int;
+        if (left.kind == ValueType::Float || right.kind == ValueType::Float)
+        {
+            if (isIntegral(op))
+            {
+                report("Error! Operator not defined for float");
+                return ValueType::Error;
+            }
+            return ValueType::Float;
+        }
+        return ValueType::Int;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::func_call& x)
+    {
+        // the call itself isn't tagged, its name is
+        track(x.var);
+        std::vector<ValueType> args;
+        for (auto& arg : x.args)
+            args.push_back(visitDerived(arg));
+
+        const std::uint32_t index = globalOf(findKey(x.var.name));
+        if (index == None)
+        {
+            report(x.var, "Error! Unknown function " + x.var.name);
+            return ValueType::Error;
+        }
+        const Global& function = m_Globals[index];
+        if (function.kind != Global::Kind::Function)
+        {
+            report(x.var, "Error! " + x.var.name + " is no function");
+            return ValueType::Error;
+        }
+
+        if (args.size() != function.params.size())
+            report(x.var, "Error! " + function.name + " expects " + std::to_string(function.params.size())
+                      + " arguments, got " + std::to_string(args.size()));
+        for (std::size_t i = 0; i < std::min(args.size(), function.params.size()); ++i)
+        {
+            if (!compatible(function.params[i], args[i]))
+                report(x.var, "Error! Argument " + std::to_string(i + 1) + " of " + function.name + " expects "
+                          + typeName(function.params[i]) + ", got " + typeName(args[i]));
+        }
+        return function.type;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::assignment& x)
+    {
+        track(x);
+        const Resolved target = resolveOperand(x.lhs);
+        const ValueType value = visitDerived(x.rhs);
+        track(x);
+
+        if (!target.assignable)
+            report(x, "Error! Left side of assignment can't be assigned");
+        else if (target.isConst)
+            report(x, "Error! Assignment to constant");
+        else if (x.operator_ != ast::op_assign && target.type.kind != ValueType::Error
+                 && (target.type.kind != ValueType::Int
+                     && (target.type.kind != ValueType::Float || isIntegral(x.operator_))))
+            report(x, "Error! Compound assignment not defined for " + typeName(target.type));
+        else
+            checkAssignable(x, target.type, value, "assign");
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::variable_declaration& x)
+    {
+        ValueType type;
+        if (m_InFunction)
+        {
+            type = typeOf(x.typed_var_.type_);
+            declareLocal(x.typed_var_.var, type, false, x.typed_var_.isConst);
+        }
+        else
+        {
+            // globals were resolved by declare
+            const std::uint32_t index = globalOf(findKey(x.typed_var_.var.name));
+            if (index != None)
+                type = m_Globals[index].type;
+        }
+        if (x.rhs)
+            checkAssignable(x.typed_var_.var, type, visitDerived(*x.rhs), "initialize");
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::multi_variable_declaration& x)
+    {
+        const ValueType type = typeOf(x.type_);
+        for (const auto& var : x.vars)
+            declareLocal(var, type, false, x.isConst);
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::array_declaration& x)
+    {
+        ValueType type;
+        if (m_InFunction)
+        {
+            type = typeOf(x.typed_var_.type_);
+            declareLocal(x.typed_var_.var, type, true, x.typed_var_.isConst);
+        }
+        else
+        {
+            const std::uint32_t index = globalOf(findKey(x.typed_var_.var.name));
+            if (index != None)
+                type = m_Globals[index].type;
+        }
+
+        const ValueType size = visitDerived(x.size);
+        if (size.kind != ValueType::Error && size.kind != ValueType::Int)
+            report(x.typed_var_.var, "Error! Array size must be int, not " + typeName(size));
+        if (x.rhs)
+        {
+            for (auto& element : *x.rhs)
+            {
+                const ValueType value = visitDerived(element);
+                checkAssignable(x.typed_var_.var, type, value, "initialize");
+            }
+        }
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::return_statement& x)
+    {
+        if (!x.operand_)
+            return ValueType::Void;
+        const ValueType value = visitDerived(*x.operand_);
+        // literal operands aren't tagged, report at the return
+        if (!m_InFunction)
+            report(x, "Error! Return with a value outside of a function");
+        else if (m_ReturnType.kind == ValueType::Void)
+            report(x, "Error! Void function returns a value");
+        else
+            checkAssignable(x, m_ReturnType, value, "return");
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::condition_block& x)
+    {
+        checkCondition(x.condition);
+        visitDerived(x.then);
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::while_statement& x)
+    {
+        checkCondition(x.condition);
+        visitDerived(x.body);
+        return ValueType::Void;
+    }
+
+    void TypeChecker::checkCondition(ast::operand& condition)
+    {
+        const ValueType type = visitDerived(condition);
+        if (type.kind != ValueType::Error && (!isNumeric(type) || type.kind == ValueType::Float))
+            report("Error! Condition must be int, not " + typeName(type));
+    }
+
+    void TypeChecker::checkAssignable(const ast::position_tagged& position, ValueType target, ValueType value, const std::string& what)
+    {
+        if (!compatible(target, value))
+            report(position, "Error! Can't " + what + " " + typeName(target) + " with " + typeName(value));
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::function& x)
+    {
+        track(x.name);
+        const std::uint32_t index = globalOf(findKey(x.name.name));
+        m_ReturnType = index != None ? m_Globals[index].type : ValueType::Error;
+        m_InFunction = true;
+        m_Locals.clear();
+        for (const auto& param : x.params)
+            declareLocal(param.var, typeOf(param.type_), false, false);
+        visitDerived(x.body);
+        m_Locals.clear();
+        m_InFunction = false;
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::prototype& x)
+    {
+        track(x.name);
+        const std::uint32_t index = globalOf(findKey(x.name.name));
+        const ValueType type = index != None ? m_Globals[index].type : ValueType::Error;
+        if (type.kind == ValueType::Instance && type.classId != ValueType::AnyClass)
+            m_CurrentClass = &m_Classes[type.classId];
+        visitDerived(x.body);
+        m_CurrentClass = nullptr;
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::instance& x)
+    {
+        track(x.name);
+        const std::uint32_t index = globalOf(findKey(x.name.name));
+        const ValueType type = index != None ? m_Globals[index].type : ValueType::Error;
+        if (type.kind == ValueType::Instance && type.classId != ValueType::AnyClass)
+            m_CurrentClass = &m_Classes[type.classId];
+        visitDerived(x.body);
+        m_CurrentClass = nullptr;
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::instance_var_decl& x)
+    {
+        // resolved by declare
+        return ValueType::Void;
+    }
+
+    TypeChecker::result_type TypeChecker::operator()(ast::extern_class& x)
+    {
+        // members are resolved by declare
+        return ValueType::Void;
+    }
+
+    bool TypeChecker::compatible(ValueType target, ValueType value)
+    {
+        if (target.kind == ValueType::Error || value.kind == ValueType::Error)
+            return true;
+        switch (target.kind)
+        {
+            case ValueType::Int:
+            case ValueType::Func:
+                // instances and functions are passed around as their symbol index
+                return value.kind == ValueType::Int || value.kind == ValueType::Instance || value.kind == ValueType::Func;
+            case ValueType::Float:
+                return value.kind == ValueType::Float || value.kind == ValueType::Int;
+            case ValueType::String:
+                return value.kind == ValueType::String;
+            case ValueType::Instance:
+                if (value.kind == ValueType::Int)
+                    return true;
+                return value.kind == ValueType::Instance
+                       && (target.classId == ValueType::AnyClass || value.classId == ValueType::AnyClass
+                           || target.classId == value.classId);
+            default:
+                return false;
+        }
+    }
+
+    std::string TypeChecker::typeName(ValueType type) const
+    {
+        switch (type.kind)
+        {
+            case ValueType::Void: return "void";
+            case ValueType::Int: return "int";
+            case ValueType::Float: return "float";
+            case ValueType::String: return "string";
+            case ValueType::Func: return "func";
+            case ValueType::Instance:
+                return type.classId == ValueType::AnyClass ? "instance" : m_Classes[type.classId].name;
+            default:
+                return "unknown";
+        }
+    }
+
+    void TypeChecker::track(const ast::position_tagged& position)
+    {
+        if (position.location != ast::invalid_location)
+            m_Position = position;
+    }
+
+    void TypeChecker::report(const ast::position_tagged& position, const std::string& message)
+    {
+        ++m_ErrorCount;
+        error_handler(position.location != ast::invalid_location ? position : m_Position, message);
+    }
+
+    void TypeChecker::report(const std::string& message)
+    {
+        report(m_Position, message);
+    }
+}
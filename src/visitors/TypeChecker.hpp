@@ -0,0 +1,192 @@
+#pragma once
+
+#include "visitors/VisitorAdapter.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ASTVisitors
+{
+    /**
+     * type of a value as seen by the type checker
+     */
+    struct ValueType
+    {
+        enum Kind : std::uint8_t
+        {
+            Error,      // unknown or already reported, compatible with everything
+            Void,
+            Int,
+            Float,
+            String,
+            Func,
+            Instance
+        };
+
+        static const std::uint32_t AnyClass = 0xFFFFFFFFu;
+
+        ValueType(Kind kind = Error, std::uint32_t classId = AnyClass)
+                : kind(kind),
+                  classId(classId)
+        {}
+
+        Kind kind;
+        std::uint32_t classId; // class of an instance, AnyClass for the untyped instance keyword
+    };
+
+    /**
+     * resolves every variable, member access and function call against the
+     * classes, prototypes, instances, functions and globals of the checked programs
+     * and reports unknown names and mismatching types.
+     * Names are interned case-insensitively once, scopes are flat vectors indexed
+     * by those keys: globals by key, class members sorted by key and locals as a
+     * stack searched from the innermost declaration.
+     */
+    class TypeChecker : public VisitorAdapter<TypeChecker, ValueType>
+    {
+    public:
+        TypeChecker(const ErrorHandler& errorHandler);
+
+        /**
+         * registers the global declarations of a program,
+         * declarations of other programs (i.e. externals) are visible to every checked program
+         */
+        void declare(ast::program& x);
+
+        /**
+         * checks a program, all programs it refers to must have been declared before
+         */
+        void check(ast::program& x);
+
+        /**
+         * declares and checks a single program
+         */
+        void start(ast::program& x) override;
+
+        std::size_t errorCount() const { return m_ErrorCount; }
+
+        result_type operator()(unsigned int& x);
+        result_type operator()(float& x);
+        result_type operator()(std::string& x);
+        result_type operator()(ast::variable& x);
+        result_type operator()(ast::memberAccess& x);
+        result_type operator()(ast::unary& x);
+        result_type operator()(ast::expression& x);
+        result_type operator()(ast::func_call& x);
+        result_type operator()(ast::array_access& x);
+        result_type operator()(ast::assignment& x);
+        result_type operator()(ast::variable_declaration& x);
+        result_type operator()(ast::multi_variable_declaration& x);
+        result_type operator()(ast::array_declaration& x);
+        result_type operator()(ast::return_statement& x);
+        result_type operator()(ast::condition_block& x);
+        result_type operator()(ast::while_statement& x);
+        result_type operator()(ast::function& x);
+        result_type operator()(ast::prototype& x);
+        result_type operator()(ast::instance& x);
+        result_type operator()(ast::instance_var_decl& x);
+        result_type operator()(ast::extern_class& x);
+
+        /**
+         * default case: call base function
+         */
+        template <class T>
+        result_type operator()(T& x)
+        {
+            return visitBase(x);
+        }
+
+    private:
+        static const std::uint32_t None = 0xFFFFFFFFu;
+
+        struct Global
+        {
+            enum class Kind { Variable, Constant, Function, Class, Prototype, Instance };
+
+            Kind kind;
+            std::string name;
+            ValueType type;                // type of variables, return type, class of prototypes and instances
+            bool isArray;
+            std::uint32_t classId;         // index into m_Classes for classes
+            std::vector<ValueType> params; // parameter types of functions
+            const ast::global_decl* declaration;
+            bool resolved;
+        };
+
+        struct Member
+        {
+            std::uint32_t key;
+            ValueType type;
+            bool isArray;
+        };
+
+        struct Class
+        {
+            std::string name;
+            std::vector<Member> members; // sorted by key
+        };
+
+        struct Local
+        {
+            std::uint32_t key;
+            ValueType type;
+            bool isArray;
+            bool isConst;
+        };
+
+        /**
+         * what a name or member access refers to
+         */
+        struct Resolved
+        {
+            ValueType type;
+            bool isArray;
+            bool isConst;
+            bool assignable;
+        };
+
+        std::uint32_t intern(const std::string& name);
+        std::uint32_t findKey(const std::string& name);
+        std::uint32_t globalOf(std::uint32_t key) const;
+
+        void addGlobal(const ast::variable& name, Global::Kind kind, const ast::global_decl& declaration);
+        void resolveDeclarations();
+        void resolveGlobal(Global& global);
+        ValueType typeOf(const ast::type& type);
+        ValueType baseOf(const std::string& name, const ast::position_tagged& position, bool allowPrototype);
+        void addMember(Class& cls, const ast::typed_var& var, bool isArray);
+        const Member* findMember(const Class& cls, std::uint32_t key) const;
+        void declareLocal(const ast::variable& name, ValueType type, bool isArray, bool isConst);
+
+        Resolved resolveName(ast::variable& x);
+        Resolved resolveMember(ast::memberAccess& x);
+        Resolved resolveAccess(ast::array_access& x);
+        Resolved resolveOperand(ast::operand& x);
+
+        ValueType binaryResult(ast::optoken op, ValueType left, ValueType right);
+        void checkCondition(ast::operand& condition);
+        void checkAssignable(const ast::position_tagged& position, ValueType target, ValueType value, const std::string& what);
+
+        static bool compatible(ValueType target, ValueType value);
+        std::string typeName(ValueType type) const;
+
+        void report(const ast::position_tagged& position, const std::string& message);
+        void report(const std::string& message);
+        void track(const ast::position_tagged& position);
+
+        std::unordered_map<std::string, std::uint32_t> m_Keys;
+        std::string m_KeyBuffer;
+        std::vector<std::uint32_t> m_GlobalOfKey; // key -> index into m_Globals or None
+        std::vector<Global> m_Globals;
+        std::vector<std::uint32_t> m_Unresolved; // globals declared since the last check
+        std::vector<Class> m_Classes;
+        std::vector<Local> m_Locals;
+
+        const Class* m_CurrentClass;  // members are visible unqualified in prototype and instance bodies
+        bool m_InFunction;
+        ValueType m_ReturnType;
+        ast::position_tagged m_Position; // last tagged node, for errors on untagged nodes
+        std::size_t m_ErrorCount;
+    };
+}
@@ -25,15 +25,15 @@ namespace ASTVisitors
         // for the sake of readability of template error messages, ErrorHandler_ is not a template parameter anymore
         typedef parser::error_handler_type ErrorHandler_;
         typedef ErrorHandler_ ErrorHandler;
-        typedef std::function<void(boost::spirit::x3::position_tagged, std::string const&)> error_handler_type;
+        typedef std::function<void(ast::position_tagged, std::string const&)> error_handler_type;
         typedef VisitorAdapter<Derived, ResultType> BaseType;
 
         VisitorAdapter(ErrorHandler const& error_handler, const std::string& name="UnnamedVisitor") :
                 BaseVisitor(name),
                 error_handler(
-                        [&error_handler](boost::spirit::x3::position_tagged pos, std::string const& msg)
+                        [&error_handler](ast::position_tagged pos, std::string const& msg)
                         {
-                            BOOST_ASSERT_MSG(pos.id_first != -1 && pos.id_last != -1, "untagged ast object");
+                            BOOST_ASSERT_MSG(pos.location != ast::invalid_location, "untagged ast object");
                             error_handler(pos, msg);
                         }
             )
@@ -79,7 +79,7 @@ namespace ASTVisitors
         {
             // member access on object
             visitDerived(x.object);
-            visitDerived(x.object);
+            visitDerived(x.member);
             return ResultType();
         }
 
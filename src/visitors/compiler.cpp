@@ -6,16 +6,22 @@
 =============================================================================*/
 #include "compiler.hpp"
 #include "vm/vm.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/foreach.hpp>
 #include <boost/variant/apply_visitor.hpp>
 #include <boost/assert.hpp>
 #include <boost/lexical_cast.hpp>
+#include <climits>
+#include <algorithm>
 #include <iostream>
 #include <set>
 
 namespace code_gen {
     using result_type = compiler::result_type;
 
+    constexpr std::size_t program::removed;
+
     void program::op(int a) {
         code.push_back(a);
     }
@@ -31,16 +37,199 @@ namespace code_gen {
         code.push_back(c);
     }
 
+    void program::clear() {
+        code.clear();
+        variables.clear();
+        variable_types.clear();
+        variable_counts.clear();
+        variable_classes.clear();
+        functions.clear();
+        function_names.clear();
+        strings.assign(1, std::string());               // handle 0 is the empty string
+        string_handles.clear();
+        string_handles[std::string()] = 0;
+        globals.clear();
+        global_values.clear();
+        constant_values.clear();
+        instances.clear();
+        instance_classes.clear();
+        initializers.clear();
+        initializer_functions.clear();
+        classes.clear();
+    }
+
     int const *program::find_var(std::string const &name) const {
-        auto i = variables.find(name);
+        auto i = variables.find(boost::algorithm::to_lower_copy(name));
         if (i == variables.end())
             return 0;
         return &i->second;
     }
 
-    void program::add_var(std::string const &name) {
-        std::size_t n = variables.size();
-        variables[name] = int(n);
+    void program::add_var(std::string const &name, value_type type, int class_index, std::uint32_t count) {
+        std::size_t n = variable_types.size();
+        variables[boost::algorithm::to_lower_copy(name)] = int(n);
+        variable_types.insert(variable_types.end(), count, type);
+        variable_classes.insert(variable_classes.end(), count, class_index);
+        variable_counts.insert(variable_counts.end(), count, 0);
+        variable_counts[n] = count;
+    }
+
+    program::function_info const *program::find_function(std::string const &name) const {
+        auto i = functions.find(boost::algorithm::to_lower_copy(name));
+        if (i == functions.end())
+            return 0;
+        return &i->second;
+    }
+
+    program::function_info *program::find_function(std::string const &name) {
+        auto i = functions.find(boost::algorithm::to_lower_copy(name));
+        if (i == functions.end())
+            return 0;
+        return &i->second;
+    }
+
+    program::function_info &program::add_function(std::string const &name, value_type result,
+                                                   std::vector<value_type> parameters) {
+        auto i = functions.emplace(boost::algorithm::to_lower_copy(name), function_info());
+        function_info &f = i.first->second;
+        if (i.second) {
+            function_names.push_back(i.first->first);
+            f.handle = int(function_names.size());
+        }
+        f.address = 0;
+        f.result = result;
+        f.parameters = std::move(parameters);
+        return f;
+    }
+
+    std::size_t program::function_address(int handle) const {
+        if (handle <= 0 || std::size_t(handle) > function_names.size())
+            return removed;
+        auto i = functions.find(function_names[handle - 1]);
+        return i == functions.end() ? removed : i->second.address;
+    }
+
+    std::vector<entry_point> program::entry_points() const {
+        std::vector<entry_point> entries;
+        for (auto const &f : functions)
+            entries.push_back(entry_point{f.second.address, int(f.second.parameters.size())});
+        for (auto const &f : initializer_functions)
+            entries.push_back(entry_point{f.first, 1});         // the instance
+        return entries;
+    }
+
+    program::global_info const *program::find_global(std::string const &name) const {
+        auto i = globals.find(boost::algorithm::to_lower_copy(name));
+        if (i == globals.end())
+            return 0;
+        return &i->second;
+    }
+
+    program::global_info const &program::add_global(std::string const &name, value_type type, std::uint32_t count,
+                                                    bool constant, int class_index) {
+        std::vector<int> &region = constant ? constant_values : global_values;
+        global_info &global = globals[boost::algorithm::to_lower_copy(name)];
+        global = global_info{std::uint32_t(region.size()), count, type, constant, class_index};
+        region.resize(region.size() + count, 0);        // 0, 0.0, "" or no instance
+        return global;
+    }
+
+    int &program::initial_value(global_info const &global, std::uint32_t index) {
+        return (global.constant ? constant_values : global_values)[global.slot + index];
+    }
+
+    void program::relocate(std::vector<int> code, std::vector<std::size_t> const &relocation) {
+        for (auto f = functions.begin(); f != functions.end();) {
+            f->second.address = relocation[f->second.address];
+            if (f->second.address == removed)
+                f = functions.erase(f);
+            else
+                ++f;
+        }
+        std::map<std::size_t, std::string> moved;
+        for (auto const &f : initializer_functions) {
+            if (relocation[f.first] != removed)
+                moved[relocation[f.first]] = f.second;
+        }
+        initializer_functions.swap(moved);
+        for (instance_init &init : initializers) {
+            if (init.initializer != instance_init::no_initializer)
+                init.initializer = relocation[init.initializer];    // removed is no_initializer
+        }
+        this->code = std::move(code);
+    }
+
+    void program::strip_globals(std::vector<bool> const &used_globals, std::vector<bool> const &used_constants,
+                                std::vector<std::size_t> &global_slots, std::vector<std::size_t> &constant_slots) {
+        global_slots.assign(global_values.size(), removed);
+        constant_slots.assign(constant_values.size(), removed);
+        std::vector<int> kept_globals, kept_constants;
+        // in slot order, so the regions keep their layout
+        std::map<std::uint32_t, std::map<std::string, global_info>::iterator> by_slot[2];
+        for (auto g = globals.begin(); g != globals.end(); ++g)
+            by_slot[g->second.constant][g->second.slot] = g;
+        for (int constant = 0; constant < 2; ++constant) {
+            std::vector<bool> const &used = constant ? used_constants : used_globals;
+            std::vector<int> &values = constant ? constant_values : global_values;
+            std::vector<int> &kept = constant ? kept_constants : kept_globals;
+            std::vector<std::size_t> &slots = constant ? constant_slots : global_slots;
+            for (auto const &entry : by_slot[constant]) {
+                global_info &global = entry.second->second;
+                if (std::find(used.begin() + global.slot, used.begin() + global.slot + global.count, true)
+                        == used.begin() + global.slot + global.count) {
+                    globals.erase(entry.second);
+                    continue;
+                }
+                for (std::uint32_t i = 0; i < global.count; ++i)
+                    slots[global.slot + i] = kept.size() + i;
+                kept.insert(kept.end(), values.begin() + global.slot, values.begin() + global.slot + global.count);
+                global.slot = std::uint32_t(slots[global.slot]);
+            }
+        }
+        global_values.swap(kept_globals);
+        constant_values.swap(kept_constants);
+    }
+
+    int program::add_string(std::string const &value) {
+        auto i = string_handles.emplace(value, int(strings.size()));
+        if (i.second)
+            strings.push_back(value);
+        return i.first->second;
+    }
+
+    int const *program::find_instance(std::string const &name) const {
+        auto i = instances.find(boost::algorithm::to_lower_copy(name));
+        if (i == instances.end())
+            return 0;
+        return &i->second;
+    }
+
+    int program::add_instance(std::string const &name, int class_index) {
+        auto i = instances.emplace(boost::algorithm::to_lower_copy(name), int(instances.size()) + 1);
+        if (i.second) {
+            instance_classes.push_back(class_index);
+            initializers.emplace_back();
+        } else if (instance_classes[i.first->second - 1] < 0) {
+            instance_classes[i.first->second - 1] = class_index;
+        }
+        return i.first->second;
+    }
+
+    void program::add_initializer_function(std::string const &name, std::size_t address) {
+        initializer_functions[address] = name;
+    }
+
+    int program::find_class(std::string const &name) const {
+        for (std::size_t i = 0; i < classes.size(); ++i) {
+            if (boost::algorithm::iequals(classes[i].name, name))
+                return int(i);
+        }
+        return -1;
+    }
+
+    int program::add_class(class_layout layout) {
+        classes.push_back(std::move(layout));
+        return int(classes.size()) - 1;
     }
 
     void program::print_variables(std::vector<int> const &stack) const {
@@ -52,14 +241,47 @@ namespace code_gen {
     void program::print_assembler() const {
         auto pc = code.begin();
 
-        std::vector<std::string> locals(variables.size());
-        typedef std::pair<std::string, int> pair;
-        for (pair const &p : variables) {
-            locals[p.second] = p.first;
+        std::vector<std::string> locals(variable_types.size());
+        for (auto const &p : variables) {
+            const std::uint32_t count = variable_counts[p.second];
+            for (std::uint32_t i = 0; i < count; ++i)
+                locals[p.second + i] = count == 1 ? p.first : p.first + "[" + boost::lexical_cast<std::string>(i) + "]";
             std::cout << "local       "
                       << p.first << ", @" << p.second << std::endl;
         }
 
+        // names are known for the locals of the last compiled function only
+        auto local_name = [&locals](int index) {
+            if (std::size_t(index) < locals.size())
+                return locals[index];
+            return "@" + boost::lexical_cast<std::string>(index);
+        };
+
+        // the global or constant a slot belongs to, name[index] for array elements
+        std::vector<std::pair<std::string, std::uint32_t>> global_at(global_values.size()), constant_at(constant_values.size());
+        for (auto const &g : globals) {
+            auto &at = g.second.constant ? constant_at : global_at;
+            for (std::uint32_t i = 0; i < g.second.count; ++i)
+                at[g.second.slot + i] = std::make_pair(g.first, g.second.count == 1 ? std::uint32_t(-1) : i);
+        }
+        auto slot_name = [](std::vector<std::pair<std::string, std::uint32_t>> const &at, int slot, bool element) {
+            if (std::size_t(slot) >= at.size())
+                return "$" + boost::lexical_cast<std::string>(slot);
+            if (!element || at[slot].second == std::uint32_t(-1))
+                return at[slot].first;
+            return at[slot].first + "[" + boost::lexical_cast<std::string>(at[slot].second) + "]";
+        };
+
+        std::vector<std::string> instance_names(instance_classes.size() + 1);
+        for (auto const &i : instances)
+            instance_names[i.second] = i.first;
+
+        std::map<std::size_t, std::string> functions_at;
+        for (auto const &f : functions)
+            functions_at[f.second.address] = f.first;
+        for (auto const &f : initializer_functions)
+            functions_at[f.first] = "init " + f.second;
+
         std::map<std::size_t, std::string> lines;
         std::set<std::size_t> jumps;
 
@@ -67,7 +289,7 @@ namespace code_gen {
             std::string line;
             std::size_t address = pc - code.begin();
 
-            switch (*pc++) {
+            switch (byte_code(*pc++)) {
                 case op_pos:
                     line += "      op_pos";
                     break;
@@ -156,14 +378,62 @@ namespace code_gen {
                     line += "      op_logical_or";
                     break;
 
+                case op_fneg:
+                    line += "      op_fneg";
+                    break;
+
+                case op_itof:
+                    line += "      op_itof";
+                    break;
+
+                case op_fadd:
+                    line += "      op_fadd";
+                    break;
+
+                case op_fsub:
+                    line += "      op_fsub";
+                    break;
+
+                case op_fmul:
+                    line += "      op_fmul";
+                    break;
+
+                case op_fdiv:
+                    line += "      op_fdiv";
+                    break;
+
+                case op_feq:
+                    line += "      op_feq";
+                    break;
+
+                case op_fneq:
+                    line += "      op_fneq";
+                    break;
+
+                case op_flt:
+                    line += "      op_flt";
+                    break;
+
+                case op_flte:
+                    line += "      op_flte";
+                    break;
+
+                case op_fgt:
+                    line += "      op_fgt";
+                    break;
+
+                case op_fgte:
+                    line += "      op_fgte";
+                    break;
+
                 case op_load:
                     line += "      op_load     ";
-                    line += boost::lexical_cast<std::string>(locals[*pc++]);
+                    line += local_name(*pc++);
                     break;
 
                 case op_store:
                     line += "      op_store    ";
-                    line += boost::lexical_cast<std::string>(locals[*pc++]);
+                    line += local_name(*pc++);
                     break;
 
                 case op_int:
@@ -171,6 +441,26 @@ namespace code_gen {
                     line += boost::lexical_cast<std::string>(*pc++);
                     break;
 
+                case op_instance: {
+                    line += "      op_instance ";
+                    const int handle = *pc++;
+                    if (handle > 0 && std::size_t(handle) < instance_names.size())
+                        line += instance_names[handle];
+                    else
+                        line += boost::lexical_cast<std::string>(handle);
+                }
+                    break;
+
+                case op_function: {
+                    line += "      op_function ";
+                    const int handle = *pc++;
+                    if (handle > 0 && std::size_t(handle) <= function_names.size())
+                        line += function_names[handle - 1];
+                    else
+                        line += boost::lexical_cast<std::string>(handle);
+                }
+                    break;
+
                 case op_jump: {
                     line += "      op_jump     ";
                     std::size_t pos = (pc - code.begin()) + *pc++;
@@ -182,6 +472,13 @@ namespace code_gen {
                 }
                     break;
 
+                case op_jump_table:
+                    line += "      op_jump_table ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
                 case op_jump_if: {
                     line += "      op_jump_if  ";
                     std::size_t pos = (pc - code.begin()) + *pc++;
@@ -197,6 +494,111 @@ namespace code_gen {
                     line += "      op_stk_adj  ";
                     line += boost::lexical_cast<std::string>(*pc++);
                     break;
+
+                case op_call:
+                    line += "      op_call     ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_return:
+                    line += "      op_return";
+                    break;
+
+                case op_pop:
+                    line += "      op_pop";
+                    break;
+
+                case op_call_external:
+                    line += "      op_call_external ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_load_field:
+                    line += "      op_load_field  +";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_store_field:
+                    line += "      op_store_field +";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_store_string_field:
+                    line += "      op_store_string_field +";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_load_global:
+                    line += "      op_load_global  ";
+                    line += slot_name(global_at, *pc++, true);
+                    break;
+
+                case op_store_global:
+                    line += "      op_store_global ";
+                    line += slot_name(global_at, *pc++, true);
+                    break;
+
+                case op_load_global_index:
+                    line += "      op_load_global_index  ";
+                    line += slot_name(global_at, *pc++, false);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_store_global_index:
+                    line += "      op_store_global_index ";
+                    line += slot_name(global_at, *pc++, false);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_load_const_index:
+                    line += "      op_load_const_index   ";
+                    line += slot_name(constant_at, *pc++, false);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_keep:
+                    line += "      op_keep";
+                    break;
+
+                case op_load_index:
+                    line += "      op_load_index  ";
+                    line += local_name(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_store_index:
+                    line += "      op_store_index ";
+                    line += local_name(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_load_field_index:
+                    line += "      op_load_field_index  +";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_store_field_index:
+                    line += "      op_store_field_index +";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
+
+                case op_clear:
+                    line += "      op_clear    ";
+                    line += local_name(*pc++);
+                    line += ", ";
+                    line += boost::lexical_cast<std::string>(*pc++);
+                    break;
             }
             lines[address] = line;
         }
@@ -204,7 +606,10 @@ namespace code_gen {
         std::cout << "start:" << std::endl;
         for (auto const &l : lines) {
             std::size_t pos = l.first;
-            if (jumps.find(pos) != jumps.end())
+            auto f = functions_at.find(pos);
+            if (f != functions_at.end())
+                std::cout << f->second << ':' << std::endl;
+            else if (jumps.find(pos) != jumps.end())
                 std::cout << pos << ':' << std::endl;
             std::cout << l.second << std::endl;
         }
@@ -212,25 +617,263 @@ namespace code_gen {
         std::cout << "end:" << std::endl;
     }
 
-    result_type compiler::operator()(unsigned int& x) {
-        program.op(op_int, x);
-        return true;
+    value_type compiler::type_of(ast::type const& x) {
+        const std::string name = boost::algorithm::to_lower_copy(x.name);
+        if (name == "int")
+            return type_int;
+        if (name == "func")
+            return type_func;
+        if (name == "float")
+            return type_float;
+        if (name == "string")
+            return type_string;
+        if (name == "void")
+            return type_void;
+        return type_instance;                           // the instance keyword or a class
     }
 
-    result_type compiler::operator()(ast::variable& x) {
-        int const *p = program.find_var(x.name);
-        if (p == 0) {
-            error_handler(x, "Undeclared variable: " + x.name);
+    namespace {
+        // largest array or class in 32-bit slots
+        constexpr unsigned max_array_size = 1u << 20;
+
+        // the argument of instance initializers, no identifier has a space
+        const char *const object_name = " object";
+
+        bool is_comparison(ast::optoken op) {
+            switch (op) {
+                case ast::op_equal:
+                case ast::op_not_equal:
+                case ast::op_less:
+                case ast::op_less_equal:
+                case ast::op_greater:
+                case ast::op_greater_equal:
+                case ast::op_logical_and:
+                case ast::op_logical_or:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // type of a binary operation, the same rules as compiler::binary
+        value_type result_of(ast::optoken op, value_type left, value_type right) {
+            if (is_comparison(op))
+                return type_int;
+            return left == type_float || right == type_float ? type_float : type_int;
+        }
+
+        // a && b && c or a || b || c, the operators of a precedence level share an expression
+        bool is_logical(ast::expression const &x) {
+            if (x.rest.empty())
+                return false;
+            const ast::optoken op = x.rest.front().operator_;
+            if (op != ast::op_logical_and && op != ast::op_logical_or)
+                return false;
+            for (ast::operation const &oper : x.rest) {
+                if (oper.operator_ != op)
+                    return false;
+            }
+            return true;
+        }
+
+        // the operand inside expressions without operators, i.e. parentheses
+        ast::operand &innermost(ast::operand &x) {
+            if (auto *e = boost::get<x3::forward_ast<ast::expression>>(&x)) {
+                if (e->get().rest.empty())
+                    return innermost(e->get().first);
+            }
+            return x;
+        }
+
+        // variables and members with the same name, e.g. the subject of every compare of a switch
+        bool same_variable(ast::operand &a, ast::operand &b) {
+            ast::operand &x = innermost(a);
+            ast::operand &y = innermost(b);
+            if (ast::variable *v = boost::get<ast::variable>(&x)) {
+                ast::variable *w = boost::get<ast::variable>(&y);
+                return w != 0 && boost::algorithm::iequals(v->name, w->name);
+            }
+            if (ast::memberAccess *m = boost::get<ast::memberAccess>(&x)) {
+                ast::memberAccess *n = boost::get<ast::memberAccess>(&y);
+                return n != 0 && boost::algorithm::iequals(m->object.name, n->object.name)
+                       && boost::algorithm::iequals(m->member.name, n->member.name);
+            }
             return false;
         }
-        program.op(op_load, *p);
-        return true;
+
+        // fewer cases stay compares in order
+        constexpr std::size_t min_switch_cases = 4;
+
+        // the int operation at compile time the way the vm computes it, false where the vm throws
+        bool fold_binary(ast::optoken op, int a, int b, int &result) {
+            switch (op) {
+                case ast::op_plus: result = int(std::uint32_t(a) + std::uint32_t(b)); return true;
+                case ast::op_minus: result = int(std::uint32_t(a) - std::uint32_t(b)); return true;
+                case ast::op_times: result = int(std::uint32_t(a) * std::uint32_t(b)); return true;
+                case ast::op_divide:
+                case ast::op_modulo:
+                    if (b == 0)
+                        return false;
+                    if (b == -1)
+                        result = op == ast::op_divide ? int(0u - std::uint32_t(a)) : 0;
+                    else
+                        result = op == ast::op_divide ? a / b : a % b;
+                    return true;
+                case ast::op_shift_left: result = int(std::uint32_t(a) << (b & 31)); return true;
+                case ast::op_shift_right: result = a >> (b & 31); return true;
+                case ast::op_equal: result = a == b; return true;
+                case ast::op_not_equal: result = a != b; return true;
+                case ast::op_less: result = a < b; return true;
+                case ast::op_less_equal: result = a <= b; return true;
+                case ast::op_greater: result = a > b; return true;
+                case ast::op_greater_equal: result = a >= b; return true;
+                case ast::op_bitwise_and: result = a & b; return true;
+                case ast::op_bitwise_xor: result = a ^ b; return true;
+                case ast::op_bitwise_or: result = a | b; return true;
+                case ast::op_logical_and: result = a && b; return true;
+                case ast::op_logical_or: result = a || b; return true;
+                default:
+                    return false;
+            }
+        }
+
+        // instances and functions are handles, they mix with ints (e.g. comparisons with Hlp_GetInstanceID)
+        bool is_handle(value_type type) {
+            return type == type_int || type == type_instance || type == type_func;
+        }
+
+        // pushes a constant, strip_unreachable follows the handles
+        int constant_op(value_type type) {
+            return type == type_instance ? op_instance : type == type_func ? op_function : op_int;
+        }
+
+        // a constant of type from stored as type to, int constants become floats
+        bool assignable(value_type from, value_type to, int &value) {
+            if (from == type_int && to == type_float) {
+                value = float_to_slot(float(value));
+                return true;
+            }
+            return from == to || (is_handle(from) && is_handle(to));
+        }
+
+        const char *type_name(value_type type) {
+            switch (type) {
+                case type_void: return "void";
+                case type_int: return "int";
+                case type_float: return "float";
+                case type_string: return "string";
+                case type_instance: return "instance";
+                case type_func: return "func";
+            }
+            return "?";
+        }
     }
 
-    result_type compiler::operator()(ast::operation& x) {
-        if (!visitDerived(x.operand_))
+    value_type compiler::type_of(ast::operand& x) {
+        // the static type of an operand without compiling it
+        field_ref ref;
+        if (field_of(x, ref, false))
+            return ref.field->type;
+        if (boost::get<float>(&x))
+            return type_float;
+        if (boost::get<std::string>(&x))
+            return type_string;
+        variable_ref slots;
+        if (ast::variable *var = boost::get<ast::variable>(&x)) {
+            if (variable_of(*var, slots))
+                return slots.type;
+            if (program.find_instance(var->name))
+                return type_instance;
+            return program.find_function(var->name) ? type_func : type_int;
+        }
+        if (auto *array = boost::get<x3::forward_ast<ast::array_access>>(&x)) {
+            ast::variable *var = boost::get<ast::variable>(&array->get().var);
+            if (var && variable_of(*var, slots))
+                return slots.type;
+            if (array_field_of(array->get(), ref, false))
+                return ref.field->type;
+        }
+        if (auto *u = boost::get<x3::forward_ast<ast::unary>>(&x)) {
+            value_type t = type_of(u->get().operand_);
+            return u->get().operator_ == ast::op_logical_not ? type_int : t;
+        }
+        if (auto *e = boost::get<x3::forward_ast<ast::expression>>(&x)) {
+            value_type t = type_of(e->get().first);
+            for (ast::operation& oper : e->get().rest)
+                t = result_of(oper.operator_, t, type_of(oper.operand_));
+            return t;
+        }
+        if (auto *call = boost::get<x3::forward_ast<ast::func_call>>(&x)) {
+            const std::string& name = call->get().var.name;
+            int index = externals ? externals->find(name) : -1;
+            if (index >= 0)
+                return (*externals)[std::size_t(index)].result;
+            program::function_info const *f = program.find_function(name);
+            return f ? f->result : type_int;
+        }
+        return type_int;
+    }
+
+    bool compiler::convert(value_type from, value_type to) {
+        if (from == to || to == type_void)
+            return true;
+        if (from == type_int && to == type_float) {
+            program.op(static_cast<int>(op_itof));
+            return true;
+        }
+        if (is_handle(from) && is_handle(to))
+            return true;
+        error_handler(position, std::string("Cannot convert ") + type_name(from) + " to " + type_name(to));
+        return false;
+    }
+
+    bool compiler::binary(ast::optoken op, value_type left, value_type right) {
+        if (left == type_string || right == type_string || left == type_void || right == type_void) {
+            error_handler(position, std::string("Invalid operands ") + type_name(left) + " and " + type_name(right));
             return false;
-        switch (x.operator_) {
+        }
+        if (left == type_float || right == type_float) {
+            // both operands are floats by now
+            switch (op) {
+                case ast::op_plus:
+                    program.op(op_fadd);
+                    break;
+                case ast::op_minus:
+                    program.op(op_fsub);
+                    break;
+                case ast::op_times:
+                    program.op(op_fmul);
+                    break;
+                case ast::op_divide:
+                    program.op(op_fdiv);
+                    break;
+                case ast::op_equal:
+                    program.op(op_feq);
+                    break;
+                case ast::op_not_equal:
+                    program.op(op_fneq);
+                    break;
+                case ast::op_less:
+                    program.op(op_flt);
+                    break;
+                case ast::op_less_equal:
+                    program.op(op_flte);
+                    break;
+                case ast::op_greater:
+                    program.op(op_fgt);
+                    break;
+                case ast::op_greater_equal:
+                    program.op(op_fgte);
+                    break;
+                default:
+                    error_handler(position, "Operator not defined for float operands");
+                    return false;
+            }
+            type = result_of(op, left, right);
+            return true;
+        }
+
+        switch (op) {
             case ast::op_plus:
                 program.op(op_add);
                 break;
@@ -293,77 +936,643 @@ namespace code_gen {
                 BOOST_ASSERT(0);
                 return false;
         }
+        type = type_int;
         return true;
     }
 
-    result_type compiler::operator()(ast::unary& x) {
-        if (!visitDerived(x.operand_))
-            return false;
-        switch (x.operator_) {
-            case ast::op_positive:
-                program.op(static_cast<int>(op_pos));
-                break;
-            case ast::op_negative:
-                program.op(static_cast<int>(op_neg));
-                break;
-            case ast::op_logical_not:
-                program.op(static_cast<int>(op_lognot));
-                break;
-            case ast::op_bitwise_not:
-                program.op(static_cast<int>(op_bitnot));
-                break;
-            default:
-                BOOST_ASSERT(0);
-                return false;
-        }
+    void compiler::track(ast::position_tagged const& x) {
+        if (x.location != ast::invalid_location)
+            position = x;
+    }
+
+    result_type compiler::operator()(unsigned int& x) {
+        program.op(op_int, x);
+        type = type_int;
         return true;
     }
 
-    result_type compiler::operator()(ast::expression& x)
-    {
-        if (!visitDerived(x.first))
-            return false;
-        for (ast::operation& oper : x.rest) {
-            if (!visitDerived(oper))
-                return false;
-        }
+    result_type compiler::operator()(float& x) {
+        program.op(op_int, float_to_slot(x));
+        type = type_float;
         return true;
     }
 
-    result_type compiler::operator()(ast::assignment& x) {
-/*        if (!visitDerived(x.rhs))
-            return false;
-        int const *p = program.find_var(x.lhs.name);
-        if (p == 0) {
-            error_handler(x.lhs, "Undeclared variable: " + x.lhs.name);
-            return false;
-        }
-        program.op(op_store, *p);
-        return true;*/
-        throw std::runtime_error("unimplemented");
-        return false;
+    result_type compiler::operator()(std::string& x) {
+        program.op(op_int, program.add_string(x));
+        type = type_string;
+        return true;
     }
 
-    result_type compiler::operator()(ast::variable_declaration& x) {
-/*        int const *p = program.find_var(x.var.name);
-        if (p != 0) {
-            error_handler(x.var, "Duplicate variable: " + x.var.name);
-            return false;
+    result_type compiler::operator()(ast::variable& x) {
+        track(x);
+        variable_ref slots;
+        if (variable_of(x, slots)) {
+            if (slots.count != 1) {
+                error_handler(x, "Array needs an index: " + x.name);
+                return false;
+            }
+            return load_variable(slots, 0);
         }
-        bool success = true;
-        if (x.rhs)
-            success = visitDerived(*x.rhs);
-        if (success) // don't add the variable if the RHS fails
-        {
-            program.add_var(x.var.name);
-            program.op(op_store, *program.find_var(x.var.name));
+        field_ref ref;
+        if (field_of(x, ref))
+            return whole_field(ref, true) && load_field(ref);
+        if (int const *instance = program.find_instance(x.name)) {
+            program.op(op_instance, *instance);
+            type = type_instance;
+            return true;
         }
-        return success;*/
-        throw std::runtime_error("unimplemented");
+        if (program::function_info const *function = program.find_function(x.name)) {
+            program.op(op_function, function->handle);
+            type = type_func;
+            return true;
+        }
+        error_handler(x, "Undeclared variable: " + x.name);
         return false;
     }
 
-    result_type compiler::operator()(ast::block& x) {
+    int compiler::class_of(ast::type const& x) const {
+        int index = program.find_class(x.name);
+        if (index >= 0)
+            return index;
+        auto prototype = prototypes.find(boost::algorithm::to_lower_copy(x.name));
+        return prototype == prototypes.end() ? -1 : program.find_class(prototype->second->baseClassName.name);
+    }
+
+    class_field const *compiler::find_member(ast::memberAccess& x, bool report) {
+        int class_index = -1;
+        if (int const *p = program.find_var(x.object.name)) {
+            class_index = program.var_class(*p);
+        } else if (program::global_info const *global = global_of(x.object.name)) {
+            class_index = global->count == 1 ? global->class_index : -1;
+        } else if (int const *instance = program.find_instance(x.object.name)) {
+            class_index = program.instance_class(*instance);
+        } else {
+            if (report)
+                error_handler(x.object, "Undeclared variable: " + x.object.name);
+            return 0;
+        }
+        if (class_index < 0) {
+            if (report)
+                error_handler(x.object, x.object.name + " is no instance of a known class");
+            return 0;
+        }
+        class_layout const &layout = program.class_at(class_index);
+        class_field const *field = layout.find(x.member.name);
+        if (field == 0 && report)
+            error_handler(x.member, "Class " + layout.name + " has no member " + x.member.name);
+        return field;
+    }
+
+    class_field const *compiler::object_member(std::string const& name) const {
+        // locals hide the members of the instance being initialized
+        if (object_class < 0 || program.find_var(name) != 0)
+            return 0;
+        return program.class_at(object_class).find(name);
+    }
+
+    bool compiler::field_of(ast::variable& x, field_ref& ref) {
+        ref = field_ref();
+        ref.field = object_member(x.name);
+        if (ref.field == 0)
+            return false;
+        track(x);
+        ref.offset = ref.field->offset;
+        return true;
+    }
+
+    bool compiler::field_of(ast::memberAccess& x, field_ref& ref, bool report) {
+        track(x.member);
+        ref = field_ref();
+        ref.object = &x.object;
+        ref.field = find_member(x, report);
+        if (ref.field == 0)
+            return false;
+        ref.offset = ref.field->offset;
+        return true;
+    }
+
+    bool compiler::array_field_of(ast::array_access& x, field_ref& ref, bool report) {
+        // the member without the index
+        ast::variable *var = boost::get<ast::variable>(&x.var);
+        ast::memberAccess *member = boost::get<ast::memberAccess>(&x.var);
+        track(x);
+        if (var)
+            track(*var);
+        if (member ? field_of(*member, ref, report) : var && field_of(*var, ref))
+            return true;
+        if (report && member == 0)
+            error_handler(position, "Unsupported array access");
+        return false;
+    }
+
+    bool compiler::field_of(ast::array_access& x, field_ref& ref, bool report) {
+        int index;
+        if (!array_field_of(x, ref, report))
+            return false;
+        if (!constant_index(x.index, index)) {
+            if (report)
+                error_handler(position, "Array index must be a constant: " + ref.field->name);
+            return false;
+        }
+        if (index < 0 || unsigned(index) >= ref.field->count) {
+            if (report)
+                error_handler(position, "Array index out of range: " + ref.field->name);
+            return false;
+        }
+        ref.offset += std::uint32_t(index) * std::uint32_t(sizeof(std::int32_t));
+        return true;
+    }
+
+    bool compiler::field_of(ast::operand& x, field_ref& ref, bool report) {
+        if (ast::variable *var = boost::get<ast::variable>(&x))
+            return field_of(*var, ref) && whole_field(ref, report);
+        if (ast::memberAccess *member = boost::get<ast::memberAccess>(&x))
+            return field_of(*member, ref, report) && whole_field(ref, report);
+        if (auto *array = boost::get<x3::forward_ast<ast::array_access>>(&x))
+            return field_of(array->get(), ref, report);
+        return false;
+    }
+
+    bool compiler::whole_field(field_ref& ref, bool report) {
+        if (ref.field->count == 1)
+            return true;
+        if (report)
+            error_handler(position, "Array member needs an index: " + ref.field->name);
+        return false;
+    }
+
+    void compiler::push_object(ast::variable* object) {
+        if (object == 0)
+            program.op(op_load, *program.find_var(object_name));
+        else if (int const *p = program.find_var(object->name))
+            program.op(op_load, *p);
+        else if (program::global_info const *global = global_of(object->name))
+            load_global(*global, 0);
+        else
+            program.op(op_instance, *program.find_instance(object->name));
+    }
+
+    program::global_info const *compiler::global_of(std::string const& name) const {
+        // locals and the members of the instance being initialized hide globals, local constants are innermost
+        if (program.find_var(name) != 0 || object_member(name) != 0)
+            return 0;
+        auto local = local_constants.find(boost::algorithm::to_lower_copy(name));
+        if (local != local_constants.end())
+            return &local->second;
+        return program.find_global(name);
+    }
+
+    program::global_info const *compiler::constant_of(std::string const& name) {
+        // a global constant declared further down is declared now, in front of the one reading it
+        program::global_info const *global = global_of(name);
+        if (global != 0 || program.find_var(name) != 0 || object_member(name) != 0)
+            return global;
+        auto pending = pending_constants.find(boost::algorithm::to_lower_copy(name));
+        if (pending == pending_constants.end() || pending->second.started)
+            return 0;
+        pending->second.started = true;
+        const ast::position_tagged reader = position;
+        const bool declared = declare_constant(*pending->second.decl);
+        position = reader;
+        return declared ? global_of(name) : 0;
+    }
+
+    bool compiler::variable_of(ast::variable const& x, variable_ref& ref) const {
+        ref = variable_ref();
+        if (int const *p = program.find_var(x.name)) {
+            ref.first = std::uint32_t(*p);
+            ref.count = program.var_count(*p);
+            ref.type = program.var_type(*p);
+            return true;
+        }
+        ref.global = global_of(x.name);
+        if (ref.global == 0)
+            return false;
+        ref.first = ref.global->slot;
+        ref.count = ref.global->count;
+        ref.type = ref.global->type;
+        return true;
+    }
+
+    bool compiler::load_global(program::global_info const& global, std::uint32_t index) {
+        // constants are known, only arrays of them indexed at run time read the constant region
+        if (global.constant)
+            program.op(constant_op(global.type), program.initial_value(global, index));
+        else
+            program.op(op_load_global, int(global.slot + index));
+        type = global.type;
+        return true;
+    }
+
+    bool compiler::load_variable(variable_ref const& ref, std::uint32_t index) {
+        if (ref.global != 0)
+            return load_global(*ref.global, index);
+        program.op(op_load, int(ref.first + index));
+        type = ref.type;
+        return true;
+    }
+
+    bool compiler::constant_index(ast::operand& x, int& index) {
+        value_type index_type;
+        return constant_value(x, index_type, index) && index_type == type_int;
+    }
+
+    bool compiler::load_element(ast::variable const& var, variable_ref const& ref, ast::operand& index) {
+        // constant indices address the slot directly, others are checked once by the vm
+        int value;
+        if (constant_index(index, value)) {
+            if (value < 0 || unsigned(value) >= ref.count) {
+                error_handler(position, "Array index out of range: " + var.name);
+                return false;
+            }
+            return load_variable(ref, unsigned(value));
+        }
+        if (!visitDerived(index) || !convert(type, type_int))
+            return false;
+        if (ref.global == 0)
+            program.op(op_load_index, int(ref.first), int(ref.count));
+        else
+            program.op(ref.global->constant ? op_load_const_index : op_load_global_index, int(ref.first), int(ref.count));
+        type = ref.type;
+        return true;
+    }
+
+    bool compiler::side_effect_free(ast::operand& x) {
+        // compiling it twice gives the same value, i.e. it calls nothing
+        ast::operand &inner = innermost(x);
+        if (auto *u = boost::get<x3::forward_ast<ast::unary>>(&inner))
+            return side_effect_free(u->get().operand_);
+        if (auto *e = boost::get<x3::forward_ast<ast::expression>>(&inner)) {
+            if (!side_effect_free(e->get().first))
+                return false;
+            for (ast::operation &oper : e->get().rest) {
+                if (!side_effect_free(oper.operand_))
+                    return false;
+            }
+            return true;
+        }
+        if (auto *array = boost::get<x3::forward_ast<ast::array_access>>(&inner))
+            return side_effect_free(array->get().index);
+        return boost::get<x3::forward_ast<ast::func_call>>(&inner) == 0;
+    }
+
+    bool compiler::load_field(field_ref const& ref) {
+        push_object(ref.object);
+        program.op(op_load_field, int(ref.offset));
+        type = ref.field->type;
+        return true;
+    }
+
+    result_type compiler::operator()(ast::memberAccess& x) {
+        field_ref ref;
+        return field_of(x, ref, true) && whole_field(ref, true) && load_field(ref);
+    }
+
+    result_type compiler::operator()(ast::array_access& x) {
+        ast::variable *var = boost::get<ast::variable>(&x.var);
+        variable_ref slots;
+        if (var && variable_of(*var, slots))
+            return load_element(*var, slots, x.index);
+        field_ref ref;
+        int index;
+        if (!constant_index(x.index, index) && array_field_of(x, ref, false)) {
+            push_object(ref.object);
+            if (!visitDerived(x.index) || !convert(type, type_int))
+                return false;
+            program.op(op_load_field_index, int(ref.offset), int(ref.field->count));
+            type = ref.field->type;
+            return true;
+        }
+        return field_of(x, ref, true) && load_field(ref);
+    }
+
+    result_type compiler::operator()(ast::operation& x) {
+        track(x);
+        value_type left = type;
+        bool floats = left == type_float || (left == type_int && type_of(x.operand_) == type_float);
+        if (floats && left == type_int)
+            program.op(static_cast<int>(op_itof));                        // int + float, the left side is on top yet
+        if (!visitDerived(x.operand_))
+            return false;
+        value_type right = type;
+        if (floats && right == type_int) {
+            program.op(static_cast<int>(op_itof));
+            right = type_float;
+        }
+        return binary(x.operator_, floats ? type_float : left, right);
+    }
+
+    result_type compiler::operator()(ast::unary& x) {
+        if (!visitDerived(x.operand_))
+            return false;
+        if (type == type_string || type == type_void) {
+            error_handler(position, std::string("Invalid operand ") + type_name(type));
+            return false;
+        }
+        if (type == type_float) {
+            switch (x.operator_) {
+                case ast::op_positive:
+                    break;
+                case ast::op_negative:
+                    program.op(static_cast<int>(op_fneg));
+                    break;
+                default:
+                    error_handler(position, "Operator not defined for float operands");
+                    return false;
+            }
+            return true;
+        }
+        switch (x.operator_) {
+            case ast::op_positive:
+                program.op(static_cast<int>(op_pos));
+                break;
+            case ast::op_negative:
+                program.op(static_cast<int>(op_neg));
+                break;
+            case ast::op_logical_not:
+                program.op(static_cast<int>(op_lognot));
+                break;
+            case ast::op_bitwise_not:
+                program.op(static_cast<int>(op_bitnot));
+                break;
+            default:
+                BOOST_ASSERT(0);
+                return false;
+        }
+        type = type_int;
+        return true;
+    }
+
+    result_type compiler::operator()(ast::expression& x)
+    {
+        track(x);
+        if (is_logical(x)) {
+            // 1 or 0 by control flow, the right operands run only if needed
+            std::vector<std::size_t> falses;
+            if (!branch(x, false, falses))
+                return false;
+            program.op(op_int, 1);
+            program.op(op_jump, 3);                     // over the op_int 0
+            patch(falses);
+            program.op(op_int, 0);
+            type = type_int;
+            return true;
+        }
+        if (!visitDerived(x.first))
+            return false;
+        for (ast::operation& oper : x.rest) {
+            if (!visitDerived(oper))
+                return false;
+        }
+        return true;
+    }
+
+    result_type compiler::operator()(ast::func_call& x) {
+        track(x);
+        int index = externals ? externals->find(x.var.name) : -1;
+        program::function_info const *f = index < 0 ? program.find_function(x.var.name) : 0;
+        if (index < 0 && f == 0) {
+            error_handler(x.var, "Undeclared function: " + x.var.name);
+            return false;
+        }
+        std::vector<value_type> const &parameters = index < 0 ? f->parameters : (*externals)[std::size_t(index)].parameters;
+        if (x.args.size() != parameters.size()) {
+            error_handler(x, "Function " + x.var.name + " expects " + std::to_string(parameters.size())
+                             + " arguments, got " + std::to_string(x.args.size()));
+            return false;
+        }
+        auto parameter = parameters.begin();
+        for (ast::operand& arg : x.args) {
+            if (!visitDerived(arg) || !convert(type, *parameter++))
+                return false;
+        }
+        if (index >= 0) {
+            program.op(op_call_external, index);
+            type = (*externals)[std::size_t(index)].result;
+        } else {
+            program.op(op_call, int(parameters.size()), 0); // the address is filled in once all functions are compiled
+            calls.emplace_back(program.size() - 1, x.var.name);
+            type = f->result;
+        }
+        return true;
+    }
+
+    bool compiler::compound(ast::optoken op, value_type target) {
+        // x += y is x = x + y, the old value is below the right hand side
+        switch (op) {
+            case ast::op_assign:
+                return true;
+            case ast::op_assign_plus:
+                return binary(ast::op_plus, target, target);
+            case ast::op_assign_minus:
+                return binary(ast::op_minus, target, target);
+            case ast::op_assign_times:
+                return binary(ast::op_times, target, target);
+            case ast::op_assign_divide:
+                return binary(ast::op_divide, target, target);
+            case ast::op_assign_modulo:
+                return binary(ast::op_modulo, target, target);
+            default:
+                BOOST_ASSERT(0);
+                return false;
+        }
+    }
+
+    bool compiler::store_element(ast::variable const& var, variable_ref const& ref, ast::operand* index,
+                                 ast::assignment& x) {
+        if (ref.global != 0 && ref.global->constant) {
+            error_handler(var, "Cannot assign to constant: " + var.name);
+            return false;
+        }
+        std::uint32_t element = 0;
+        bool indexed = false;           // at run time
+        if (index == 0) {
+            if (ref.count != 1) {
+                error_handler(var, "Array needs an index: " + var.name);
+                return false;
+            }
+        } else {
+            int value;
+            if (constant_index(*index, value)) {
+                if (value < 0 || unsigned(value) >= ref.count) {
+                    error_handler(position, "Array index out of range: " + var.name);
+                    return false;
+                }
+                element = unsigned(value);
+            } else {
+                // the index stays below the value for the store, x[i] += y loads the element with a second copy
+                indexed = true;
+                const int copies = x.operator_ == ast::op_assign ? 1 : 2;
+                if (copies == 2 && !side_effect_free(*index)) {
+                    error_handler(position, "Compound assignment needs an index without calls: " + var.name);
+                    return false;
+                }
+                for (int i = 0; i < copies; ++i) {
+                    if (!visitDerived(*index) || !convert(type, type_int))
+                        return false;
+                }
+            }
+        }
+        const bool global = ref.global != 0;
+        if (x.operator_ != ast::op_assign) {
+            if (indexed)
+                program.op(global ? op_load_global_index : op_load_index, int(ref.first), int(ref.count));
+            else
+                program.op(global ? op_load_global : op_load, int(ref.first + element));
+        }
+        if (!visitDerived(x.rhs) || !convert(type, ref.type) || !compound(x.operator_, ref.type))
+            return false;
+        if (global && ref.type == type_string)
+            program.op(op_keep);        // strings stored in globals outlive the call
+        if (indexed)
+            program.op(global ? op_store_global_index : op_store_index, int(ref.first), int(ref.count));
+        else
+            program.op(global ? op_store_global : op_store, int(ref.first + element));
+        return true;
+    }
+
+    bool compiler::store_field_element(field_ref const& ref, ast::operand& index, ast::assignment& x) {
+        // instance and index stay below the value for the store, x.a[i] += y loads the element with second copies
+        const int copies = x.operator_ == ast::op_assign ? 1 : 2;
+        if (copies == 2 && !side_effect_free(index)) {
+            error_handler(position, "Compound assignment needs an index without calls: " + ref.field->name);
+            return false;
+        }
+        for (int i = 0; i < copies; ++i) {
+            push_object(ref.object);
+            if (!visitDerived(index) || !convert(type, type_int))
+                return false;
+        }
+        if (x.operator_ != ast::op_assign)
+            program.op(op_load_field_index, int(ref.offset), int(ref.field->count));
+        if (!visitDerived(x.rhs) || !convert(type, ref.field->type) || !compound(x.operator_, ref.field->type))
+            return false;
+        if (ref.field->type == type_string)
+            program.op(op_keep);
+        program.op(op_store_field_index, int(ref.offset), int(ref.field->count));
+        return true;
+    }
+
+    result_type compiler::operator()(ast::assignment& x) {
+        track(x);
+        field_ref ref;
+        variable_ref slots;
+        if (auto *array = boost::get<x3::forward_ast<ast::array_access>>(&x.lhs)) {
+            ast::variable *var = boost::get<ast::variable>(&array->get().var);
+            if (var && variable_of(*var, slots))
+                return store_element(*var, slots, &array->get().index, x);
+            int index;
+            if (!constant_index(array->get().index, index) && array_field_of(array->get(), ref, false))
+                return store_field_element(ref, array->get().index, x);
+        }
+        ast::variable *lhs = boost::get<ast::variable>(&x.lhs);
+        if (lhs ? field_of(*lhs, ref) : field_of(x.lhs, ref, true)) {
+            if (lhs && !whole_field(ref, true))
+                return false;
+            push_object(ref.object);
+            if (x.operator_ != ast::op_assign) {
+                push_object(ref.object);
+                program.op(op_load_field, int(ref.offset));
+            }
+            if (!visitDerived(x.rhs) || !convert(type, ref.field->type) || !compound(x.operator_, ref.field->type))
+                return false;
+            // strings stored in objects outlive the call
+            program.op(ref.field->type == type_string ? op_store_string_field : op_store_field, int(ref.offset));
+            return true;
+        }
+        if (lhs == 0) {
+            if (boost::get<ast::memberAccess>(&x.lhs) == 0 && boost::get<x3::forward_ast<ast::array_access>>(&x.lhs) == 0)
+                error_handler(x, "Unsupported assignment target");
+            return false;
+        }
+        if (!variable_of(*lhs, slots)) {
+            error_handler(*lhs, "Undeclared variable: " + lhs->name);
+            return false;
+        }
+        return store_element(*lhs, slots, 0, x);
+    }
+
+    bool compiler::declare_local(ast::variable const &var, value_type type, int class_index, std::uint32_t count) {
+        if (program.find_var(var.name) != 0 || local_constants.count(boost::algorithm::to_lower_copy(var.name))) {
+            error_handler(var, "Duplicate variable: " + var.name);
+            return false;
+        }
+        program.add_var(var.name, type, class_index, count);
+        return true;
+    }
+
+    result_type compiler::operator()(ast::variable_declaration& x) {
+        ast::variable const &var = x.typed_var_.var;
+        const value_type declared = type_of(x.typed_var_.type_);
+        value_type constant_type;
+        int value;
+        if (x.typed_var_.isConst && x.rhs && constant_value(*x.rhs, constant_type, value))
+            return declare_global(x.typed_var_, 1, {&*x.rhs}, true);    // no code, uses fold to its value
+        if (x.rhs) {
+            if (!visitDerived(*x.rhs) || !convert(type, declared))
+                return false;
+        } else {
+            program.op(op_int, 0);                      // locals start out as 0, 0.0, "" or no instance
+        }
+        if (!declare_local(var, declared, class_of(x.typed_var_.type_)))  // don't add the variable if the RHS fails
+            return false;
+        program.op(op_store, *program.find_var(var.name));
+        return true;
+    }
+
+    result_type compiler::operator()(ast::multi_variable_declaration& x) {
+        const value_type declared = type_of(x.type_);
+        for (ast::variable const &var : x.vars) {
+            if (!declare_local(var, declared, class_of(x.type_)))
+                return false;
+            program.op(op_int, 0);
+            program.op(op_store, *program.find_var(var.name));
+        }
+        return true;
+    }
+
+    result_type compiler::operator()(ast::array_declaration& x) {
+        ast::variable const &var = x.typed_var_.var;
+        std::vector<ast::operand*> values;
+        if (x.rhs) {
+            for (ast::operand &value : *x.rhs)
+                values.push_back(&value);
+        }
+        std::uint32_t count;
+        if (!constant_size(x.size, count))
+            return false;
+        // constant tables are data of the program, not stores run by every call
+        if (x.typed_var_.isConst)
+            return declare_global(x.typed_var_, count, values, true);
+        if (values.size() > count) {
+            error_handler(var, "Too many values for " + var.name);
+            return false;
+        }
+        const value_type declared = type_of(x.typed_var_.type_);
+        if (!declare_local(var, declared, class_of(x.typed_var_.type_), count))
+            return false;
+        const int first = *program.find_var(var.name);
+        program.op(op_clear, first, int(count));
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            if (!visitDerived(*values[i]) || !convert(type, declared))
+                return false;
+            program.op(op_store, first + int(i));
+        }
+        return true;
+    }
+
+    result_type compiler::operator()(ast::statement& x) {
+        // a value computed as statement, i.e. a call, is discarded
+        if (ast::operand *value = boost::get<ast::operand>(&x)) {
+            if (!visitDerived(*value))
+                return false;
+            program.op(op_pop);
+            return true;
+        }
+        return visitBase(x);
+    }
+
+    result_type compiler::operator()(ast::block& x) {
         for (auto& s : x) {
             if (!visitDerived(s))
                 return false;
@@ -371,53 +1580,789 @@ namespace code_gen {
         return true;
     }
 
-    result_type compiler::operator()(ast::if_statement& x) {
-/*        if (!visitDerived(x.condition))
+    bool compiler::switch_cases(ast::operand& condition, std::size_t block, ast::operand*& subject,
+                                std::vector<switch_case>& cases) {
+        auto *e = boost::get<x3::forward_ast<ast::expression>>(&innermost(condition));
+        if (e == 0)
+            return false;
+        ast::expression &compare = e->get();
+        if (is_logical(compare) && compare.rest.front().operator_ == ast::op_logical_or) {
+            // x == 1 || x == 2, one block for both
+            if (!switch_cases(compare.first, block, subject, cases))
+                return false;
+            for (ast::operation &oper : compare.rest) {
+                if (!switch_cases(oper.operand_, block, subject, cases))
+                    return false;
+            }
+            return true;
+        }
+        if (compare.rest.size() != 1 || compare.rest.front().operator_ != ast::op_equal)
             return false;
-        program.op(op_jump_if, 0);                      // we shall fill this (0) in later
-        std::size_t skip = program.size() - 1;            // mark its position
-        if (!visitDerived(x.then))
+        switch_case c{0, type_int, block};
+        ast::operand *variable = &compare.first;
+        if (!constant_value(compare.rest.front().operand_, c.type, c.value)) {
+            variable = &compare.rest.front().operand_;
+            if (!constant_value(compare.first, c.type, c.value))
+                return false;
+        }
+        if (!is_handle(c.type))
             return false;
-        program[skip] = int(program.size() - skip);       // now we know where to jump to (after the if branch)
+        if (subject == 0) {
+            value_type type = type_of(*variable);
+            if (!is_handle(type) || !side_effect_free(*variable))
+                return false;
+            subject = variable;
+        } else if (!same_variable(*subject, *variable)) {
+            return false;
+        }
+        cases.push_back(c);
+        return true;
+    }
 
-        if (x.else_)                                    // We got an alse
-        {
-            program[skip] += 2;                         // adjust for the "else" jump
-            program.op(op_jump, 0);                     // we shall fill this (0) in later
-            std::size_t exit = program.size() - 1;        // mark its position
-            if (!visitDerived(*x.else_))
+    bool compiler::search_cases(ast::operand& subject, std::vector<switch_case> const& cases, std::size_t first,
+                                std::size_t last, std::vector<std::vector<std::size_t>>& entries,
+                                std::vector<std::size_t>& others) {
+        if (last - first < min_switch_cases) {
+            for (std::size_t i = first; i < last; ++i) {
+                if (!visitDerived(subject) || !convert(type, type_int))
+                    return false;
+                program.op(constant_op(cases[i].type), cases[i].value);
+                program.op(op_neq);
+                program.op(op_jump_if, 0);              // not unequal: the block
+                entries[cases[i].block].push_back(program.size() - 1);
+            }
+            program.op(op_jump, 0);
+            others.push_back(program.size() - 1);
+            return true;
+        }
+        // the lower half falls through, the upper half is behind it
+        const std::size_t middle = first + (last - first) / 2;
+        if (!visitDerived(subject) || !convert(type, type_int))
+            return false;
+        program.op(constant_op(cases[middle].type), cases[middle].value);
+        program.op(op_lt);
+        program.op(op_jump_if, 0);
+        std::size_t upper = program.size() - 1;
+        if (!search_cases(subject, cases, first, middle, entries, others))
+            return false;
+        program[upper] = int(program.size() - upper);
+        return search_cases(subject, cases, middle, last, entries, others);
+    }
+
+    bool compiler::switch_statement(ast::if_statement& x, ast::operand& subject, std::vector<switch_case> const& cases) {
+        std::vector<std::vector<std::size_t>> entries(x.condition_blocks.size());
+        std::vector<std::size_t> others;                // to the else or behind the if
+        const long long lowest = cases.front().value;
+        const long long range = (long long)(cases.back().value) - lowest + 1;
+        if (range <= 2 * (long long)(cases.size())) {
+            // at least every other value has a block, the table takes one op_jump per value
+            if (!visitDerived(subject) || !convert(type, type_int))
+                return false;
+            program.op(op_jump_table, int(lowest), int(range));
+            auto c = cases.begin();
+            for (long long value = lowest; value < lowest + range; ++value) {
+                program.op(op_jump, 0);
+                (c->value == value ? entries[(c++)->block] : others).push_back(program.size() - 1);
+            }
+            program.op(op_jump, 0);
+            others.push_back(program.size() - 1);
+        } else if (!search_cases(subject, cases, 0, cases.size(), entries, others)) {
+            return false;
+        }
+
+        std::vector<std::size_t> exits;
+        std::size_t block = 0;
+        for (ast::condition_block& b : x.condition_blocks) {
+            patch(entries[block]);
+            if (!visitDerived(b.then))
                 return false;
-            program[exit] = int(program.size() - exit);   // now we know where to jump to (after the else branch)
-        }*/
-        throw std::runtime_error("unimplemented");
+            if (++block < x.condition_blocks.size() || x.else_) {
+                program.op(op_jump, 0);                 // leave the if after the branch
+                exits.push_back(program.size() - 1);
+            }
+        }
+        patch(others);
+        if (x.else_ && !visitDerived(*x.else_))
+            return false;
+        patch(exits);
+        return true;
+    }
+
+    result_type compiler::operator()(ast::if_statement& x) {
+        ast::operand *subject = 0;
+        std::vector<switch_case> cases;
+        bool chain = x.condition_blocks.size() > 1;
+        std::size_t block = 0;
+        for (auto b = x.condition_blocks.begin(); chain && b != x.condition_blocks.end(); ++b)
+            chain = switch_cases(b->condition, block++, subject, cases);
+        if (chain) {
+            // the first block with a value takes it, like the compares in order
+            std::stable_sort(cases.begin(), cases.end(),
+                             [](switch_case const &a, switch_case const &b) { return a.value < b.value; });
+            cases.erase(std::unique(cases.begin(), cases.end(),
+                                    [](switch_case const &a, switch_case const &b) { return a.value == b.value; }),
+                        cases.end());
+            if (cases.size() >= min_switch_cases)
+                return switch_statement(x, *subject, cases);
+        }
+
+        std::vector<std::size_t> exits;
+        std::size_t remaining = x.condition_blocks.size();
+        for (ast::condition_block& block : x.condition_blocks) {
+            std::vector<std::size_t> skips;             // we shall fill these in later
+            if (!branch(block.condition, false, skips))
+                return false;
+            if (!visitDerived(block.then))
+                return false;
+            if (--remaining > 0 || x.else_) {
+                program.op(op_jump, 0);                 // leave the if after the branch
+                exits.push_back(program.size() - 1);
+            }
+            patch(skips);                               // now we know where to jump to (the next condition)
+        }
+        if (x.else_ && !visitDerived(*x.else_))
+            return false;
+        for (std::size_t exit : exits)
+            program[exit] = int(program.size() - exit);
         return true;
     }
 
     result_type compiler::operator()(ast::while_statement& x) {
         std::size_t loop = program.size();              // mark our position
-        if (!visitDerived(x.condition))
+        std::vector<std::size_t> exits;                 // we shall fill these in later
+        if (!branch(x.condition, false, exits))
             return false;
-        program.op(op_jump_if, 0);                      // we shall fill this (0) in later
-        std::size_t exit = program.size() - 1;            // mark its position
         if (!visitDerived(x.body))
             return false;
         program.op(op_jump,
                    int(loop - 1) - int(program.size()));         // loop back
-        program[exit] = int(program.size() - exit);       // now we know where to jump to (to exit the loop)
+        patch(exits);                                   // now we know where to jump to (to exit the loop)
         return true;
     }
 
-    result_type compiler::compile(ast::program& x) {
-        program.clear();
+    bool compiler::branch(ast::operand& x, bool when, std::vector<std::size_t>& jumps) {
+        ast::operand &inner = innermost(x);
+        if (auto *u = boost::get<x3::forward_ast<ast::unary>>(&inner)) {
+            if (u->get().operator_ == ast::op_logical_not)
+                return branch(u->get().operand_, !when, jumps);
+        }
+        if (auto *e = boost::get<x3::forward_ast<ast::expression>>(&inner)) {
+            if (is_logical(e->get()))
+                return branch(e->get(), when, jumps);
+        }
+        value_type constant_type;
+        int value;
+        if (constant_value(inner, constant_type, value) && constant_type == type_int) {
+            // e.g. a constant debug switch, the other branch is left behind
+            if ((value != 0) == when) {
+                program.op(op_jump, 0);
+                jumps.push_back(program.size() - 1);
+            }
+            return true;
+        }
+        if (!visitDerived(inner) || !convert(type, type_int))
+            return false;
+        if (when)
+            program.op(static_cast<int>(op_lognot));   // op_jump_if jumps on false
+        program.op(op_jump_if, 0);
+        jumps.push_back(program.size() - 1);
+        return true;
+    }
+
+    bool compiler::branch(ast::expression& x, bool when, std::vector<std::size_t>& jumps) {
+        track(x);
+        // the value that decides the whole expression as soon as one operand has it
+        const bool decisive = x.rest.front().operator_ == ast::op_logical_or;
+        std::vector<std::size_t> decided;
+        std::vector<ast::operand*> operands{&x.first};
+        for (ast::operation &oper : x.rest)
+            operands.push_back(&oper.operand_);
+        for (std::size_t i = 0; i < operands.size(); ++i) {
+            // the last operand decides alone, the others only when decisive
+            const bool last = i + 1 == operands.size();
+            if (!branch(*operands[i], last ? when : decisive, last || when == decisive ? jumps : decided))
+                return false;
+        }
+        patch(decided);
+        return true;
+    }
+
+    void compiler::patch(std::vector<std::size_t> const& jumps) {
+        for (std::size_t jump : jumps)
+            program[jump] = int(program.size() - jump);
+    }
+
+    result_type compiler::operator()(ast::return_statement& x) {
+        if (x.operand_) {
+            if (!visitDerived(*x.operand_) || !convert(type, result))
+                return false;
+        } else {
+            program.op(op_int, 0);                      // every call leaves a value on the stack
+        }
+        program.op(op_return);
+        return true;
+    }
+
+    result_type compiler::operator()(ast::function& x) {
+        program::function_info *f = program.find_function(x.name.name);
+        if (f == 0) {
+            std::vector<value_type> parameters;
+            for (ast::typed_var const &param : x.params)
+                parameters.push_back(type_of(param.type_));
+            f = &program.add_function(x.name.name, type_of(x.returnType), std::move(parameters));
+        }
+        f->address = program.size();
+        result = f->result;
+        track(x.name);
+        program.clear_vars();
+        scope = x.name.name;
+        local_constants.clear();
+        for (ast::typed_var const &param : x.params) {
+            if (!declare_local(param.var, type_of(param.type_), class_of(param.type_)))
+                return false;
+        }
         // op_stk_adj 0 for now. we'll know how many variables we'll have later
         program.op(op_stk_adj, 0);
+        std::size_t frame = program.size() - 1;
+        if (!visitDerived(x.body))
+            return false;
+        program.op(op_int, 0);                          // running off the end returns 0
+        program.op(op_return);
+        program[frame] = int(program.nvars());          // now store the actual number of variables
+        return true;
+    }
 
-        if (!visitDerived(x)) {
-            program.clear();
+    bool compiler::constant_size(ast::operand& x, std::uint32_t& size) {
+        if (ast::variable *var = boost::get<ast::variable>(&innermost(x)))
+            track(*var);
+        value_type type;
+        int value;
+        if (!constant_value(x, type, value) || type != type_int || value <= 0 || unsigned(value) > max_array_size) {
+            error_handler(position, "Array size must be a constant between 1 and " + std::to_string(max_array_size));
             return false;
         }
-        program[1] = int(program.nvars());              // now store the actual number of variables
+        size = unsigned(value);
         return true;
     }
-}
 
+    bool compiler::declare_global(ast::typed_var const& var, std::uint32_t count, std::vector<ast::operand*> const& values,
+                                  bool local) {
+        // local constants are globals of their scope, the scope qualifies their name
+        ast::variable const &name = var.var;
+        track(name);
+        const std::string key = boost::algorithm::to_lower_copy(name.name);
+        if (local ? program.find_var(name.name) != 0 || local_constants.count(key) != 0 : program.find_global(name.name) != 0) {
+            error_handler(name, "Duplicate variable: " + name.name);
+            return false;
+        }
+        if (var.isConst && values.empty()) {
+            error_handler(name, "Constant without a value: " + name.name);
+            return false;
+        }
+        if (values.size() > count) {
+            error_handler(name, "Too many values for " + name.name);
+            return false;
+        }
+        // the values are known before the program runs, they are the initial contents of the slots
+        const value_type type = type_of(var.type_);
+        std::vector<int> initial;
+        for (ast::operand *value : values) {
+            value_type from;
+            int slot;
+            if (!constant_value(*value, from, slot)) {
+                error_handler(position, "Value of " + name.name + " must be constant");
+                return false;
+            }
+            if (!assignable(from, type, slot)) {
+                error_handler(position, std::string("Cannot convert ") + type_name(from) + " to " + type_name(type));
+                return false;
+            }
+            initial.push_back(slot);
+        }
+        program::global_info const &global = program.add_global(local ? scope + "." + name.name : name.name,
+                                                                type, count, var.isConst, class_of(var.type_));
+        for (std::size_t i = 0; i < initial.size(); ++i)
+            program.initial_value(global, std::uint32_t(i)) = initial[i];
+        if (local)
+            local_constants[key] = global;
+        return true;
+    }
+
+    bool compiler::declare_array(ast::array_declaration& x) {
+        std::vector<ast::operand*> values;
+        if (x.rhs) {
+            for (ast::operand &value : *x.rhs)
+                values.push_back(&value);
+        }
+        std::uint32_t count;
+        return constant_size(x.size, count) && declare_global(x.typed_var_, count, values);
+    }
+
+    bool compiler::declare_constant(ast::global_decl& x) {
+        if (ast::variable_declaration *var = boost::get<ast::variable_declaration>(&x))
+            return declare_global(var->typed_var_, 1, var->rhs ? std::vector<ast::operand*>{&*var->rhs}
+                                                                : std::vector<ast::operand*>());
+        return declare_array(boost::get<ast::array_declaration>(x));
+    }
+
+    bool compiler::declare_class(ast::extern_class& x) {
+        track(x.name);
+        if (program.find_class(x.name.name) >= 0) {
+            error_handler(x.name, "Duplicate class: " + x.name.name);
+            return false;
+        }
+        // members are laid out in order, every element is a 32-bit slot
+        class_layout layout;
+        layout.name = x.name.name;
+        auto add = [&](ast::variable const &var, value_type type, std::uint32_t count) {
+            if (layout.find(var.name)) {
+                error_handler(var, "Duplicate member: " + var.name);
+                return false;
+            }
+            if (layout.size + std::uint64_t(count) * sizeof(std::int32_t) > std::uint64_t(max_array_size) * sizeof(std::int32_t)) {
+                error_handler(var, "Class is too large: " + x.name.name);
+                return false;
+            }
+            layout.fields.push_back(class_field{var.name, type, layout.size, count});
+            layout.size += count * std::uint32_t(sizeof(std::int32_t));
+            return true;
+        };
+        for (ast::statement& member : x.body) {
+            if (ast::multi_variable_declaration *vars = boost::get<ast::multi_variable_declaration>(&member)) {
+                for (ast::variable const &var : vars->vars) {
+                    if (!add(var, type_of(vars->type_), 1))
+                        return false;
+                }
+            } else if (ast::array_declaration *array = boost::get<ast::array_declaration>(&member)) {
+                std::uint32_t count;
+                if (!constant_size(array->size, count) || !add(array->typed_var_.var, type_of(array->typed_var_.type_), count))
+                    return false;
+            } else {
+                error_handler(x.name, "Unsupported member in class " + x.name.name);
+                return false;
+            }
+        }
+
+        // a class of the host keeps the offsets of its struct
+        if (class_layout const *host = classes ? classes->find(x.name.name) : 0) {
+            for (class_field &field : layout.fields) {
+                class_field const *bound = host->find(field.name);
+                if (bound == 0 || bound->type != field.type || bound->count != field.count) {
+                    error_handler(x.name, "Member " + field.name + " of class " + x.name.name
+                                          + " doesn't match the host layout");
+                    return false;
+                }
+                field.offset = bound->offset;
+            }
+            layout.size = host->size;
+        }
+        program.add_class(std::move(layout));
+        return true;
+    }
+
+    bool compiler::constant_value(ast::operand& x, value_type& type, int& value) {
+        // members of the instance being initialized are known while only constants were written to them
+        ast::operand &inner = innermost(x);
+        if (unsigned *literal = boost::get<unsigned>(&inner)) {
+            type = type_int;
+            value = int(*literal);
+            return true;
+        }
+        if (float *literal = boost::get<float>(&inner)) {
+            type = type_float;
+            value = float_to_slot(*literal);
+            return true;
+        }
+        if (std::string *literal = boost::get<std::string>(&inner)) {
+            type = type_string;
+            value = program.add_string(*literal);
+            return true;
+        }
+        field_ref ref;
+        if (init != 0 && field_of(inner, ref, false)) {
+            const std::size_t slot = ref.offset / sizeof(std::int32_t);
+            if (ref.object != 0 || init->opaque || init->touched[slot])
+                return false;
+            type = ref.field->type;
+            value = init->image[slot];
+            return true;
+        }
+        if (ast::variable *var = boost::get<ast::variable>(&inner)) {
+            if (program.find_var(var->name) != 0 || object_member(var->name) != 0)
+                return false;
+            if (program::global_info const *global = constant_of(var->name)) {
+                if (!global->constant || global->count != 1)
+                    return false;
+                type = global->type;
+                value = program.initial_value(*global, 0);
+                return true;
+            }
+            if (int const *instance = program.find_instance(var->name)) {
+                type = type_instance;
+                value = *instance;
+                return true;
+            }
+            if (program::function_info const *function = program.find_function(var->name)) {
+                type = type_func;
+                value = function->handle;
+                return true;
+            }
+            return false;
+        }
+        if (auto *array = boost::get<x3::forward_ast<ast::array_access>>(&inner)) {
+            // elements of constant arrays at constant indices
+            ast::variable *var = boost::get<ast::variable>(&array->get().var);
+            program::global_info const *global = var ? constant_of(var->name) : 0;
+            value_type index_type;
+            int index;
+            if (global == 0 || !global->constant || !constant_value(array->get().index, index_type, index)
+                    || index_type != type_int || index < 0 || unsigned(index) >= global->count)
+                return false;
+            type = global->type;
+            value = program.initial_value(*global, unsigned(index));
+            return true;
+        }
+        if (auto *u = boost::get<x3::forward_ast<ast::unary>>(&inner)) {
+            if (!constant_value(u->get().operand_, type, value))
+                return false;
+            const ast::optoken op = u->get().operator_;
+            if (type == type_float && (op == ast::op_positive || op == ast::op_negative)) {
+                if (op == ast::op_negative)
+                    value = float_to_slot(-slot_to_float(value));
+                return true;
+            }
+            if (type != type_int)
+                return false;
+            switch (op) {
+                case ast::op_positive: break;
+                case ast::op_negative: value = int(0u - std::uint32_t(value)); break;
+                case ast::op_logical_not: value = !value; break;
+                case ast::op_bitwise_not: value = ~value; break;
+                default: return false;
+            }
+            return true;
+        }
+        if (auto *e = boost::get<x3::forward_ast<ast::expression>>(&inner)) {
+            if (!constant_value(e->get().first, type, value) || type != type_int)
+                return false;
+            for (ast::operation &oper : e->get().rest) {
+                value_type right_type;
+                int right;
+                if (!constant_value(oper.operand_, right_type, right) || right_type != type_int
+                        || !fold_binary(oper.operator_, value, right, value))
+                    return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool compiler::simple_reads(ast::operand& x, std::vector<std::uint32_t>& slots) {
+        // the members of the instance being initialized that x reads, false if x may read others or call
+        ast::operand &inner = innermost(x);
+        if (boost::get<unsigned>(&inner) || boost::get<float>(&inner) || boost::get<std::string>(&inner))
+            return true;
+        field_ref ref;
+        if (field_of(inner, ref, false)) {
+            if (ref.object != 0)
+                return false;
+            slots.push_back(ref.offset / sizeof(std::int32_t));
+            return true;
+        }
+        if (boost::get<ast::variable>(&inner))
+            return true;        // locals, globals and instance handles
+        if (auto *array = boost::get<x3::forward_ast<ast::array_access>>(&inner)) {
+            ast::variable *var = boost::get<ast::variable>(&array->get().var);
+            variable_ref array_slots;
+            return var && variable_of(*var, array_slots) && simple_reads(array->get().index, slots);
+        }
+        if (auto *u = boost::get<x3::forward_ast<ast::unary>>(&inner))
+            return simple_reads(u->get().operand_, slots);
+        if (auto *e = boost::get<x3::forward_ast<ast::expression>>(&inner)) {
+            if (!simple_reads(e->get().first, slots))
+                return false;
+            for (ast::operation &oper : e->get().rest) {
+                if (!simple_reads(oper.operand_, slots))
+                    return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool compiler::fold(ast::statement& x) {
+        // a constant written to a member goes to the image, which is copied before the initializer runs.
+        // that's only the same if no code before reads or writes the member
+        ast::assignment *assignment = boost::get<ast::assignment>(&x);
+        field_ref ref;
+        if (assignment == 0 || assignment->operator_ != ast::op_assign || init->opaque
+                || !field_of(assignment->lhs, ref, false) || ref.object != 0)
+            return false;
+        const std::size_t slot = ref.offset / sizeof(std::int32_t);
+        value_type type;
+        int value;
+        if (init->touched[slot] || !constant_value(assignment->rhs, type, value))
+            return false;
+        if (!assignable(type, ref.field->type, value))
+            return false;       // compiling the assignment reports it
+        init->image[slot] = value;
+        return true;
+    }
+
+    void compiler::note_residue(ast::statement& x) {
+        std::vector<std::uint32_t> slots;
+        field_ref ref;
+        ast::operand *value = 0;
+        if (ast::assignment *assignment = boost::get<ast::assignment>(&x)) {
+            value = &assignment->rhs;
+            if (field_of(assignment->lhs, ref, false) && ref.object == 0)
+                slots.push_back(ref.offset / sizeof(std::int32_t));
+            else if (boost::get<ast::variable>(&assignment->lhs) == 0)
+                value = 0;      // a member of another instance, which may be this one
+        } else if (ast::variable_declaration *var = boost::get<ast::variable_declaration>(&x)) {
+            if (var->rhs)
+                value = &*var->rhs;
+        }
+        if (value == 0 || !simple_reads(*value, slots)) {
+            init->opaque = true;
+            return;
+        }
+        for (std::uint32_t slot : slots)
+            init->touched[slot] = true;
+    }
+
+    bool compiler::compile_initializer(ast::variable const& name, int class_index, init_state& state, ast::block& body) {
+        track(name);
+        const std::size_t start = program.size();
+        program.clear_vars();
+        scope = name.name;
+        local_constants.clear();
+        program.add_var(object_name, type_instance, class_index);
+        program.op(op_stk_adj, 0);
+        std::size_t frame = program.size() - 1;
+        if (state.code != instance_init::no_initializer) {
+            // the rest of the prototype first
+            program.op(op_load, 0);
+            program.op(op_call, 1, int(state.code));
+            program.op(op_pop);
+        }
+        const std::size_t residue = program.size();
+
+        object_class = class_index;
+        init = &state;
+        result = type_void;
+        bool ok = true;
+        for (ast::statement &statement : body) {
+            if (fold(statement))
+                continue;
+            if (!visitDerived(statement)) {
+                ok = false;
+                break;
+            }
+            note_residue(statement);
+        }
+        object_class = -1;
+        init = 0;
+        if (!ok)
+            return false;
+
+        if (program.size() == residue) {
+            program.truncate(start);        // everything folded, the prototype's initializer does if any
+            return true;
+        }
+        program.op(op_int, 0);
+        program.op(op_return);
+        program[frame] = int(program.nvars());
+        program.add_initializer_function(name.name, start);
+        state.code = start;
+        return true;
+    }
+
+    compiler::init_state const *compiler::prototype_state(ast::prototype& x) {
+        const std::string name = boost::algorithm::to_lower_copy(x.name.name);
+        auto cached = prototype_inits.find(name);
+        if (cached != prototype_inits.end())
+            return &cached->second;
+        int class_index = program.find_class(x.baseClassName.name);
+        if (class_index < 0) {
+            error_handler(x.baseClassName, "Unknown class of prototype " + x.name.name);
+            return 0;
+        }
+        init_state state;
+        std::size_t slots = (program.class_at(class_index).size + sizeof(std::int32_t) - 1) / sizeof(std::int32_t);
+        state.image.assign(slots, 0);
+        state.touched.assign(slots, false);
+        if (!compile_initializer(x.name, class_index, state, x.body))
+            return 0;
+        return &(prototype_inits[name] = std::move(state));
+    }
+
+    bool compiler::initialize(ast::instance& x) {
+        // the prototype body and then the instance body, as one image and one initializer
+        const int handle = *program.find_instance(x.name.name);
+        const int class_index = program.instance_class(handle);
+        auto prototype = prototypes.find(boost::algorithm::to_lower_copy(x.type_.name));
+        if (class_index < 0) {
+            if (x.body.empty() && prototype == prototypes.end())
+                return true;
+            error_handler(x.type_, "Unknown class of instance " + x.name.name);
+            return false;
+        }
+        class_layout const &layout = program.class_at(class_index);
+
+        init_state state;
+        if (prototype != prototypes.end()) {
+            init_state const *base = prototype_state(*prototype->second);
+            if (base == 0)
+                return false;
+            state = *base;
+        } else {
+            std::size_t slots = (layout.size + sizeof(std::int32_t) - 1) / sizeof(std::int32_t);
+            state.image.assign(slots, 0);
+            state.touched.assign(slots, false);
+        }
+        if (!compile_initializer(x.name, class_index, state, x.body))
+            return false;
+
+        instance_init result;
+        result.image = std::move(state.image);
+        result.initializer = state.code;
+        std::vector<class_field> fields = layout.fields;
+        std::sort(fields.begin(), fields.end(),
+                  [](class_field const &a, class_field const &b) { return a.offset < b.offset; });
+        for (class_field const &field : fields) {
+            const std::uint32_t size = field.count * std::uint32_t(sizeof(std::int32_t));
+            if (!result.spans.empty() && result.spans.back().first + result.spans.back().second == field.offset)
+                result.spans.back().second += size;
+            else
+                result.spans.emplace_back(field.offset, size);
+        }
+        program.set_initializer(handle, std::move(result));
+        return true;
+    }
+
+    result_type compiler::compile(ast::program& x) {
+        program.clear();
+        calls.clear();
+        prototypes.clear();
+        prototype_inits.clear();
+
+        auto constant_name = [](ast::global_decl &decl) -> ast::typed_var const * {
+            ast::variable_declaration *var = boost::get<ast::variable_declaration>(&decl);
+            ast::array_declaration *array = boost::get<ast::array_declaration>(&decl);
+            ast::typed_var const *typed = var ? &var->typed_var_ : array ? &array->typed_var_ : 0;
+            return typed && typed->isConst ? typed : 0;
+        };
+
+        // functions first, they may be called before their definition and constants may name them
+        for (ast::global_decl& decl : x) {
+            ast::function *f = boost::get<ast::function>(&decl);
+            if (f == 0)
+                continue;
+            if (program.find_function(f->name.name) != 0) {
+                error_handler(f->name, "Duplicate function: " + f->name.name);
+                program.clear();
+                return false;
+            }
+            std::vector<value_type> parameters;
+            for (ast::typed_var const &param : f->params)
+                parameters.push_back(type_of(param.type_));
+            program.add_function(f->name.name, type_of(f->returnType), std::move(parameters));
+        }
+
+        // the handles of all instances, constants may name them. Their classes follow once the classes are declared
+        for (ast::global_decl& decl : x) {
+            if (ast::instance *instance = boost::get<ast::instance>(&decl)) {
+                program.add_instance(instance->name.name);
+            } else if (ast::instance_var_decl *instances = boost::get<ast::instance_var_decl>(&decl)) {
+                for (ast::variable const &name : instances->vars)
+                    program.add_instance(name.name);
+            }
+        }
+
+        // classes and what instances need to find theirs, i.e. prototypes and the constants of array sizes.
+        // constants in source order, those they read further down are declared on demand by constant_of
+        pending_constants.clear();
+        for (ast::global_decl& decl : x) {
+            if (ast::typed_var const *name = constant_name(decl))
+                pending_constants.emplace(boost::algorithm::to_lower_copy(name->var.name), pending_constant{&decl, false});
+        }
+        for (ast::global_decl& decl : x) {
+            bool ok = true;
+            ast::typed_var const *name = constant_name(decl);
+            if (ast::prototype *prototype = boost::get<ast::prototype>(&decl)) {
+                prototypes[boost::algorithm::to_lower_copy(prototype->name.name)] = prototype;
+            } else if (name) {
+                pending_constant &pending = pending_constants[boost::algorithm::to_lower_copy(name->var.name)];
+                if (pending.decl != &decl) {
+                    ok = declare_constant(decl);        // reports the duplicate
+                } else if (!pending.started) {
+                    pending.started = true;
+                    ok = declare_constant(decl);
+                }
+            }
+            if (!ok) {
+                pending_constants.clear();
+                program.clear();
+                return false;
+            }
+        }
+        pending_constants.clear();
+        for (ast::global_decl& decl : x) {
+            ast::extern_class *c = boost::get<ast::extern_class>(&decl);
+            if (c && !declare_class(*c)) {
+                program.clear();
+                return false;
+            }
+        }
+
+        // the other globals, they may be instances of the classes
+        for (ast::global_decl& decl : x) {
+            bool ok = true;
+            ast::variable_declaration *var = boost::get<ast::variable_declaration>(&decl);
+            ast::array_declaration *array = boost::get<ast::array_declaration>(&decl);
+            if (var && !var->typed_var_.isConst) {
+                ok = declare_global(var->typed_var_, 1, var->rhs ? std::vector<ast::operand*>{&*var->rhs}
+                                                                 : std::vector<ast::operand*>());
+            } else if (array && !array->typed_var_.isConst) {
+                ok = declare_array(*array);
+            }
+            if (!ok) {
+                program.clear();
+                return false;
+            }
+        }
+
+        // the classes of all instances, they may be used before their definition
+        for (ast::global_decl& decl : x) {
+            if (ast::instance *instance = boost::get<ast::instance>(&decl)) {
+                program.add_instance(instance->name.name, class_of(instance->type_));
+            } else if (ast::instance_var_decl *instances = boost::get<ast::instance_var_decl>(&decl)) {
+                for (ast::variable const &name : instances->vars)
+                    program.add_instance(name.name, class_of(instances->type_));
+            }
+        }
+
+        // functions first, the initializers call them
+        for (ast::global_decl& decl : x) {
+            ast::function *f = boost::get<ast::function>(&decl);
+            if (f && !visitDerived(*f)) {
+                program.clear();
+                return false;
+            }
+        }
+
+        // then the initializers of prototypes and instances
+        for (ast::global_decl& decl : x) {
+            ast::instance *instance = boost::get<ast::instance>(&decl);
+            if (instance && !initialize(*instance)) {
+                program.clear();
+                return false;
+            }
+        }
+
+        for (auto const &call : calls)
+            program[call.first] = int(program.find_function(call.second)->address);
+        return true;
+    }
+}
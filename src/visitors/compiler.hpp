@@ -9,9 +9,14 @@
 #include "VisitorAdapter.hpp"
 #include "ast.hpp"
 #include "error_handler.hpp"
+#include "vm/classes.hpp"
+#include "vm/values.hpp"
+#include "vm/verifier.hpp"
 #include <vector>
 #include <map>
 
+class external_registry;
+
 namespace code_gen
 {
     ///////////////////////////////////////////////////////////////////////////
@@ -19,26 +24,149 @@ namespace code_gen
     ///////////////////////////////////////////////////////////////////////////
     struct program
     {
+        struct function_info
+        {
+            std::size_t address;
+            value_type result;
+            std::vector<value_type> parameters;
+            int handle;             // of the function as a value
+        };
+
+        struct global_info
+        {
+            std::uint32_t slot;     // of the first element in the global or the constant region
+            std::uint32_t count;    // 1 unless an array
+            value_type type;
+            bool constant;
+            int class_index;        // class of instance variables, -1 otherwise
+        };
+
+        program() { clear(); }
+
         void op(int a);
         void op(int a, int b);
         void op(int a, int b, int c);
 
         int& operator[](std::size_t i) { return code[i]; }
         int operator[](std::size_t i) const { return code[i]; }
-        void clear() { code.clear(); variables.clear(); }
+        void clear();
         std::size_t size() const { return code.size(); }
         std::vector<int> const& operator()() const { return code; }
+        void truncate(std::size_t size) { code.resize(size); }
 
-        std::size_t nvars() const { return variables.size(); }
+        /**
+         * locals by case-insensitive name, arrays take count consecutive slots
+         */
+        std::size_t nvars() const { return variable_types.size(); }
         int const* find_var(std::string const& name) const;
-        void add_var(std::string const& name);
+        void add_var(std::string const& name, value_type type = type_int, int class_index = -1, std::uint32_t count = 1);
+        void clear_vars() { variables.clear(); variable_types.clear(); variable_classes.clear(); variable_counts.clear(); }
+        value_type var_type(int index) const { return variable_types[index]; }
+        int var_class(int index) const { return variable_classes[index]; }
+        std::uint32_t var_count(int index) const { return variable_counts[index]; }
+
+        /**
+         * functions by case-insensitive name
+         */
+        function_info const* find_function(std::string const& name) const;
+        function_info* find_function(std::string const& name);
+        function_info& add_function(std::string const& name, value_type result, std::vector<value_type> parameters);
+
+        /**
+         * functions as values are handles, the handle of a function is its index + 1 in the order they were added.
+         * Handles stay valid when the code is relocated, the host runs the function at its address
+         * @return address of the function, removed for unknown handles and stripped functions
+         */
+        std::size_t function_address(int handle) const;
+
+        /**
+         * global variables and constants by case-insensitive name. Variables get consecutive slots
+         * of the global region, constants of the read-only constant region, arrays are contiguous.
+         * load both with vmachine::load_globals before running the program
+         */
+        global_info const* find_global(std::string const& name) const;
+        global_info const& add_global(std::string const& name, value_type type, std::uint32_t count,
+                                      bool constant, int class_index = -1);
+        int& initial_value(global_info const& global, std::uint32_t index);
+        std::map<std::string, global_info> const& all_globals() const { return globals; }
+        std::vector<int> const& global_data() const { return global_values; }
+        std::vector<int> const& constant_data() const { return constant_values; }
+
+        /**
+         * string literals, the handle of a literal is its index.
+         * load them with vmachine::strings().assign before running the program
+         */
+        int add_string(std::string const& value);
+        std::vector<std::string> const& string_pool() const { return strings; }
+
+        /**
+         * instances by case-insensitive name, the handle of an instance is its index + 1.
+         * Adding an instance again keeps its handle and class, an unknown class (-1) is set
+         */
+        int const* find_instance(std::string const& name) const;
+        int add_instance(std::string const& name, int class_index = -1);
+        int instance_class(int handle) const { return instance_classes[handle - 1]; }
+        std::size_t instance_count() const { return instance_classes.size(); }    // handles are 1 to count
+
+        /**
+         * initialization of an instance from its prototype and body, see vmachine::init_instance
+         */
+        instance_init const& initializer(int handle) const { return initializers[handle - 1]; }
+        void set_initializer(int handle, instance_init init) { initializers[handle - 1] = std::move(init); }
+        void add_initializer_function(std::string const& name, std::size_t address);
+
+        /**
+         * layouts of the classes by case-insensitive name, -1 if unknown.
+         * create or bind the instances of a class with this layout before running the program
+         */
+        int find_class(std::string const& name) const;
+        int add_class(class_layout layout);
+        class_layout const& class_at(int index) const { return classes[index]; }
+        std::size_t class_count() const { return classes.size(); }
+
+        /**
+         * every compiled function, for verifier::verify
+         */
+        std::vector<entry_point> entry_points() const;
+
+        static constexpr std::size_t removed = std::size_t(-1);
+
+        /**
+         * replaces the code by a transformed one, e.g. by inline_calls.
+         * relocation maps the address of every function and initializer to its address in the new code,
+         * functions mapped to removed are dropped
+         */
+        void relocate(std::vector<int> code, std::vector<std::size_t> const& relocation);
+
+        /**
+         * drops the globals and constants without a used slot, the others move down to close the gaps.
+         * global_slots and constant_slots receive the new slot of every old one, removed for dropped slots,
+         * the code must be relocated with them
+         */
+        void strip_globals(std::vector<bool> const& used_globals, std::vector<bool> const& used_constants,
+                           std::vector<std::size_t>& global_slots, std::vector<std::size_t>& constant_slots);
 
         void print_variables(std::vector<int> const& stack) const;
         void print_assembler() const;
 
     private:
 
-        std::map<std::string, int> variables;
+        std::map<std::string, int> variables;     // locals of the function being compiled
+        std::vector<value_type> variable_types;
+        std::vector<int> variable_classes;        // class of instance variables, -1 otherwise
+        std::vector<std::uint32_t> variable_counts;   // elements of arrays at their first slot, 1 for scalars
+        std::map<std::string, function_info> functions;
+        std::vector<std::string> function_names;  // by handle - 1
+        std::map<std::string, global_info> globals;
+        std::vector<int> global_values;           // initial values
+        std::vector<int> constant_values;
+        std::vector<std::string> strings;
+        std::map<std::string, int> string_handles;
+        std::map<std::string, int> instances;
+        std::vector<int> instance_classes;
+        std::vector<instance_init> initializers;
+        std::map<std::size_t, std::string> initializer_functions; // address -> prototype or instance
+        std::vector<class_layout> classes;
         std::vector<int> code;
     };
 
@@ -47,23 +175,41 @@ namespace code_gen
     ////////////////////////////////////////////////////////////////////////////
     struct compiler : public ASTVisitors::VisitorAdapter<compiler, bool>
     {
+        /**
+         * calls of names bound in externals are compiled to op_call_external,
+         * externals take precedence over script functions with the same name.
+         * classes bound in classes get the member offsets of the host struct
+         */
         template <typename ErrorHandler>
-        compiler(code_gen::program& program, ErrorHandler const& error_handler)
+        compiler(code_gen::program& program, ErrorHandler const& error_handler,
+                 external_registry const* externals = nullptr, class_registry const* classes = nullptr)
                 : VisitorAdapter(error_handler)
                 , program(program)
+                , externals(externals)
+                , classes(classes)
         {}
 
         result_type operator()(ast::nil) { BOOST_ASSERT(0); return false; }
         result_type operator()(unsigned int& x);
+        result_type operator()(float& x);
+        result_type operator()(std::string& x);
         result_type operator()(ast::variable& x);
+        result_type operator()(ast::memberAccess& x);
+        result_type operator()(ast::array_access& x);
         result_type operator()(ast::operation& x);
         result_type operator()(ast::unary& x);
         result_type operator()(ast::expression& x);
+        result_type operator()(ast::func_call& x);
         result_type operator()(ast::assignment& x);
         result_type operator()(ast::variable_declaration& x);
+        result_type operator()(ast::multi_variable_declaration& x);
+        result_type operator()(ast::array_declaration& x);
+        result_type operator()(ast::statement& x);
         result_type operator()(ast::block& x);
         result_type operator()(ast::if_statement& x);
         result_type operator()(ast::while_statement& x);
+        result_type operator()(ast::return_statement& x);
+        result_type operator()(ast::function& x);
 
         /**
          * default case: call base function
@@ -74,8 +220,149 @@ namespace code_gen
             return visitBase(x);
         }
 
+        /**
+         * compiles all functions of the program, calls may precede the called function
+         */
         bool compile(ast::program& x);
 
+        /**
+         * type of a type name, class names are instances
+         */
+        static value_type type_of(ast::type const& x);
+
         code_gen::program& program;
+
+        value_type type = type_void;          // type of the value the last compiled operand pushed
+
+    private:
+        bool declare_local(ast::variable const& var, value_type type, int class_index = -1, std::uint32_t count = 1);
+        bool declare_class(ast::extern_class& x);
+        bool constant_size(ast::operand& x, std::uint32_t& size);
+        int class_of(ast::type const& x) const;
+        class_field const* find_member(ast::memberAccess& x, bool report = true);
+        bool compound(ast::optoken op, value_type target);
+
+        /**
+         * an element of an object: obj.member, a member of the instance being initialized,
+         * or an element of an array member with a constant index
+         */
+        struct field_ref
+        {
+            ast::variable* object = 0;      // 0: the instance being initialized
+            class_field const* field = 0;
+            std::uint32_t offset = 0;       // of the element
+        };
+
+        class_field const* object_member(std::string const& name) const;
+
+        /**
+         * a local, global or constant by its slots, arrays take count consecutive slots
+         */
+        struct variable_ref
+        {
+            std::uint32_t first = 0;
+            std::uint32_t count = 1;
+            value_type type = type_int;
+            program::global_info const* global = 0;     // 0: locals of the frame
+        };
+
+        program::global_info const* global_of(std::string const& name) const;
+        program::global_info const* constant_of(std::string const& name);
+        bool variable_of(ast::variable const& x, variable_ref& ref) const;
+        bool declare_global(ast::typed_var const& var, std::uint32_t count, std::vector<ast::operand*> const& values,
+                            bool local = false);
+        bool declare_array(ast::array_declaration& x);
+        bool declare_constant(ast::global_decl& x);
+        bool load_global(program::global_info const& global, std::uint32_t index);
+        bool load_variable(variable_ref const& ref, std::uint32_t index);
+        bool load_element(ast::variable const& var, variable_ref const& ref, ast::operand& index);
+        bool store_element(ast::variable const& var, variable_ref const& ref, ast::operand* index, ast::assignment& x);
+        bool constant_index(ast::operand& x, int& index);
+        bool side_effect_free(ast::operand& x);
+        bool field_of(ast::variable& x, field_ref& ref);
+        bool field_of(ast::memberAccess& x, field_ref& ref, bool report);
+        bool field_of(ast::array_access& x, field_ref& ref, bool report);
+        bool array_field_of(ast::array_access& x, field_ref& ref, bool report);
+        bool field_of(ast::operand& x, field_ref& ref, bool report);
+        bool whole_field(field_ref& ref, bool report);
+        void push_object(ast::variable* object);
+        bool load_field(field_ref const& ref);
+        bool store_field_element(field_ref const& ref, ast::operand& index, ast::assignment& x);
+
+
+        /**
+         * an instance initializer while it is compiled: the memory image of the constant member
+         * writes so far, and which members code compiled so far may read or write
+         */
+        struct init_state
+        {
+            std::vector<int> image;
+            std::vector<bool> touched;      // by slot
+            bool opaque = false;            // code so far may touch any member, e.g. a call
+            std::size_t code = instance_init::no_initializer;
+        };
+
+        bool constant_value(ast::operand& x, value_type& type, int& value);
+        bool simple_reads(ast::operand& x, std::vector<std::uint32_t>& slots);
+        bool fold(ast::statement& x);
+        void note_residue(ast::statement& x);
+        bool compile_initializer(ast::variable const& name, int class_index, init_state& state, ast::block& body);
+        init_state const* prototype_state(ast::prototype& x);
+        bool initialize(ast::instance& x);
+        value_type type_of(ast::operand& x);
+        bool convert(value_type from, value_type to);
+        bool binary(ast::optoken op, value_type left, value_type right);
+
+        /**
+         * conditions as control flow: jumps to a position patched later if x is when, falls through otherwise.
+         * && and || evaluate their right operands only if needed
+         */
+        bool branch(ast::operand& x, bool when, std::vector<std::size_t>& jumps);
+        bool branch(ast::expression& x, bool when, std::vector<std::size_t>& jumps);
+        void patch(std::vector<std::size_t> const& jumps);
+
+        /**
+         * if/else-if chains comparing one side-effect-free operand with constants, e.g.
+         * if (x == 1) {} else if (x == 2 || x == 5) {}. Dense values dispatch through op_jump_table,
+         * sparse ones through a binary search of compares
+         */
+        struct switch_case
+        {
+            int value;
+            value_type type;
+            std::size_t block;      // the first condition block with the value
+        };
+
+        bool switch_cases(ast::operand& condition, std::size_t block, ast::operand*& subject,
+                          std::vector<switch_case>& cases);
+        bool switch_statement(ast::if_statement& x, ast::operand& subject, std::vector<switch_case> const& cases);
+        bool search_cases(ast::operand& subject, std::vector<switch_case> const& cases, std::size_t first,
+                          std::size_t last, std::vector<std::vector<std::size_t>>& entries,
+                          std::vector<std::size_t>& others);
+        void track(ast::position_tagged const& x);
+
+        ast::position_tagged position;        // last tagged node, for errors on untagged nodes
+        value_type result = type_void;        // of the function being compiled
+
+        external_registry const* externals;
+        class_registry const* classes;
+        std::map<std::string, ast::prototype*> prototypes;        // by lower case name
+        std::map<std::string, init_state> prototype_inits;        // by lower case name
+
+        /**
+         * the first declaration of every global constant while compile declares them.
+         * A constant read before its declaration is declared on demand, see constant_of
+         */
+        struct pending_constant
+        {
+            ast::global_decl* decl;
+            bool started;           // declared or being declared, a constant can't read itself
+        };
+        std::map<std::string, pending_constant> pending_constants;  // by lower case name
+        std::string scope;                    // name of the function or instance being compiled
+        std::map<std::string, program::global_info> local_constants;  // of the scope by lower case name
+        int object_class = -1;                // of the instance being initialized
+        init_state* init = 0;
+        std::vector<std::pair<std::size_t, std::string>> calls;   // operand of op_call -> called function
     };
 }
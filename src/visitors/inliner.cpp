@@ -0,0 +1,229 @@
+#include "inliner.hpp"
+#include "vm/vm.hpp"
+#include <algorithm>
+#include <map>
+
+namespace code_gen {
+    namespace {
+        constexpr std::size_t no_address = std::size_t(-1);
+
+        struct function_code {
+            std::size_t start = 0;
+            std::size_t end = 0;
+            int arguments = 0;
+            int frame = -1;                     // locals, -1 unless the code starts with op_stk_adj
+            std::vector<std::size_t> body;      // reachable instructions behind op_stk_adj in order, empty if not inlinable
+            std::size_t size = 0;               // words of the body
+            std::size_t sites = 0;              // calls of the function
+        };
+
+        std::size_t length(std::vector<int> const &code, std::size_t pc) {
+            return 1 + std::size_t(verifier::operand_count(code[pc]));
+        }
+
+        bool addresses_locals(int op) {
+            switch (op) {
+                case op_load:
+                case op_store:
+                case op_load_index:
+                case op_store_index:
+                case op_clear:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        void analyze(std::vector<int> const &code, function_code &f) {
+            if (code[f.start] != int(op_stk_adj) || f.end - f.start < 2)
+                return;
+            f.frame = code[f.start + 1];
+            if (f.frame < f.arguments)
+                return;
+
+            // dead code isn't copied, e.g. the return 0 behind a return
+            std::vector<bool> reached(f.end - f.start, false);
+            std::vector<std::size_t> pending{f.start + 2};
+            while (!pending.empty()) {
+                std::size_t pc = pending.back();
+                pending.pop_back();
+                while (!reached[pc - f.start]) {
+                    reached[pc - f.start] = true;
+                    const int op = code[pc];
+                    const std::size_t next = pc + length(code, pc);
+                    if (op == int(op_stk_adj))
+                        return;
+                    if (op == int(op_return))
+                        break;
+                    if (op == int(op_jump_table)) {
+                        // the entries are op_jumps, each is reached
+                        const int count = code[pc + 2];
+                        if (count < 0 || next + 2 * std::size_t(count) >= f.end)
+                            return;
+                        for (int i = 0; i <= count; ++i)
+                            pending.push_back(next + 2 * std::size_t(i));
+                        break;
+                    }
+                    if (op == int(op_jump) || op == int(op_jump_if)) {
+                        long long target = (long long) (pc + 1) + code[pc + 1];
+                        if (target <= (long long) (f.start) || target >= (long long) (f.end))
+                            return;
+                        if (op == int(op_jump)) {
+                            pc = std::size_t(target);
+                            continue;
+                        }
+                        pending.push_back(std::size_t(target));
+                    }
+                    if (next >= f.end)
+                        return;         // runs into the next function
+                    pc = next;
+                }
+            }
+            for (std::size_t pc = f.start; pc < f.end; pc += length(code, pc)) {
+                if (reached[pc - f.start]) {
+                    f.body.push_back(pc);
+                    f.size += length(code, pc);
+                }
+            }
+        }
+
+        /**
+         * the new code with relocations of the old addresses
+         */
+        struct rewriter {
+            std::vector<int> const &code;
+            std::vector<int> out;
+            std::vector<std::size_t> relocation;
+            std::vector<std::pair<std::size_t, std::size_t>> jumps;    // operand in out -> target in code
+            std::vector<std::size_t> calls;                            // operand in out, still the target in code
+
+            explicit rewriter(std::vector<int> const &code)
+                    : code(code), relocation(code.size() + 1, no_address) {
+            }
+
+            void copy(std::size_t pc, int locals) {
+                const int op = code[pc];
+                out.insert(out.end(), code.begin() + pc, code.begin() + pc + length(code, pc));
+                const std::size_t operand = out.size() - length(code, pc) + 1;
+                if (addresses_locals(op))
+                    out[operand] += locals;
+                if (op == int(op_jump) || op == int(op_jump_if))
+                    jumps.emplace_back(operand, std::size_t((long long) (pc + 1) + code[pc + 1]));
+                else if (op == int(op_call))
+                    calls.push_back(operand + 1);
+            }
+
+            void inline_body(function_code const &callee, int base) {
+                // the arguments are on the stack, the last one on top
+                for (int i = callee.arguments - 1; i >= 0; --i) {
+                    out.push_back(op_store);
+                    out.push_back(base + i);
+                }
+                std::map<std::size_t, std::size_t> moved;
+                const std::size_t first_jump = jumps.size();
+                std::vector<std::size_t> exits;
+                for (std::size_t pc : callee.body) {
+                    moved[pc] = out.size();
+                    if (code[pc] != int(op_return)) {
+                        copy(pc, base);
+                    } else if (pc != callee.body.back()) {
+                        // the return value stays on the stack
+                        out.push_back(op_jump);
+                        out.push_back(0);
+                        exits.push_back(out.size() - 1);
+                    }
+                }
+                for (std::size_t i = first_jump; i < jumps.size(); ++i)
+                    out[jumps[i].first] = int(moved[jumps[i].second] - jumps[i].first);
+                jumps.resize(first_jump);
+                for (std::size_t exit : exits)
+                    out[exit] = int(out.size() - exit);
+            }
+        };
+    }
+
+    std::size_t inline_calls(program& x, inline_options const& options) {
+        std::vector<int> const &code = x();
+        std::vector<entry_point> entries = x.entry_points();
+        std::sort(entries.begin(), entries.end(),
+                  [](entry_point const &a, entry_point const &b) { return a.address < b.address; });
+
+        std::map<std::size_t, function_code> functions;
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].address >= code.size() || functions.count(entries[i].address))
+                continue;
+            function_code &f = functions[entries[i].address];
+            f.start = entries[i].address;
+            f.end = code.size();
+            for (std::size_t j = i + 1; j < entries.size() && f.end == code.size(); ++j) {
+                if (entries[j].address > f.start)
+                    f.end = entries[j].address;
+            }
+            f.arguments = entries[i].arguments;
+            analyze(code, f);
+        }
+        for (std::size_t pc = 0; pc < code.size(); pc += length(code, pc)) {
+            if (code[pc] == int(op_call)) {
+                auto callee = functions.find(std::size_t(code[pc + 2]));
+                if (callee != functions.end())
+                    ++callee->second.sites;
+            }
+        }
+
+        auto inlinable = [&options](function_code const &f) {
+            if (f.body.empty())
+                return false;
+            if (f.size <= options.max_size)
+                return true;
+            const bool hot = options.profile && f.start < options.profile->size()
+                             && (*options.profile)[f.start] >= options.hot_calls;
+            return f.size <= options.max_hot_size && (f.sites == 1 || hot);
+        };
+
+        // the code outside functions can't grow its frame
+        std::vector<std::pair<std::size_t, function_code const *>> regions;
+        if (functions.empty() || functions.begin()->first > 0)
+            regions.emplace_back(0, nullptr);
+        for (auto const &f : functions)
+            regions.emplace_back(f.first, &f.second);
+
+        rewriter r(code);
+        const double budget = double(code.size()) * (options.max_growth - 1.0);
+        double growth = 0;
+        std::size_t inlined = 0;
+        for (std::size_t i = 0; i < regions.size(); ++i) {
+            function_code const *caller = regions[i].second;
+            const std::size_t end = i + 1 < regions.size() ? regions[i + 1].first : code.size();
+            const std::size_t frame = r.out.size() + 1;
+            int extra = 0;          // locals of the inlined callees, they share the slots
+            for (std::size_t pc = regions[i].first; pc < end; pc += length(code, pc)) {
+                r.relocation[pc] = r.out.size();
+                auto callee = code[pc] == int(op_call) ? functions.find(std::size_t(code[pc + 2])) : functions.end();
+                if (caller && caller->frame >= 0 && callee != functions.end() && &callee->second != caller
+                        && inlinable(callee->second)) {
+                    const function_code &f = callee->second;
+                    const double words = double(f.size + 2 * std::size_t(f.arguments)) - 3.0;
+                    if (growth + words <= budget) {
+                        growth += words;
+                        r.inline_body(f, caller->frame);
+                        extra = std::max(extra, f.frame);
+                        ++inlined;
+                        continue;
+                    }
+                }
+                r.copy(pc, 0);
+            }
+            if (extra > 0)
+                r.out[frame] = caller->frame + extra;
+        }
+        r.relocation[code.size()] = r.out.size();
+
+        for (auto const &jump : r.jumps)
+            r.out[jump.first] = int(r.relocation[jump.second] - jump.first);
+        for (std::size_t call : r.calls)
+            r.out[call] = int(r.relocation[std::size_t(r.out[call])]);
+        if (inlined > 0)
+            x.relocate(std::move(r.out), r.relocation);
+        return inlined;
+    }
+}
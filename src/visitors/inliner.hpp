@@ -0,0 +1,33 @@
+#pragma once
+
+#include "compiler.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace code_gen
+{
+    ///////////////////////////////////////////////////////////////////////////
+    //  The Inliner
+    ///////////////////////////////////////////////////////////////////////////
+
+    /**
+     * limits of inline_calls, sizes are code words of the reachable body of a callee
+     */
+    struct inline_options
+    {
+        std::size_t max_size = 24;          // inlined at every call, e.g. getters and wrappers of one external
+        std::size_t max_hot_size = 96;      // inlined if called from one place only or hot in the profile
+        std::uint64_t hot_calls = 1000;
+        double max_growth = 1.5;            // of the whole code
+        std::vector<std::uint64_t> const* profile = nullptr;    // calls by function address, see vmachine::profile_calls
+    };
+
+    /**
+     * replaces calls of small functions by their body: the arguments are stored into locals
+     * the caller's frame grows by, and returns jump behind the inlined body.
+     * Functions stay for other callers and the host, bodies are inlined as compiled,
+     * so calls inside them stay calls.
+     * @return the number of calls inlined
+     */
+    std::size_t inline_calls(program& x, inline_options const& options = inline_options());
+}
@@ -0,0 +1,223 @@
+#include "linker.hpp"
+#include "vm/vm.hpp"
+#include <algorithm>
+#include <set>
+
+namespace code_gen {
+    namespace {
+        /**
+         * the reached functions, instances and globals, each is scanned once when it is reached first
+         */
+        struct reachability {
+            program const &x;
+            std::vector<std::size_t> starts;                    // of functions and initializers, sorted
+            std::vector<program::global_info const *> owner[2]; // global of every slot of the global and the constant region
+            std::set<std::size_t> functions;
+            std::vector<bool> instances;
+            std::vector<bool> used[2];                          // slots of the global and the constant region
+            std::vector<std::size_t> pending_functions;
+            std::vector<int> pending_instances;
+            std::vector<program::global_info const *> pending_globals;
+
+            explicit reachability(program const &x) : x(x), instances(x.instance_count() + 1, false) {
+                for (entry_point const &entry : x.entry_points())
+                    starts.push_back(entry.address);
+                std::sort(starts.begin(), starts.end());
+                starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+                owner[0].assign(x.global_data().size(), 0);
+                owner[1].assign(x.constant_data().size(), 0);
+                for (auto const &g : x.all_globals()) {
+                    for (std::uint32_t i = 0; i < g.second.count; ++i)
+                        owner[g.second.constant][g.second.slot + i] = &g.second;
+                }
+                used[0].assign(owner[0].size(), false);
+                used[1].assign(owner[1].size(), false);
+            }
+
+            std::size_t end_of(std::size_t start) const {
+                auto next = std::upper_bound(starts.begin(), starts.end(), start);
+                return next == starts.end() ? x().size() : *next;
+            }
+
+            void function(std::size_t address) {
+                if (address < x().size() && functions.insert(address).second)
+                    pending_functions.push_back(address);
+            }
+
+            void instance(int handle) {
+                if (handle > 0 && std::size_t(handle) < instances.size() && !instances[handle]) {
+                    instances[handle] = true;
+                    pending_instances.push_back(handle);
+                }
+            }
+
+            void global(bool constant, int slot) {
+                if (slot < 0 || std::size_t(slot) >= owner[constant].size())
+                    return;
+                program::global_info const *g = owner[constant][slot];
+                if (g == 0 || used[constant][g->slot])
+                    return;
+                // arrays as a whole, their elements stay contiguous
+                std::fill(used[constant].begin() + g->slot, used[constant].begin() + g->slot + g->count, true);
+                pending_globals.push_back(g);
+            }
+
+            void scan_function(std::size_t start) {
+                std::vector<int> const &code = x();
+                const std::size_t end = end_of(start);
+                for (std::size_t pc = start; pc < end;) {
+                    const int operands = verifier::operand_count(code[pc]);
+                    if (operands < 0 || pc + std::size_t(operands) >= end)
+                        break;
+                    switch (code[pc]) {
+                        case op_call:
+                            function(std::size_t(code[pc + 2]));
+                            break;
+                        case op_instance:
+                            instance(code[pc + 1]);
+                            break;
+                        case op_function:
+                            function(x.function_address(code[pc + 1]));
+                            break;
+                        case op_load_global:
+                        case op_store_global:
+                        case op_load_global_index:
+                        case op_store_global_index:
+                            global(false, code[pc + 1]);
+                            break;
+                        case op_load_const_index:
+                            global(true, code[pc + 1]);
+                            break;
+                        default:
+                            break;
+                    }
+                    pc += 1 + std::size_t(operands);
+                }
+            }
+
+            void scan_instance(int handle) {
+                instance_init const &init = x.initializer(handle);
+                if (init.initializer != instance_init::no_initializer)
+                    function(init.initializer);
+                const int class_index = x.instance_class(handle);
+                if (class_index < 0)
+                    return;
+                for (class_field const &field : x.class_at(class_index).fields) {
+                    for (std::uint32_t i = 0; i < field.count; ++i) {
+                        const std::size_t slot = field.offset / sizeof(std::int32_t) + i;
+                        if (slot < init.image.size())
+                            held(field.type, init.image[slot]);
+                    }
+                }
+            }
+
+            void scan_global(program::global_info const &g) {
+                std::vector<int> const &values = g.constant ? x.constant_data() : x.global_data();
+                for (std::uint32_t i = 0; i < g.count; ++i)
+                    held(g.type, values[g.slot + i]);
+            }
+
+            // an instance or function a member or global holds. ints take instances as well (e.g. C_INFO.npc = Diego),
+            // so an int that is a valid handle keeps its instance
+            void held(value_type type, int value) {
+                if (type == type_instance || type == type_int)
+                    instance(value);
+                else if (type == type_func)
+                    function(x.function_address(value));
+            }
+
+            void run() {
+                while (!pending_functions.empty() || !pending_instances.empty() || !pending_globals.empty()) {
+                    if (!pending_functions.empty()) {
+                        std::size_t start = pending_functions.back();
+                        pending_functions.pop_back();
+                        scan_function(start);
+                    } else if (!pending_instances.empty()) {
+                        int handle = pending_instances.back();
+                        pending_instances.pop_back();
+                        scan_instance(handle);
+                    } else {
+                        program::global_info const *g = pending_globals.back();
+                        pending_globals.pop_back();
+                        scan_global(*g);
+                    }
+                }
+            }
+        };
+    }
+
+    strip_result strip_unreachable(program& x, link_roots const& roots) {
+        reachability reached(x);
+        if (reached.starts.empty() || reached.starts.front() > 0)
+            reached.scan_function(0);           // code outside of functions stays
+        for (std::string const &name : roots.functions) {
+            if (program::function_info const *f = x.find_function(name))
+                reached.function(f->address);
+        }
+        for (std::string const &name : roots.instances) {
+            if (int const *handle = x.find_instance(name))
+                reached.instance(*handle);
+        }
+        for (std::string const &name : roots.globals) {
+            if (program::global_info const *g = x.find_global(name))
+                reached.global(g->constant, int(g->slot));
+        }
+        reached.run();
+
+        // the reached functions move down over the gaps, jumps are relative
+        strip_result result;
+        std::vector<int> const &code = x();
+        std::vector<int> out;
+        std::vector<std::size_t> relocation(code.size() + 1, program::removed);
+        std::vector<std::size_t> regions(reached.starts);
+        if (regions.empty() || regions.front() > 0)
+            regions.insert(regions.begin(), 0);
+        for (std::size_t start : regions) {
+            const std::size_t end = reached.end_of(start);
+            const bool entry = std::binary_search(reached.starts.begin(), reached.starts.end(), start);
+            if (entry && !reached.functions.count(start)) {
+                ++result.functions;
+                result.code += end - start;
+                continue;
+            }
+            for (std::size_t pc = start; pc < end; ++pc)
+                relocation[pc] = out.size() + (pc - start);
+            out.insert(out.end(), code.begin() + start, code.begin() + end);
+        }
+        relocation[code.size()] = out.size();
+
+        const std::size_t globals = x.all_globals().size();
+        std::vector<std::size_t> global_slots, constant_slots;
+        x.strip_globals(reached.used[0], reached.used[1], global_slots, constant_slots);
+        result.globals = globals - x.all_globals().size();
+
+        for (std::size_t pc = 0; pc < out.size(); pc += 1 + std::size_t(verifier::operand_count(out[pc]))) {
+            switch (out[pc]) {
+                case op_call:
+                    out[pc + 2] = int(relocation[std::size_t(out[pc + 2])]);
+                    break;
+                case op_load_global:
+                case op_store_global:
+                case op_load_global_index:
+                case op_store_global_index:
+                    out[pc + 1] = int(global_slots[std::size_t(out[pc + 1])]);
+                    break;
+                case op_load_const_index:
+                    out[pc + 1] = int(constant_slots[std::size_t(out[pc + 1])]);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        for (int handle = 1; std::size_t(handle) < reached.instances.size(); ++handle) {
+            instance_init const &init = x.initializer(handle);
+            if (reached.instances[handle] || (init.image.empty() && init.initializer == instance_init::no_initializer))
+                continue;
+            x.set_initializer(handle, instance_init());
+            ++result.instances;
+        }
+        x.relocate(std::move(out), relocation);
+        return result;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "compiler.hpp"
+#include <string>
+#include <vector>
+
+namespace code_gen
+{
+    ///////////////////////////////////////////////////////////////////////////
+    //  The Linker
+    ///////////////////////////////////////////////////////////////////////////
+
+    /**
+     * what the engine reaches by name, unknown names are ignored
+     */
+    struct link_roots
+    {
+        std::vector<std::string> functions;     // called by the engine, e.g. startup functions and daily routines
+        std::vector<std::string> instances;     // referenced by world data
+        std::vector<std::string> globals;       // read or written by the host
+    };
+
+    /**
+     * what strip_unreachable removed
+     */
+    struct strip_result
+    {
+        std::size_t functions = 0;      // including initializers of prototypes and instances
+        std::size_t instances = 0;      // their handles stay, without image and initializer
+        std::size_t globals = 0;        // variables and constants
+        std::size_t code = 0;           // words
+    };
+
+    /**
+     * removes everything the roots don't reach from the compiled program: functions,
+     * the initialization of instances and globals, constants included. Reached are the roots,
+     * whatever reached code calls, names as instance (op_instance) or function (op_function)
+     * or reads and writes as global, and instances and functions in members and globals
+     * of reached instances and globals, int members and globals holding an instance handle included.
+     * Function handles stay valid.
+     * Globals move to close the gaps, load them with vmachine::load_globals afterwards
+     */
+    strip_result strip_unreachable(program& x, link_roots const& roots);
+}
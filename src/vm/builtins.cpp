@@ -0,0 +1,31 @@
+#include "builtins.hpp"
+#include "externals.hpp"
+
+void bind_string_builtins(external_registry& externals)
+{
+    externals.bind<string_handle(string_arena&, string_handle, string_handle)>(
+            "ConcatStrings", [](string_arena& strings, string_handle first, string_handle second) {
+                return string_handle{strings.concat(first.index, second.index)};
+            });
+
+    externals.bind<string_handle(string_arena&, int)>(
+            "IntToString", [](string_arena& strings, int value) {
+                char digits[12];
+                char* first = digits + sizeof(digits);
+                unsigned magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+                do
+                {
+                    *--first = char('0' + magnitude % 10);
+                    magnitude /= 10;
+                } while (magnitude);
+                if (value < 0)
+                    *--first = '-';
+                return string_handle{strings.temporary(first, std::size_t(digits + sizeof(digits) - first))};
+            });
+
+    // interned strings are equal if their handles are
+    externals.bind<int(string_arena&, string_handle, string_handle)>(
+            "Hlp_StrCmp", [](string_arena& strings, string_handle first, string_handle second) {
+                return int(strings.equal(first.index, second.index));
+            });
+}
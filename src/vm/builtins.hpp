@@ -0,0 +1,10 @@
+#pragma once
+
+class external_registry;
+
+/**
+ * binds the engine's string externals, they work on the string arena of the vm
+ * and don't allocate once the arena has grown:
+ * ConcatStrings(string, string), IntToString(int), Hlp_StrCmp(string, string)
+ */
+void bind_string_builtins(external_registry& externals);
@@ -0,0 +1,44 @@
+#include "classes.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <stdexcept>
+
+class_field const* class_layout::find(std::string const& name) const
+{
+    for (class_field const& field : fields)
+    {
+        if (boost::algorithm::iequals(field.name, name))
+            return &field;
+    }
+    return nullptr;
+}
+
+class_layout const* class_registry::find(std::string const& name) const
+{
+    auto it = indices.find(boost::algorithm::to_lower_copy(name));
+    return it == indices.end() ? nullptr : &layouts[it->second];
+}
+
+std::size_t class_registry::add(std::string const& name, std::size_t size)
+{
+    if (size > 0xFFFFFFFFu)
+        throw std::runtime_error("Error: class " + name + " is too large");
+    auto inserted = indices.emplace(boost::algorithm::to_lower_copy(name), layouts.size());
+    if (inserted.second)
+        layouts.emplace_back();
+    class_layout& layout = layouts[inserted.first->second];
+    layout.name = name;
+    layout.size = std::uint32_t(size);
+    layout.fields.clear();
+    return inserted.first->second;
+}
+
+void class_registry::add_field(std::size_t index, class_field field)
+{
+    class_layout& layout = layouts[index];
+    if (layout.find(field.name))
+        throw std::runtime_error("Error: class " + layout.name + " has two members " + field.name);
+    if (field.offset % sizeof(std::int32_t) != 0)
+        throw std::runtime_error("Error: member " + field.name + " of class " + layout.name + " is not aligned");
+    layout.fields.push_back(std::move(field));
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "externals.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////
+//  Class Layouts
+///////////////////////////////////////////////////////////////////////////
+
+/**
+ * a member of a class, every element is a 32-bit script value
+ */
+struct class_field
+{
+    std::string name;
+    value_type type;
+    std::uint32_t offset;   // in bytes from the start of the object
+    std::uint32_t count;    // elements of an array member, 1 otherwise
+};
+
+/**
+ * memory layout of the objects of a class.
+ * The compiler lowers member access to the offset of the field,
+ * so the vm reads and writes objects without looking up names
+ */
+struct class_layout
+{
+    std::string name;
+    std::uint32_t size = 0;
+    std::vector<class_field> fields;
+
+    /**
+     * @return the field with the case-insensitive name or nullptr
+     */
+    class_field const* find(std::string const& name) const;
+};
+
+/**
+ * layouts of engine structs, e.g. C_NPC, so scripts work on the objects of the host.
+ * The host binds the members of a standard layout struct by name:
+ *
+ *     classes.bind<npc>("C_NPC").field("id", &npc::id).field("attribute", &npc::attribute);
+ *
+ * members are int, float, string_handle, instance_handle or function_handle, or arrays of them.
+ * Scripts compiled against a class must only declare members bound here
+ */
+class class_registry
+{
+public:
+    template <typename T>
+    class binder
+    {
+    public:
+        binder(class_registry& registry, std::size_t index) : registry(registry), index(index) {}
+
+        template <typename M>
+        binder& field(std::string const& name, M T::*member)
+        {
+            using element = typename std::remove_all_extents<M>::type;
+            static_assert(sizeof(element) == sizeof(std::int32_t), "class members are 32-bit script values");
+
+            // the offset of the member in storage that is never constructed
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+            T const* object = reinterpret_cast<T const*>(&storage);
+            auto offset = reinterpret_cast<char const*>(&(object->*member)) - reinterpret_cast<char const*>(object);
+
+            registry.add_field(index, class_field{name, slot_value<element>::type, std::uint32_t(offset),
+                                                  std::uint32_t(sizeof(M) / sizeof(element))});
+            return *this;
+        }
+
+    private:
+        class_registry& registry;
+        std::size_t index;
+    };
+
+    /**
+     * binds a struct to a class name, binding a name again starts over
+     */
+    template <typename T>
+    binder<T> bind(std::string const& name)
+    {
+        static_assert(std::is_standard_layout<T>::value, "only standard layout structs have fixed member offsets");
+        return binder<T>(*this, add(name, sizeof(T)));
+    }
+
+    /**
+     * @return the layout of the case-insensitive class name or nullptr
+     */
+    class_layout const* find(std::string const& name) const;
+
+private:
+    std::size_t add(std::string const& name, std::size_t size);
+    void add_field(std::size_t index, class_field field);
+
+    std::vector<class_layout> layouts;
+    std::unordered_map<std::string, std::size_t> indices;   // lower case name -> index
+};
+
+/**
+ * how an instance starts out: the spans of the image are copied into the object,
+ * then the initializer runs with the instance handle as argument, if there is one.
+ * The compiler flattens the prototype and the instance body into this, the image holds
+ * every constant member write and the initializer the rest (see vmachine::init_instance)
+ */
+struct instance_init
+{
+    static constexpr std::size_t no_initializer = std::size_t(-1);
+
+    std::vector<std::int32_t> image;                                // the whole object in slots
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> spans;     // offset and size in bytes of the script members
+    std::size_t initializer = no_initializer;                       // entry point taking the instance
+};
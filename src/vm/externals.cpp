@@ -0,0 +1,27 @@
+#include "externals.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <stdexcept>
+
+int external_registry::find(std::string const& name) const
+{
+    auto it = indices.find(boost::algorithm::to_lower_copy(name));
+    return it == indices.end() ? -1 : it->second;
+}
+
+int external_registry::add(external entry, std::shared_ptr<void> target)
+{
+    auto inserted = indices.emplace(boost::algorithm::to_lower_copy(entry.name), int(table.size()));
+    if (!inserted.second)
+    {
+        external& bound = table[inserted.first->second];
+        if (bound.parameters != entry.parameters || bound.result != entry.result)
+            throw std::runtime_error("Error: external " + entry.name + " rebound with a different signature");
+        bound.invoke = entry.invoke;
+        bound.target = entry.target;
+        targets[inserted.first->second] = std::move(target);
+        return inserted.first->second;
+    }
+    table.push_back(std::move(entry));
+    targets.push_back(std::move(target));
+    return inserted.first->second;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "strings.hpp"
+#include "values.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////
+//  Engine Externals
+///////////////////////////////////////////////////////////////////////////
+
+/**
+ * conversion between C++ values and the 32-bit stack slots
+ * of external arguments and return values
+ */
+template <typename T>
+struct slot_value;
+
+template <>
+struct slot_value<int>
+{
+    static constexpr value_type type = type_int;
+    static int get(string_arena&, int slot) { return slot; }
+    static int put(string_arena&, int value) { return value; }
+};
+
+template <>
+struct slot_value<float>
+{
+    static constexpr value_type type = type_float;
+    static float get(string_arena&, int slot) { return slot_to_float(slot); }
+    static int put(string_arena&, float value) { return float_to_slot(value); }
+};
+
+template <>
+struct slot_value<std::string>
+{
+    static constexpr value_type type = type_string;
+    static std::string get(string_arena& strings, int slot) { return strings.str(slot); }
+    static int put(string_arena& strings, std::string const& value) { return strings.temporary(value); }
+};
+
+/**
+ * a string argument or return value without copying it, valid until the current call returns
+ */
+struct string_handle
+{
+    int index;
+};
+
+template <>
+struct slot_value<string_handle>
+{
+    static constexpr value_type type = type_string;
+    static string_handle get(string_arena&, int slot) { return string_handle{slot}; }
+    static int put(string_arena&, string_handle value) { return value.index; }
+};
+
+template <>
+struct slot_value<instance_handle>
+{
+    static constexpr value_type type = type_instance;
+    static instance_handle get(string_arena&, int slot) { return instance_handle{slot}; }
+    static int put(string_arena&, instance_handle value) { return value.index; }
+};
+
+template <>
+struct slot_value<function_handle>
+{
+    static constexpr value_type type = type_func;
+    static function_handle get(string_arena&, int slot) { return function_handle{slot}; }
+    static int put(string_arena&, function_handle value) { return value.index; }
+};
+
+namespace detail
+{
+    template <typename T>
+    using slot_of = slot_value<typename std::decay<T>::type>;
+
+    template <typename R>
+    struct call_result
+    {
+        template <typename Call>
+        static int put(string_arena& strings, Call call) { return slot_of<R>::put(strings, call()); }
+        static value_type type() { return slot_of<R>::type; }
+    };
+
+    template <>
+    struct call_result<void>
+    {
+        template <typename Call>
+        static int put(string_arena&, Call call)
+        {
+            call();
+            return 0;   // calls always leave a value on the stack
+        }
+        static value_type type() { return type_void; }
+    };
+
+    /**
+     * marshals the arguments from the stack, callables whose first parameter is
+     * a string_arena& get the strings of the vm there
+     */
+    template <typename F, typename Signature>
+    struct external_call;
+
+    template <typename F, typename R, typename... Args>
+    struct external_call<F, R(Args...)>
+    {
+        static int invoke(void* target, string_arena& strings, int const* args)
+        {
+            return call(*static_cast<F*>(target), strings, args, std::index_sequence_for<Args...>());
+        }
+
+        template <std::size_t... I>
+        static int call(F& function, string_arena& strings, int const* args, std::index_sequence<I...>)
+        {
+            (void)args;
+            return call_result<R>::put(strings, [&]() -> R {
+                return function(slot_of<Args>::get(strings, args[I])...);
+            });
+        }
+
+        static std::vector<value_type> parameters() { return {slot_of<Args>::type...}; }
+        static value_type result() { return call_result<R>::type(); }
+    };
+
+    template <typename F, typename R, typename... Args>
+    struct external_call<F, R(string_arena&, Args...)>
+    {
+        static int invoke(void* target, string_arena& strings, int const* args)
+        {
+            return call(*static_cast<F*>(target), strings, args, std::index_sequence_for<Args...>());
+        }
+
+        template <std::size_t... I>
+        static int call(F& function, string_arena& strings, int const* args, std::index_sequence<I...>)
+        {
+            (void)args;
+            return call_result<R>::put(strings, [&]() -> R {
+                return function(strings, slot_of<Args>::get(strings, args[I])...);
+            });
+        }
+
+        static std::vector<value_type> parameters() { return {slot_of<Args>::type...}; }
+        static value_type result() { return call_result<R>::type(); }
+    };
+}
+
+/**
+ * engine functions callable from scripts, e.g. Hlp_Random or Wld_InsertNpc.
+ * The host binds C++ callables by name. The compiler resolves the names
+ * of called externals to indices into this table, so a call in the vm
+ * is a single indirect call through the entry, without any lookup.
+ * Names are case-insensitive like all Daedalus identifiers.
+ */
+class external_registry
+{
+public:
+    struct external
+    {
+        std::string name;
+        int arguments;
+        int (*invoke)(void* target, string_arena& strings, int const* args);   // args points to the first argument slot
+        void* target;                                   // the bound callable
+        std::vector<value_type> parameters;             // for the compiler
+        value_type result;
+    };
+
+    /**
+     * binds a function, the signature is deduced
+     * @return index of the external
+     */
+    template <typename R, typename... Args>
+    int bind(std::string const& name, R (*function)(Args...))
+    {
+        return bind<R(Args...)>(name, function);
+    }
+
+    /**
+     * binds any callable with the given signature, e.g. bind<int(int)>("Hlp_Random", lambda).
+     * A first parameter string_arena& receives the strings of the vm, it is no script argument.
+     * Binding a name again replaces the callable but keeps the index,
+     * so compiled code stays valid. The parameter types must not change
+     * @return index of the external
+     */
+    template <typename Signature, typename F>
+    int bind(std::string const& name, F function)
+    {
+        using callable = typename std::decay<F>::type;
+        std::shared_ptr<void> target = std::make_shared<callable>(std::move(function));
+        using call = detail::external_call<callable, Signature>;
+        std::vector<value_type> parameters = call::parameters();
+        int arguments = int(parameters.size());
+        external entry{name, arguments, &call::invoke, target.get(), std::move(parameters), call::result()};
+        return add(std::move(entry), std::move(target));
+    }
+
+    /**
+     * @return index of the external or -1 if nothing is bound to the name
+     */
+    int find(std::string const& name) const;
+
+    external const& operator[](std::size_t index) const { return table[index]; }
+    std::size_t size() const { return table.size(); }
+
+private:
+    int add(external entry, std::shared_ptr<void> target);
+
+    std::vector<external> table;
+    std::vector<std::shared_ptr<void>> targets;     // owns the callables of the table
+    std::unordered_map<std::string, int> indices;   // lower case name -> index
+};
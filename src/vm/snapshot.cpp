@@ -0,0 +1,285 @@
+#include "snapshot.hpp"
+#include "vm.hpp"
+#include "visitors/compiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::size_t data_alignment = 16;
+
+    std::size_t align(std::size_t offset)
+    {
+        return (offset + data_alignment - 1) / data_alignment * data_alignment;
+    }
+
+    /**
+     * whether code reachable from the entry calls an external or uses global variables, following jumps and calls.
+     * The host may change either before the load, the constant region is part of the program
+     */
+    bool uses_host_state(verified_code const& code, std::size_t entry)
+    {
+        std::vector<int> const& program = *code.code;
+        std::vector<bool> seen(program.size(), false);
+        std::vector<std::size_t> pending{entry};
+        while (!pending.empty())
+        {
+            std::size_t pc = pending.back();
+            pending.pop_back();
+            while (pc < program.size() && !seen[pc])
+            {
+                seen[pc] = true;
+                const auto op = byte_code(program[pc]);
+                const std::size_t next = pc + 1 + verifier::operand_count(op);
+                if (op == op_call_external || (op >= op_load_global && op <= op_store_global_index))
+                    return true;
+                if (op == op_call)
+                    pending.push_back(std::size_t(program[pc + 2]));
+                else if (op == op_jump_if)
+                    pending.push_back(pc + 1 + program[pc + 1]);
+                else if (op == op_jump_table)
+                {
+                    for (int i = 1; i <= program[pc + 2]; ++i)
+                        pending.push_back(next + 2 * std::size_t(i));
+                }
+                if (op == op_jump)
+                    pc = pc + 1 + program[pc + 1];
+                else if (op == op_return)
+                    break;
+                else
+                    pc = next;
+            }
+        }
+        return false;
+    }
+}
+
+std::uint64_t instance_snapshot::fingerprint_of(code_gen::program const& program)
+{
+    // FNV-1a, sizes go in front of every sequence so moving data between neighbours changes the hash
+    std::uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i)
+            hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+    };
+    auto add_size = [&add](std::size_t value) {
+        std::uint64_t size = value;
+        add(&size, sizeof(size));
+    };
+    auto add_string = [&](std::string const& value) {
+        add_size(value.size());
+        add(value.data(), value.size());
+    };
+    auto add_ints = [&](std::vector<int> const& values) {
+        add_size(values.size());
+        add(values.data(), values.size() * sizeof(int));
+    };
+
+    add_ints(program());
+    add_size(program.string_pool().size());
+    for (std::string const& value : program.string_pool())
+        add_string(value);
+    add_ints(program.global_data());
+    add_ints(program.constant_data());
+
+    add_size(program.class_count());
+    for (std::size_t i = 0; i < program.class_count(); ++i)
+    {
+        class_layout const& layout = program.class_at(int(i));
+        add_string(layout.name);
+        add_size(layout.size);
+        add_size(layout.fields.size());
+        for (class_field const& field : layout.fields)
+        {
+            add_string(field.name);
+            add_size(std::size_t(field.type));
+            add_size(field.offset);
+            add_size(field.count);
+        }
+    }
+
+    add_size(program.instance_count());
+    for (int handle = 1; handle <= int(program.instance_count()); ++handle)
+    {
+        instance_init const& init = program.initializer(handle);
+        add_size(std::size_t(program.instance_class(handle)));
+        add_size(init.image.size());
+        add(init.image.data(), init.image.size() * sizeof(std::int32_t));
+        add_size(init.spans.size());
+        for (auto const& span : init.spans)
+        {
+            add_size(span.first);
+            add_size(span.second);
+        }
+        add_size(init.initializer);
+    }
+    return hash;
+}
+
+std::size_t instance_snapshot::write(std::string const& filename, verified_code const& code,
+                                     code_gen::program const& program, std::vector<snapshot_instance> const& instances)
+{
+    vmachine vm(4096, code.externals);
+    vm.strings().assign(program.string_pool());
+    vm.load_globals(program.global_data(), program.constant_data());
+
+    std::vector<snapshot_entry> entries;
+    std::vector<snapshot_span> spans;
+    std::vector<std::vector<std::int32_t>> memory;
+    std::size_t pending = 0;
+    for (snapshot_instance const& instance : instances)
+    {
+        instance_init const& init = *instance.init;
+        std::vector<std::int32_t> object(init.image);
+        object.resize((instance.size + sizeof(std::int32_t) - 1) / sizeof(std::int32_t), 0);
+
+        std::uint64_t initializer = init.initializer;
+        if (initializer != instance_init::no_initializer && !uses_host_state(code, init.initializer))
+        {
+            // only this instance is bound, touching any other one throws and leaves the initializer for the load
+            vm.bind_instance(instance.handle, object.data(), instance.size);
+            try
+            {
+                vm.execute(code, init.initializer, {instance.handle});
+                initializer = instance_init::no_initializer;
+            }
+            catch (std::runtime_error const&)
+            {
+                std::copy(init.image.begin(), init.image.end(), object.begin());
+            }
+            vm.bind_instance(instance.handle, nullptr, 0);
+        }
+        if (initializer != instance_init::no_initializer)
+            ++pending;
+
+        snapshot_entry entry{instance.handle, instance.size, 0, initializer, std::uint32_t(spans.size()),
+                             std::uint32_t(init.spans.size())};
+        for (auto const& span : init.spans)
+        {
+            if (std::size_t(span.first) + span.second > instance.size)
+                throw std::runtime_error("Error: instance " + std::to_string(instance.handle) + " is smaller than its class");
+            spans.push_back(snapshot_span{span.first, span.second});
+        }
+        entries.push_back(entry);
+        memory.push_back(std::move(object));
+    }
+
+    snapshot_header header{snapshot_magic, snapshot_version, fingerprint_of(program),
+                           std::uint32_t(entries.size()), std::uint32_t(spans.size()), std::uint32_t(vm.global_count()), 0,
+                           align(sizeof(snapshot_header) + entries.size() * sizeof(snapshot_entry) + spans.size() * sizeof(snapshot_span))};
+    std::vector<std::int32_t> slab(vm.global_count());
+    for (std::size_t slot = 0; slot < slab.size(); ++slot)
+        slab[slot] = vm.global(slot);
+
+    std::size_t offset = align(header.global_data + slab.size() * sizeof(std::int32_t));
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[i].data = offset;
+        offset = align(offset + entries[i].size);
+    }
+
+    std::string out;
+    out.reserve(offset);
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(snapshot_entry));
+    out.append(reinterpret_cast<const char*>(spans.data()), spans.size() * sizeof(snapshot_span));
+    out.resize(header.global_data, '\0');
+    out.append(reinterpret_cast<const char*>(slab.data()), slab.size() * sizeof(std::int32_t));
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        out.resize(entries[i].data, '\0');
+        out.append(reinterpret_cast<const char*>(memory[i].data()), entries[i].size);
+    }
+    out.resize(offset, '\0');
+
+    // replaced at once, a running world keeps the snapshot it mapped
+    const std::string temporary = filename + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), std::streamsize(out.size())) || !file.flush())
+            throw std::runtime_error("Error: couldn't write snapshot \"" + temporary + '"');
+    }
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Error: couldn't replace snapshot \"" + filename + '"');
+    return pending;
+}
+
+instance_snapshot::instance_snapshot(std::string const& filename, std::uint64_t fingerprint)
+    : base(nullptr)
+    , length(0)
+    , count(0)
+    , entries(nullptr)
+    , span_table(nullptr)
+    , global_table(nullptr)
+    , global_size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::runtime_error("Error: couldn't open snapshot \"" + filename + '"');
+    struct stat info;
+    if (fstat(fd, &info) == 0 && std::size_t(info.st_size) >= sizeof(snapshot_header))
+    {
+        // private and writable: the vm writes to instances, the file stays as it is
+        void* data = mmap(nullptr, std::size_t(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            base = static_cast<char*>(data);
+            length = std::size_t(info.st_size);
+        }
+    }
+    close(fd);
+    if (!base)
+        throw std::runtime_error("Error: couldn't map snapshot \"" + filename + '"');
+
+    try
+    {
+        snapshot_header const& header = *reinterpret_cast<snapshot_header const*>(base);
+        if (header.magic != snapshot_magic || header.version != snapshot_version)
+            throw std::runtime_error("Error: \"" + filename + "\" is no instance snapshot of this version");
+        if (header.fingerprint != fingerprint)
+            throw std::runtime_error("Error: snapshot \"" + filename + "\" was written for another program");
+        std::size_t tables = sizeof(snapshot_header) + std::size_t(header.instances) * sizeof(snapshot_entry)
+                             + std::size_t(header.spans) * sizeof(snapshot_span);
+        if (tables > length || header.global_data != align(tables) || header.global_data > length
+                || std::size_t(header.globals) * sizeof(std::int32_t) > length - header.global_data)
+            throw std::runtime_error("Error: corrupt snapshot \"" + filename + '"');
+        count = header.instances;
+        entries = reinterpret_cast<snapshot_entry const*>(base + sizeof(snapshot_header));
+        span_table = reinterpret_cast<snapshot_span const*>(entries + count);
+        global_size = header.globals;
+        global_table = reinterpret_cast<std::int32_t const*>(base + header.global_data);
+        tables = header.global_data + global_size * sizeof(std::int32_t);
+
+        // validate once, loading copies without checks
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            snapshot_entry const& entry = entries[i];
+            if (entry.handle <= 0 || entry.data % data_alignment != 0 || entry.data < tables || entry.data > length
+                    || entry.size > length - entry.data || entry.first_span > header.spans
+                    || entry.span_count > header.spans - entry.first_span)
+                throw std::runtime_error("Error: corrupt instance in snapshot \"" + filename + '"');
+            for (std::uint32_t s = 0; s < entry.span_count; ++s)
+            {
+                snapshot_span const& span = span_table[entry.first_span + s];
+                if (span.offset > entry.size || span.size > entry.size - span.offset)
+                    throw std::runtime_error("Error: corrupt instance in snapshot \"" + filename + '"');
+            }
+        }
+    }
+    catch (...)
+    {
+        munmap(base, length);
+        throw;
+    }
+}
+
+instance_snapshot::~instance_snapshot()
+{
+    munmap(base, length);
+}
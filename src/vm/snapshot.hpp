@@ -0,0 +1,119 @@
+#pragma once
+
+#include "classes.hpp"
+#include "verifier.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace code_gen { struct program; }
+
+///////////////////////////////////////////////////////////////////////////
+//  Instance Snapshots
+//  the memory of all instances after their initializers ran, written at
+//  build time and mapped at world load, so static data needs no script
+//  execution. A header, the instance table, the spans of the script
+//  members, the global slab and the memory of the instances, in native
+//  byte order
+///////////////////////////////////////////////////////////////////////////
+const std::uint32_t snapshot_magic = 0x504E5344;   // "DSNP"
+const std::uint32_t snapshot_version = 3;
+
+struct snapshot_header
+{
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t fingerprint;      // of the program, see instance_snapshot::fingerprint_of
+    std::uint32_t instances;
+    std::uint32_t spans;
+    std::uint32_t globals;          // slots of the global slab
+    std::uint32_t reserved;         // 0
+    std::uint64_t global_data;      // offset of the global slab in the file
+};
+
+struct snapshot_entry
+{
+    std::int32_t handle;
+    std::uint32_t size;             // of the object in bytes
+    std::uint64_t data;             // offset of the memory in the file
+    std::uint64_t initializer;      // still to run at load, instance_init::no_initializer if it ran at build time
+    std::uint32_t first_span;
+    std::uint32_t span_count;
+};
+
+struct snapshot_span
+{
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+/**
+ * an instance for instance_snapshot::write
+ */
+struct snapshot_instance
+{
+    int handle;
+    std::uint32_t size;             // of its class
+    instance_init const* init;
+};
+
+/**
+ * read-only view of a snapshot, the memory of the instances is mapped copy-on-write
+ * so the vm can work on it directly (see vmachine::load_snapshot)
+ */
+class instance_snapshot
+{
+public:
+    /**
+     * initializes the instances and writes their memory and the global slab. Initializers that
+     * call no externals, use no global variables and touch no other instance run now, the others run at load
+     * @param code the verified code of program
+     * @return the number of initializers left to run at load
+     */
+    static std::size_t write(std::string const& filename, verified_code const& code,
+                             code_gen::program const& program, std::vector<snapshot_instance> const& instances);
+
+    /**
+     * identifies a program, snapshots of other programs are rejected. Covers everything the memory
+     * of a snapshot follows from: the code, the strings, the instance images, the initial globals
+     * and constants and the class layouts
+     */
+    static std::uint64_t fingerprint_of(code_gen::program const& program);
+
+    /**
+     * maps the snapshot, throws if it is missing, corrupt or of another program
+     */
+    instance_snapshot(std::string const& filename, std::uint64_t fingerprint);
+    instance_snapshot(instance_snapshot const&) = delete;
+    instance_snapshot& operator=(instance_snapshot const&) = delete;
+    ~instance_snapshot();
+
+    std::size_t size() const { return count; }
+    snapshot_entry const& operator[](std::size_t i) const { return entries[i]; }
+
+    /**
+     * memory of the instance, writes stay in this process
+     */
+    char* data(std::size_t i) const { return base + entries[i].data; }
+
+    /**
+     * spans of the script members, entries[i].span_count of them
+     */
+    snapshot_span const* spans(std::size_t i) const { return span_table + entries[i].first_span; }
+
+    /**
+     * the global slab after the initializers that ran at build time
+     */
+    std::int32_t const* globals() const { return global_table; }
+    std::size_t global_count() const { return global_size; }
+
+private:
+    char* base;
+    std::size_t length;
+    std::size_t count;
+    snapshot_entry const* entries;
+    snapshot_span const* span_table;
+    std::int32_t const* global_table;
+    std::size_t global_size;
+};
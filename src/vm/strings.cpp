@@ -0,0 +1,337 @@
+#include "strings.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    constexpr std::size_t block_size = 64 * 1024;
+    constexpr std::size_t max_strings = 1u << 29;       // below the flags of kept and temporary handles
+    constexpr std::size_t min_kept_limit = 256 * 1024;
+}
+
+string_arena::region::region()
+    : index(64, slot{0, 0})
+    , generation(1)
+    , next_block(0)
+    , free_text(nullptr)
+    , free_size(0)
+{
+}
+
+int string_arena::region::find(const char* data, std::size_t size, std::uint32_t hash, std::size_t& at) const
+{
+    const std::size_t mask = index.size() - 1;
+    for (at = hash & mask;; at = (at + 1) & mask)
+    {
+        const slot& s = index[at];
+        if (s.generation != generation)
+            return -1;
+        const entry& e = entries[s.index];
+        if (e.hash == hash && e.size == size && std::memcmp(e.data, data, size) == 0)
+            return s.index;
+    }
+}
+
+int string_arena::region::insert(const char* data, std::size_t size, std::uint32_t hash, std::size_t at)
+{
+    if (size > 0xFFFFFFFFu || (free.empty() && entries.size() >= max_strings))
+        throw std::runtime_error("Error: string arena full");
+    int handle;
+    if (!free.empty())
+    {
+        handle = free.back();
+        free.pop_back();
+        entries[handle] = entry{data, std::uint32_t(size), hash, -1, 0};
+    }
+    else
+    {
+        handle = int(entries.size());
+        entries.push_back(entry{data, std::uint32_t(size), hash, -1, 0});
+    }
+    // at most half full
+    if (entries.size() * 2 > index.size())
+        rehash(index.size() * 2);
+    else
+        index[at] = slot{generation, handle};
+    return handle;
+}
+
+char* string_arena::region::allocate(std::size_t size)
+{
+    while (size > free_size)
+    {
+        // blocks left from before the last clear first, strings larger than a block get their own
+        if (next_block == blocks.size())
+            blocks.emplace_back(std::unique_ptr<char[]>(new char[std::max(size, block_size)]), std::max(size, block_size));
+        free_text = blocks[next_block].first.get();
+        free_size = blocks[next_block].second;
+        ++next_block;
+    }
+    char* text = free_text;
+    free_text += size;
+    free_size -= size;
+    return text;
+}
+
+void string_arena::region::release(std::size_t size)
+{
+    free_text -= size;
+    free_size += size;
+}
+
+void string_arena::region::clear()
+{
+    entries.clear();
+    free.clear();
+    // bumping the generation frees every slot of the index at once
+    if (++generation == 0)
+    {
+        std::fill(index.begin(), index.end(), slot{0, 0});
+        generation = 1;
+    }
+    next_block = 0;
+    free_text = nullptr;
+    free_size = 0;
+}
+
+void string_arena::region::rehash(std::size_t capacity)
+{
+    index.assign(capacity, slot{0, 0});
+    generation = 1;
+    const std::size_t mask = capacity - 1;
+    for (std::size_t handle = 0; handle < entries.size(); ++handle)
+    {
+        if (entries[handle].flags & unused)
+            continue;
+        std::size_t at = entries[handle].hash & mask;
+        while (index[at].generation == generation)
+            at = (at + 1) & mask;
+        index[at] = slot{generation, int(handle)};
+    }
+}
+
+string_arena::string_arena()
+{
+    assign({""});
+}
+
+std::uint32_t string_arena::hash_of(const char* data, std::size_t size)
+{
+    // FNV-1a
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i)
+        hash = (hash ^ std::uint8_t(data[i])) * 16777619u;
+    return hash;
+}
+
+bool string_arena::valid(int handle) const
+{
+    if (handle < 0)
+        return false;
+    if (handle & temporary_flag)
+        return std::size_t(handle & ~temporary_flag) < temporaries.entries.size();
+    if (handle & kept_flag)
+    {
+        const std::size_t index = std::size_t(handle & ~kept_flag);
+        return index < kept.entries.size() && !(kept.entries[index].flags & unused);
+    }
+    return std::size_t(handle) < permanent.entries.size();
+}
+
+const string_arena::entry& string_arena::entry_of(int handle) const
+{
+    if (handle & temporary_flag)
+        return temporaries.entries[handle & ~temporary_flag];
+    if (handle & kept_flag)
+        return kept.entries[handle & ~kept_flag];
+    return permanent.entries[handle];
+}
+
+int string_arena::find(const char* data, std::size_t size, std::uint32_t hash, std::size_t& at) const
+{
+    // permanent and kept strings first, a temporary equal to one of them forwards to it
+    int handle = permanent.find(data, size, hash, at);
+    if (handle >= 0)
+        return handle;
+    handle = kept.find(data, size, hash, at);
+    if (handle >= 0)
+        return handle | kept_flag;
+    handle = temporaries.find(data, size, hash, at);
+    return handle < 0 ? -1 : handle | temporary_flag;
+}
+
+void string_arena::forward(const char* data, std::size_t size, std::uint32_t hash, int handle)
+{
+    // an equal temporary stays valid until the reset, it forwards to the new string from now on
+    std::size_t at;
+    int temporary = temporaries.find(data, size, hash, at);
+    if (temporary >= 0)
+        temporaries.entries[temporary].forward = handle;
+}
+
+int string_arena::intern(const char* data, std::size_t size)
+{
+    const std::uint32_t hash = hash_of(data, size);
+    std::size_t at;
+    int handle = permanent.find(data, size, hash, at);
+    if (handle >= 0)
+        return handle;
+    std::size_t kept_at;
+    handle = kept.find(data, size, hash, kept_at);
+    if (handle >= 0)
+    {
+        // one handle per string, the kept one stays and is never swept
+        kept.entries[handle].flags |= pinned;
+        return handle | kept_flag;
+    }
+    char* text = permanent.allocate(size);
+    if (size)
+        std::memcpy(text, data, size);
+    handle = permanent.insert(text, size, hash, at);
+    forward(data, size, hash, handle);
+    return handle;
+}
+
+int string_arena::add_temporary(const char* data, std::size_t size, std::uint32_t hash, bool copy)
+{
+    std::size_t at;
+    int handle = find(data, size, hash, at);
+    if (handle >= 0)
+    {
+        if (!copy)
+            temporaries.release(size);  // data is the last allocation, drop it
+        return canonical(handle);
+    }
+    const char* text = data;
+    if (copy)
+    {
+        char* target = temporaries.allocate(size);
+        if (size)
+            std::memcpy(target, data, size);
+        text = target;
+    }
+    return temporaries.insert(text, size, hash, at) | temporary_flag;
+}
+
+int string_arena::temporary(const char* data, std::size_t size)
+{
+    return add_temporary(data, size, hash_of(data, size), true);
+}
+
+int string_arena::concat(int first, int second)
+{
+    const std::size_t first_size = size(first);
+    const std::size_t second_size = size(second);
+    if (first_size == 0)
+        return valid(second) ? second : 0;
+    if (second_size == 0)
+        return first;
+
+    // built in place, the sources stay put since blocks never move
+    const std::size_t length = first_size + second_size;
+    char* text = temporaries.allocate(length);
+    std::memcpy(text, data(first), first_size);
+    std::memcpy(text + first_size, data(second), second_size);
+    return add_temporary(text, length, hash_of(text, length), false);
+}
+
+int string_arena::keep(int handle)
+{
+    if (!valid(handle))
+        return 0;
+    handle = canonical(handle);
+    if (!(handle & temporary_flag))
+        return handle;
+
+    // not permanent or kept yet, it would forward there otherwise
+    const entry e = entry_of(handle);
+    std::size_t at;
+    kept.find(e.data, e.size, e.hash, at);
+    char* text = kept.allocate(e.size);
+    if (e.size)
+        std::memcpy(text, e.data, e.size);
+    int kept_handle = kept.insert(text, e.size, e.hash, at) | kept_flag;
+    temporaries.entries[handle & ~temporary_flag].forward = kept_handle;
+    kept_bytes += e.size + sizeof(entry);
+    return kept_handle;
+}
+
+void string_arena::mark(int const* slots, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const int handle = slots[i];
+        if ((handle & kept_flag) && !(handle & temporary_flag) && valid(handle))
+            kept.entries[handle & ~kept_flag].flags |= marked;
+    }
+}
+
+std::size_t string_arena::sweep()
+{
+    temporaries.clear();
+
+    // the live text moves into the spare blocks, the current ones are the spare blocks of the next sweep
+    std::swap(kept.blocks, spare_blocks);
+    kept.next_block = 0;
+    kept.free_text = nullptr;
+    kept.free_size = 0;
+    std::size_t dropped = 0;
+    std::size_t live = 0;
+    for (std::size_t i = 0; i < kept.entries.size(); ++i)
+    {
+        entry& e = kept.entries[i];
+        if (e.flags & unused)
+            continue;
+        if (!(e.flags & (pinned | marked)))
+        {
+            e = entry{nullptr, 0, 0, -1, unused};
+            kept.free.push_back(int(i));
+            ++dropped;
+            continue;
+        }
+        char* text = kept.allocate(e.size);
+        if (e.size)
+            std::memcpy(text, e.data, e.size);
+        e.data = text;
+        e.flags &= ~std::uint32_t(marked);
+        live += e.size + sizeof(entry);
+    }
+    kept.rehash(kept.index.size());
+    kept_bytes = live;
+    kept_limit = std::max(min_kept_limit, 2 * live);
+    return dropped;
+}
+
+int string_arena::canonical(int handle) const
+{
+    if ((handle & temporary_flag) && valid(handle))
+    {
+        int forward = temporaries.entries[handle & ~temporary_flag].forward;
+        if (forward >= 0)
+            return forward;
+    }
+    return handle;
+}
+
+void string_arena::reset_temporaries()
+{
+    temporaries.clear();
+}
+
+void string_arena::assign(std::vector<std::string> const& pool)
+{
+    permanent = region();
+    kept = region();
+    temporaries = region();
+    spare_blocks.clear();
+    kept_bytes = 0;
+    kept_limit = min_kept_limit;
+    for (std::size_t i = 0; i < pool.size(); ++i)
+    {
+        if (intern(pool[i]) != int(i))
+            throw std::runtime_error("Error: string pool entry " + std::to_string(i) + " is a duplicate");
+    }
+    if (pool.empty() || !pool[0].empty())
+        throw std::runtime_error("Error: string pool must start with the empty string");
+}
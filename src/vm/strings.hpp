@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////
+//  The String Arena
+///////////////////////////////////////////////////////////////////////////
+
+/**
+ * immutable strings of the vm, addressed by 32-bit handles.
+ * Strings are interned, equal strings have equal handles, so comparing two strings
+ * compares two ints (see equal). Handle 0 is the empty string.
+ *
+ * Permanent strings (literals, strings of the host) live until assign.
+ * Strings computed by scripts are temporaries, they live until reset_temporaries,
+ * which the vm calls when it starts running a function for the host.
+ * Temporaries reuse their memory after a reset, string-heavy scripts
+ * don't allocate once the arena has grown to their working set.
+ *
+ * Temporaries a script stores into a global or a member are kept (see keep). Kept strings
+ * live as long as a slot refers to them: once collect_due, the vm marks every handle in
+ * the globals, the constants and the instances and sweeps the others. Their handles are
+ * reused and their text moves between two sets of blocks, so kept strings don't allocate
+ * either once the arena has grown to the strings the globals and instances hold.
+ * A host that holds a kept handle elsewhere must intern it, interned strings are never swept.
+ */
+class string_arena
+{
+public:
+    string_arena();
+
+    /**
+     * @return handle of a permanent string
+     */
+    int intern(const char* data, std::size_t size);
+    int intern(std::string const& value) { return intern(value.data(), value.size()); }
+
+    /**
+     * @return handle of the string, a temporary unless the string is permanent already
+     */
+    int temporary(const char* data, std::size_t size);
+    int temporary(std::string const& value) { return temporary(value.data(), value.size()); }
+
+    /**
+     * concatenates two strings into a temporary without an intermediate copy
+     */
+    int concat(int first, int second);
+
+    /**
+     * @return a kept handle of the string, for values stored where they outlive the current call.
+     * Permanent strings keep their handle
+     */
+    int keep(int handle);
+
+    /**
+     * whether the kept strings grew enough since the last sweep to look for unreferenced ones
+     */
+    bool collect_due() const { return kept_bytes > kept_limit; }
+
+    /**
+     * marks the kept strings referenced by the slots, any value may be in them
+     */
+    void mark(int const* slots, std::size_t count);
+
+    /**
+     * drops the kept strings that weren't marked since the last sweep, invalidates all temporaries
+     * @return the number of strings dropped
+     */
+    std::size_t sweep();
+
+    /**
+     * invalidates all temporary handles
+     */
+    void reset_temporaries();
+
+    /**
+     * drops all strings and interns the pool, so the handle of pool[i] is i.
+     * the pool starts with the empty string and holds no duplicates
+     */
+    void assign(std::vector<std::string> const& pool);
+
+    bool valid(int handle) const;
+
+    /**
+     * O(1), equal strings have equal handles
+     */
+    bool equal(int first, int second) const { return first == second || canonical(first) == canonical(second); }
+
+    /**
+     * the one handle of the string, differs from the handle only for temporaries that were kept or interned
+     */
+    int canonical(int handle) const;
+
+    /**
+     * invalid handles read as the empty string
+     */
+    const char* data(int handle) const { return valid(handle) ? entry_of(handle).data : ""; }
+    std::size_t size(int handle) const { return valid(handle) ? entry_of(handle).size : 0; }
+    std::string str(int handle) const { return std::string(data(handle), size(handle)); }
+
+    std::size_t count() const { return permanent.entries.size(); }
+    std::size_t kept_count() const { return kept.entries.size() - kept.free.size(); }
+    std::size_t temporary_count() const { return temporaries.entries.size(); }
+
+private:
+    static constexpr int temporary_flag = 1 << 30;
+    static constexpr int kept_flag = 1 << 29;
+
+    enum entry_flags : std::uint32_t
+    {
+        pinned = 1,                 // kept string that was interned, never swept
+        marked = 2,                 // kept string referenced since the last sweep
+        unused = 4                  // swept, the handle is free
+    };
+
+    struct entry
+    {
+        const char* data;
+        std::uint32_t size;
+        std::uint32_t hash;
+        int forward;                // permanent or kept handle of a temporary that was kept or interned, or -1
+        std::uint32_t flags;
+    };
+
+    struct slot
+    {
+        std::uint32_t generation;   // the slot is free unless it matches the generation of the region
+        int index;
+    };
+
+    /**
+     * strings with a hash index and block storage, clear keeps the memory
+     */
+    struct region
+    {
+        region();
+
+        int find(const char* data, std::size_t size, std::uint32_t hash, std::size_t& at) const;
+        int insert(const char* data, std::size_t size, std::uint32_t hash, std::size_t at);
+        char* allocate(std::size_t size);
+        void release(std::size_t size);     // undoes the last allocate
+        void clear();
+        void rehash(std::size_t capacity);
+
+        std::vector<entry> entries;
+        std::vector<int> free;              // unused entries, only kept strings are ever dropped
+        std::vector<slot> index;
+        std::uint32_t generation;
+        std::vector<std::pair<std::unique_ptr<char[]>, std::size_t>> blocks;
+        std::size_t next_block;
+        char* free_text;
+        std::size_t free_size;
+    };
+
+    static std::uint32_t hash_of(const char* data, std::size_t size);
+    const entry& entry_of(int handle) const;
+    int find(const char* data, std::size_t size, std::uint32_t hash, std::size_t& at) const;
+    int add_temporary(const char* data, std::size_t size, std::uint32_t hash, bool copy);
+    void forward(const char* data, std::size_t size, std::uint32_t hash, int handle);
+
+    region permanent;
+    region kept;
+    region temporaries;
+    std::vector<std::pair<std::unique_ptr<char[]>, std::size_t>> spare_blocks;  // the kept text moves here on sweep
+    std::size_t kept_bytes = 0;     // text and entries of the kept strings since the last sweep
+    std::size_t kept_limit = 0;
+};
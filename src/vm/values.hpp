@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////
+//  Script Values
+//  every value fits a 32-bit stack slot. The type of a slot is known at
+//  compile time and selects the opcodes, slots carry no tag at runtime
+///////////////////////////////////////////////////////////////////////////
+enum value_type : std::uint8_t
+{
+    type_void,
+    type_int,
+    type_float,     // IEEE bits of the float
+    type_string,    // handle into the string_arena of the vm
+    type_instance,  // instance handle, 0 is no instance
+    type_func       // function handle, 0 is no function, see code_gen::program::function_address
+};
+
+inline int float_to_slot(float value)
+{
+    int slot;
+    std::memcpy(&slot, &value, sizeof(slot));
+    return slot;
+}
+
+inline float slot_to_float(int slot)
+{
+    float value;
+    std::memcpy(&value, &slot, sizeof(value));
+    return value;
+}
+
+/**
+ * instance argument or return value of an external
+ */
+struct instance_handle
+{
+    int index;
+};
+
+/**
+ * func argument, return value or member, e.g. a daily routine the host calls
+ */
+struct function_handle
+{
+    int index;
+};
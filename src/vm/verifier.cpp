@@ -0,0 +1,350 @@
+#include "verifier.hpp"
+#include "vm.hpp"
+#include "externals.hpp"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    // larger frames don't fit any vm stack, rejecting them keeps the depth arithmetic in range
+    constexpr int max_frame_size = 1 << 24;
+
+    // stack state on entry of an instruction, frame relative
+    struct state
+    {
+        int depth = -1;     // -1: not reached yet
+        int locals = 0;
+    };
+
+    std::runtime_error invalid(std::size_t address, const std::string& what)
+    {
+        return std::runtime_error("Error: invalid bytecode at " + std::to_string(address) + ": " + what);
+    }
+}
+
+bool verified_code::is_entry(std::size_t address, std::size_t arguments) const
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), address,
+                               [](const entry_point& entry, std::size_t a) { return entry.address < a; });
+    return it != entries.end() && it->address == address && std::size_t(it->arguments) == arguments;
+}
+
+int verifier::operand_count(int opcode)
+{
+    const auto op = byte_code(opcode);
+    if (op & op_unary_flag)
+        return (op >= op_pos && op <= op_bitnot) || op == op_fneg || op == op_itof ? 0 : -1;
+    if (op & op_binary_flag)
+        return (op >= op_add && op <= op_logical_or) || (op >= op_fadd && op <= op_fgte) ? 0 : -1;
+    switch (op)
+    {
+        case op_load:
+        case op_store:
+        case op_int:
+        case op_instance:
+        case op_function:
+        case op_jump_if:
+        case op_jump:
+        case op_stk_adj:
+        case op_load_field:
+        case op_store_field:
+        case op_store_string_field:
+        case op_load_global:
+        case op_store_global:
+            return 1;
+        case op_load_global_index:
+        case op_store_global_index:
+        case op_load_const_index:
+        case op_load_index:
+        case op_store_index:
+        case op_load_field_index:
+        case op_store_field_index:
+        case op_clear:
+        case op_jump_table:
+            return 2;
+        case op_call:
+            return 2;
+        case op_call_external:
+            return 1;
+        case op_return:
+        case op_pop:
+        case op_keep:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+verified_code verifier::verify(std::vector<int> const& code, std::vector<entry_point> entries,
+                               external_registry const* externals, std::size_t globals, std::size_t constants)
+{
+    const std::size_t size = code.size();
+
+    // instructions are decoded linearly, so each position is either an instruction start or an operand
+    std::vector<bool> starts(size + 1, false);
+    for (std::size_t pc = 0; pc < size;)
+    {
+        int operands = operand_count(code[pc]);
+        if (operands < 0)
+            throw invalid(pc, "unknown opcode " + std::to_string(code[pc]));
+        if (size - pc <= std::size_t(operands))
+            throw invalid(pc, "truncated instruction");
+        starts[pc] = true;
+        pc += 1 + operands;
+    }
+    starts[size] = true;
+
+    std::vector<state> states(size);
+    std::vector<int> arguments(size, -1);   // argument count of the functions starting here
+    std::vector<std::size_t> pending;
+    int max_depth = 0;
+
+    auto reach = [&](std::size_t from, std::size_t target, state s) {
+        if (!starts[target])
+            throw invalid(from, "jump into an instruction");
+        if (target == size)
+            return;     // leaving the code returns -1
+        if (states[target].depth < 0)
+        {
+            states[target] = s;
+            pending.push_back(target);
+        }
+        else if (states[target].depth != s.depth || states[target].locals != s.locals)
+            throw invalid(target, "stack depth differs between paths");
+    };
+
+    auto jump_target = [&](std::size_t operand) {
+        long long target = (long long)(operand) + code[operand];
+        if (target < 0 || target > (long long)(size))
+            throw invalid(operand - 1, "jump out of the code");
+        return std::size_t(target);
+    };
+
+    std::sort(entries.begin(), entries.end(),
+              [](const entry_point& a, const entry_point& b) { return a.address < b.address; });
+    for (const entry_point& entry : entries)
+    {
+        if (entry.address > size || !starts[entry.address])
+            throw invalid(entry.address, "entry point is no instruction");
+        if (entry.arguments < 0 || entry.arguments > max_frame_size)
+            throw invalid(entry.address, "invalid argument count of entry point");
+        if (entry.address == size)
+            continue;
+        if (arguments[entry.address] >= 0 && arguments[entry.address] != entry.arguments)
+            throw invalid(entry.address, "entry point listed with different argument counts");
+        arguments[entry.address] = entry.arguments;
+        reach(entry.address, entry.address, state{entry.arguments, entry.arguments});
+        max_depth = std::max(max_depth, entry.arguments);
+    }
+
+    while (!pending.empty())
+    {
+        const std::size_t pc = pending.back();
+        pending.pop_back();
+        state s = states[pc];
+
+        auto pop = [&](int count) {
+            if (s.depth - count < s.locals)
+                throw invalid(pc, "stack underflow");
+            s.depth -= count;
+        };
+        auto push = [&]() {
+            if (++s.depth > max_frame_size)
+                throw invalid(pc, "stack frame too large");
+            max_depth = std::max(max_depth, s.depth);
+        };
+        auto local = [&](int index) {
+            if (index < 0 || index >= s.locals)
+                throw invalid(pc, "local " + std::to_string(index) + " out of range");
+        };
+        auto locals = [&](int first, int count) {
+            if (first < 0 || count <= 0 || (long long)(first) + count > s.locals)
+                throw invalid(pc, "locals " + std::to_string(first) + " to " + std::to_string((long long)(first) + count) + " out of range");
+        };
+        auto slots = [&](int first, int count, std::size_t region) {
+            if (first < 0 || count <= 0 || std::size_t(first) + std::size_t(count) > region)
+                throw invalid(pc, "global " + std::to_string(first) + " out of range");
+        };
+
+        const auto op = byte_code(code[pc]);
+        const std::size_t next = pc + 1 + operand_count(op);
+        if (op & op_unary_flag)
+        {
+            pop(1);
+            push();
+        }
+        else if (op & op_binary_flag)
+        {
+            pop(2);
+            push();
+        }
+        else
+        {
+            switch (op)
+            {
+                case op_load:
+                    local(code[pc + 1]);
+                    push();
+                    break;
+
+                case op_store:
+                    pop(1);
+                    local(code[pc + 1]);
+                    break;
+
+                case op_int:
+                case op_instance:
+                case op_function:
+                    push();
+                    break;
+
+                case op_jump:
+                    reach(pc, jump_target(pc + 1), s);
+                    continue;
+
+                case op_jump_if:
+                    pop(1);
+                    reach(pc, jump_target(pc + 1), s);
+                    break;
+
+                case op_jump_table:
+                {
+                    const int count = code[pc + 2];
+                    if (count < 0 || (long long)(next) + 2LL * count >= (long long)(size))
+                        throw invalid(pc, "jump table out of the code");
+                    pop(1);
+                    for (std::size_t entry = next; entry <= next + 2 * std::size_t(count); entry += 2)
+                    {
+                        if (!starts[entry] || code[entry] != op_jump)
+                            throw invalid(entry, "jump table entry is no op_jump");
+                        reach(pc, entry, s);
+                    }
+                }
+                    continue;
+
+                case op_stk_adj:
+                {
+                    int n = code[pc + 1];
+                    if (n < 0 || n > max_frame_size)
+                        throw invalid(pc, "invalid frame size " + std::to_string(n));
+                    s.depth = s.locals = n;
+                    max_depth = std::max(max_depth, n);
+                }
+                    break;
+
+                case op_call:
+                {
+                    int nargs = code[pc + 1];
+                    int target = code[pc + 2];
+                    if (nargs < 0)
+                        throw invalid(pc, "negative argument count");
+                    if (target < 0 || std::size_t(target) >= size || !starts[std::size_t(target)])
+                        throw invalid(pc, "call target " + std::to_string(target) + " is no instruction");
+                    if (arguments[target] >= 0 && arguments[target] != nargs)
+                        throw invalid(pc, "function at " + std::to_string(target) + " called with different argument counts");
+                    pop(nargs);
+                    arguments[target] = nargs;
+                    reach(pc, std::size_t(target), state{nargs, nargs});
+                    max_depth = std::max(max_depth, nargs);
+                    push();     // the return value replaces the arguments
+                }
+                    break;
+
+                case op_call_external:
+                {
+                    int index = code[pc + 1];
+                    if (!externals || index < 0 || std::size_t(index) >= externals->size())
+                        throw invalid(pc, "unknown external " + std::to_string(index));
+                    pop((*externals)[std::size_t(index)].arguments);
+                    push();
+                }
+                    break;
+
+                case op_pop:
+                    pop(1);
+                    break;
+
+                case op_load_field:
+                case op_store_field:
+                case op_store_string_field:
+                {
+                    int offset = code[pc + 1];
+                    if (offset < 0 || offset % int(sizeof(int)) != 0)
+                        throw invalid(pc, "invalid field offset " + std::to_string(offset));
+                    pop(op == op_load_field ? 1 : 2);
+                    if (op == op_load_field)
+                        push();
+                }
+                    break;
+
+                case op_load_global:
+                    slots(code[pc + 1], 1, globals);
+                    push();
+                    break;
+
+                case op_store_global:
+                    pop(1);
+                    slots(code[pc + 1], 1, globals);
+                    break;
+
+                case op_load_global_index:
+                case op_load_const_index:
+                    slots(code[pc + 1], code[pc + 2], op == op_load_global_index ? globals : constants);
+                    pop(1);
+                    push();
+                    break;
+
+                case op_store_global_index:
+                    slots(code[pc + 1], code[pc + 2], globals);
+                    pop(2);
+                    break;
+
+                case op_keep:
+                    pop(1);
+                    push();
+                    break;
+
+                case op_load_index:
+                    locals(code[pc + 1], code[pc + 2]);
+                    pop(1);
+                    push();
+                    break;
+
+                case op_store_index:
+                    locals(code[pc + 1], code[pc + 2]);
+                    pop(2);
+                    break;
+
+                case op_clear:
+                    locals(code[pc + 1], code[pc + 2]);
+                    break;
+
+                case op_load_field_index:
+                case op_store_field_index:
+                {
+                    int offset = code[pc + 1];
+                    int count = code[pc + 2];
+                    if (offset < 0 || offset % int(sizeof(int)) != 0 || count <= 0
+                            || (long long)(offset) + (long long)(count) * int(sizeof(int)) > INT_MAX)
+                        throw invalid(pc, "invalid array member at " + std::to_string(offset));
+                    pop(op == op_load_field_index ? 2 : 3);
+                    if (op == op_load_field_index)
+                        push();
+                }
+                    break;
+
+                case op_return:
+                    if (s.depth <= s.locals)
+                        throw invalid(pc, "return without a value");
+                    continue;
+
+                default:
+                    throw invalid(pc, "unknown opcode");
+            }
+        }
+        reach(pc, next, s);
+    }
+    return verified_code{&code, externals, std::move(entries), unsigned(max_depth), globals, constants};
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+class external_registry;
+
+///////////////////////////////////////////////////////////////////////////
+//  The Bytecode Verifier
+///////////////////////////////////////////////////////////////////////////
+
+/**
+ * a function the host may call, it starts with its arguments as locals
+ */
+struct entry_point
+{
+    std::size_t address;
+    int arguments;
+};
+
+/**
+ * code that passed the verifier, vmachine runs it without per instruction checks.
+ * refers to the code and the externals, which must outlive it and must not change
+ */
+struct verified_code
+{
+    std::vector<int> const* code;
+    external_registry const* externals;
+    std::vector<entry_point> entries;   // sorted by address
+    unsigned max_frame;     // deepest stack frame (locals and temporaries) of any function
+    std::size_t globals;    // slots of the global region the code uses
+    std::size_t constants;  // slots of the constant region the code uses
+
+    bool is_entry(std::size_t address, std::size_t arguments) const;
+};
+
+/**
+ * checks a whole program before it runs:
+ * - every instruction is known and its operands are inside the code
+ * - jumps and calls target instruction starts (jumps may also target the end)
+ * - the stack depth is the same on every path to an instruction
+ *   and no instruction pops below the locals of its frame
+ * - op_load, op_store and the local array opcodes address locals of the current frame
+ * - every call of a function passes the same number of arguments
+ * - externals are bound in the registry
+ * - field offsets are non-negative and aligned, the vm checks them against the instance
+ *   and run time indices against the array
+ * - globals and arrays are inside the global and the constant region of the program
+ * code runs from its entry points, called functions start with their arguments as locals
+ */
+class verifier
+{
+public:
+    /**
+     * throws std::runtime_error describing the first problem found
+     */
+    static verified_code verify(std::vector<int> const& code,
+                                std::vector<entry_point> entries = {{0, 0}},
+                                external_registry const* externals = nullptr,
+                                std::size_t globals = 0, std::size_t constants = 0);
+
+    /**
+     * @return the number of operands following the opcode, -1 for unknown opcodes
+     */
+    static int operand_count(int opcode);
+};
@@ -5,9 +5,14 @@
     file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 #include "vm.hpp"
+#include "snapshot.hpp"
 #include <boost/assert.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <functional>
 #include <iostream>
+#include <stdexcept>
 
 int vmachine::execute(std::vector<int> const &code,
                       std::vector<int>::const_iterator pc,
@@ -66,6 +71,8 @@ int vmachine::execute(std::vector<int> const &code,
                     break;
 
                 case op_int:
+                case op_instance:
+                case op_function:
                     *stack_ptr++ = *pc++;
                     break;
 
@@ -81,9 +88,18 @@ int vmachine::execute(std::vector<int> const &code,
                     --stack_ptr;
                     break;
 
+                case op_jump_table: {
+                    BOOST_ASSERT(pc[1] >= 0);
+                    const std::uint32_t index = std::uint32_t(popInt()) - std::uint32_t(pc[0]);
+                    const std::uint32_t count = std::uint32_t(pc[1]);
+                    pc += 2 + 2 * std::ptrdiff_t(index < count ? index : count);
+                    BOOST_ASSERT(pc < code.end() && *pc == op_jump);
+                }
+                    break;
+
                 case op_stk_adj:
                     n_locals = *pc++;
-                    stack_ptr = stack.begin() + n_locals;
+                    stack_ptr = frame_ptr + n_locals;
                     break;
 
                 case op_call: {
@@ -105,6 +121,106 @@ int vmachine::execute(std::vector<int> const &code,
                 case op_return:
                     return stack_ptr[-1];
 
+                case op_pop:
+                    popInt();
+                    break;
+
+                case op_call_external: {
+                    BOOST_ASSERT(externals && std::size_t(*pc) < externals->size());
+                    const external_registry::external& external = (*externals)[std::size_t(*pc++)];
+                    BOOST_ASSERT(stack_ptr - external.arguments >= frame_ptr + n_locals);
+                    int r = external.invoke(external.target, string_table, &*(stack_ptr - external.arguments));
+                    stack_ptr -= external.arguments;
+                    pushInt(r);
+                }
+                    break;
+
+                case op_load_global:
+                    BOOST_ASSERT(std::size_t(*pc) < global_size);
+                    pushInt(globals[*pc++]);
+                    break;
+
+                case op_store_global:
+                    BOOST_ASSERT(std::size_t(*pc) < global_size);
+                    globals[*pc++] = popInt();
+                    break;
+
+                case op_load_global_index: {
+                    BOOST_ASSERT(std::size_t(pc[0]) + pc[1] <= global_size);
+                    stack_ptr[-1] = element(globals + pc[0], pc[1], stack_ptr[-1]);
+                    pc += 2;
+                }
+                    break;
+
+                case op_store_global_index: {
+                    BOOST_ASSERT(std::size_t(pc[0]) + pc[1] <= global_size);
+                    int value = popInt();
+                    element(globals + pc[0], pc[1], popInt()) = value;
+                    pc += 2;
+                }
+                    break;
+
+                case op_load_const_index: {
+                    BOOST_ASSERT(std::size_t(pc[0]) + pc[1] <= constants.size());
+                    stack_ptr[-1] = element(constants.data() + pc[0], pc[1], stack_ptr[-1]);
+                    pc += 2;
+                }
+                    break;
+
+                case op_keep:
+                    stack_ptr[-1] = string_table.keep(stack_ptr[-1]);
+                    break;
+
+                case op_load_index:
+                    stack_ptr[-1] = element(&frame_ptr[pc[0]], pc[1], stack_ptr[-1]);
+                    pc += 2;
+                    break;
+
+                case op_store_index: {
+                    int value = popInt();
+                    element(&frame_ptr[pc[0]], pc[1], popInt()) = value;
+                    pc += 2;
+                }
+                    break;
+
+                case op_load_field_index: {
+                    int index = popInt();
+                    stack_ptr[-1] = field(stack_ptr[-1], pc[0], pc[1], index);
+                    pc += 2;
+                }
+                    break;
+
+                case op_store_field_index: {
+                    int value = popInt();
+                    int index = popInt();
+                    field(popInt(), pc[0], pc[1], index) = value;
+                    pc += 2;
+                }
+                    break;
+
+                case op_clear:
+                    std::fill_n(frame_ptr + pc[0], pc[1], 0);
+                    pc += 2;
+                    break;
+
+                case op_load_field: {
+                    int offset = *pc++;
+                    stack_ptr[-1] = field(stack_ptr[-1], offset);
+                }
+                    break;
+
+                case op_store_field: {
+                    int value = popInt();
+                    field(popInt(), *pc++) = value;
+                }
+                    break;
+
+                case op_store_string_field: {
+                    int value = string_table.keep(popInt());
+                    field(popInt(), *pc++) = value;
+                }
+                    break;
+
                 default:
                     BOOST_ASSERT_MSG(false, "unknown op code");
             }
@@ -113,14 +229,313 @@ int vmachine::execute(std::vector<int> const &code,
     return -1;
 }
 
+int vmachine::execute(verified_code const& verified, std::size_t entry, std::initializer_list<int> args)
+{
+    int const* const begin = verified.code->data();
+    int const* const end = begin + verified.code->size();
+    int* const stack_end = stack.data() + stack.size();
+    const unsigned max_frame = verified.max_frame;
+
+    if (!verified.is_entry(entry, args.size()))
+        throw std::runtime_error("Error: no verified entry point at " + std::to_string(entry)
+                                 + " with " + std::to_string(args.size()) + " arguments");
+    if (max_frame > stack.size())
+        throw std::runtime_error("Error: vm stack overflow");
+    if (verified.globals > global_size || verified.constants > constants.size())
+        throw std::runtime_error("Error: the globals of the program aren't loaded");
+    int const* const constant_data = constants.data();
+
+    release_strings(args.begin(), args.size());
+    if (call_counts)
+    {
+        call_counts->resize(std::max(call_counts->size(), verified.code->size()), 0);
+        ++(*call_counts)[entry];
+    }
+    int const* pc = begin + entry;
+    int* frame_ptr = stack.data();
+    int* stack_ptr = std::copy(args.begin(), args.end(), frame_ptr);
+    calls.clear();
+
+    for (;;)
+    {
+        int result = -1;    // value of a function that runs off the end
+        while (pc != end)
+        {
+            byte_code op_code = byte_code(*pc++);
+            if (op_code & op_unary_flag)
+            {
+                stack_ptr[-1] = evaluateUnary(op_code, stack_ptr[-1]);
+                continue;
+            }
+            if (op_code & op_binary_flag)
+            {
+                --stack_ptr;
+                stack_ptr[-1] = evaluateBinary(op_code, stack_ptr[-1], stack_ptr[0]);
+                continue;
+            }
+            switch (op_code)
+            {
+                case op_load:
+                    *stack_ptr++ = frame_ptr[*pc++];
+                    break;
+
+                case op_store:
+                    frame_ptr[*pc++] = *--stack_ptr;
+                    break;
+
+                case op_int:
+                case op_instance:
+                case op_function:
+                    *stack_ptr++ = *pc++;
+                    break;
+
+                case op_jump:
+                    pc += *pc;
+                    break;
+
+                case op_jump_if:
+                    if (!*--stack_ptr)
+                        pc += *pc;
+                    else
+                        ++pc;
+                    break;
+
+                case op_jump_table:
+                {
+                    // one compare for every value, values out of range take the default
+                    const std::uint32_t index = std::uint32_t(*--stack_ptr) - std::uint32_t(pc[0]);
+                    const std::uint32_t count = std::uint32_t(pc[1]);
+                    pc += 2 + 2 * std::ptrdiff_t(index < count ? index : count);
+                }
+                    break;
+
+                case op_stk_adj:
+                    stack_ptr = frame_ptr + *pc++;
+                    break;
+
+                case op_call:
+                {
+                    int nargs = *pc++;
+                    int jump = *pc++;
+                    int* callee_frame = stack_ptr - nargs;
+                    if (stack_end - callee_frame < std::ptrdiff_t(max_frame) || calls.size() == calls.capacity())
+                        throw std::runtime_error("Error: vm stack overflow");
+                    calls.push_back(call_frame{pc, frame_ptr});
+                    if (call_counts)
+                        ++(*call_counts)[std::size_t(jump)];
+                    frame_ptr = stack_ptr = callee_frame;
+                    pc = begin + jump;
+                }
+                    break;
+
+                case op_return:
+                    result = stack_ptr[-1];
+                    pc = end;
+                    break;
+
+                case op_pop:
+                    --stack_ptr;
+                    break;
+
+                case op_call_external:
+                {
+                    const external_registry::external& external = (*verified.externals)[std::size_t(*pc++)];
+                    stack_ptr -= external.arguments;
+                    int r = external.invoke(external.target, string_table, stack_ptr);
+                    *stack_ptr++ = r;
+                }
+                    break;
+
+                case op_load_global:
+                    *stack_ptr++ = globals[*pc++];
+                    break;
+
+                case op_store_global:
+                    globals[*pc++] = *--stack_ptr;
+                    break;
+
+                case op_load_global_index:
+                    stack_ptr[-1] = element(globals + pc[0], pc[1], stack_ptr[-1]);
+                    pc += 2;
+                    break;
+
+                case op_store_global_index:
+                    stack_ptr -= 2;
+                    element(globals + pc[0], pc[1], stack_ptr[0]) = stack_ptr[1];
+                    pc += 2;
+                    break;
+
+                case op_load_const_index:
+                    stack_ptr[-1] = element(constant_data + pc[0], pc[1], stack_ptr[-1]);
+                    pc += 2;
+                    break;
+
+                case op_keep:
+                    stack_ptr[-1] = string_table.keep(stack_ptr[-1]);
+                    break;
+
+                case op_load_index:
+                    stack_ptr[-1] = element(frame_ptr + pc[0], pc[1], stack_ptr[-1]);
+                    pc += 2;
+                    break;
+
+                case op_store_index:
+                    stack_ptr -= 2;
+                    element(frame_ptr + pc[0], pc[1], stack_ptr[0]) = stack_ptr[1];
+                    pc += 2;
+                    break;
+
+                case op_load_field_index:
+                    --stack_ptr;
+                    stack_ptr[-1] = field(stack_ptr[-1], pc[0], pc[1], stack_ptr[0]);
+                    pc += 2;
+                    break;
+
+                case op_store_field_index:
+                    stack_ptr -= 3;
+                    field(stack_ptr[0], pc[0], pc[1], stack_ptr[1]) = stack_ptr[2];
+                    pc += 2;
+                    break;
+
+                case op_clear:
+                    std::fill_n(frame_ptr + pc[0], pc[1], 0);
+                    pc += 2;
+                    break;
+
+                case op_load_field:
+                    stack_ptr[-1] = field(stack_ptr[-1], *pc++);
+                    break;
+
+                case op_store_field:
+                    stack_ptr -= 2;
+                    field(stack_ptr[0], *pc++) = stack_ptr[1];
+                    break;
+
+                case op_store_string_field:
+                    stack_ptr -= 2;
+                    field(stack_ptr[0], *pc++) = string_table.keep(stack_ptr[1]);
+                    break;
+
+                default:
+                    break;  // the verifier rejects unknown opcodes
+            }
+        }
+
+        if (calls.empty())
+            return result;
+        // the return value replaces the arguments
+        stack_ptr = frame_ptr;
+        *stack_ptr++ = result;
+        pc = calls.back().return_pc;
+        frame_ptr = calls.back().frame_ptr;
+        calls.pop_back();
+    }
+}
+
+void vmachine::release_strings(int const* args, std::size_t count)
+{
+    if (!string_table.collect_due())
+    {
+        string_table.reset_temporaries();
+        return;
+    }
+    // any slot that holds the handle of a kept string keeps it, whatever the slot's type
+    string_table.mark(globals, global_size);
+    string_table.mark(constants.data(), constants.size());
+    for (object const& instance : objects)
+    {
+        if (instance.data)
+            string_table.mark(reinterpret_cast<int const*>(instance.data), instance.size / sizeof(int));
+    }
+    string_table.mark(args, count);
+    string_table.sweep();
+}
+
+void vmachine::load_globals(std::vector<int> const& data, std::vector<int> const& constants)
+{
+    // a cache line of slack to align the slab
+    constexpr std::size_t line = 64 / sizeof(int);
+    global_memory.reset(new int[data.size() + line]);
+    globals = global_memory.get();
+    while (reinterpret_cast<std::uintptr_t>(globals) % (line * sizeof(int)) != 0)
+        ++globals;
+    std::copy(data.begin(), data.end(), globals);
+    global_size = data.size();
+    this->constants = constants;
+}
+
+void vmachine::bind_instance(int handle, void* data, std::size_t size)
+{
+    if (handle <= 0)
+        throw std::runtime_error("Error: invalid instance handle " + std::to_string(handle));
+    if (objects.size() <= std::size_t(handle))
+        objects.resize(std::size_t(handle) + 1, object{nullptr, 0});
+    objects[handle] = object{static_cast<char*>(data), data ? size : 0};
+}
+
+void vmachine::create_instance(int handle, std::size_t size)
+{
+    owned.emplace_back(new int[(size + sizeof(int) - 1) / sizeof(int)]());
+    bind_instance(handle, owned.back().get(), size);
+}
+
+void vmachine::init_instance(verified_code const& code, int handle, instance_init const& init)
+{
+    if (unsigned(handle) >= objects.size() || !objects[handle].data)
+        throw std::runtime_error("Error: instance " + std::to_string(handle) + " is neither bound nor created");
+    object const& target = objects[handle];
+    const char* image = reinterpret_cast<const char*>(init.image.data());
+    for (auto const& span : init.spans)
+    {
+        if (std::size_t(span.first) + span.second > target.size
+                || std::size_t(span.first) + span.second > init.image.size() * sizeof(std::int32_t))
+            throw std::runtime_error("Error: instance " + std::to_string(handle) + " is smaller than its class");
+        std::memcpy(target.data + span.first, image + span.first, span.second);
+    }
+    if (init.initializer != instance_init::no_initializer)
+        execute(code, init.initializer, {handle});
+}
+
+void vmachine::load_snapshot(instance_snapshot const& snapshot, verified_code const& code)
+{
+    if (snapshot.global_count() != global_size)
+        throw std::runtime_error("Error: the snapshot has " + std::to_string(snapshot.global_count())
+                                 + " globals, the loaded program " + std::to_string(global_size));
+    std::copy(snapshot.globals(), snapshot.globals() + global_size, globals);
+    for (std::size_t i = 0; i < snapshot.size(); ++i)
+    {
+        snapshot_entry const& entry = snapshot[i];
+        if (std::size_t(entry.handle) < objects.size() && objects[entry.handle].data)
+        {
+            object const& target = objects[entry.handle];
+            snapshot_span const* spans = snapshot.spans(i);
+            for (std::uint32_t s = 0; s < entry.span_count; ++s)
+            {
+                if (std::size_t(spans[s].offset) + spans[s].size > target.size)
+                    throw std::runtime_error("Error: instance " + std::to_string(entry.handle) + " is smaller than its class");
+                std::memcpy(target.data + spans[s].offset, snapshot.data(i) + spans[s].offset, spans[s].size);
+            }
+        }
+        else
+            bind_instance(entry.handle, snapshot.data(i), entry.size);
+    }
+    for (std::size_t i = 0; i < snapshot.size(); ++i)
+    {
+        if (snapshot[i].initializer != instance_init::no_initializer)
+            execute(code, std::size_t(snapshot[i].initializer), {snapshot[i].handle});
+    }
+}
+
 int vmachine::evaluateUnary(byte_code opcode, int x)
 {
     switch (opcode)
     {
         case op_pos: return +x;
-        case op_neg: return -x;
+        case op_neg: return int(0u - std::uint32_t(x));
         case op_lognot: return !x;
         case op_bitnot: return ~x;
+        case op_fneg: return float_to_slot(-slot_to_float(x));
+        case op_itof: return float_to_slot(float(x));
         default:
             BOOST_ASSERT_MSG(false, "unknown op code");
             return -1;
@@ -131,11 +546,18 @@ int vmachine::evaluateBinary(byte_code opcode, int a, int b)
 {
     switch (opcode)
     {
-        case op_add: return a + b;
-        case op_sub: return a - b;
-        case op_mul: return a * b;
-        case op_div: return a / b;
-        case op_mod: return a % b;
+        // int arithmetic wraps around like in the engine
+        case op_add: return int(std::uint32_t(a) + std::uint32_t(b));
+        case op_sub: return int(std::uint32_t(a) - std::uint32_t(b));
+        case op_mul: return int(std::uint32_t(a) * std::uint32_t(b));
+        case op_div:
+        case op_mod:
+            // the verifier can't know the divisor, the hardware traps on these
+            if (b == 0)
+                throw std::runtime_error("Error: division by zero");
+            if (b == -1)
+                return opcode == op_div ? int(0u - std::uint32_t(a)) : 0;     // INT_MIN / -1 wraps to INT_MIN
+            return opcode == op_div ? a / b : a % b;
         case op_eq: return a == b;
         case op_neq: return a != b;
         case op_lt: return a < b;
@@ -145,10 +567,20 @@ int vmachine::evaluateBinary(byte_code opcode, int a, int b)
         case op_bitwise_or: return a | b;
         case op_bitwise_xor: return a ^ b;
         case op_bitwise_and: return a & b;
-        case op_shift_left: return a << b;
-        case op_shift_right: return a >> b;
+        case op_shift_left: return int(std::uint32_t(a) << (b & 31));     // shift counts wrap like on x86
+        case op_shift_right: return a >> (b & 31);
         case op_logical_and: return a && b;
         case op_logical_or: return a || b;
+        case op_fadd: return float_to_slot(slot_to_float(a) + slot_to_float(b));
+        case op_fsub: return float_to_slot(slot_to_float(a) - slot_to_float(b));
+        case op_fmul: return float_to_slot(slot_to_float(a) * slot_to_float(b));
+        case op_fdiv: return float_to_slot(slot_to_float(a) / slot_to_float(b));
+        case op_feq: return slot_to_float(a) == slot_to_float(b);
+        case op_fneq: return slot_to_float(a) != slot_to_float(b);
+        case op_flt: return slot_to_float(a) < slot_to_float(b);
+        case op_flte: return slot_to_float(a) <= slot_to_float(b);
+        case op_fgt: return slot_to_float(a) > slot_to_float(b);
+        case op_fgte: return slot_to_float(a) >= slot_to_float(b);
         default:
             BOOST_ASSERT_MSG(false, "unknown op code");
             return -1;
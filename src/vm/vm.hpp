@@ -7,8 +7,17 @@
 #if !defined(BOOST_SPIRIT_X3_CALC9_VM_HPP)
 #define BOOST_SPIRIT_X3_CALC9_VM_HPP
 
+#include "classes.hpp"
+#include "externals.hpp"
+#include "verifier.hpp"
+#include <initializer_list>
+#include <memory>
 #include <vector>
 #include <cstdint>
+#include <stdexcept>
+#include <string>
+
+class instance_snapshot;
 
 ///////////////////////////////////////////////////////////////////////////
 //  The Virtual Machine
@@ -57,16 +66,63 @@ enum byte_code : uint32_t
 
     op_stk_adj = 28u,     // adjust the stack (for args and locals)
     op_call = 29u,        // function call
-    op_return = 30u      // return from function
+    op_return = 30u,      // return from function
+
+    op_pop = 31u,           // discard the top stack entry
+    op_call_external = 32u, // call an engine function by its index in the external_registry
+
+    // float variants, the compiler picks them by the static type of the operands
+    op_fneg = 33u | op_unary_flag,      //  negate the top stack entry
+    op_itof = 34u | op_unary_flag,      //  convert the int top stack entry to float
+
+    op_fadd = 35u | op_binary_flag,
+    op_fsub = 36u | op_binary_flag,
+    op_fmul = 37u | op_binary_flag,
+    op_fdiv = 38u | op_binary_flag,
+    op_feq = 39u | op_binary_flag,      //  comparisons push an int
+    op_fneq = 40u | op_binary_flag,
+    op_flt = 41u | op_binary_flag,
+    op_flte = 42u | op_binary_flag,
+    op_fgt = 43u | op_binary_flag,
+    op_fgte = 44u | op_binary_flag,
+
+    // members of the instance on top of the stack, the operand is the byte offset of the field
+    op_load_field = 45u,            //  replace the instance with the value of its field
+    op_store_field = 46u,           //  store the top stack entry into the field of the instance below it
+    op_store_string_field = 47u,    //  op_store_field that makes the string permanent first
+
+    // global variables and constants, operands are slots of the global or the constant region.
+    // indexed variants pop the index and take the first slot and the length of the array
+    op_load_global = 48u,           //  push a global
+    op_store_global = 49u,          //  store the top stack entry into a global
+    op_load_global_index = 50u,     //  replace the index with the element of a global array
+    op_store_global_index = 51u,    //  store the top stack entry into the element at the index below it
+    op_load_const_index = 52u,      //  replace the index with the element of a constant array
+    op_keep = 53u,                  //  make the string on top permanent, before stores that outlive the call
+
+    // arrays with an index computed at run time, the operands are the first element and the length.
+    // the index is below the value for stores, the instance below the index for fields
+    op_load_index = 54u,            //  replace the index with the element of a local array
+    op_store_index = 55u,           //  store the top stack entry into the element of a local array
+    op_load_field_index = 56u,      //  replace instance and index with the element of an array member,
+                                    //  the first operand is the byte offset of the member
+    op_store_field_index = 57u,     //  store the top stack entry into the element of an array member
+    op_clear = 58u,                 //  zero a run of locals, e.g. a local array
+    op_instance = 59u,              //  push an instance handle, an op_int strip_unreachable can tell apart
+    op_jump_table = 60u,            //  pop a value and run the op_jump for it from the count + 1 behind,
+                                    //  the operands are the lowest value and the count, the last op_jump is the default
+    op_function = 61u               //  push a function handle, an op_int strip_unreachable can tell apart
 };
 
 class vmachine
 {
 public:
 
-    vmachine(unsigned stackSize = 4096)
+    vmachine(unsigned stackSize = 4096, external_registry const* externals = nullptr)
       : stack(stackSize)
+      , externals(externals)
     {
+        calls.reserve(stackSize);
     }
 
     int execute(
@@ -77,17 +133,155 @@ public:
 
     int execute(std::vector<int> const& code)
     {
+        release_strings(nullptr, 0);
         return execute(code, code.begin(), stack.begin());
     };
 
+    /**
+     * fast path for code that passed the verifier, no checks per instruction.
+     * stack space and call depth are checked once per call,
+     * running out of either throws std::runtime_error
+     */
+    int execute(verified_code const& code)
+    {
+        return execute(code, 0, {});
+    }
+
+    /**
+     * calls the function at entry, which must be one of the verified entry points.
+     * Temporary strings of the previous call are released first, and kept strings no global,
+     * constant, instance or argument refers to any more if they grew enough.
+     * String arguments must be permanent or kept (see string_arena::keep)
+     */
+    int execute(verified_code const& code, std::size_t entry, std::initializer_list<int> args);
+
     std::vector<int> const& get_stack() const { return stack; };
 
+    /**
+     * counts the calls of every function by its address while the fast path runs,
+     * the profile for code_gen::inline_calls. nullptr stops counting
+     */
+    void profile_calls(std::vector<std::uint64_t>* counts) { call_counts = counts; }
+
+    /**
+     * strings of the running program, load the string pool of the program before running it.
+     * Strings computed by a call stay valid until the next call
+     */
+    string_arena& strings() { return string_table; }
+
+    /**
+     * the global variables with their initial values and the constant region of a program,
+     * code verified for more slots than these doesn't run
+     */
+    void load_globals(std::vector<int> const& data, std::vector<int> const& constants);
+
+    /**
+     * a global variable by slot, for the host
+     */
+    int& global(std::size_t slot) { return globals[slot]; }
+    std::size_t global_count() const { return global_size; }
+
+    /**
+     * makes the object the memory of an instance, its layout must be the class layout
+     * the program was compiled with (see class_registry). The object must outlive its use by the vm
+     */
+    void bind_instance(int handle, void* data, std::size_t size);
+
+    template <typename T>
+    void bind_instance(int handle, T& object)
+    {
+        bind_instance(handle, &object, sizeof(T));
+    }
+
+    /**
+     * zeroed memory for an instance of a class the host doesn't bind
+     */
+    void create_instance(int handle, std::size_t size);
+
+    /**
+     * initializes a bound or created instance, usually the object was just made for it.
+     * host members outside the spans of the image keep their values
+     */
+    void init_instance(verified_code const& code, int handle, instance_init const& init);
+
+    /**
+     * initializes the globals and instances of a snapshot: the global slab is restored, so load_globals
+     * of the program must come first. Instances the host bound get the script members copied,
+     * the others work on the mapped memory. Then the initializers left for the load run.
+     * The snapshot must outlive its use by the vm
+     */
+    void load_snapshot(instance_snapshot const& snapshot, verified_code const& code);
+
     static int evaluateUnary(byte_code opcode, int x);
     static int evaluateBinary(byte_code opcode, int a, int b);
 
 private:
 
+    struct call_frame
+    {
+        int const* return_pc;
+        int* frame_ptr;
+    };
+
+    struct object
+    {
+        char* data;
+        std::size_t size;
+    };
+
+    /**
+     * the field at offset of an instance, throws std::runtime_error unless the instance has one
+     */
+    int& field(int handle, int offset)
+    {
+        if (unsigned(handle) >= objects.size() || unsigned(offset) + sizeof(int) > objects[handle].size)
+            throw std::runtime_error("Error: instance " + std::to_string(handle) + " has no field at " + std::to_string(offset));
+        return *reinterpret_cast<int*>(objects[handle].data + offset);
+    }
+
+    /**
+     * element of an array member, the index is checked against the member
+     */
+    int& field(int handle, int offset, int count, int index)
+    {
+        return field(handle, offset + int(sizeof(int)) * checked(count, index));
+    }
+
+    /**
+     * invalidates the temporary strings, sweeps the kept ones the slots of the vm don't refer to if due
+     */
+    void release_strings(int const* args, std::size_t count);
+
+    /**
+     * element of an array
+     */
+    template <typename T>
+    static T& element(T* first, int count, int index)
+    {
+        return first[checked(count, index)];
+    }
+
+    /**
+     * the one bounds check of indexed opcodes, throws std::runtime_error if the index is out of range
+     */
+    static int checked(int count, int index)
+    {
+        if (unsigned(index) >= unsigned(count))
+            throw std::runtime_error("Error: array index " + std::to_string(index) + " out of range");
+        return index;
+    }
+
     std::vector<int> stack;
+    string_arena string_table;
+    std::unique_ptr<int[]> global_memory;
+    int* globals = nullptr;            // cache line aligned start of global_memory
+    std::size_t global_size = 0;
+    std::vector<int> constants;        // read-only, no opcode stores to it
+    external_registry const* externals;   // for op_call_external in the checked path
+    std::vector<call_frame> calls;     // for the fast path, which doesn't recurse
+    std::vector<std::uint64_t>* call_counts = nullptr;
+    std::vector<object> objects;       // by instance handle, 0 is no instance
+    std::vector<std::unique_ptr<int[]>> owned;   // memory of created instances
 };
 
 
@@ -0,0 +1,188 @@
+#include "Builder.hpp"
+#include "visitors/SymbolCollector.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace XRef
+{
+    using ASTVisitors::SymbolKind;
+
+    namespace
+    {
+        bool isScoped(SymbolKind kind)
+        {
+            return kind == SymbolKind::Parameter || kind == SymbolKind::Local;
+        }
+
+        template <typename T>
+        Section append(std::string& out, const std::vector<T>& elements)
+        {
+            Section section{std::uint32_t(out.size()), std::uint32_t(elements.size())};
+            out.append(reinterpret_cast<const char*>(elements.data()), elements.size() * sizeof(T));
+            return section;
+        }
+    }
+
+    std::uint32_t Builder::intern(const std::string& string)
+    {
+        auto it = m_StringOffsets.find(string);
+        if (it != m_StringOffsets.end())
+            return it->second;
+        const std::uint32_t offset = std::uint32_t(m_Strings.size());
+        m_Strings.append(string.c_str(), string.size() + 1);
+        m_StringOffsets.emplace(string, offset);
+        return offset;
+    }
+
+    std::uint32_t Builder::symbol(const std::string& name)
+    {
+        std::string key = boost::algorithm::to_lower_copy(name);
+        auto it = m_SymbolIds.find(key);
+        if (it != m_SymbolIds.end())
+            return it->second;
+        const std::uint32_t id = std::uint32_t(m_Symbols.size());
+        m_Symbols.emplace_back();
+        m_Symbols.back().key = key;
+        m_SymbolIds.emplace(std::move(key), id);
+        return id;
+    }
+
+    void Builder::add(const std::string& path, const parser::parsed_file& file)
+    {
+        if (!file.source)
+            return;
+        const parser::source_file& source = *file.source;
+
+        std::ostringstream diagnostics;
+        parser::error_handler_type error_handler(source, diagnostics);
+        ASTVisitors::SymbolCollector collector(error_handler);
+        // visitors take mutable ASTs, the collector only reads
+        collector.start(const_cast<ast::program&>(file.ast));
+
+        const std::uint32_t fileId = std::uint32_t(m_Files.size());
+        m_Files.push_back(intern(path));
+        auto position = [&source](ast::source_location location, std::uint32_t& line, std::uint32_t& column) {
+            std::size_t offset = source.offset_of(location);
+            line = std::uint32_t(source.lines.line_of(offset));
+            column = std::uint32_t(offset - source.lines.line_start(offset) + 1);
+        };
+        auto container = [this](const std::string& name) {
+            return name.empty() ? None : intern(name);
+        };
+
+        std::set<std::pair<int, std::string>> locals;
+        for (const auto& definition : collector.definitions())
+        {
+            if (isScoped(definition.kind))
+            {
+                locals.emplace(definition.scope, boost::algorithm::to_lower_copy(definition.name));
+                continue;
+            }
+
+            const std::uint32_t id = symbol(definition.name);
+            Definition entry{id, fileId, 0, 0, std::uint32_t(definition.kind), container(definition.container)};
+            position(definition.location, entry.line, entry.column);
+            if (m_Symbols[id].name == None)
+                m_Symbols[id].name = intern(definition.name);
+            m_Symbols[id].definitions.push_back(entry);
+
+            const bool derives = definition.kind == SymbolKind::Prototype || definition.kind == SymbolKind::Instance;
+            if (derives && !definition.type.empty() && !ASTVisitors::SymbolCollector::isBuiltinType(definition.type))
+            {
+                const std::uint32_t base = symbol(definition.type);
+                if (m_Symbols[id].base == None)
+                    m_Symbols[id].base = base;
+                m_Symbols[base].derived.push_back(id);
+            }
+        }
+
+        for (const auto& reference : collector.references())
+        {
+            // parameters and locals shadow globals, those references stay out of the index
+            if (!reference.member
+                && locals.count(std::make_pair(reference.scope, boost::algorithm::to_lower_copy(reference.name))))
+                continue;
+
+            const std::uint32_t id = symbol(reference.name);
+            Reference entry{id, fileId, 0, 0, container(reference.container)};
+            position(reference.location, entry.line, entry.column);
+            m_Symbols[id].references.push_back(entry);
+        }
+    }
+
+    void Builder::write(const std::string& filename) const
+    {
+        // symbols sorted by key, the stored indices refer to the sorted order
+        std::vector<std::uint32_t> order(m_Symbols.size());
+        for (std::uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [this](std::uint32_t a, std::uint32_t b) {
+            return m_Symbols[a].key < m_Symbols[b].key;
+        });
+        std::vector<std::uint32_t> sortedIndex(m_Symbols.size());
+        for (std::uint32_t i = 0; i < order.size(); ++i)
+            sortedIndex[order[i]] = i;
+
+        // keys go into a copy of the string table, interning is not needed for them
+        std::string strings = m_Strings;
+        std::vector<Symbol> symbols;
+        std::vector<Definition> definitions;
+        std::vector<Reference> references;
+        std::vector<std::uint32_t> derived;
+        symbols.reserve(order.size());
+        for (std::uint32_t id : order)
+        {
+            const SymbolEntry& entry = m_Symbols[id];
+            Symbol symbol;
+            symbol.key = std::uint32_t(strings.size());
+            strings.append(entry.key.c_str(), entry.key.size() + 1);
+            symbol.name = entry.name;
+            symbol.base = entry.base == None ? None : sortedIndex[entry.base];
+
+            symbol.definitions = {std::uint32_t(definitions.size()), std::uint32_t(entry.definitions.size())};
+            for (Definition definition : entry.definitions)
+            {
+                definition.symbol = sortedIndex[definition.symbol];
+                definitions.push_back(definition);
+            }
+            symbol.references = {std::uint32_t(references.size()), std::uint32_t(entry.references.size())};
+            for (Reference reference : entry.references)
+            {
+                reference.symbol = sortedIndex[reference.symbol];
+                references.push_back(reference);
+            }
+            symbol.derived = {std::uint32_t(derived.size()), std::uint32_t(entry.derived.size())};
+            for (std::uint32_t child : entry.derived)
+                derived.push_back(sortedIndex[child]);
+            symbols.push_back(symbol);
+        }
+
+        // all elements are 32-bit fields, appending the arrays keeps them aligned
+        std::string out(sizeof(Header), '\0');
+        Header header;
+        header.magic = Magic;
+        header.version = Version;
+        header.files = append(out, m_Files);
+        header.symbols = append(out, symbols);
+        header.definitions = append(out, definitions);
+        header.references = append(out, references);
+        header.derived = append(out, derived);
+        header.strings = {std::uint32_t(out.size()), std::uint32_t(strings.size())};
+        out += strings;
+        std::copy(reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header + 1), out.begin());
+
+        const std::string temporary = filename + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.write(out.data(), std::streamsize(out.size())) || !file.flush())
+                throw std::runtime_error("Error: couldn't write index \"" + temporary + '"');
+        }
+        if (std::rename(temporary.c_str(), filename.c_str()) != 0)
+            throw std::runtime_error("Error: couldn't replace index \"" + filename + '"');
+    }
+}
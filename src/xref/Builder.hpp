@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Format.hpp"
+#include "project.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace XRef
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  Collects definitions, references and the inheritance of prototypes and
+    //  instances from parsed files and writes them as symbol index.
+    //  Parameters and locals, as well as the references to them, are left out,
+    //  the index answers project-wide questions only.
+    ////////////////////////////////////////////////////////////////////////////
+    class Builder
+    {
+    public:
+        /**
+         * collects the symbols of the AST of file, which is listed under path
+         */
+        void add(const std::string& path, const parser::parsed_file& file);
+
+        /**
+         * writes the index, replacing filename atomically
+         */
+        void write(const std::string& filename) const;
+
+    private:
+        struct SymbolEntry
+        {
+            std::string key;
+            std::uint32_t name = None;
+            std::uint32_t base = None;
+            std::vector<Definition> definitions;
+            std::vector<Reference> references;
+            std::vector<std::uint32_t> derived;
+        };
+
+        std::uint32_t intern(const std::string& string);
+        std::uint32_t symbol(const std::string& name);
+
+        std::vector<std::uint32_t> m_Files;
+        std::vector<SymbolEntry> m_Symbols;
+        std::unordered_map<std::string, std::uint32_t> m_SymbolIds; // key -> index into m_Symbols
+        std::string m_Strings;
+        std::unordered_map<std::string, std::uint32_t> m_StringOffsets;
+    };
+}
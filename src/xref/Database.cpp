@@ -0,0 +1,180 @@
+#include "Database.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace XRef
+{
+    namespace
+    {
+        template <typename T>
+        bool inRange(Span<T> span, const Range& range)
+        {
+            return range.first <= span.size() && range.count <= span.size() - range.first;
+        }
+    }
+
+    Database::Database(const std::string& filename)
+            : m_Data(nullptr),
+              m_Size(0)
+    {
+        int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw std::runtime_error("Error: couldn't open index \"" + filename + '"');
+        struct stat info;
+        if (fstat(fd, &info) == 0 && std::size_t(info.st_size) >= sizeof(Header))
+        {
+            void* data = mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                m_Data = static_cast<const char*>(data);
+                m_Size = std::size_t(info.st_size);
+            }
+        }
+        close(fd);
+        if (!m_Data)
+            throw std::runtime_error("Error: couldn't map index \"" + filename + '"');
+
+        try
+        {
+            const Header& header = *reinterpret_cast<const Header*>(m_Data);
+            if (header.magic != Magic || header.version != Version)
+                throw std::runtime_error("Error: \"" + filename + "\" is no symbol index of this version");
+            m_Files = section<std::uint32_t>(header.files);
+            m_Symbols = section<Symbol>(header.symbols);
+            m_Definitions = section<Definition>(header.definitions);
+            m_References = section<Reference>(header.references);
+            m_Derived = section<std::uint32_t>(header.derived);
+            m_Strings = section<char>(header.strings);
+            if (!m_Strings.empty() && m_Strings[m_Strings.size() - 1] != '\0')
+                throw std::runtime_error("Error: corrupt string table in index \"" + filename + '"');
+
+            // validate once, queries index the arrays without checks
+            for (const Symbol& symbol : m_Symbols)
+            {
+                if (!inRange(m_Definitions, symbol.definitions) || !inRange(m_References, symbol.references)
+                    || !inRange(m_Derived, symbol.derived) || symbol.key >= m_Strings.size()
+                    || (symbol.name != None && symbol.name >= m_Strings.size())
+                    || (symbol.base != None && symbol.base >= m_Symbols.size()))
+                    throw std::runtime_error("Error: corrupt symbol in index \"" + filename + '"');
+            }
+            for (std::uint32_t child : m_Derived)
+            {
+                if (child >= m_Symbols.size())
+                    throw std::runtime_error("Error: corrupt inheritance in index \"" + filename + '"');
+            }
+            for (std::uint32_t path : m_Files)
+            {
+                if (path >= m_Strings.size())
+                    throw std::runtime_error("Error: corrupt file table in index \"" + filename + '"');
+            }
+            auto checkSite = [this, &filename](std::uint32_t file, std::uint32_t container) {
+                if (file >= m_Files.size() || (container != None && container >= m_Strings.size()))
+                    throw std::runtime_error("Error: corrupt entry in index \"" + filename + '"');
+            };
+            for (const Definition& definition : m_Definitions)
+                checkSite(definition.file, definition.container);
+            for (const Reference& reference : m_References)
+                checkSite(reference.file, reference.container);
+        }
+        catch (...)
+        {
+            munmap(const_cast<char*>(m_Data), m_Size);
+            throw;
+        }
+    }
+
+    Database::~Database()
+    {
+        munmap(const_cast<char*>(m_Data), m_Size);
+    }
+
+    template <typename T>
+    Span<T> Database::section(const Section& section) const
+    {
+        if (section.offset % alignof(T) != 0 || section.offset > m_Size
+            || section.count > (m_Size - section.offset) / sizeof(T))
+            throw std::runtime_error("Error: index section out of bounds");
+        return Span<T>(reinterpret_cast<const T*>(m_Data + section.offset), section.count);
+    }
+
+    const Symbol* Database::find(const std::string& name) const
+    {
+        const std::string key = boost::algorithm::to_lower_copy(name);
+        auto it = std::lower_bound(m_Symbols.begin(), m_Symbols.end(), key, [this](const Symbol& symbol, const std::string& value) {
+            return std::strcmp(string(symbol.key), value.c_str()) < 0;
+        });
+        if (it == m_Symbols.end() || key != string(it->key))
+            return nullptr;
+        return it;
+    }
+
+    Span<Definition> Database::definitions(const Symbol& symbol) const
+    {
+        return Span<Definition>(m_Definitions.begin() + symbol.definitions.first, symbol.definitions.count);
+    }
+
+    Span<Reference> Database::references(const Symbol& symbol) const
+    {
+        return Span<Reference>(m_References.begin() + symbol.references.first, symbol.references.count);
+    }
+
+    std::vector<const Symbol*> Database::derived(const Symbol& symbol) const
+    {
+        std::vector<const Symbol*> result;
+        for (std::uint32_t i = 0; i < symbol.derived.count; ++i)
+            result.push_back(&symbolAt(m_Derived[symbol.derived.first + i]));
+        return result;
+    }
+
+    std::vector<const Symbol*> Database::allDerived(const Symbol& symbol) const
+    {
+        std::vector<const Symbol*> result;
+        std::vector<bool> seen(m_Symbols.size());
+        seen[std::size_t(&symbol - m_Symbols.begin())] = true;
+        result.push_back(&symbol);
+        for (std::size_t i = 0; i < result.size(); ++i)
+        {
+            for (const Symbol* child : derived(*result[i]))
+            {
+                std::size_t index = std::size_t(child - m_Symbols.begin());
+                if (!seen[index])
+                {
+                    seen[index] = true;
+                    result.push_back(child);
+                }
+            }
+        }
+        result.erase(result.begin());
+        return result;
+    }
+
+    std::vector<const Symbol*> Database::bases(const Symbol& symbol) const
+    {
+        // a cycle of prototypes is an error in the scripts, but mustn't hang the query
+        std::vector<const Symbol*> result;
+        for (std::uint32_t base = symbol.base; base != None && result.size() < m_Symbols.size(); base = symbolAt(base).base)
+            result.push_back(&symbolAt(base));
+        return result;
+    }
+
+    const char* Database::name(const Symbol& symbol) const
+    {
+        return string(symbol.name != None ? symbol.name : symbol.key);
+    }
+
+    const char* Database::string(std::uint32_t offset) const
+    {
+        return m_Strings.begin() + offset;
+    }
+
+    const char* Database::file(std::uint32_t index) const
+    {
+        return string(m_Files[index]);
+    }
+}
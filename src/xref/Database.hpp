@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Format.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace XRef
+{
+    /**
+     * contiguous elements of the mapped index
+     */
+    template <typename T>
+    class Span
+    {
+    public:
+        Span() : m_First(nullptr), m_Size(0) {}
+        Span(const T* first, std::size_t size) : m_First(first), m_Size(size) {}
+
+        const T* begin() const { return m_First; }
+        const T* end() const { return m_First + m_Size; }
+        std::size_t size() const { return m_Size; }
+        bool empty() const { return m_Size == 0; }
+        const T& operator[](std::size_t i) const { return m_First[i]; }
+
+    private:
+        const T* m_First;
+        std::size_t m_Size;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    //  Read-only view of a symbol index written by the Builder
+    //  the file is mapped into memory, lookups are a binary search over the
+    //  sorted symbols and return ranges pointing into the mapping.
+    ////////////////////////////////////////////////////////////////////////////
+    class Database
+    {
+    public:
+        /**
+         * maps the index, throws if the file is missing or isn't a valid index
+         */
+        explicit Database(const std::string& filename);
+        Database(const Database&) = delete;
+        Database& operator=(const Database&) = delete;
+        ~Database();
+
+        /**
+         * @return symbol with the given name (case insensitive) or nullptr
+         */
+        const Symbol* find(const std::string& name) const;
+
+        Span<Definition> definitions(const Symbol& symbol) const;
+        Span<Reference> references(const Symbol& symbol) const;
+
+        /**
+         * @return prototypes and instances directly based on the symbol
+         */
+        std::vector<const Symbol*> derived(const Symbol& symbol) const;
+
+        /**
+         * @return symbols transitively based on the symbol, breadth first
+         */
+        std::vector<const Symbol*> allDerived(const Symbol& symbol) const;
+
+        /**
+         * @return base prototype and class of the symbol, nearest first
+         */
+        std::vector<const Symbol*> bases(const Symbol& symbol) const;
+
+        const char* name(const Symbol& symbol) const;
+        const char* string(std::uint32_t offset) const;
+        const char* file(std::uint32_t index) const;
+
+    private:
+        template <typename T>
+        Span<T> section(const Section& section) const;
+
+        const Symbol& symbolAt(std::uint32_t index) const { return m_Symbols[index]; }
+
+        const char* m_Data;
+        std::size_t m_Size;
+        Span<std::uint32_t> m_Files;
+        Span<Symbol> m_Symbols;
+        Span<Definition> m_Definitions;
+        Span<Reference> m_References;
+        Span<std::uint32_t> m_Derived;
+        Span<char> m_Strings;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+namespace XRef
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //  On-disk layout of the symbol index
+    //  a header followed by flat arrays of 32-bit fields in native byte order,
+    //  so the file can be mapped and queried without deserialization.
+    //  Symbols are sorted by their lowercase name, the definitions, references
+    //  and derived symbols of a symbol are contiguous ranges of their arrays.
+    //  Strings are offsets into a table of zero-terminated strings.
+    ////////////////////////////////////////////////////////////////////////////
+    const std::uint32_t Magic = 0x46525844; // "DXRF"
+    const std::uint32_t Version = 1;
+    const std::uint32_t None = 0xFFFFFFFFu;
+
+    struct Section
+    {
+        std::uint32_t offset; // bytes from the start of the file
+        std::uint32_t count;  // number of elements, bytes for the string table
+    };
+
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        Section files;       // string offsets of the file paths
+        Section symbols;
+        Section definitions;
+        Section references;
+        Section derived;     // symbol indices
+        Section strings;
+    };
+
+    struct Range
+    {
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    struct Symbol
+    {
+        std::uint32_t key;          // lowercase name, the sort key
+        std::uint32_t name;         // name as spelled at the first definition
+        std::uint32_t base;         // symbol of the base class or prototype, None if there is none
+        Range definitions;
+        Range references;
+        Range derived;              // prototypes and instances directly based on the symbol
+    };
+
+    struct Definition
+    {
+        std::uint32_t symbol;
+        std::uint32_t file;
+        std::uint32_t line;         // 1-based
+        std::uint32_t column;       // 1-based, in bytes
+        std::uint32_t kind;         // ASTVisitors::SymbolKind
+        std::uint32_t container;    // string offset of the enclosing declaration, None for globals
+    };
+
+    struct Reference
+    {
+        std::uint32_t symbol;
+        std::uint32_t file;
+        std::uint32_t line;
+        std::uint32_t column;
+        std::uint32_t container;    // string offset of the enclosing declaration, None at global scope
+    };
+}
@@ -0,0 +1,90 @@
+#include "Query.hpp"
+#include "Database.hpp"
+#include "visitors/SymbolCollector.hpp"
+#include <stdexcept>
+
+namespace XRef
+{
+    using ASTVisitors::SymbolKind;
+
+    namespace
+    {
+        const char* kindName(std::uint32_t kind)
+        {
+            switch (SymbolKind(kind))
+            {
+                case SymbolKind::Function: return "func";
+                case SymbolKind::Prototype: return "prototype";
+                case SymbolKind::Instance: return "instance";
+                case SymbolKind::Class: return "class";
+                case SymbolKind::Variable: return "var";
+                case SymbolKind::Constant: return "const";
+                case SymbolKind::Member: return "member";
+                case SymbolKind::Parameter: return "parameter";
+                case SymbolKind::Local: return "local";
+            }
+            return "symbol";
+        }
+
+        void printSite(const Database& database, std::uint32_t file, std::uint32_t line, std::uint32_t column,
+                       std::ostream& out)
+        {
+            out << database.file(file) << ':' << line << ':' << column << ": ";
+        }
+
+        void printDefinitions(const Database& database, const Symbol& symbol, std::ostream& out)
+        {
+            for (const Definition& definition : database.definitions(symbol))
+            {
+                printSite(database, definition.file, definition.line, definition.column, out);
+                out << kindName(definition.kind) << ' ' << database.name(symbol);
+                if (definition.container != None)
+                    out << " in " << database.string(definition.container);
+                out << '\n';
+            }
+        }
+    }
+
+    int runQuery(const std::string& indexFile, const std::vector<std::string>& request, std::ostream& out)
+    {
+        if (request.size() != 2)
+            throw std::runtime_error("Error: expected definitions|references|derived|bases <name>");
+        const std::string& command = request[0];
+        if (command != "definitions" && command != "references" && command != "derived" && command != "bases")
+            throw std::runtime_error("Error: unknown query \"" + command + '"');
+
+        Database database(indexFile);
+        const Symbol* symbol = database.find(request[1]);
+        if (!symbol)
+        {
+            out << "unknown symbol: " << request[1] << '\n';
+            return 1;
+        }
+
+        if (command == "definitions")
+            printDefinitions(database, *symbol, out);
+        else if (command == "references")
+        {
+            for (const Reference& reference : database.references(*symbol))
+            {
+                printSite(database, reference.file, reference.line, reference.column, out);
+                out << database.name(*symbol);
+                if (reference.container != None)
+                    out << " in " << database.string(reference.container);
+                out << '\n';
+            }
+        }
+        else
+        {
+            // derived and bases list the definitions of every symbol along the chain
+            const auto chain = command == "derived" ? database.allDerived(*symbol) : database.bases(*symbol);
+            for (const Symbol* related : chain)
+            {
+                if (database.definitions(*related).empty())
+                    out << database.name(*related) << " (not defined in the project)\n";
+                printDefinitions(database, *related, out);
+            }
+        }
+        return 0;
+    }
+}
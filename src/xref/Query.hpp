@@ -0,0 +1,15 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace XRef
+{
+    /**
+     * answers a request on the index file, one line per result
+     * @param request definitions|references|derived|bases followed by a symbol name
+     * @return exit status, 1 if the symbol is unknown
+     */
+    int runQuery(const std::string& indexFile, const std::vector<std::string>& request, std::ostream& out);
+}
@@ -0,0 +1,291 @@
+#include "Script.hpp"
+#include <boost/test/unit_test.hpp>
+#include <climits>
+
+using namespace Test;
+
+namespace
+{
+    bool contains(const code_gen::program& program, byte_code opcode)
+    {
+        const std::vector<int>& code = program();
+        for (std::size_t pc = 0; pc < code.size(); pc += 1 + std::size_t(verifier::operand_count(code[pc])))
+        {
+            if (byte_code(code[pc]) == opcode)
+                return true;
+        }
+        return false;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(CodeGen)
+
+BOOST_AUTO_TEST_CASE(int_arithmetic_wraps)
+{
+    Script script(
+        "func int add(var int a, var int b) { return a + b; };\n"
+        "func int mul(var int a, var int b) { return a * b; };\n"
+        "func int div(var int a, var int b) { return a / b; };\n"
+        "func int mod(var int a, var int b) { return a % b; };\n"
+        "func int shl(var int a, var int b) { return a << b; };\n"
+        "func int shr(var int a, var int b) { return a >> b; };\n");
+    const code_gen::program& p = script.program;
+    BOOST_CHECK_EQUAL(run(p, "add", {INT_MAX, 1}), value(INT_MIN));
+    BOOST_CHECK_EQUAL(run(p, "mul", {0x10000, 0x10000}), value(0));
+    BOOST_CHECK_EQUAL(run(p, "div", {-7, 2}), value(-3));
+    BOOST_CHECK_EQUAL(run(p, "mod", {-7, 2}), value(-1));
+    BOOST_CHECK_EQUAL(run(p, "div", {INT_MIN, -1}), value(INT_MIN));
+    BOOST_CHECK_EQUAL(run(p, "mod", {INT_MIN, -1}), value(0));
+    BOOST_CHECK_EQUAL(run(p, "div", {1, 0}), error("Error: division by zero"));
+    BOOST_CHECK_EQUAL(run(p, "mod", {1, 0}), error("Error: division by zero"));
+    BOOST_CHECK_EQUAL(run(p, "shl", {1, 33}), value(2));
+    BOOST_CHECK_EQUAL(run(p, "shr", {-8, 1}), value(-4));
+}
+
+BOOST_AUTO_TEST_CASE(constants_fold_like_the_vm_computes)
+{
+    Script script(
+        "const int MIN = -2147483647 - 1;\n"
+        "const int WRAPPED = 2147483647 + 1;\n"
+        "const int QUOTIENT = MIN / -1;\n"
+        "const int REMAINDER = MIN % -1;\n"
+        "const int SHIFTED = 1 << 33;\n"
+        "func int quotient() { return QUOTIENT; };\n"
+        "func int computed(var int a, var int b) { return a / b; };\n"
+        "func int remainder() { return REMAINDER; };\n"
+        "func int wrapped() { return WRAPPED; };\n"
+        "func int shifted() { return SHIFTED; };\n");
+    const code_gen::program& p = script.program;
+    BOOST_CHECK_EQUAL(run(p, "quotient"), run(p, "computed", {INT_MIN, -1}));
+    BOOST_CHECK_EQUAL(run(p, "remainder"), value(0));
+    BOOST_CHECK_EQUAL(run(p, "wrapped"), value(INT_MIN));
+    BOOST_CHECK_EQUAL(run(p, "shifted"), value(2));
+}
+
+BOOST_AUTO_TEST_CASE(division_by_a_constant_zero_is_reported)
+{
+    BOOST_CHECK(!Script::errors("const int ZERO = 0; const int X = 1 / ZERO;").empty());
+}
+
+BOOST_AUTO_TEST_CASE(loops_and_locals)
+{
+    Script script(
+        "func int sum(var int n) {\n"
+        "    var int total; var int i;\n"
+        "    while (i < n) { i += 1; total += i; };\n"
+        "    return total;\n"
+        "};\n"
+        "func int fib(var int n) { if (n < 2) { return n; }; return fib(n - 1) + fib(n - 2); };\n");
+    BOOST_CHECK_EQUAL(run(script.program, "sum", {100}), value(5050));
+    BOOST_CHECK_EQUAL(run(script.program, "sum", {0}), value(0));
+    BOOST_CHECK_EQUAL(run(script.program, "fib", {20}), value(6765));
+}
+
+BOOST_AUTO_TEST_CASE(short_circuit_skips_the_right_operand)
+{
+    Script script(
+        "func int andCalls(var int a) { if (a && Test_Count(1)) { return 1; }; return 0; };\n"
+        "func int orCalls(var int a) { if (a || Test_Count(0)) { return 1; }; return 0; };\n"
+        "func int andValue(var int a, var int b) { var int x; x = a && b; return x; };\n"
+        "func int orValue(var int a, var int b) { return a || b; };\n"
+        "func int nested(var int a, var int b) { if (!(a && b) || (a == 2 && !b)) { return 1; }; return 0; };\n");
+    const code_gen::program& p = script.program;
+
+    int before = externalCalls();
+    BOOST_CHECK_EQUAL(run(p, "andCalls", {0}), value(0));
+    BOOST_CHECK_EQUAL(externalCalls(), before);
+    BOOST_CHECK_EQUAL(run(p, "andCalls", {1}), value(1));
+    BOOST_CHECK_EQUAL(externalCalls(), before + 2);     // once per path
+
+    before = externalCalls();
+    BOOST_CHECK_EQUAL(run(p, "orCalls", {5}), value(1));
+    BOOST_CHECK_EQUAL(externalCalls(), before);
+    BOOST_CHECK_EQUAL(run(p, "orCalls", {0}), value(0));
+    BOOST_CHECK_EQUAL(externalCalls(), before + 2);
+
+    for (int a : {0, 1, 2, -3})
+    {
+        for (int b : {0, 1, 7})
+        {
+            BOOST_CHECK_EQUAL(run(p, "andValue", {a, b}), value(a && b));
+            BOOST_CHECK_EQUAL(run(p, "orValue", {a, b}), value(a || b));
+            BOOST_CHECK_EQUAL(run(p, "nested", {a, b}), value(!(a && b) || (a == 2 && !b)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dense_chains_dispatch_through_a_jump_table)
+{
+    Script script(
+        "func int pick(var int x) {\n"
+        "    if (x == 1) { return 10; }\n"
+        "    else if (x == 2 || x == 5) { return 20; }\n"
+        "    else if (3 == x) { return 30; }\n"
+        "    else if (x == 4) { return 40; }\n"
+        "    else if (x == 1) { return 99; }\n"
+        "    else { return -1; };\n"
+        "};\n"
+        "func int noElse(var int x) {\n"
+        "    var int r; r = 7;\n"
+        "    if (x == 0) { r = 1; } else if (x == 1) { r = 2; } else if (x == 2) { r = 3; } else if (x == 3) { r = 4; };\n"
+        "    return r;\n"
+        "};\n");
+    BOOST_CHECK(contains(script.program, op_jump_table));
+    for (int x : {INT_MIN, -1, 0, 1, 2, 3, 4, 5, 6, INT_MAX})
+    {
+        const int expected = x == 1 ? 10 : x == 2 || x == 5 ? 20 : x == 3 ? 30 : x == 4 ? 40 : -1;
+        BOOST_CHECK_EQUAL(run(script.program, "pick", {x}), value(expected));
+        BOOST_CHECK_EQUAL(run(script.program, "noElse", {x}), value(x >= 0 && x <= 3 ? x + 1 : 7));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sparse_chains_search_their_cases)
+{
+    Script script(
+        "const int BIG = 100000;\n"
+        "func int pick(var int x) {\n"
+        "    if (x == -2147483647 - 1) { return 1; }\n"
+        "    else if (x == -500) { return 2; }\n"
+        "    else if (x == 0) { return 3; }\n"
+        "    else if (x == 77 || x == BIG) { return 4; }\n"
+        "    else if (x == 2147483647) { return 5; };\n"
+        "    return 0;\n"
+        "};\n");
+    BOOST_CHECK(!contains(script.program, op_jump_table));
+    const std::vector<std::pair<int, int>> cases = {
+        {INT_MIN, 1}, {INT_MIN + 1, 0}, {-500, 2}, {-499, 0}, {0, 3}, {77, 4}, {100000, 4}, {INT_MAX, 5}, {INT_MAX - 1, 0}, {5, 0}
+    };
+    for (const auto& c : cases)
+        BOOST_CHECK_EQUAL(run(script.program, "pick", {c.first}), value(c.second));
+}
+
+BOOST_AUTO_TEST_CASE(chains_with_side_effects_stay_compares)
+{
+    // the subject is evaluated once per compare, a call can't be dispatched on
+    Script script(
+        "func int pick(var int x) {\n"
+        "    if (Test_Count(x) == 1) { return 1; } else if (Test_Count(x) == 2) { return 2; }\n"
+        "    else if (Test_Count(x) == 3) { return 3; } else if (Test_Count(x) == 4) { return 4; };\n"
+        "    return 0;\n"
+        "};\n");
+    const int before = externalCalls();
+    BOOST_CHECK_EQUAL(run(script.program, "pick", {3}), value(3));
+    BOOST_CHECK_EQUAL(externalCalls(), before + 2 * 3);
+}
+
+BOOST_AUTO_TEST_CASE(arrays_check_their_index_once)
+{
+    Script script(
+        "var int table[4];\n"
+        "const int SQUARES[4] = {0, 1, 4, 9};\n"
+        "func int local(var int i) { var int a[3]; a[0] = 5; a[1] = 6; a[2] = 7; return a[i]; };\n"
+        "func int square(var int i) { return SQUARES[i]; };\n"
+        "func int store(var int i, var int v) { table[i] = v; return table[i] + table[0]; };\n");
+    const code_gen::program& p = script.program;
+    BOOST_CHECK_EQUAL(run(p, "local", {2}), value(7));
+    BOOST_CHECK_EQUAL(run(p, "local", {3}), error("Error: array index 3 out of range"));
+    BOOST_CHECK_EQUAL(run(p, "local", {-1}), error("Error: array index -1 out of range"));
+    BOOST_CHECK_EQUAL(run(p, "square", {3}), value(9));
+    BOOST_CHECK_EQUAL(run(p, "square", {4}), error("Error: array index 4 out of range"));
+    BOOST_CHECK_EQUAL(run(p, "store", {3, 8}), value(8));
+    BOOST_CHECK_EQUAL(run(p, "store", {4, 8}), error("Error: array index 4 out of range"));
+}
+
+BOOST_AUTO_TEST_CASE(globals_keep_their_values_across_calls)
+{
+    Script script(
+        "var int counter = 40;\n"
+        "func int next() { counter += 1; return counter; };\n");
+    Machine machine(script.program);
+    BOOST_CHECK_EQUAL(machine.global("counter"), 40);
+    BOOST_CHECK_EQUAL(machine.call("next", {}, false), value(41));
+    BOOST_CHECK_EQUAL(machine.call("next", {}, true), value(42));
+    BOOST_CHECK_EQUAL(machine.global("counter"), 42);
+}
+
+BOOST_AUTO_TEST_CASE(constants_read_constants_and_instances_declared_later)
+{
+    Script script(
+        "const int HERO_ID = Hero;\n"
+        "const int A = B + 1;\n"
+        "const int B = C * 2;\n"
+        "const int ELEMENT = LATER[1];\n"
+        "const int SIZED[COUNT] = {7, 8};\n"
+        "const int C = 3;\n"
+        "const int LATER[2] = {4, 5};\n"
+        "const int COUNT = 2;\n"
+        "class C_NPC { var int id; };\n"
+        "instance Hero(C_NPC) { id = HERO_ID; };\n"
+        "func int hero() { return HERO_ID; };\n"
+        "func int sum() { return A * 100 + ELEMENT * 10 + SIZED[1]; };\n");
+    const int hero = *script.program.find_instance("Hero");
+    BOOST_CHECK_EQUAL(run(script.program, "hero"), value(hero));
+    BOOST_CHECK_EQUAL(run(script.program, "sum"), value(7 * 100 + 5 * 10 + 8));
+    BOOST_CHECK_EQUAL(Machine(script.program).field("Hero", "id"), hero);
+
+    BOOST_CHECK_NE(Script::errors("const int P = Q; const int Q = P;").find("must be constant"), std::string::npos);
+    BOOST_CHECK_NE(Script::errors("const int P = P + 1;").find("must be constant"), std::string::npos);
+    BOOST_CHECK_NE(Script::errors("const int D = 1; const int E = D; const int D = 2;").find("Duplicate variable"),
+                   std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(strings_concatenate_and_compare)
+{
+    Script script(
+        "var string last;\n"
+        "func int same(var int n) {\n"
+        "    last = ConcatStrings(\"item\", IntToString(n));\n"
+        "    return Hlp_StrCmp(last, ConcatStrings(\"it\", ConcatStrings(\"em\", IntToString(n))));\n"
+        "};\n");
+    Machine machine(script.program);
+    BOOST_CHECK_EQUAL(machine.call("same", {-12}, false), value(1));
+    BOOST_CHECK_EQUAL(machine.string(machine.global("last")), "item-12");
+    BOOST_CHECK_EQUAL(run(script.program, "same", {7}), value(1));
+}
+
+BOOST_AUTO_TEST_CASE(prototypes_flatten_into_instances)
+{
+    Script script(
+        "class C_ITEM { var int value; var int flags; var int weight; var int table[2]; var string name; };\n"
+        "func int twice(var int x) { return 2 * x; };\n"
+        "prototype ItemPro(C_ITEM) { flags = 1; value = 3; name = \"item\"; table[1] = 4; };\n"
+        "prototype Computed(C_ITEM) { value = twice(5); flags = value + 1; };\n"
+        "instance Plain(ItemPro) { };\n"
+        "instance Override(ItemPro) { value = 9; weight = value + flags; };\n"
+        "instance FromComputed(Computed) { weight = value * 10; table[0] = flags; };\n"
+        "instance Bare(C_ITEM) { weight = 6; };\n");
+    Machine machine(script.program);
+    BOOST_CHECK_EQUAL(machine.field("Plain", "value"), 3);
+    BOOST_CHECK_EQUAL(machine.field("Plain", "flags"), 1);
+    BOOST_CHECK_EQUAL(machine.field("Plain", "table", 1), 4);
+    BOOST_CHECK_EQUAL(machine.string(machine.field("Plain", "name")), "item");
+    BOOST_CHECK_EQUAL(machine.field("Override", "value"), 9);
+    BOOST_CHECK_EQUAL(machine.field("Override", "weight"), 10);
+    BOOST_CHECK_EQUAL(machine.field("Override", "table", 1), 4);
+    BOOST_CHECK_EQUAL(machine.field("FromComputed", "value"), 10);
+    BOOST_CHECK_EQUAL(machine.field("FromComputed", "flags"), 11);
+    BOOST_CHECK_EQUAL(machine.field("FromComputed", "weight"), 100);
+    BOOST_CHECK_EQUAL(machine.field("FromComputed", "table", 0), 11);
+    BOOST_CHECK_EQUAL(machine.field("Bare", "weight"), 6);
+    BOOST_CHECK_EQUAL(machine.field("Bare", "value"), 0);
+
+    // constant writes need no initializer at all
+    const int plain = *script.program.find_instance("Plain");
+    BOOST_CHECK(script.program.initializer(plain).initializer == instance_init::no_initializer);
+}
+
+BOOST_AUTO_TEST_CASE(member_access_through_instances)
+{
+    Script script(
+        "class C_NPC { var int id; var int attribute[3]; };\n"
+        "instance Hero(C_NPC) { id = 7; attribute[2] = 50; };\n"
+        "func int health(var C_NPC npc, var int i) { return npc.attribute[i]; };\n"
+        "func int heal(var C_NPC npc) { npc.attribute[2] += 10; return npc.attribute[2] + Hero.id; };\n");
+    const int hero = *script.program.find_instance("Hero");
+    BOOST_CHECK_EQUAL(run(script.program, "health", {hero, 2}), value(50));
+    BOOST_CHECK_EQUAL(run(script.program, "health", {hero, 3}), error("Error: array index 3 out of range"));
+    BOOST_CHECK_EQUAL(run(script.program, "heal", {hero}), value(67));
+    BOOST_CHECK_EQUAL(run(script.program, "health", {0, 0}).error.empty(), false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
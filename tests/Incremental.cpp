@@ -0,0 +1,253 @@
+#include "incremental.hpp"
+#include "visitors/PrettyPrinter.hpp"
+#include "visitors/VisitorAdapter.hpp"
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <sstream>
+#include <type_traits>
+
+using namespace parser;
+
+namespace
+{
+    /**
+     * the position tags of all nodes as offsets into their file
+     */
+    class Offsets : public ASTVisitors::VisitorAdapter<Offsets>
+    {
+    public:
+        Offsets(const ErrorHandler& errorHandler, ast::source_location base)
+                : VisitorAdapter(errorHandler),
+                  m_Base(base)
+        {
+        }
+
+        template <class T>
+        result_type operator()(T& x)
+        {
+            record(x, std::is_base_of<ast::position_tagged, T>());
+            return visitBase(x);
+        }
+
+        std::vector<std::size_t> offsets;
+
+    private:
+        template <class T>
+        void record(T& x, std::true_type)
+        {
+            offsets.push_back(x.location == ast::invalid_location ? std::size_t(-1) : std::size_t(x.location - m_Base));
+        }
+
+        template <class T>
+        void record(T&, std::false_type)
+        {
+        }
+
+        ast::source_location m_Base;
+    };
+
+    /**
+     * what a parse left behind, locations relative to the file so that files at other bases compare equal
+     */
+    struct Parsed
+    {
+        std::vector<std::string> segments;
+        std::string printed;
+        std::vector<std::size_t> offsets;
+    };
+
+    Parsed describe(error_handler_type& errorHandler, ast::program& ast, const std::vector<segment>& segments)
+    {
+        Parsed result;
+        const ast::source_location base = errorHandler.get_source().base;
+        for (const segment& s : segments)
+        {
+            std::ostringstream out;
+            out << s.offset << '+' << s.length << ": " << s.declarations << " declarations";
+            for (const diagnostic& error : s.errors)
+                out << ", error at " << error.first - base << " to " << error.last - base << ' ' << error.message;
+            result.segments.push_back(out.str());
+        }
+        ASTVisitors::PrettyPrinter(errorHandler, result.printed).start(ast);
+        Offsets offsets(errorHandler, base);
+        offsets.start(ast);
+        result.offsets = std::move(offsets.offsets);
+        return result;
+    }
+
+    Parsed parsed(const std::string& text)
+    {
+        const source_file& file = source_manager::get().add_file("full.d", text);
+        std::ostringstream discarded;
+        error_handler_type errorHandler(file, discarded);
+        ast::program ast;
+        std::vector<segment> segments;
+        parse_segments(errorHandler, ast, segments);
+        Parsed result = describe(errorHandler, ast, segments);
+        ast.clear();
+        source_manager::get().remove_file(file);
+        return result;
+    }
+
+    /**
+     * parses text, edits it in place and reparses it the way project::reparse does.
+     * If moves, a file behind it makes the file move to a new base when the edit grows it
+     */
+    Parsed reparsed(const std::string& text, const text_edit& edit, bool moves, segment_change& change)
+    {
+        source_manager& manager = source_manager::get();
+        const source_file& file = manager.add_file("incremental.d", text, moves ? 0 : edit.text.size());
+        const source_file& behind = manager.add_file("behind.d", "");
+        std::ostringstream discarded;
+        ast::program ast;
+        std::vector<segment> segments;
+        {
+            error_handler_type errorHandler(file, discarded);
+            parse_segments(errorHandler, ast, segments);
+        }
+        const ast::source_location oldBase = file.base;
+        manager.edit_file(file, edit.offset, edit.removed, edit.text);
+        BOOST_CHECK_EQUAL(file.base != oldBase, moves && edit.text.size() > edit.removed);
+        error_handler_type errorHandler(file, discarded);
+        reparse(errorHandler, oldBase, edit, ast, segments, change);
+        Parsed result = describe(errorHandler, ast, segments);
+        ast.clear();
+        manager.remove_file(behind);
+        manager.remove_file(file);
+        return result;
+    }
+
+    /**
+     * the reparse after replacing removed characters at offset must equal a parse of the whole edited text,
+     * with the file keeping its base and moving
+     */
+    segment_change checkEdit(const std::string& text, std::size_t offset, std::size_t removed, const std::string& inserted)
+    {
+        std::string edited = text;
+        edited.replace(offset, removed, inserted);
+        const Parsed expected = parsed(edited);
+        segment_change change;
+        for (bool moves : {false, true})
+        {
+            const Parsed actual = reparsed(text, {offset, removed, inserted}, moves, change);
+            BOOST_TEST_CONTEXT("replacing \"" << text.substr(offset, removed) << "\" at " << offset << " by \""
+                                              << inserted << (moves ? "\" moving the file" : "\""))
+            {
+                BOOST_CHECK_EQUAL_COLLECTIONS(actual.segments.begin(), actual.segments.end(),
+                                              expected.segments.begin(), expected.segments.end());
+                BOOST_CHECK_EQUAL(actual.printed, expected.printed);
+                BOOST_CHECK_EQUAL_COLLECTIONS(actual.offsets.begin(), actual.offsets.end(),
+                                              expected.offsets.begin(), expected.offsets.end());
+            }
+        }
+        return change;
+    }
+
+    segment_change checkEdit(const std::string& text, const std::string& old, const std::string& inserted)
+    {
+        BOOST_REQUIRE(text.find(old) != std::string::npos);
+        return checkEdit(text, text.find(old), old.size(), inserted);
+    }
+
+    const std::string source =
+        "const string GREETING = \"a;b{\";\n"
+        "// a comment; with \"semicolons\" {\n"
+        "func int first(var int a) { if (a) { return 1; }; return 2; };\n"
+        "/* block ; comment */\n"
+        "var int counter;\n"
+        "func void second() { counter = first(counter); };\n";
+}
+
+BOOST_AUTO_TEST_SUITE(Incremental)
+
+BOOST_AUTO_TEST_CASE(segments_end_behind_top_level_semicolons)
+{
+    BOOST_CHECK_EQUAL(segment_end("var int a; var int b;", 0), 10u);
+    BOOST_CHECK_EQUAL(segment_end("func void f() { a; b; }; x", 0), 24u);
+    BOOST_CHECK_EQUAL(segment_end("const string s = \";\"; x", 0), 21u);
+    BOOST_CHECK_EQUAL(segment_end("// ;\n/* ; */ var int a; x", 0), 23u);
+    BOOST_CHECK_EQUAL(segment_end("var int a /* ; ", 0), 15u);     // unterminated comments run to the end
+    BOOST_CHECK_EQUAL(segment_end("const string s = \"; ", 0), 20u);
+    BOOST_CHECK_EQUAL(segment_end("} } var int a; x", 0), 14u);     // stray braces don't nest below 0
+
+    const text_edit edit = diff("var int a; var int b;", "var int a; var int cb;");
+    BOOST_CHECK_EQUAL(edit.offset, 19u);
+    BOOST_CHECK_EQUAL(edit.removed, 0u);
+    BOOST_CHECK_EQUAL(edit.text, "c");
+}
+
+BOOST_AUTO_TEST_CASE(edits_inside_strings_and_comments)
+{
+    // only the segment of the edit is parsed again
+    segment_change change = checkEdit(source, "a;b{", "a;;b}{");
+    BOOST_CHECK_EQUAL(change.removed, 1u);
+    BOOST_CHECK_EQUAL(change.inserted, 1u);
+    change = checkEdit(source, "block ; comment", "block ;; comment }");
+    BOOST_CHECK_EQUAL(change.first, 2u);
+    BOOST_CHECK_EQUAL(change.removed, 1u);
+
+    checkEdit(source, "with \"semicolons\"", "with \"semi");
+    checkEdit(source, "// a comment", "/* a comment");             // runs to the end of the block comment
+    checkEdit(source, "comment */", "comment");                    // runs to the end of the file
+    checkEdit(source, "\"a;b{\"", "\"a;b{");                       // unterminated string
+    checkEdit(source, "/* block", "\"/* block");
+    checkEdit(source, "if (a)", "/* */ if (a)");
+}
+
+BOOST_AUTO_TEST_CASE(edits_across_a_semicolon_boundary)
+{
+    checkEdit(source, "counter;\n", "counter\n");                  // merges two segments
+    checkEdit(source, "return 1; };", "return 1; } var int split;");
+    checkEdit(source, "{ if (a) { return 1; }", "{ if (a) { return 1; }; };");  // splits into an extra segment
+    checkEdit(source, "2; };\n/* block", "3; };\n/* other");
+    checkEdit(source, "first(var int a) {", "first(var int a) {};\nvar int b; func int other() {");
+    checkEdit(source, ";\nfunc void", "; func int");
+}
+
+BOOST_AUTO_TEST_CASE(edits_deleting_whole_segments)
+{
+    const std::size_t counter = source.find("\nvar int counter;") + 1;
+    segment_change change = checkEdit(source, counter, std::string("var int counter;").size(), "");
+    BOOST_CHECK_EQUAL(change.inserted, 1u);         // the comment in front of it joins the next declaration
+
+    checkEdit(source, 0, source.find(";\n") + 1, "");                   // the first one
+    const std::size_t second = source.find("func void second");
+    checkEdit(source, second, source.size() - second, "");             // the last one
+    const std::size_t first = source.find("func int first");
+    checkEdit(source, first, source.find("var int counter") - first, "");
+    checkEdit(source, 0, source.size(), "");                            // all of them
+    checkEdit("", 0, 0, source);
+}
+
+BOOST_AUTO_TEST_CASE(edits_at_the_end)
+{
+    checkEdit(source, source.size(), 0, "var int appended;");
+    checkEdit(source, source.size(), 0, "var int unterminated");
+    checkEdit(source, source.size(), 0, "/* open comment;");
+    checkEdit(source, source.size() - 2, 2, "");                        // the last semicolon
+    const std::string open = "var int a; func void f() { a = 1;";
+    checkEdit(open, open.size(), 0, " };");
+    checkEdit(open, open.size(), 0, "");
+    checkEdit(open + " };", open.size(), 3, "");
+}
+
+BOOST_AUTO_TEST_CASE(random_edits_match_a_full_parse)
+{
+    const std::vector<std::string> pieces = {
+        ";", "{", "}", "\"", "/*", "*/", "//", "\n", "x", " var int v;", " func int g() { return 1; };", ""
+    };
+    std::mt19937 random(30);
+    std::string text = source;
+    for (int i = 0; i < 300; ++i)
+    {
+        const std::size_t offset = random() % (text.size() + 1);
+        const std::size_t removed = std::min<std::size_t>(random() % 12, text.size() - offset);
+        const std::string inserted = pieces[random() % pieces.size()];
+        checkEdit(text, offset, removed, inserted);
+        text.replace(offset, removed, inserted);
+        if (text.size() < source.size() / 2)
+            text += source;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
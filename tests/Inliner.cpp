@@ -0,0 +1,126 @@
+#include "Script.hpp"
+#include "visitors/inliner.hpp"
+#include <boost/test/unit_test.hpp>
+
+using namespace Test;
+
+namespace
+{
+    /**
+     * the program after inline_calls, which must inline at least one call
+     * and compute what the original computes on every call
+     */
+    code_gen::program inlined(const code_gen::program& program, const std::vector<std::pair<std::string, std::vector<int>>>& calls,
+                              const code_gen::inline_options& options = code_gen::inline_options())
+    {
+        code_gen::program result = program;
+        BOOST_CHECK_GT(code_gen::inline_calls(result, options), 0u);
+        for (const auto& call : calls)
+            BOOST_CHECK_EQUAL(run(result, call.first, call.second), run(program, call.first, call.second));
+        return result;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(Inliner)
+
+BOOST_AUTO_TEST_CASE(arguments_map_to_the_callers_locals)
+{
+    // the callee's arguments arrive in reverse order on the stack, a swap shows a mix up
+    Script script(
+        "func int sub(var int a, var int b) { return a - b; };\n"
+        "func int mix(var int a, var int b, var int c) { var int t; t = a * 100 + b * 10; return t + c; };\n"
+        "func int caller(var int x, var int y) { var int local; local = 3; return sub(x, y) * 1000 + mix(y, local, x) + local; };\n");
+    inlined(script.program, {{"caller", {7, 2}}, {"caller", {-4, 9}}, {"sub", {1, 5}}});
+}
+
+BOOST_AUTO_TEST_CASE(early_returns_jump_behind_the_body)
+{
+    Script script(
+        "func int sign(var int x) { if (x < 0) { return -1; }; if (x == 0) { return 0; }; return 1; };\n"
+        "func int clamp(var int x) { while (1) { if (x > 10) { return 10; }; return x; }; return -5; };\n"
+        "func int caller(var int x) { return sign(x) * 100 + clamp(x) + sign(x - 5); };\n");
+    code_gen::program result = inlined(script.program, {{"caller", {-3}}, {"caller", {0}}, {"caller", {5}}, {"caller", {42}}});
+    BOOST_CHECK_EQUAL(run(result, "caller", {42}), value(100 + 10 + 1));
+}
+
+BOOST_AUTO_TEST_CASE(locals_start_over_at_every_inlined_call)
+{
+    Script script(
+        "func int count(var int n) { var int total; while (n > 0) { total += n; n -= 1; }; return total; };\n"
+        "func int caller(var int n) { var int i; var int sum; while (i < 3) { sum += count(n + i); i += 1; }; return sum + count(n); };\n");
+    code_gen::inline_options options;
+    options.max_size = options.max_hot_size;
+    inlined(script.program, {{"caller", {4}}, {"caller", {0}}}, options);
+}
+
+BOOST_AUTO_TEST_CASE(switch_tables_and_short_circuits_move_along)
+{
+    Script script(
+        "func int kind(var int x) {\n"
+        "    if (x == 0) { return 10; } else if (x == 1) { return 11; } else if (x == 2) { return 12; } else if (x == 3) { return 13; };\n"
+        "    return 0;\n"
+        "};\n"
+        "func int both(var int a, var int b) { return a && Test_Count(b); };\n"
+        "func int caller(var int x) { return kind(x) + kind(x + 1) * 100 + both(x, x + 1); };\n");
+    inlined(script.program, {{"caller", {-1}}, {"caller", {0}}, {"caller", {2}}, {"caller", {3}}, {"caller", {9}}});
+}
+
+BOOST_AUTO_TEST_CASE(errors_in_inlined_bodies_still_throw)
+{
+    Script script(
+        "var int table[2];\n"
+        "func int at(var int i) { return table[i]; };\n"
+        "func int quotient(var int a, var int b) { return a / b; };\n"
+        "func int caller(var int i) { return at(i) + quotient(10, i); };\n");
+    code_gen::program result = inlined(script.program, {{"caller", {1}}, {"caller", {0}}, {"caller", {2}}});
+    BOOST_CHECK_EQUAL(run(result, "caller", {0}), error("Error: division by zero"));
+    BOOST_CHECK_EQUAL(run(result, "caller", {2}), error("Error: array index 2 out of range"));
+}
+
+BOOST_AUTO_TEST_CASE(recursive_and_large_functions_stay_calls)
+{
+    Script script(
+        "func int fact(var int n) { if (n <= 1) { return 1; }; return n * fact(n - 1); };\n"
+        "func int caller(var int n) { return fact(n); };\n");
+    code_gen::inline_options none;
+    none.max_size = 0;
+    none.max_hot_size = 0;
+    code_gen::program result = script.program;
+    BOOST_CHECK_EQUAL(code_gen::inline_calls(result, none), 0u);
+
+    // fact is inlined into caller, the call inside fact stays, a tiny program needs room to grow
+    code_gen::inline_options options;
+    options.max_size = options.max_hot_size;
+    options.max_growth = 4;
+    result = inlined(script.program, {{"caller", {6}}, {"fact", {5}}}, options);
+    BOOST_CHECK_EQUAL(run(result, "caller", {6}), value(720));
+}
+
+BOOST_AUTO_TEST_CASE(hot_functions_from_the_profile)
+{
+    std::string source = "func int helper(var int x) { var int y; y = x;";
+    for (int i = 0; i < 6; ++i)
+        source += " y = y * 3 + " + std::to_string(i) + ";";
+    source += " return y; };\n"
+              "func int first(var int x) { return helper(x) + 1; };\n"
+              "func int second(var int x) { return helper(x) + 2; };\n";
+    Script script(source);
+
+    // too large for max_size and called from two places, only a profile makes it hot
+    code_gen::inline_options options;
+    options.max_size = 4;
+    options.max_growth = 4;
+    code_gen::program result = script.program;
+    BOOST_CHECK_EQUAL(code_gen::inline_calls(result, options), 0u);
+
+    std::vector<std::uint64_t> profile;
+    Machine machine(script.program);
+    machine.vm().profile_calls(&profile);
+    for (int i = 0; i < int(options.hot_calls); ++i)
+        machine.call("first", {i}, false);
+    machine.vm().profile_calls(nullptr);
+    options.profile = &profile;
+    inlined(script.program, {{"first", {3}}, {"second", {3}}, {"first", {-8}}}, options);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+#include "line_index.hpp"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using parser::line_index;
+
+namespace
+{
+    line_index indexOf(const std::string& text)
+    {
+        return line_index(text.begin(), text.end());
+    }
+
+    /**
+     * the line of every offset including the end, a lone "\r", "\r\n" and "\n" each end a line
+     */
+    std::vector<std::size_t> linesOf(const line_index& lines, const std::string& text)
+    {
+        std::vector<std::size_t> result;
+        for (std::size_t offset = 0; offset <= text.size(); ++offset)
+            result.push_back(lines.line_of(offset));
+        return result;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(LineIndex)
+
+BOOST_AUTO_TEST_CASE(line_terminators)
+{
+    const std::string text = "a\nb\r\nc\rd\r\r\ne\n";
+    const line_index lines = indexOf(text);
+    BOOST_CHECK_EQUAL(lines.line_count(), 7u);
+    const std::vector<std::size_t> expected = {1, 1, 2, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7};
+    const std::vector<std::size_t> actual = linesOf(lines, text);
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+
+    BOOST_CHECK_EQUAL(lines.line_start(4), 2u);         // the "\n" of "\r\n" is on the line of "b"
+    BOOST_CHECK_EQUAL(lines.line_start(5), 5u);
+    BOOST_CHECK_EQUAL(lines.offset_of_line(4), 7u);     // behind the lone "\r"
+    BOOST_CHECK_EQUAL(lines.offset_of_line(0), 0u);
+    BOOST_CHECK_EQUAL(lines.offset_of_line(100), text.size());
+    BOOST_CHECK_EQUAL(indexOf("").line_count(), 1u);
+    BOOST_CHECK_EQUAL(indexOf("\r").line_count(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(columns_expand_tabs)
+{
+    const std::string text = "\tx\na\tb\r\n  \t\ty";
+    const line_index lines = indexOf(text);
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 0, 4), 1u);
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 1, 4), 5u);
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 5, 4), 5u);     // "b" behind "a\t"
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 5, 8), 9u);
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 5, 0), 3u);     // no tab stops, a tab is one column
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 12, 4), 9u);    // "y" behind "  \t\t"
+    BOOST_CHECK_EQUAL(lines.column_of(text.begin(), 3, 4), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(edits_give_the_index_of_the_new_text)
+{
+    // "\r" and "\n" pair up or split across the edit boundaries, the result must be a fresh index
+    const std::vector<std::string> pieces = {"\r", "\n", "\r\n", "a", "\t", "bc", ""};
+    std::mt19937 random(26);
+    std::string text = "a\r\nb\rc\nd";
+    line_index lines = indexOf(text);
+    for (int i = 0; i < 5000; ++i)
+    {
+        const std::size_t offset = random() % (text.size() + 1);
+        const std::size_t removed = std::min<std::size_t>(random() % 4, text.size() - offset);
+        std::string inserted = pieces[random() % pieces.size()];
+        if (random() % 2)
+            inserted += pieces[random() % pieces.size()];
+        text.replace(offset, removed, inserted);
+        lines.replace(text, offset, removed, inserted.size());
+
+        const std::vector<std::size_t> expected = linesOf(indexOf(text), text);
+        const std::vector<std::size_t> actual = linesOf(lines, text);
+        BOOST_REQUIRE_MESSAGE(actual == expected, "replacing " << removed << " at " << offset << " in a text of "
+                                                               << text.size() << " characters");
+        if (text.size() > 64)
+        {
+            text.erase(0, 32);
+            lines = indexOf(text);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
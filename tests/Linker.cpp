@@ -0,0 +1,133 @@
+#include "Script.hpp"
+#include "visitors/inliner.hpp"
+#include "visitors/linker.hpp"
+#include <boost/test/unit_test.hpp>
+
+using namespace Test;
+
+namespace
+{
+    bool stripped(const code_gen::program& program, const std::string& function)
+    {
+        const code_gen::program::function_info* info = program.find_function(function);
+        return !info || info->address == code_gen::program::removed;
+    }
+
+    const std::string world =
+        "class C_NPC { var int id; var func routine; };\n"
+        "var int calls;\n"
+        "var int unused;\n"
+        "var string greeting = \"hello\";\n"
+        "const int TABLE[3] = {5, 6, 7};\n"
+        "const int UNUSED_TABLE[2] = {1, 2};\n"
+        "func int helper(var int x) { calls += 1; return TABLE[x] + x; };\n"
+        "func int Rtn_Hero() { return 77; };\n"
+        "func int dead(var int x) { unused = x; return UNUSED_TABLE[x]; };\n"
+        "func int startup(var int x) { return helper(x) * 10 + Hlp_StrCmp(greeting, \"hello\"); };\n"
+        "func int byRoutine() { return Hero.id; };\n"
+        "prototype NpcPro(C_NPC) { routine = Rtn_Hero; };\n"
+        "instance Hero(NpcPro) { id = 4; };\n"
+        "instance Stranger(NpcPro) { id = dead(1); };\n";
+}
+
+BOOST_AUTO_TEST_SUITE(Linker)
+
+BOOST_AUTO_TEST_CASE(roots_compute_the_same_after_stripping)
+{
+    Script script(world);
+    code_gen::program program = script.program;
+    code_gen::link_roots roots;
+    roots.functions = {"startup", "byRoutine"};
+    const code_gen::strip_result result = code_gen::strip_unreachable(program, roots);
+
+    BOOST_CHECK(stripped(program, "dead"));
+    BOOST_CHECK(!stripped(program, "helper"));
+    BOOST_CHECK(!stripped(program, "Rtn_Hero"));     // the member of a reached instance holds it
+    BOOST_CHECK_GE(result.functions, 1u);
+    BOOST_CHECK_EQUAL(result.instances, 1u);        // Stranger
+    BOOST_CHECK_GE(result.globals, 2u);             // unused, UNUSED_TABLE
+    BOOST_CHECK(program.find_global("calls") != nullptr);
+
+    for (int x : {0, 2, 3})
+        BOOST_CHECK_EQUAL(run(program, "startup", {x}), run(script.program, "startup", {x}));
+    BOOST_CHECK_EQUAL(run(program, "byRoutine"), value(4));
+
+    Machine machine(program);
+    machine.call("startup", {1}, false);
+    BOOST_CHECK_EQUAL(machine.global("calls"), 1);
+    BOOST_CHECK_EQUAL(machine.string(machine.global("greeting")), "hello");
+    BOOST_CHECK_EQUAL(machine.field("Hero", "routine"), script.program.find_function("Rtn_Hero")->handle);
+}
+
+BOOST_AUTO_TEST_CASE(instance_and_global_roots)
+{
+    Script script(world);
+    code_gen::program program = script.program;
+    code_gen::link_roots roots;
+    roots.instances = {"Stranger"};
+    roots.globals = {"unused"};
+    code_gen::strip_unreachable(program, roots);
+
+    // the initializer of Stranger calls dead, which reads the unused table
+    BOOST_CHECK(!stripped(program, "dead"));
+    BOOST_CHECK(stripped(program, "startup"));
+    BOOST_CHECK(stripped(program, "helper"));
+    BOOST_CHECK(program.find_global("unused") != nullptr);
+    Machine machine(program);
+    BOOST_CHECK_EQUAL(machine.field("Stranger", "id"), 2);
+    BOOST_CHECK_EQUAL(machine.global("unused"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(int_members_keep_their_instance)
+{
+    // the npc of a dialog is an int member, the instance is folded into the image
+    Script script(
+        "class C_NPC { var int id; };\n"
+        "class C_INFO { var int npc; var int nr; };\n"
+        "instance Diego(C_NPC) { id = 7; };\n"
+        "instance Lester(C_NPC) { id = 8; };\n"
+        "instance DIA_Diego(C_INFO) { npc = Diego; nr = 100; };\n");
+    code_gen::program program = script.program;
+    code_gen::link_roots roots;
+    roots.instances = {"DIA_Diego"};
+    const code_gen::strip_result result = code_gen::strip_unreachable(program, roots);
+
+    BOOST_CHECK_EQUAL(result.instances, 1u);        // Lester
+    Machine machine(program);
+    BOOST_CHECK_EQUAL(machine.field("DIA_Diego", "npc"), *program.find_instance("Diego"));
+    BOOST_CHECK_EQUAL(machine.field("Diego", "id"), 7);
+    BOOST_CHECK_EQUAL(machine.field("Lester", "id"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(function_values_keep_their_target)
+{
+    Script script(
+        "var func callback;\n"
+        "func int target() { return 5; };\n"
+        "func int other() { return 6; };\n"
+        "func int setup() { callback = target; return callback; };\n");
+    code_gen::program program = script.program;
+    code_gen::link_roots roots;
+    roots.functions = {"setup"};
+    code_gen::strip_unreachable(program, roots);
+    BOOST_CHECK(stripped(program, "other"));
+    BOOST_CHECK(!stripped(program, "target"));
+
+    const int handle = script.program.find_function("target")->handle;
+    BOOST_CHECK_EQUAL(run(program, "setup"), value(handle));
+    BOOST_CHECK_EQUAL(program.function_address(handle), program.find_function("target")->address);
+}
+
+BOOST_AUTO_TEST_CASE(inlining_after_stripping)
+{
+    Script script(world);
+    code_gen::program program = script.program;
+    code_gen::link_roots roots;
+    roots.functions = {"startup"};
+    code_gen::strip_unreachable(program, roots);
+    BOOST_CHECK_GT(code_gen::inline_calls(program), 0u);
+    for (int x : {0, 1, 2, 5})
+        BOOST_CHECK_EQUAL(run(program, "startup", {x}), run(script.program, "startup", {x}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,183 @@
+#include "Script.hpp"
+#include "program.hpp"
+#include "error_handler.hpp"
+#include "vm/builtins.hpp"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <stdexcept>
+
+namespace Test
+{
+    namespace
+    {
+        int countedCalls = 0;
+    }
+
+    Outcome value(int value)
+    {
+        Outcome outcome;
+        outcome.value = value;
+        return outcome;
+    }
+
+    Outcome error(const std::string& message)
+    {
+        Outcome outcome;
+        outcome.error = message;
+        return outcome;
+    }
+
+    bool operator==(const Outcome& a, const Outcome& b)
+    {
+        return a.error == b.error && (!a.error.empty() || a.value == b.value);
+    }
+
+    bool operator!=(const Outcome& a, const Outcome& b)
+    {
+        return !(a == b);
+    }
+
+    std::ostream& operator<<(std::ostream& out, const Outcome& outcome)
+    {
+        if (outcome.error.empty())
+            return out << outcome.value;
+        return out << "threw \"" << outcome.error << '"';
+    }
+
+    const external_registry& externals()
+    {
+        static external_registry registry = []() {
+            external_registry externals;
+            bind_string_builtins(externals);
+            externals.bind<int(int)>("Test_Count", [](int value) {
+                ++countedCalls;
+                return value;
+            });
+            return externals;
+        }();
+        return registry;
+    }
+
+    int externalCalls()
+    {
+        return countedCalls;
+    }
+
+    Script::Script(const std::string& source)
+            : m_Source(&parser::source_manager::get().add_file("test.d", source))
+    {
+        std::ostringstream diagnostics;
+        parser::error_handler_type errorHandler(*m_Source, diagnostics);
+        if (!parser::parse(errorHandler, m_Ast)
+                || !code_gen::compiler(program, errorHandler, &externals()).compile(m_Ast))
+        {
+            parser::source_manager::get().remove_file(*m_Source);
+            throw std::runtime_error("Error: the test script doesn't compile\n" + diagnostics.str());
+        }
+    }
+
+    Script::~Script()
+    {
+        m_Ast.clear();
+        parser::source_manager::get().remove_file(*m_Source);
+    }
+
+    std::string Script::errors(const std::string& source)
+    {
+        try
+        {
+            Script script(source);
+            return std::string();
+        }
+        catch (const std::runtime_error& e)
+        {
+            return e.what();
+        }
+    }
+
+    verified_code verify(const code_gen::program& program)
+    {
+        return verifier::verify(program(), program.entry_points(), &externals(),
+                                program.global_data().size(), program.constant_data().size());
+    }
+
+    Machine::Machine(const code_gen::program& program)
+            : m_Program(program),
+              m_Code(verify(program)),
+              m_Vm(4096, &externals())
+    {
+        m_Vm.strings().assign(program.string_pool());
+        m_Vm.load_globals(program.global_data(), program.constant_data());
+        for (int handle = 1; handle <= int(program.instance_count()); ++handle)
+        {
+            if (program.instance_class(handle) >= 0)
+                m_Vm.create_instance(handle, program.class_at(program.instance_class(handle)).size);
+        }
+        for (int handle = 1; handle <= int(program.instance_count()); ++handle)
+        {
+            if (program.instance_class(handle) >= 0)
+                m_Vm.init_instance(m_Code, handle, program.initializer(handle));
+        }
+    }
+
+    Outcome Machine::call(const std::string& function, const std::vector<int>& args, bool checked)
+    {
+        const code_gen::program::function_info* info = m_Program.find_function(function);
+        if (!info || info->address == code_gen::program::removed)
+            throw std::runtime_error("Error: no function " + function);
+        try
+        {
+            if (checked)
+            {
+                std::vector<int> frame(4096);
+                std::copy(args.begin(), args.end(), frame.begin());
+                const std::vector<int>& code = m_Program();
+                return value(m_Vm.execute(code, code.begin() + std::ptrdiff_t(info->address), frame.begin()));
+            }
+            switch (args.size())
+            {
+                case 0: return value(m_Vm.execute(m_Code, info->address, {}));
+                case 1: return value(m_Vm.execute(m_Code, info->address, {args[0]}));
+                case 2: return value(m_Vm.execute(m_Code, info->address, {args[0], args[1]}));
+                case 3: return value(m_Vm.execute(m_Code, info->address, {args[0], args[1], args[2]}));
+                default: throw std::logic_error("too many arguments for a test call");
+            }
+        }
+        catch (const std::runtime_error& e)
+        {
+            return error(e.what());
+        }
+    }
+
+    int Machine::global(const std::string& name, std::uint32_t index)
+    {
+        const code_gen::program::global_info* global = m_Program.find_global(name);
+        if (!global || global->constant || index >= global->count)
+            throw std::runtime_error("Error: no global " + name);
+        return m_Vm.global(global->slot + index);
+    }
+
+    int Machine::field(const std::string& instance, const std::string& member, std::uint32_t index)
+    {
+        const int* handle = m_Program.find_instance(instance);
+        if (!handle || m_Program.instance_class(*handle) < 0)
+            throw std::runtime_error("Error: no instance " + instance);
+        const class_field* field = m_Program.class_at(m_Program.instance_class(*handle)).find(member);
+        if (!field || index >= field->count)
+            throw std::runtime_error("Error: no member " + member);
+
+        // op_load_field on the instance, the checked path reads the object of the vm
+        const std::vector<int> code = {op_stk_adj, 0, op_int, *handle, op_load_field, int(field->offset + 4 * index), op_return};
+        std::vector<int> frame(16);
+        return m_Vm.execute(code, code.begin(), frame.begin());
+    }
+
+    Outcome run(const code_gen::program& program, const std::string& function, const std::vector<int>& args)
+    {
+        Outcome checked = Machine(program).call(function, args, true);
+        Outcome fast = Machine(program).call(function, args, false);
+        BOOST_CHECK_MESSAGE(checked == fast, function << ": the checked path gives " << checked
+                                                      << ", the fast path " << fast);
+        return fast;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "ast.hpp"
+#include "source_manager.hpp"
+#include "visitors/compiler.hpp"
+#include "vm/externals.hpp"
+#include "vm/vm.hpp"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Test
+{
+    /**
+     * result of a script function, or the message of the std::runtime_error it threw
+     */
+    struct Outcome
+    {
+        int value = 0;
+        std::string error;      // empty unless it threw
+    };
+
+    Outcome value(int value);
+    Outcome error(const std::string& message);
+
+    bool operator==(const Outcome& a, const Outcome& b);
+    bool operator!=(const Outcome& a, const Outcome& b);
+    std::ostream& operator<<(std::ostream& out, const Outcome& outcome);
+
+    /**
+     * the string builtins and Test_Count(int), which counts its calls and returns its argument
+     */
+    const external_registry& externals();
+    int externalCalls();
+
+    /**
+     * a Daedalus source compiled with the externals above
+     */
+    class Script
+    {
+    public:
+        /**
+         * @throws std::runtime_error with the diagnostics if the source doesn't parse or compile
+         */
+        explicit Script(const std::string& source);
+        Script(const Script&) = delete;
+        Script& operator=(const Script&) = delete;
+        ~Script();
+
+        /**
+         * @return the diagnostics of a source that doesn't compile, empty if it does
+         */
+        static std::string errors(const std::string& source);
+
+        code_gen::program program;
+
+    private:
+        const parser::source_file* m_Source;
+        ast::program m_Ast;
+    };
+
+    /**
+     * a vm with the globals of a program loaded and every instance of a known class initialized
+     */
+    class Machine
+    {
+    public:
+        explicit Machine(const code_gen::program& program);
+
+        /**
+         * runs the function with the arguments
+         * @param checked on the checked path, on the verified fast path otherwise
+         */
+        Outcome call(const std::string& function, const std::vector<int>& args, bool checked);
+
+        int global(const std::string& name, std::uint32_t index = 0);
+        std::string string(int handle) { return m_Vm.strings().str(handle); }
+
+        /**
+         * a member of an instance by its names
+         */
+        int field(const std::string& instance, const std::string& member, std::uint32_t index = 0);
+
+        vmachine& vm() { return m_Vm; }
+        const verified_code& code() const { return m_Code; }
+
+    private:
+        const code_gen::program& m_Program;
+        verified_code m_Code;
+        vmachine m_Vm;
+    };
+
+    /**
+     * verifies the program with the regions and entry points it was compiled with
+     */
+    verified_code verify(const code_gen::program& program);
+
+    /**
+     * runs the function on the checked and the fast path of fresh machines, which must agree
+     * @return the outcome of the fast path
+     */
+    Outcome run(const code_gen::program& program, const std::string& function, const std::vector<int>& args = {});
+}
@@ -0,0 +1,129 @@
+#include "Script.hpp"
+#include "vm/snapshot.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+
+using namespace Test;
+
+namespace
+{
+    const std::string snapshotFile = "daedalus_tests.snapshot";
+
+    const std::string items =
+        "class C_ITEM { var int value; var int flags; var int weight; var string name; var int extra[2]; };\n"
+        "const int PRICES[4] = {10, 20, 30, 40};\n"
+        "var int created = 100;\n"
+        "func int weightOf(var int value) { return value / 2 + 1; };\n"
+        "prototype ItemPro(C_ITEM) { flags = 1; name = \"item\"; };\n"
+        "instance Sword(ItemPro) { value = 8; weight = weightOf(value); extra[1] = PRICES[flags]; };\n"
+        "instance Counted(ItemPro) { value = 2; created += 1; weight = created; };\n"
+        "instance Counting(ItemPro) { value = Test_Count(4); name = ConcatStrings(name, \"s\"); };\n"
+        "instance Shield(C_ITEM) { value = 5; };\n";
+
+    std::vector<snapshot_instance> instancesOf(const code_gen::program& program)
+    {
+        std::vector<snapshot_instance> instances;
+        for (int handle = 1; handle <= int(program.instance_count()); ++handle)
+            instances.push_back({handle, program.class_at(program.instance_class(handle)).size, &program.initializer(handle)});
+        return instances;
+    }
+
+    /**
+     * the members of every instance and the globals, strings by their text
+     */
+    std::vector<std::string> state(const code_gen::program& program, vmachine& machine, const verified_code& code,
+                                   const instance_snapshot* snapshot)
+    {
+        machine.strings().assign(program.string_pool());
+        machine.load_globals(program.global_data(), program.constant_data());
+        std::vector<std::vector<int>> memory;
+        for (const auto& instance : instancesOf(program))
+        {
+            memory.emplace_back(instance.size / sizeof(int), 0);
+            machine.bind_instance(instance.handle, memory.back().data(), instance.size);
+        }
+        if (snapshot)
+            machine.load_snapshot(*snapshot, code);
+        else
+        {
+            for (const auto& instance : instancesOf(program))
+                machine.init_instance(code, instance.handle, *instance.init);
+        }
+
+        std::vector<std::string> result;
+        for (std::size_t slot = 0; slot < machine.global_count(); ++slot)
+            result.push_back(std::to_string(machine.global(slot)));
+        for (int handle = 1; handle <= int(program.instance_count()); ++handle)
+        {
+            for (const class_field& field : program.class_at(program.instance_class(handle)).fields)
+            {
+                for (std::uint32_t i = 0; i < field.count; ++i)
+                {
+                    const int value = memory[handle - 1][field.offset / sizeof(int) + i];
+                    result.push_back(field.type == type_string ? machine.strings().str(value) : std::to_string(value));
+                }
+            }
+        }
+        return result;
+    }
+
+    std::uint64_t fingerprint(const std::string& source)
+    {
+        Script script(source);
+        return instance_snapshot::fingerprint_of(script.program);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(Snapshot)
+
+BOOST_AUTO_TEST_CASE(loading_gives_the_state_of_running_the_initializers)
+{
+    Script script(items);
+    const code_gen::program& program = script.program;
+    const verified_code code = verify(program);
+
+    // Counted reads a global and Counting calls externals, they run at load
+    const std::size_t deferred = instance_snapshot::write(snapshotFile, code, program, instancesOf(program));
+    BOOST_CHECK_EQUAL(deferred, 2u);
+    instance_snapshot snapshot(snapshotFile, instance_snapshot::fingerprint_of(program));
+    std::remove(snapshotFile.c_str());
+    BOOST_CHECK_EQUAL(snapshot.size(), program.instance_count());
+
+    vmachine initialized(4096, &externals());
+    vmachine loaded(4096, &externals());
+    const std::vector<std::string> expected = state(program, initialized, code, nullptr);
+    const std::vector<std::string> actual = state(program, loaded, code, &snapshot);
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL(loaded.global(program.find_global("created")->slot), 101);
+}
+
+BOOST_AUTO_TEST_CASE(snapshots_of_other_programs_are_rejected)
+{
+    Script script(items);
+    const verified_code code = verify(script.program);
+    instance_snapshot::write(snapshotFile, code, script.program, instancesOf(script.program));
+
+    const std::uint64_t same = fingerprint(items);
+    BOOST_CHECK_EQUAL(same, instance_snapshot::fingerprint_of(script.program));
+    BOOST_CHECK_NO_THROW(instance_snapshot(snapshotFile, same));
+
+    // edits that only change data, not code
+    const std::vector<std::pair<std::string, std::string>> edits = {
+        {"value = 5;", "value = 6;"},                       // folded into the image
+        {"created = 100;", "created = 101;"},               // initial value of a global
+        {"{10, 20, 30, 40}", "{10, 21, 30, 40}"},           // constant table
+        {"name = \"item\";", "name = \"items\";"},          // string pool
+        {"var int extra[2];", "var int extra[3];"},         // class layout
+    };
+    for (const auto& edit : edits)
+    {
+        std::string edited = items;
+        edited.replace(edited.find(edit.first), edit.first.size(), edit.second);
+        const std::uint64_t other = fingerprint(edited);
+        BOOST_CHECK_MESSAGE(other != same, "editing " << edit.first << " keeps the fingerprint");
+        BOOST_CHECK_THROW(instance_snapshot(snapshotFile, other), std::runtime_error);
+    }
+    std::remove(snapshotFile.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,73 @@
+#include "Script.hpp"
+#include <boost/test/unit_test.hpp>
+
+using namespace Test;
+
+BOOST_AUTO_TEST_SUITE(Strings)
+
+BOOST_AUTO_TEST_CASE(interned_strings_compare_by_handle)
+{
+    string_arena strings;
+    strings.assign({"", "a", "ab"});
+    const int temporary = strings.concat(strings.intern("a"), strings.temporary("b"));
+    BOOST_CHECK_EQUAL(temporary, 2);        // equal to a permanent string, so it is that string
+    const int other = strings.temporary("abc");
+    BOOST_CHECK(strings.equal(other, strings.temporary("abc")));
+    const int kept = strings.keep(other);
+    BOOST_CHECK(strings.equal(kept, other));
+    BOOST_CHECK_EQUAL(strings.str(kept), "abc");
+    strings.reset_temporaries();
+    BOOST_CHECK_EQUAL(strings.str(kept), "abc");
+    BOOST_CHECK_EQUAL(strings.str(other), "");      // invalid handles read as the empty string
+}
+
+BOOST_AUTO_TEST_CASE(kept_strings_are_swept_once_unreferenced)
+{
+    string_arena strings;
+    strings.assign({""});
+    int live = strings.keep(strings.temporary("live"));
+    int pinned = strings.intern(strings.str(strings.keep(strings.temporary("pinned"))));
+    int dead = strings.keep(strings.temporary("dead"));
+    BOOST_CHECK_EQUAL(strings.kept_count(), 3u);
+
+    strings.mark(&live, 1);
+    BOOST_CHECK_EQUAL(strings.sweep(), 1u);
+    BOOST_CHECK_EQUAL(strings.kept_count(), 2u);
+    BOOST_CHECK_EQUAL(strings.str(live), "live");
+    BOOST_CHECK_EQUAL(strings.str(pinned), "pinned");
+    BOOST_CHECK(!strings.valid(dead));
+
+    // the swept handle is reused, the string is found by its text again
+    const int again = strings.keep(strings.temporary("again"));
+    BOOST_CHECK_EQUAL(again, dead);
+    BOOST_CHECK_EQUAL(strings.keep(strings.temporary("live")), live);
+}
+
+BOOST_AUTO_TEST_CASE(stored_strings_stay_bounded)
+{
+    // every call stores a new string into a member and a global, only the last ones are referenced
+    Script script(
+        "class C_NPC { var string name; };\n"
+        "instance Hero(C_NPC) { name = \"hero\"; };\n"
+        "var string last;\n"
+        "var string fifth;\n"
+        "func int rename(var int n) {\n"
+        "    Hero.name = ConcatStrings(\"npc \", IntToString(n));\n"
+        "    last = IntToString(n);\n"
+        "    if (n == 5) { fifth = last; };\n"
+        "    return n;\n"
+        "};\n");
+    Machine machine(script.program);
+    std::size_t most = 0;
+    for (int n = 0; n < 200000; ++n)
+    {
+        machine.call("rename", {n}, false);
+        most = std::max(most, machine.vm().strings().kept_count());
+    }
+    BOOST_CHECK_LT(most, 50000u);
+    BOOST_CHECK_EQUAL(machine.string(machine.field("Hero", "name")), "npc 199999");
+    BOOST_CHECK_EQUAL(machine.string(machine.global("last")), "199999");
+    BOOST_CHECK_EQUAL(machine.string(machine.global("fifth")), "5");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
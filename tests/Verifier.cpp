@@ -0,0 +1,103 @@
+#include "Script.hpp"
+#include <boost/test/unit_test.hpp>
+
+using namespace Test;
+
+namespace
+{
+    /**
+     * the message the verifier rejects the code with, empty if it passes
+     */
+    std::string rejection(const std::vector<int>& code, std::vector<entry_point> entries = {{0, 0}},
+                          std::size_t globals = 0, std::size_t constants = 0)
+    {
+        try
+        {
+            verifier::verify(code, entries, &externals(), globals, constants);
+            return std::string();
+        }
+        catch (const std::runtime_error& e)
+        {
+            return e.what();
+        }
+    }
+
+    void checkRejected(const std::vector<int>& code, const std::string& reason,
+                       std::vector<entry_point> entries = {{0, 0}}, std::size_t globals = 0)
+    {
+        const std::string message = rejection(code, entries, globals);
+        BOOST_CHECK_MESSAGE(message.find(reason) != std::string::npos,
+                            "expected \"" << reason << "\", got \"" << message << '"');
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(Verifier)
+
+BOOST_AUTO_TEST_CASE(accepts_compiled_programs)
+{
+    Script script(
+        "var int g[2];\n"
+        "class C_NPC { var int id; var int values[2]; };\n"
+        "instance Hero(C_NPC) { id = 1; };\n"
+        "func int f(var int a, var C_NPC npc) { var int l[2]; l[a] = npc.values[a]; g[a] = l[a]; return Test_Count(g[a]) && a; };\n");
+    BOOST_CHECK_NO_THROW(verify(script.program));
+    BOOST_CHECK_EQUAL(rejection({op_stk_adj, 1, op_int, 4, op_store, 0, op_load, 0, op_return}), "");
+}
+
+BOOST_AUTO_TEST_CASE(rejects_malformed_code)
+{
+    checkRejected({12345}, "unknown opcode");
+    checkRejected({op_stk_adj, 0, op_int}, "truncated instruction");
+    checkRejected({op_stk_adj, 0, op_jump, 2, op_int, 1, op_return}, "jump into an instruction");
+    checkRejected({op_stk_adj, 0, op_jump, 100}, "jump out of the code");
+    checkRejected({op_stk_adj, 0, op_int, 1, op_return}, "entry point is no instruction", {{1, 0}});
+}
+
+BOOST_AUTO_TEST_CASE(rejects_unbalanced_stacks)
+{
+    checkRejected({op_stk_adj, 0, op_add, op_return}, "stack underflow");
+    checkRejected({op_stk_adj, 1, op_pop, op_int, 0, op_return}, "stack underflow");      // pops a local
+    checkRejected({op_stk_adj, 0, op_return}, "return without a value");
+    // one path pushes a value more than the other
+    checkRejected({op_stk_adj, 0, op_int, 1, op_jump_if, 3, op_int, 2, op_int, 3, op_return}, "stack depth differs");
+}
+
+BOOST_AUTO_TEST_CASE(rejects_out_of_range_operands)
+{
+    checkRejected({op_stk_adj, 1, op_load, 1, op_return}, "local 1 out of range");
+    checkRejected({op_stk_adj, 2, op_int, 0, op_load_index, 1, 2, op_return}, "locals 1 to 3 out of range");
+    checkRejected({op_stk_adj, 0, op_load_global, 2, op_return}, "global 2 out of range", {{0, 0}}, 2);
+    checkRejected({op_stk_adj, 0, op_int, 1, op_load_field, 2, op_return}, "invalid field offset 2");
+    checkRejected({op_stk_adj, 0, op_call_external, 99, op_return}, "unknown external 99");
+    checkRejected({op_stk_adj, -1, op_int, 0, op_return}, "invalid frame size");
+}
+
+BOOST_AUTO_TEST_CASE(rejects_inconsistent_calls)
+{
+    // the function at 15 is called with one and with two arguments
+    checkRejected({op_stk_adj, 0, op_int, 1, op_call, 1, 15, op_int, 1, op_int, 2, op_call, 2, 15, op_return,
+                   op_stk_adj, 2, op_load, 0, op_return},
+                  "called with different argument counts");
+    checkRejected({op_stk_adj, 0, op_call, 0, 3, op_return}, "is no instruction");
+    checkRejected({op_stk_adj, 0, op_int, 0, op_return}, "different argument counts", {{0, 0}, {0, 1}});
+}
+
+BOOST_AUTO_TEST_CASE(rejects_jump_tables_without_jumps)
+{
+    checkRejected({op_stk_adj, 0, op_int, 0, op_jump_table, 0, 1, op_jump, 4, op_int, 0, op_int, 1, op_return},
+                  "jump table entry is no op_jump");
+    checkRejected({op_stk_adj, 0, op_int, 0, op_jump_table, 0, 5, op_jump, 2, op_int, 1, op_return},
+                  "jump table out of the code");
+}
+
+BOOST_AUTO_TEST_CASE(fast_path_refuses_unverified_entries)
+{
+    Script script("func int f(var int a) { return a; };\n");
+    Machine machine(script.program);
+    const std::size_t address = script.program.find_function("f")->address;
+    BOOST_CHECK_THROW(machine.vm().execute(machine.code(), address, {}), std::runtime_error);
+    BOOST_CHECK_THROW(machine.vm().execute(machine.code(), address + 2, {1}), std::runtime_error);
+    BOOST_CHECK_EQUAL(machine.vm().execute(machine.code(), address, {3}), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
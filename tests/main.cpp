@@ -0,0 +1,8 @@
+#define BOOST_TEST_MODULE daedalus
+#include <boost/test/included/unit_test.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+//  Regression tests of the code generator and the vm:
+//  small Daedalus programs are compiled, verified and run on the checked
+//  and the fast path, before and after inline_calls and strip_unreachable
+///////////////////////////////////////////////////////////////////////////////